@@ -0,0 +1,724 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "autosave_journal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileDevice>
+#include <QFileInfo>
+#include <QHash>
+#include <QIODevice>
+#include <QLatin1String>
+#include <QSaveFile>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include "core/map.h"
+#include "core/map_part.h"
+#include "core/objects/object.h"
+#include "fileformats/file_format.h"
+#include "fileformats/file_format_registry.h"
+#include "fileformats/file_import_export.h"
+#include "undo/object_undo.h"
+#include "undo/undo.h"
+#include "undo/undo_manager.h"
+
+
+namespace {
+
+/// The magic bytes at the start of a journal.
+constexpr char journal_magic[8] = { 'O', 'M', 'A', 'P', 'J', 'R', 'N', 'L' };
+
+/// The version of the journal which is created by this implementation.
+constexpr quint32 journal_version = 1;
+
+/// The version of the QDataStream serialization.
+constexpr int stream_version = QDataStream::Qt_5_0;
+
+/**
+ * The types of records in a journal.
+ */
+enum RecordType : quint8
+{
+	BaseFileRecord = 1,  ///< The path, size and modification time of the base file
+	BaseMapRecord  = 2,  ///< A complete copy of the map in the XML format
+	StepRecord     = 3,  ///< An undo step which applies a change when executed
+};
+
+
+void writeHeader(QDataStream& stream)
+{
+	stream.writeRawData(journal_magic, int(sizeof(journal_magic)));
+	stream << journal_version;
+}
+
+void writeRecord(QDataStream& stream, RecordType type, const QByteArray& payload)
+{
+	stream << quint8(type) << payload << qChecksum(payload.constData(), uint(payload.size()));
+}
+
+/**
+ * Reads a record from the stream.
+ * 
+ * Returns false if the record is incomplete or damaged.
+ */
+bool readRecord(QDataStream& stream, quint8& type, QByteArray& payload)
+{
+	quint16 checksum;
+	stream >> type >> payload >> checksum;
+	return stream.status() == QDataStream::Ok
+	       && checksum == qChecksum(payload.constData(), uint(payload.size()));
+}
+
+QByteArray serialize(UndoStep& step)
+{
+	QByteArray data;
+	QXmlStreamWriter xml(&data);
+	step.save(xml);
+	return data;
+}
+
+
+/**
+ * Returns true if the indices of the step are unique and in range for a part
+ * with the given number of objects.
+ * 
+ * The objects of an AddObjectsUndoStep are inserted, so their indices may
+ * extend beyond the existing objects.
+ */
+bool hasValidIndices(const ObjectModifyingUndoStep& step, std::size_t num_objects)
+{
+	auto indices = step.modifiedObjectIndices();
+	if (indices.empty())
+		return true;
+		
+	std::sort(begin(indices), end(indices));
+	if (std::adjacent_find(begin(indices), end(indices)) != end(indices))
+		return false;
+		
+	auto limit = num_objects;
+	if (step.getType() == UndoStep::AddObjectsUndoStepType)
+		limit += indices.size();
+	return indices.front() >= 0 && std::size_t(indices.back()) < limit;
+}
+
+
+/**
+ * The objects of the map parts, as seen by a sequence of undo steps.
+ * 
+ * For each part touched by the steps, the list holds the objects which
+ * would be at each index after executing the steps visited so far.
+ * Objects which would be modified in place are unknown (nullptr).
+ */
+using PartObjects = std::unordered_map<int, std::vector<const Object*>>;
+
+/**
+ * Adds steps which apply the change reverted by the given step to
+ * forward_steps, taking the current state from part_objects.
+ * 
+ * Steps are visited in the order in which they are executed, i.e. the
+ * sub-steps of a combined step from last to first. So forward_steps is
+ * in the order of sub-steps of a combined step which applies the changes.
+ * 
+ * Returns false if such steps cannot be determined.
+ */
+bool addForwardSteps(UndoStep* step, Map* map, PartObjects& part_objects, std::vector<std::unique_ptr<UndoStep>>& forward_steps)
+{
+	switch (step->getType())
+	{
+		case UndoStep::CombinedUndoStepType:
+			{
+				auto combined_step = static_cast<CombinedUndoStep*>(step);
+				for (auto i = combined_step->getNumSubSteps(); i > 0; --i)
+				{
+					if (!addForwardSteps(combined_step->getSubStep(i - 1), map, part_objects, forward_steps))
+						return false;
+				}
+				return true;
+			}
+			
+		case UndoStep::ValidNoOpUndoStepType:
+			forward_steps.push_back(std::make_unique<NoOpUndoStep>(map, true));
+			return true;
+			
+		case UndoStep::DeleteObjectsUndoStepType:
+		case UndoStep::AddObjectsUndoStepType:
+		case UndoStep::ReplaceObjectsUndoStepType:
+		case UndoStep::ModifyObjectsUndoStepType:
+		case UndoStep::SwitchSymbolUndoStepType:
+		case UndoStep::SwitchDashesUndoStepType:
+		case UndoStep::ObjectTagsUndoStepType:
+			break;
+			
+		default:
+			return false;
+	}
+	
+	auto const object_step = static_cast<ObjectModifyingUndoStep*>(step);
+	auto const part_index = object_step->getPartIndex();
+	if (part_index < 0 || part_index >= map->getNumParts())
+		return false;
+		
+	auto found = part_objects.find(part_index);
+	if (found == end(part_objects))
+	{
+		auto const part = map->getPart(part_index);
+		std::vector<const Object*> objects;
+		objects.reserve(std::size_t(part->getNumObjects()));
+		for (int i = 0; i < part->getNumObjects(); ++i)
+			objects.push_back(part->getObject(i));
+		found = part_objects.emplace(part_index, std::move(objects)).first;
+	}
+	auto& objects = found->second;
+	
+	auto const& indices = object_step->modifiedObjectIndices();
+	if (!hasValidIndices(*object_step, objects.size()))
+		return false;
+		
+	switch (step->getType())
+	{
+		case UndoStep::AddObjectsUndoStepType:
+			{
+				// The objects were deleted.
+				auto forward_step = std::make_unique<DeleteObjectsUndoStep>(map);
+				forward_step->setPartIndex(part_index);
+				for (auto index : indices)
+					forward_step->addObject(index);
+				forward_steps.push_back(std::move(forward_step));
+				
+				auto const& contained = static_cast<ObjectCreatingUndoStep*>(step)->containedObjects();
+				std::vector<std::pair<int, const Object*>> inserted;
+				inserted.reserve(indices.size());
+				for (std::size_t i = 0; i < indices.size(); ++i)
+					inserted.emplace_back(indices[i], contained[i]);
+				std::sort(begin(inserted), end(inserted));
+				for (auto const& item : inserted)
+					objects.insert(begin(objects) + item.first, item.second);
+				return true;
+			}
+			
+		case UndoStep::DeleteObjectsUndoStepType:
+			{
+				// The objects were added.
+				auto forward_step = std::make_unique<AddObjectsUndoStep>(map);
+				forward_step->setPartIndex(part_index);
+				for (auto index : indices)
+				{
+					auto const object = objects[std::size_t(index)];
+					if (!object)
+						return false;
+					forward_step->addObject(index, object->duplicate());
+				}
+				forward_steps.push_back(std::move(forward_step));
+				
+				auto removed = indices;
+				std::sort(begin(removed), end(removed), std::greater<int>());
+				for (auto index : removed)
+					objects.erase(begin(objects) + index);
+				return true;
+			}
+			
+		default:
+			{
+				// The objects were modified.
+				auto forward_step = std::make_unique<ReplaceObjectsUndoStep>(map);
+				forward_step->setPartIndex(part_index);
+				for (auto index : indices)
+				{
+					auto const object = objects[std::size_t(index)];
+					if (!object)
+						return false;
+					forward_step->addObject(index, object->duplicate());
+				}
+				forward_steps.push_back(std::move(forward_step));
+				
+				if (step->getType() == UndoStep::ReplaceObjectsUndoStepType)
+				{
+					auto const& contained = static_cast<ObjectCreatingUndoStep*>(step)->containedObjects();
+					for (std::size_t i = 0; i < indices.size(); ++i)
+						objects[std::size_t(indices[i])] = contained[i];
+				}
+				else
+				{
+					for (auto index : indices)
+						objects[std::size_t(index)] = nullptr;
+				}
+				return true;
+			}
+	}
+}
+
+/**
+ * Returns a step which applies the change reverted by the given step,
+ * for the current state of the map.
+ * 
+ * For a combined step, the state between the sub-steps is reconstructed
+ * from the objects held by the sub-steps, so that each sub-step gets its
+ * own forward step.
+ * 
+ * Returns nullptr if such a step cannot be determined.
+ */
+std::unique_ptr<UndoStep> forwardStep(UndoStep* step, Map* map)
+{
+	PartObjects part_objects;
+	std::vector<std::unique_ptr<UndoStep>> forward_steps;
+	if (!addForwardSteps(step, map, part_objects, forward_steps))
+		return {};
+		
+	if (forward_steps.empty())
+		return std::make_unique<NoOpUndoStep>(map, true);
+		
+	if (forward_steps.size() == 1)
+		return std::move(forward_steps.front());
+		
+	auto combined_step = std::make_unique<CombinedUndoStep>(map);
+	for (auto& forward_step : forward_steps)
+		combined_step->push(forward_step.release());
+	return std::move(combined_step);
+}
+
+
+/**
+ * Executes a step which was loaded from the journal.
+ * 
+ * The parts and object indices of the step are checked before execution,
+ * for each sub-step of a combined step.
+ * 
+ * Returns false if the step does not fit the state of the map. In this case,
+ * the map may be partially modified.
+ */
+bool replayStep(UndoStep* step, Map* map)
+{
+	if (!step->isValid())
+		return false;
+		
+	switch (step->getType())
+	{
+		case UndoStep::CombinedUndoStepType:
+			{
+				// Like CombinedUndoStep::undo(), but checking each sub-step.
+				auto combined_step = static_cast<CombinedUndoStep*>(step);
+				for (auto i = combined_step->getNumSubSteps(); i > 0; --i)
+				{
+					if (!replayStep(combined_step->getSubStep(i - 1), map))
+						return false;
+				}
+				return true;
+			}
+			
+		case UndoStep::ValidNoOpUndoStepType:
+		case UndoStep::MapPartUndoStepType:
+			break;
+			
+		default:
+			{
+				auto const object_step = static_cast<ObjectModifyingUndoStep*>(step);
+				auto const part_index = object_step->getPartIndex();
+				if (part_index < 0 || part_index >= map->getNumParts()
+				    || !hasValidIndices(*object_step, std::size_t(map->getPart(part_index)->getNumObjects())))
+				{
+					return false;
+				}
+			}
+	}
+	
+	std::unique_ptr<UndoStep> inverse_step(step->undo());
+	return inverse_step && inverse_step->isValid();
+}
+
+
+}  // namespace
+
+
+
+// ### AutosaveJournal ###
+
+constexpr qint64 AutosaveJournal::min_compaction_size;
+
+
+AutosaveJournal::AutosaveJournal(Map* map, QObject* parent)
+: QObject(parent)
+, map(map)
+{
+	connect(&map->undoManager(), &UndoManager::stepPushed, this, &AutosaveJournal::stepPushed);
+	connect(&map->undoManager(), &UndoManager::aboutToExecute, this, &AutosaveJournal::aboutToExecute);
+	connect(map, &Map::propertiesModified, this, &AutosaveJournal::propertiesModified);
+	connect(map, &Map::saveFinished, this, &AutosaveJournal::saveFinished);
+}
+
+AutosaveJournal::~AutosaveJournal() = default;
+
+
+
+// static
+bool AutosaveJournal::understands(const unsigned char* buffer, std::size_t size)
+{
+	return size >= sizeof(journal_magic)
+	       && std::memcmp(buffer, journal_magic, sizeof(journal_magic)) == 0;
+}
+
+// static
+bool AutosaveJournal::restore(const QString& path, Map* map, MapView* view, bool load_symbols_only, QString& error_message)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		error_message = file.errorString();
+		return false;
+	}
+	
+	QDataStream stream(&file);
+	stream.setVersion(stream_version);
+	
+	unsigned char magic[sizeof(journal_magic)];
+	quint32 version = 0;
+	if (stream.readRawData(reinterpret_cast<char*>(magic), int(sizeof(magic))) != int(sizeof(magic))
+	    || !understands(magic, sizeof(magic)))
+	{
+		error_message = tr("Invalid autosave journal.");
+		return false;
+	}
+	stream >> version;
+	if (version > journal_version)
+	{
+		error_message = tr("Unsupported autosave journal version %1.").arg(version);
+		return false;
+	}
+	
+	quint8 base_type;
+	QByteArray base_payload;
+	if (!readRecord(stream, base_type, base_payload))
+	{
+		error_message = tr("The autosave journal is incomplete.");
+		return false;
+	}
+	
+	if (!loadBase(base_type, base_payload, path, map, view, load_symbols_only, error_message))
+		return false;
+		
+	if (load_symbols_only)
+		return true;
+		
+	// Steps refer to symbols by index.
+	SymbolDictionary symbol_dict;
+	for (int i = 0; i < map->getNumSymbols(); ++i)
+		symbol_dict.insert(QString::number(i), map->getSymbol(i));
+		
+	// Incomplete records at the end of the journal are ignored.
+	// All later records depend on the changes of an invalid record,
+	// so the first invalid record aborts the replay.
+	quint8 type;
+	QByteArray payload;
+	while (!stream.atEnd() && readRecord(stream, type, payload))
+	{
+		if (type != StepRecord)
+			continue;
+			
+		QXmlStreamReader xml(payload);
+		std::unique_ptr<UndoStep> step;
+		if (xml.readNextStartElement() && xml.name() == QLatin1String("step"))
+			step.reset(UndoStep::load(xml, map, symbol_dict));
+		if (!step || xml.hasError() || !replayStep(step.get(), map))
+		{
+			// Fall back to the last full snapshot.
+			qWarning("Discarding the changes recorded in the autosave journal %s: invalid record",
+			         qPrintable(path));
+			map->reset();
+			return loadBase(base_type, base_payload, path, map, view, load_symbols_only, error_message);
+		}
+	}
+	
+	return true;
+}
+
+// static
+bool AutosaveJournal::loadBase(quint8 type, const QByteArray& payload, const QString& path, Map* map, MapView* view, bool load_symbols_only, QString& error_message)
+{
+	if (type == BaseFileRecord)
+	{
+		QString base_path;
+		qint64 base_size;
+		qint64 base_modified;
+		QDataStream base_stream(payload);
+		base_stream.setVersion(stream_version);
+		base_stream >> base_path >> base_size >> base_modified;
+		
+		QFileInfo info(base_path);
+		if (!info.exists())
+			info.setFile(QFileInfo(path).dir(), info.fileName());  // moved together
+		if (!info.exists()
+		    || info.size() != base_size
+		    || info.lastModified().toMSecsSinceEpoch() != base_modified)
+		{
+			error_message = tr("The file on which the autosave journal is based has been modified or removed:\n%1").arg(base_path);
+			return false;
+		}
+		if (!map->loadFrom(info.absoluteFilePath(), nullptr, view, load_symbols_only, false))
+		{
+			error_message = tr("Cannot load the file on which the autosave journal is based:\n%1").arg(base_path);
+			return false;
+		}
+		return true;
+	}
+	
+	if (type == BaseMapRecord)
+	{
+		auto const format = FileFormats.findFormat("XML");
+		QByteArray data = payload;
+		QBuffer buffer(&data);
+		if (!format || !buffer.open(QIODevice::ReadOnly))
+		{
+			error_message = tr("Invalid autosave journal.");
+			return false;
+		}
+		
+		std::unique_ptr<Importer> importer(format->createImporter(&buffer, map, view));
+		try
+		{
+			importer->doImport(load_symbols_only, QFileInfo(path).absolutePath());
+			importer->finishImport();
+		}
+		catch (FileFormatException& e)
+		{
+			error_message = e.message();
+			return false;
+		}
+		return true;
+	}
+	
+	error_message = tr("Invalid autosave journal.");
+	return false;
+}
+
+
+
+void AutosaveJournal::setBaseFile(const QString& path)
+{
+	records.clear();
+	records_size = 0;
+	journal_path.clear();
+	compaction_needed = false;
+	
+	base_path.clear();
+	base_size = 0;
+	base_pending = false;
+	
+	auto const format = FileFormats.findFormatForFilename(path);
+	if (!format || !format->supportsImport() || format->isExportLossy())
+	{
+		compaction_needed = true;
+		return;
+	}
+	
+	base_path = QFileInfo(path).absoluteFilePath();
+	base_pending = map->isSaving();
+	if (!base_pending)
+		saveFinished(path, true);
+}
+
+bool AutosaveJournal::needsCompaction() const
+{
+	return compaction_needed
+	       || records_size > std::max(base_size, min_compaction_size);
+}
+
+bool AutosaveJournal::write(const QString& path, MapView* view)
+{
+	if (base_pending)
+		map->finishSaving();  // Captures the base file via saveFinished().
+		
+	if (needsCompaction())
+		return compact(path, view);
+		
+	if (journal_path != path || !QFileInfo::exists(path))
+	{
+		// A copy of the map embedded in another journal cannot be reused.
+		if (base_path.isEmpty())
+			return compact(path, view);
+		return start(path);
+	}
+	
+	return append(path);
+}
+
+
+
+void AutosaveJournal::stepPushed(UndoStep* step)
+{
+	if (compaction_needed)
+		return;
+		
+	auto forward_step = forwardStep(step, map);
+	if (!forward_step)
+	{
+		invalidate();
+		return;
+	}
+	
+	records.push_back(serialize(*forward_step));
+	records_size += records.back().size();
+}
+
+void AutosaveJournal::aboutToExecute(UndoStep* step)
+{
+	if (compaction_needed)
+		return;
+		
+	records.push_back(serialize(*step));
+	records_size += records.back().size();
+}
+
+void AutosaveJournal::propertiesModified()
+{
+	invalidate();
+}
+
+void AutosaveJournal::saveFinished(const QString& path, bool success)
+{
+	if (base_path.isEmpty() || QFileInfo(path).absoluteFilePath() != base_path)
+		return;
+		
+	base_pending = false;
+	QFileInfo const info(base_path);
+	if (success && info.exists())
+	{
+		base_size = info.size();
+		base_modified = info.lastModified().toMSecsSinceEpoch();
+	}
+	else
+	{
+		base_path.clear();
+		invalidate();
+	}
+}
+
+void AutosaveJournal::invalidate()
+{
+	records.clear();
+	records_size = 0;
+	compaction_needed = true;
+}
+
+
+
+bool AutosaveJournal::compact(const QString& path, MapView* view)
+{
+	auto const format = FileFormats.findFormat("XML");
+	if (!format)
+		return false;
+		
+	QByteArray data;
+	{
+		QBuffer buffer(&data);
+		buffer.open(QIODevice::WriteOnly);
+		std::unique_ptr<Exporter> exporter(format->createExporter(&buffer, map, view));
+		try
+		{
+			exporter->doExport();
+		}
+		catch (std::exception& e)
+		{
+			qWarning("Cannot compact the autosave journal: %s", e.what());
+			return false;
+		}
+	}
+	
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+		
+	QDataStream stream(&file);
+	stream.setVersion(stream_version);
+	writeHeader(stream);
+	writeRecord(stream, BaseMapRecord, data);
+	if (stream.status() != QDataStream::Ok || !file.commit())
+		return false;
+		
+	records.clear();
+	records_size = 0;
+	base_path.clear();
+	base_size = data.size();
+	journal_path = path;
+	compaction_needed = false;
+	return true;
+}
+
+bool AutosaveJournal::start(const QString& path)
+{
+	QByteArray base;
+	{
+		QDataStream base_stream(&base, QIODevice::WriteOnly);
+		base_stream.setVersion(stream_version);
+		base_stream << base_path << base_size << base_modified;
+	}
+	
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+		
+	QDataStream stream(&file);
+	stream.setVersion(stream_version);
+	writeHeader(stream);
+	writeRecord(stream, BaseFileRecord, base);
+	for (auto const& record : records)
+		writeRecord(stream, StepRecord, record);
+	if (stream.status() != QDataStream::Ok || !file.commit())
+		return false;
+		
+	records.clear();
+	journal_path = path;
+	return true;
+}
+
+bool AutosaveJournal::append(const QString& path)
+{
+	QFile file(path);
+	if (file.open(QIODevice::WriteOnly | QIODevice::Append))
+	{
+		QDataStream stream(&file);
+		stream.setVersion(stream_version);
+		for (auto const& record : records)
+			writeRecord(stream, StepRecord, record);
+		file.close();
+		if (stream.status() == QDataStream::Ok && file.error() == QFileDevice::NoError)
+		{
+			records.clear();
+			return true;
+		}
+	}
+	
+	// The journal may end with a partial record now.
+	journal_path.clear();
+	invalidate();
+	return false;
+}
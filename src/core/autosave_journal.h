@@ -0,0 +1,191 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_AUTOSAVE_JOURNAL_H
+#define OPENORIENTEERING_AUTOSAVE_JOURNAL_H
+
+#include <cstddef>
+#include <vector>
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+class Map;
+class MapView;
+class UndoStep;
+
+
+/**
+ * An append-only journal of the changes to a map since the last full save.
+ * 
+ * The journal starts with a reference to a base file which holds the state of
+ * the map when the journal was started, or with a complete copy of the map.
+ * It is followed by records of the object changes, in the order in which they
+ * were made. The records are built from the steps pushed to the map's undo
+ * manager, and from the steps executed by undo and redo.
+ * 
+ * The sub-steps of combined steps, e.g. from boolean operations, are recorded
+ * individually, reconstructing the state between them from the objects held
+ * by the sub-steps.
+ * 
+ * Changes which are not covered by undo steps, such as changes to colors,
+ * symbols or templates, cannot be recorded. After such changes, the next
+ * write() will compact the journal, i.e. replace it with a complete copy of
+ * the map. The journal is also compacted when the records grow larger than
+ * the base map.
+ * 
+ * Map::loadFrom() recognizes journals: It loads the base map and replays the
+ * recorded changes on top of it.
+ */
+class AutosaveJournal : public QObject
+{
+	Q_OBJECT
+	
+public:
+	/**
+	 * Constructs a journal which records the changes to the given map.
+	 * 
+	 * Until setBaseFile() is called, the journal has no base, and the next
+	 * write() will store a complete copy of the map.
+	 */
+	explicit AutosaveJournal(Map* map, QObject* parent = nullptr);
+	
+	~AutosaveJournal() override;
+	
+	
+	/**
+	 * Returns true if the given data starts with the magic bytes of a journal.
+	 */
+	static bool understands(const unsigned char* buffer, std::size_t size);
+	
+	/**
+	 * Loads the base map of the journal at the given path into the map,
+	 * and replays the recorded changes.
+	 * 
+	 * Records which are incomplete, e.g. after a crash while writing the
+	 * journal, are ignored. If a record is invalid or does not fit the state
+	 * of the map, the replay is aborted, and the map is loaded from the base
+	 * without any of the recorded changes.
+	 * 
+	 * Returns false on error, setting error_message.
+	 */
+	static bool restore(const QString& path, Map* map, MapView* view, bool load_symbols_only, QString& error_message);
+	
+	
+	/**
+	 * Sets the file which holds the current state of the map.
+	 * 
+	 * This discards all changes recorded so far. If the map is currently
+	 * being saved to this file, the file is used after saving finished.
+	 * Files in a lossy format and unknown files cannot serve as base.
+	 * In this case, the next write() will store a complete copy of the map.
+	 */
+	void setBaseFile(const QString& path);
+	
+	/**
+	 * Returns true if the next write() will store a complete copy of the map.
+	 */
+	bool needsCompaction() const;
+	
+	/**
+	 * Writes the journal to the given path.
+	 * 
+	 * When the journal at this path is up to date except for the most recent
+	 * changes, only the records of these changes are appended. Otherwise,
+	 * the journal is compacted.
+	 * 
+	 * Returns false on error.
+	 */
+	bool write(const QString& path, MapView* view);
+	
+	
+	/**
+	 * The minimum size of the records which triggers compaction.
+	 */
+	static constexpr qint64 min_compaction_size = 1024 * 1024;
+	
+protected:
+	/**
+	 * Loads the base map from the first record of a journal.
+	 * 
+	 * Returns false on error, setting error_message.
+	 */
+	static bool loadBase(quint8 type, const QByteArray& payload, const QString& path, Map* map, MapView* view, bool load_symbols_only, QString& error_message);
+	
+	/**
+	 * Records the changes which are reverted by a newly pushed step.
+	 */
+	void stepPushed(UndoStep* step);
+	
+	/**
+	 * Records a step which is about to be executed by undo or redo.
+	 */
+	void aboutToExecute(UndoStep* step);
+	
+	/**
+	 * Takes note of changes which are not covered by undo steps.
+	 */
+	void propertiesModified();
+	
+	/**
+	 * Captures the properties of the base file when saving has finished.
+	 */
+	void saveFinished(const QString& path, bool success);
+	
+	/**
+	 * Discards the recorded changes and marks the journal for compaction.
+	 */
+	void invalidate();
+	
+	/**
+	 * Replaces the journal at the given path with a complete copy of the map.
+	 */
+	bool compact(const QString& path, MapView* view);
+	
+	/**
+	 * Replaces the journal at the given path with a reference to the base
+	 * file, followed by the recorded changes.
+	 */
+	bool start(const QString& path);
+	
+	/**
+	 * Appends the recorded changes to the journal at the given path.
+	 */
+	bool append(const QString& path);
+	
+private:
+	Map* const map;
+	
+	std::vector<QByteArray> records;  ///< Changes not yet written
+	qint64 records_size = 0;          ///< Size of the records written to the journal
+	
+	QString base_path;                ///< The file holding the base map, or empty
+	qint64 base_size = 0;             ///< The size of the base map
+	qint64 base_modified = 0;         ///< The modification time of the base file
+	bool base_pending = false;        ///< True while the base file is being saved
+	
+	QString journal_path;             ///< The journal which is up to date except for the records
+	bool compaction_needed = true;
+};
+
+
+#endif
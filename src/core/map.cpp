@@ -23,19 +23,25 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <exception>
 #include <iterator>
 #include <memory>
+#include <utility>
 
 #include <Qt>
 #include <QtGlobal>
 #include <QtMath>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+#include <QAtomicInt>
 #include <QByteArray>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QIODevice>
 #include <QLatin1String>
 #include <QLocale>
@@ -44,10 +50,13 @@
 #include <QPoint>
 #include <QPointF>
 #include <QSaveFile>
+#include <QSignalBlocker>
 #include <QStringList>
 #include <QTextDocument>
+#include <QTimer>
 #include <QTranslator>
 
+#include "core/autosave_journal.h"
 #include "core/georeferencing.h"
 #include "core/map_color.h"
 #include "core/map_coord.h"
@@ -56,7 +65,6 @@
 #include "core/map_printer.h"
 #include "core/map_view.h"
 #include "core/objects/object.h"
-#include "core/objects/object_operations.h"
 #include "core/renderables/renderable.h"
 #include "core/symbols/combined_symbol.h"
 #include "core/symbols/line_symbol.h"
@@ -86,6 +94,40 @@ QPointer<QTranslator> map_symbol_translator{};
 namespace
 {
 
+/**
+ * The interval of progress reports for whole-map operations, in milliseconds.
+ */
+constexpr unsigned long progress_interval = 100;
+
+
+/**
+ * The number of objects which are updated at once when updates are deferred.
+ */
+constexpr std::size_t deferred_updates_chunk_size = 2000;
+
+/**
+ * The margin which is added to the coordinates' bounding box when estimating
+ * the extent of an object which is not yet updated, in millimeters.
+ * 
+ * This estimate is not exact for large point symbols and texts, but objects
+ * which are missed will be drawn after their deferred update.
+ */
+constexpr qreal deferred_updates_margin = 10.0;
+
+
+/**
+ * Returns an estimate of the extent of an object whose output is dirty.
+ */
+QRectF estimatedExtent(const Object* object)
+{
+	QRectF rect;
+	for (const auto& coord : object->getRawCoordinateVector())
+		rectIncludeSafe(rect, MapCoordF(coord));
+	return rect.adjusted(-deferred_updates_margin, -deferred_updates_margin,
+	                     deferred_updates_margin, deferred_updates_margin);
+}
+
+
 /** A record of information about the mapping of a color in a source MapColorSet
  *  to a color in a destination MapColorSet.
  */
@@ -452,10 +494,17 @@ Map::Map()
 	connect(this, &Map::colorChanged, this, &Map::checkSpotColorPresence);
 	connect(this, &Map::colorDeleted, this, &Map::checkSpotColorPresence);
 	connect(undo_manager.data(), &UndoManager::cleanChanged, this, &Map::undoCleanChanged);
+	connect(undo_manager.data(), &UndoManager::stepPushed, this, &Map::modifiedWhileSaving);
+	connect(undo_manager.data(), &UndoManager::aboutToExecute, this, &Map::modifiedWhileSaving);
 }
 
 Map::~Map()
 {
+	{
+		// Complete a file which is still being written, but don't notify.
+		const QSignalBlocker blocker(this);
+		finishSaving();
+	}
 	clear();  // properly destruct all children
 }
 
@@ -477,6 +526,9 @@ void Map::clear()
 	selection_renderables->clear();
 	
 	renderables->clear();
+	deferred_object_updates = false;
+	deferred_extents.clear();
+	deferred_queue.clear();
 	
 	for (MapPart* part : parts)
 		delete part;
@@ -501,6 +553,7 @@ void Map::init()
 	undo_manager->setClean();
 	
 	symbol_set_id = QString();
+	symbols_session_id = QUuid::createUuid();
 	map_notes = QString();
 	
 	printer_config.reset();
@@ -534,19 +587,30 @@ unsigned int Map::getScaleDenominator() const
 	return georeferencing->getScaleDenominator();
 }
 
-void Map::changeScale(unsigned int new_scale_denominator, const MapCoord& scaling_center, bool scale_symbols, bool scale_objects, bool scale_georeferencing, bool scale_templates)
+bool Map::changeScale(unsigned int new_scale_denominator, const MapCoord& scaling_center, bool scale_symbols, bool scale_objects, bool scale_georeferencing, bool scale_templates, const ProgressObserver& observer)
 {
 	if (new_scale_denominator == getScaleDenominator())
-		return;
+		return true;
 	
 	double factor = getScaleDenominator() / (double)new_scale_denominator;
 	
-	if (scale_symbols)
-		scaleAllSymbols(factor);
+	if (scale_symbols || scale_objects)
+	{
+		std::function<void (Object*)> transform = [](Object* object) { object->setOutputDirty(); };
+		if (scale_objects)
+			transform = [factor, center = MapCoordF{scaling_center}](Object* object) { object->scale(center, factor); };
+		
+		if (scale_symbols)
+			scaleSymbols(factor);
+		// Scaled symbols cannot be restored exactly.
+		if (!transformAllObjects(transform, observer, !scale_symbols))
+			return false;
+		if (scale_symbols)
+			setSymbolsDirty();
+	}
 	if (scale_objects)
 	{
 		undo_manager->clear();
-		scaleAllObjects(factor, scaling_center);
 		if (hasPrinterConfig())
 		{
 			auto print_area = printer_config->print_area;
@@ -581,15 +645,21 @@ void Map::changeScale(unsigned int new_scale_denominator, const MapCoord& scalin
 	setScaleDenominator(new_scale_denominator);
 	setOtherDirty();
 	updateAllMapWidgets();
+	return true;
 }
 
-void Map::rotateMap(double rotation, const MapCoord& center, bool adjust_georeferencing, bool adjust_declination, bool adjust_templates)
+bool Map::rotateMap(double rotation, const MapCoord& center, bool adjust_georeferencing, bool adjust_declination, bool adjust_templates, const ProgressObserver& observer)
 {
 	if (std::fmod(rotation, 2 * M_PI) == 0)
-		return;
+		return true;
+	
+	auto const transform = [rotation, center = MapCoordF{center}](Object* object) {
+		object->rotateAround(center, rotation);
+	};
+	if (!transformAllObjects(transform, observer, true))
+		return false;
 	
 	undo_manager->clear();
-	rotateAllObjects(rotation, center);
 	
 	if (adjust_georeferencing)
 	{
@@ -624,6 +694,7 @@ void Map::rotateMap(double rotation, const MapCoord& center, bool adjust_georefe
 	
 	setOtherDirty();
 	updateAllMapWidgets();
+	return true;
 }
 
 void Map::setMapNotes(const QString& text)
@@ -633,20 +704,20 @@ void Map::setMapNotes(const QString& text)
 
 bool Map::saveTo(const QString& path, MapView* view)
 {
+	finishSaving();
+	
 	bool success = exportTo(path, view);
 	if (success)
-	{
-		colors_dirty = false;
-		symbols_dirty = false;
-		templates_dirty = false;
-		objects_dirty = false;
-		other_dirty = false;
-		unsaved_changes = false;
-		undoManager().setClean();
-	}
+		markAsSaved();
 	return success;
 }
 
+void Map::markAsSaved()
+{
+	setHasUnsavedChanges(false);
+	undoManager().setClean();
+}
+
 bool Map::exportTo(const QString& path, MapView* view, const FileFormat* format)
 {
 	Q_ASSERT(view && "Saving a file without view information is not supported!");
@@ -708,6 +779,130 @@ bool Map::exportTo(const QString& path, MapView* view, const FileFormat* format)
 	return success;
 }
 
+/**
+ * A file being written by Map::saveToAsync().
+ */
+struct Map::AsyncSave
+{
+	QString path;
+	QSaveFile file;
+	std::unique_ptr<Exporter> exporter;
+	QFutureWatcher<void> watcher;
+	QString error;
+	bool modified = false;  ///< True if the map was modified after taking the snapshot
+	
+	explicit AsyncSave(const QString& path)
+	: path(path)
+	, file(path)
+	{}
+	
+	/**
+	 * Writes the file from the exporter's snapshot.
+	 * 
+	 * This function runs on a worker thread.
+	 */
+	void run()
+	{
+		try
+		{
+			exporter->doExport();
+		}
+		catch (std::exception &e)
+		{
+			file.cancelWriting();
+			error = Map::tr("Internal error while saving:\n%1").arg(QString::fromLocal8Bit(e.what()));
+			return;
+		}
+		
+		if (!file.commit())
+			error = Map::tr("Cannot save file\n%1:\n%2").arg(path, file.errorString());
+	}
+};
+
+bool Map::saveToAsync(const QString& path, MapView* view)
+{
+	Q_ASSERT(view && "Saving a file without view information is not supported!");
+	
+	// Only one file at a time
+	finishSaving();
+	
+	auto format = FileFormats.findFormatForFilename(path);
+	if (!format)
+		format = FileFormats.findFormat(FileFormats.defaultFormat());
+	if (!format || !format->supportsExport())
+		return saveTo(path, view);  // reports the error
+	
+	auto job = std::make_unique<AsyncSave>(path);
+	job->exporter.reset(format->createExporter(&job->file, this, view));
+	if (!job->file.open(QIODevice::WriteOnly))
+	{
+		QMessageBox::warning(nullptr, tr("Error"), tr("Cannot save file\n%1:\n%2").arg(path, job->file.errorString()));
+		return false;
+	}
+	
+	try
+	{
+		if (!job->exporter->takeSnapshot())
+		{
+			job->file.cancelWriting();
+			job.reset();
+			return saveTo(path, view);
+		}
+	}
+	catch (std::exception &e)
+	{
+		job->file.cancelWriting();
+		const QString error = QString::fromLocal8Bit(e.what());
+		QMessageBox::warning(nullptr, tr("Error"), tr("Internal error while saving:\n%1").arg(error));
+		return false;
+	}
+	
+	// From now on, the exporter no longer accesses the map.
+	// The map is marked as saved when the file is complete.
+	auto raw_job = job.get();
+	connect(&job->watcher, &QFutureWatcher<void>::finished, this, &Map::finishSaving);
+	job->watcher.setFuture(QtConcurrent::run([raw_job]() { raw_job->run(); }));
+	async_save = std::move(job);
+	return true;
+}
+
+bool Map::isSaving() const
+{
+	return bool(async_save);
+}
+
+bool Map::finishSaving()
+{
+	if (!async_save)
+		return true;
+	
+	auto job = std::move(async_save);
+	job->watcher.waitForFinished();
+	
+	auto const success = job->error.isEmpty();
+	if (!success)
+	{
+		QMessageBox::warning(nullptr, tr("Error"), job->error);
+	}
+	else
+	{
+		// Later changes are not in the file.
+		if (!job->modified)
+			markAsSaved();
+		
+		if (!job->exporter->warnings().empty())
+		{
+			showMessageBox(nullptr,
+			               tr("Warning"),
+			               tr("The map export generated warnings."),
+			               job->exporter->warnings() );
+		}
+	}
+	
+	emit saveFinished(job->path, success);
+	return success;
+}
+
 bool Map::loadFrom(const QString& path, QWidget* dialog_parent, MapView* view, bool load_symbols_only, bool show_error_messages)
 {
 	// Ensure the file exists and is readable.
@@ -733,8 +928,17 @@ bool Map::loadFrom(const QString& path, QWidget* dialog_parent, MapView* view, b
 
 	bool import_complete = false;
 	QString error_msg = tr("Invalid file type.");
+	if (AutosaveJournal::understands(buffer, total_read))
+	{
+		file.close();
+		import_complete = AutosaveJournal::restore(path, this, view, load_symbols_only, error_msg);
+	}
+	
 	for (auto format : FileFormats.formats())
 	{
+		// If the last importer finished successfully
+		if (import_complete) break;
+		
 		// If the format supports import, and thinks it can understand the file header, then proceed.
 		if (format->supportsImport() && format->understands(buffer, total_read))
 		{
@@ -780,8 +984,6 @@ bool Map::loadFrom(const QString& path, QWidget* dialog_parent, MapView* view, b
 			}
 			if (importer) delete importer;
 		}
-		// If the last importer finished successfully
-		if (import_complete) break;
 	}
 	
 	if (view)
@@ -800,8 +1002,19 @@ bool Map::loadFrom(const QString& path, QWidget* dialog_parent, MapView* view, b
 		return false;
 	}
 
-	// Update all objects without trying to remove their renderables first, this gives a significant speedup when loading large files
-	updateAllObjects(); // TODO: is the comment above still applicable?
+	if (view)
+	{
+		// The map is going to be displayed: Generate the output on demand,
+		// so that the visible area can be drawn as soon as possible.
+		renderables->clear();
+		applyOnAllObjects([](Object* object) { object->setOutputDirty(); });
+		deferObjectUpdates();
+	}
+	else
+	{
+		// Update all objects without trying to remove their renderables first, this gives a significant speedup when loading large files
+		updateAllObjects(); // TODO: is the comment above still applicable?
+	}
 	
 	setHasUnsavedChanges(false);
 
@@ -1039,7 +1252,7 @@ bool Map::importFromIODevice(QIODevice* stream)
 void Map::draw(QPainter* painter, const RenderConfig& config)
 {
 	// Update the renderables of all objects marked as dirty
-	updateObjects();
+	updateObjects(config.bounding_box);
 	
 	// The actual drawing
 	renderables->draw(painter, config);
@@ -1048,7 +1261,7 @@ void Map::draw(QPainter* painter, const RenderConfig& config)
 void Map::drawOverprintingSimulation(QPainter* painter, const RenderConfig& config)
 {
 	// Update the renderables of all objects marked as dirty
-	updateObjects();
+	updateObjects(config.bounding_box);
 	
 	// The actual drawing
 	renderables->drawOverprintingSimulation(painter, config);
@@ -1057,7 +1270,7 @@ void Map::drawOverprintingSimulation(QPainter* painter, const RenderConfig& conf
 void Map::drawColorSeparation(QPainter* painter, const RenderConfig& config, const MapColor* spot_color, bool use_color)
 {
 	// Update the renderables of all objects marked as dirty
-	updateObjects();
+	updateObjects(config.bounding_box);
 	
 	// The actual drawing
 	renderables->drawColorSeparation(painter, config, spot_color, use_color);
@@ -1098,6 +1311,20 @@ void Map::updateObjects()
 	applyOnAllObjects(&Object::update);
 }
 
+void Map::updateObjects(const QRectF& area)
+{
+	if (!deferred_object_updates)
+	{
+		updateObjects();
+		return;
+	}
+	
+	updateDeferredObjects(area);
+	
+	// Continue the deferred updates next to this area.
+	deferred_updates_center = area.center();
+}
+
 void Map::removeRenderablesOfObject(const Object* object, bool mark_area_as_dirty)
 {
 	renderables->removeRenderablesOfObject(object, mark_area_as_dirty);
@@ -1183,13 +1410,13 @@ void Map::deleteSelectedObjects()
 			if (index >= 0)
 			{
 				undo_step->addObject(index, *obj);
-				part->deleteObject(index, true);
 			}
 			else
 			{
 				qDebug() << this << "::deleteSelectedObjects(): Object" << *obj << "not found in current map part.";
 			}
 		}
+		part->deleteObjects(selectedObjectsBegin(), selectedObjectsEnd(), true);
 		
 		setObjectsDirty();
 		clearObjectSelection(true);
@@ -1203,7 +1430,7 @@ void Map::includeSelectionRect(QRectF& rect) const
 		rectIncludeSafe(rect, object->getExtent());
 }
 
-void Map::drawSelection(QPainter* painter, bool force_min_size, MapWidget* widget, MapRenderables* replacement_renderables, bool draw_normal)
+void Map::drawSelection(QPainter* painter, bool force_min_size, MapWidget* widget, MapRenderables* replacement_renderables, bool draw_normal, const QRect& viewport_rect)
 {
 	MapView* view = widget->getMapView();
 	
@@ -1223,7 +1450,8 @@ void Map::drawSelection(QPainter* painter, bool force_min_size, MapWidget* widge
 		options |= RenderConfig::Highlighted;
 		selection_opacity = 0.4;
 	}
-	RenderConfig config = { *this, view->calculateViewedRect(widget->viewportToView(widget->rect())), view->calculateFinalZoomFactor(), options, selection_opacity };
+	auto const viewed_rect = widget->viewportToView(viewport_rect.isNull() ? widget->rect() : viewport_rect);
+	RenderConfig config = { *this, view->calculateViewedRect(viewed_rect), view->calculateFinalZoomFactor(), options, selection_opacity };
 	replacement_renderables->draw(painter, config);
 	
 	painter->restore();
@@ -1254,23 +1482,44 @@ void Map::removeObjectFromSelection(Object* object, bool emit_selection_changed)
 
 bool Map::removeSymbolFromSelection(const Symbol* symbol, bool emit_selection_changed)
 {
-	bool removed_at_least_one_object = false;
-	auto it_end = object_selection.end();
-	for (auto it = object_selection.begin(); it != it_end; )
+	// Visit either the objects with the given symbol, or the selected objects,
+	// whatever is smaller.
+	std::size_t num_objects_with_symbol = 0;
+	for (auto part : parts)
+		num_objects_with_symbol += part->objectsWithSymbol(symbol).size();
+	
+	std::vector<Object*> removed_objects;
+	if (num_objects_with_symbol < object_selection.size())
 	{
-		if ((*it)->getSymbol() != symbol)
+		for (auto part : parts)
 		{
-			++it;
-			continue;
+			for (auto object : part->objectsWithSymbol(symbol))
+			{
+				if (object_selection.contains(object))
+					removed_objects.push_back(object);
+			}
 		}
-		
-		removed_at_least_one_object = true;
-		removeSelectionRenderables(*it);
-		Object* removed_object = *it;
-		it = object_selection.erase(it);
-		if (first_selected_object == removed_object)
-			first_selected_object = object_selection.empty() ? nullptr : *object_selection.begin();
 	}
+	else
+	{
+		for (auto object : object_selection)
+		{
+			if (object->getSymbol() == symbol)
+				removed_objects.push_back(object);
+		}
+	}
+	
+	for (auto object : removed_objects)
+	{
+		removeSelectionRenderables(object);
+		object_selection.erase(object);
+		if (first_selected_object == object)
+			first_selected_object = nullptr;
+	}
+	if (!first_selected_object && !object_selection.empty())
+		first_selected_object = *object_selection.begin();
+	
+	bool const removed_at_least_one_object = !removed_objects.empty();
 	if (emit_selection_changed && removed_at_least_one_object)
 		emit objectSelectionChanged();
 	return removed_at_least_one_object;
@@ -1278,7 +1527,7 @@ bool Map::removeSymbolFromSelection(const Symbol* symbol, bool emit_selection_ch
 
 bool Map::isObjectSelected(const Object* object) const
 {
-	return object_selection.find(const_cast<Object*>(object)) != object_selection.end();
+	return object_selection.contains(object);
 }
 
 bool Map::toggleObjectSelection(Object* object, bool emit_selection_changed)
@@ -1536,6 +1785,7 @@ void Map::setColorsDirty()
 {
 	colors_dirty = true;
 	setHasUnsavedChanges(true);
+	emit propertiesModified();
 }
 
 void Map::useColorsFrom(Map* map)
@@ -1633,6 +1883,11 @@ void Map::setSymbolSetId(const QString& id)
 	symbols_dirty = true;
 }
 
+QUuid Map::symbolsSessionId() const
+{
+	return symbols_session_id;
+}
+
 
 QHash<const Symbol*, Symbol*> Map::importSymbols(
         const Map& other,
@@ -1819,6 +2074,7 @@ void Map::setSymbol(Symbol* symbol, int pos)
 	
 	// Change the symbol
 	symbols[pos] = symbol;
+	symbols_session_id = QUuid::createUuid();
 	emit symbolChanged(pos, symbol, old_symbol);
 	setSymbolsDirty();
 	delete old_symbol;
@@ -1846,6 +2102,7 @@ void Map::deleteSymbol(int pos)
 	Symbol* temp = symbols[pos];
 	delete symbols[pos];
 	symbols.erase(symbols.begin() + pos);
+	symbols_session_id = QUuid::createUuid();
 	
 	if (symbols.empty())
 	{
@@ -1883,6 +2140,7 @@ void Map::setSymbolsDirty()
 {
 	symbols_dirty = true;
 	setHasUnsavedChanges(true);
+	emit propertiesModified();
 }
 
 void Map::updateSymbolIcons(const MapColor* color)
@@ -1898,6 +2156,14 @@ void Map::updateSymbolIcons(const MapColor* color)
 }
 
 void Map::scaleAllSymbols(double factor)
+{
+	scaleSymbols(factor);
+	updateAllObjects();
+	
+	setSymbolsDirty();
+}
+
+void Map::scaleSymbols(double factor)
 {
 	int size = getNumSymbols();
 	for (int i = 0; i < size; ++i)
@@ -1906,24 +2172,13 @@ void Map::scaleAllSymbols(double factor)
 		symbol->scale(factor);
 		emit symbolChanged(i, symbol, symbol);
 	}
-	updateAllObjects();
-	
-	setSymbolsDirty();
 }
 
 void Map::determineSymbolsInUse(std::vector< bool >& out) const
 {
 	out.assign(symbols.size(), false);
-	for (auto part : parts)
-	{
-		for (int o = 0; o < part->getNumObjects(); ++o)
-		{
-			const Symbol* symbol = part->getObject(o)->getSymbol();
-			int index = findSymbolIndex(symbol);
-			if (index >= 0)
-				out[index] = true;
-		}
-	}
+	for (std::size_t i = 0; i < symbols.size(); ++i)
+		out[i] = existsObjectWithSymbol(symbols[i]);
 	
 	determineSymbolUseClosure(out);
 }
@@ -2085,6 +2340,7 @@ void Map::setTemplatesDirty()
 {
 	templates_dirty = true;
 	setHasUnsavedChanges(true);
+	emit propertiesModified();
 }
 
 void Map::emitTemplateChanged(Template* temp)
@@ -2178,9 +2434,11 @@ void Map::removePart(std::size_t index)
 	
 	MapPart* part = parts[index];
 	
-	// FIXME: This loop should move to MapPart.
-	while(part->getNumObjects())
-		part->deleteObject(0, false);
+	// FIXME: This should move to MapPart.
+	std::vector<Object*> objects;
+	objects.reserve(std::size_t(part->getNumObjects()));
+	part->applyOnAllObjects([&objects](Object* object) { objects.push_back(object); });
+	part->deleteObjects(begin(objects), end(objects), false);
 	
 	parts.erase(parts.begin() + index);
 	if (current_part_index >= index)
@@ -2225,24 +2483,18 @@ void Map::setCurrentPartIndex(std::size_t index)
 	}
 }
 
-std::size_t Map::reassignObjectsToMapPart(std::set<Object*>::const_iterator begin, std::set<Object*>::const_iterator end, std::size_t source, std::size_t destination)
+std::size_t Map::reassignObjectsToMapPart(ObjectSelection::const_iterator begin, ObjectSelection::const_iterator end, std::size_t source, std::size_t destination)
 {
 	Q_ASSERT(source < parts.size());
 	Q_ASSERT(destination < parts.size());
 	
-	std::size_t count = 0;
 	MapPart* const source_part = parts[source];
 	MapPart* const target_part = parts[destination];
-	for (auto it = begin; it != end; ++it)
-	{
-		Object* const object = *it;
-		source_part->deleteObject(object, true);
-
-		int index = target_part->getNumObjects();
-		target_part->addObject(object, index);
-		
-		++count;
-	}
+	std::vector<Object*> objects(begin, end);
+	source_part->deleteObjects(objects.begin(), objects.end(), true);
+	for (auto object : objects)
+		target_part->addObject(object);
+	std::size_t const count = objects.size();
 	
 	setOtherDirty();
 	
@@ -2276,9 +2528,10 @@ std::size_t Map::reassignObjectsToMapPart(std::vector<int>::const_iterator begin
 	
 	bool selection_changed = false;
 	
-	std::size_t count = 0;
 	MapPart* const source_part = parts[source];
 	MapPart* const target_part = parts[destination];
+	std::vector<Object*> objects;
+	objects.reserve(std::size_t(std::distance(begin, end)));
 	for (auto it = begin; it != end; ++it)
 	{
 		Object* const object = source_part->getObject(*it);
@@ -2289,20 +2542,19 @@ std::size_t Map::reassignObjectsToMapPart(std::vector<int>::const_iterator begin
 			selection_changed = true;
 		}
 		
-		source_part->deleteObject(object, true);
-		
-		int index = target_part->getNumObjects();
-		target_part->addObject(object, index);
-		
-		++count;
+		objects.push_back(object);
 	}
 	
+	source_part->deleteObjects(objects.begin(), objects.end(), true);
+	for (auto object : objects)
+		target_part->addObject(object);
+	
 	setOtherDirty();
 	
 	if (selection_changed)
 		emit objectSelectionChanged();
 	
-	return target_part->getNumObjects() - count;
+	return target_part->getNumObjects() - objects.size();
 }
 
 std::size_t Map::mergeParts(std::size_t source, std::size_t destination)
@@ -2310,20 +2562,17 @@ std::size_t Map::mergeParts(std::size_t source, std::size_t destination)
 	Q_ASSERT(source < parts.size());
 	Q_ASSERT(destination < parts.size());
 	
-	std::size_t count = 0;
 	MapPart* const source_part = parts[source];
 	MapPart* const target_part = parts[destination];
-	// Preserve order (but not efficient)
-	for (std::size_t i = source_part->getNumObjects(); i > 0 ; --i)
-	{
-		Object* object = source_part->getObject(0);
-		source_part->deleteObject(0, true);
-		
-		int index = target_part->getNumObjects();
-		target_part->addObject(object, index);
-		
-		++count;
-	}
+	// Preserve order
+	std::vector<Object*> objects;
+	objects.reserve(std::size_t(source_part->getNumObjects()));
+	for (int i = 0; i < source_part->getNumObjects(); ++i)
+		objects.push_back(source_part->getObject(i));
+	source_part->deleteObjects(objects.begin(), objects.end(), true);
+	for (auto object : objects)
+		target_part->addObject(object);
+	std::size_t const count = objects.size();
 	
 	if (current_part_index == source)
 		setCurrentPartIndex(destination);
@@ -2484,46 +2733,354 @@ void Map::applyOnAllObjects(const std::function<void (Object*, MapPart*, int)>&
 
 void Map::scaleAllObjects(double factor, const MapCoord& scaling_center)
 {
-	applyOnAllObjects(ObjectOp::Scale{factor, MapCoordF{scaling_center}});
+	transformAllObjects([factor, center = MapCoordF{scaling_center}](Object* object) {
+		object->scale(center, factor);
+	}, {}, false);
 }
 
 void Map::rotateAllObjects(double rotation, const MapCoord& center)
 {
-	applyOnAllObjects(ObjectOp::Rotate{rotation, MapCoordF{center}});
+	transformAllObjects([rotation, center = MapCoordF{center}](Object* object) {
+		object->rotateAround(center, rotation);
+	}, {}, false);
+}
+
+bool Map::transformAllObjects(const std::function<void (Object*)>& transform, const ProgressObserver& observer, bool cancelable)
+{
+	struct TransformTask
+	{
+		Object* object;
+		std::unique_ptr<Object> original;  ///< For cancellation
+	};
+	
+	std::vector<TransformTask> tasks;
+	tasks.reserve(std::size_t(getNumObjects()));
+	for (auto part : parts)
+	{
+		for (int i = 0; i < part->getNumObjects(); ++i)
+			tasks.push_back({ part->getObject(i), nullptr });
+	}
+	if (tasks.empty())
+		return true;
+	
+	QRectF dirty_rect;
+	for (const auto& task : tasks)
+		rectIncludeSafe(dirty_rect, task.object->getExtent());
+	
+	// The output is regenerated concurrently, so the renderables
+	// must not be in use by the map in the meantime.
+	renderables->clear();
+	selection_renderables->clear();
+	
+	auto const options = Symbol::RenderableOptions(QFlag(renderableOptions()));
+	auto const keep_originals = cancelable && bool(observer);
+	QAtomicInt progress;
+	auto const work = [&transform, &progress, options, keep_originals](TransformTask& task) {
+		if (keep_originals)
+			task.original.reset(task.object->duplicate());
+		transform(task.object);
+		// Text layout needs fonts, so texts are left to the calling thread.
+		if (task.object->getType() != Object::Text)
+			task.object->updateDetached(options);
+		progress.fetchAndAddRelaxed(1);
+	};
+	
+	auto canceled = false;
+	auto const total = int(tasks.size());
+	if (!observer)
+	{
+		QtConcurrent::blockingMap(tasks, work);
+	}
+	else
+	{
+		// The observer may run the event loop.
+		setProcessingObjects(true);
+		auto future = QtConcurrent::map(tasks, work);
+		auto const report = [&observer, &progress, &canceled, &future, total, cancelable]() {
+			if (!observer(progress.load(), total) && cancelable && !canceled)
+			{
+				canceled = true;
+				future.cancel();
+			}
+		};
+		report();
+		
+		// Leave the local event loop as soon as the work is finished.
+		QEventLoop loop;
+		QFutureWatcher<void> watcher;
+		connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+		QTimer timer;
+		connect(&timer, &QTimer::timeout, report);
+		watcher.setFuture(future);
+		if (!future.isFinished())
+		{
+			timer.start(int(progress_interval));
+			loop.exec();
+			timer.stop();
+		}
+		future.waitForFinished();
+		setProcessingObjects(false);
+	}
+	
+	if (canceled)
+	{
+		// Restore the processed objects. The other ones are unchanged.
+		QtConcurrent::blockingMap(tasks, [options](TransformTask& task) {
+			if (!task.original)
+				return;
+			task.object->copyFrom(*task.original);
+			task.original.reset();
+			if (task.object->getType() != Object::Text)
+				task.object->updateDetached(options);
+		});
+	}
+	
+	for (const auto& task : tasks)
+	{
+		task.object->updateDetached(options);
+		insertRenderablesOfObject(task.object);
+		rectIncludeSafe(dirty_rect, task.object->getExtent());
+	}
+	for (auto object : object_selection)
+		selection_renderables->insertRenderablesOfObject(object);
+	
+	if (dirty_rect.isValid())
+		setObjectAreaDirty(dirty_rect);
+	
+	if (observer && !canceled)
+		observer(total, total);
+	return !canceled;
 }
 
 void Map::updateAllObjects()
 {
-	applyOnAllObjects(&Object::forceUpdate);
+	transformAllObjects([](Object* object) {
+		object->setOutputDirty();
+	}, {}, false);
+}
+
+void Map::updateObjects(const std::vector<Object*>& objects)
+{
+	QRectF dirty_rect;
+	for (auto object : objects)
+		rectIncludeSafe(dirty_rect, object->getExtent());
+	
+	auto const options = Symbol::RenderableOptions(QFlag(renderableOptions()));
+	QtConcurrent::blockingMap(begin(objects), end(objects), [options](Object* object) {
+		// Text layout needs fonts, so texts are left to the calling thread.
+		if (object->getType() != Object::Text)
+			object->updateDetached(options);
+	});
+	
+	for (auto object : objects)
+	{
+		object->updateDetached(options);
+		insertRenderablesOfObject(object);
+		rectIncludeSafe(dirty_rect, object->getExtent());
+	}
+	
+	if (dirty_rect.isValid())
+		setObjectAreaDirty(dirty_rect);
+}
+
+void Map::deferObjectUpdates()
+{
+	deferred_extents.clear();
+	deferred_queue.clear();
+	for (auto part : parts)
+	{
+		for (int i = 0; i < part->getNumObjects(); ++i)
+		{
+			auto object = part->getObject(i);
+			if (object->isOutputDirty())
+			{
+				auto const extent = estimatedExtent(object);
+				deferred_extents.emplace(object, extent);
+				deferred_queue.emplace_back(object, extent.center());
+			}
+		}
+	}
+	deferred_queue_sorted = false;
+	
+	if (!deferred_object_updates && !deferred_extents.empty())
+	{
+		deferred_object_updates = true;
+		QTimer::singleShot(0, this, &Map::updateNextDeferredObjects);
+	}
+}
+
+bool Map::hasDeferredObjectUpdates() const
+{
+	return deferred_object_updates;
+}
+
+bool Map::isObjectUpdateDeferred(const Object* object) const
+{
+	return deferred_object_updates
+	       && object->isOutputDirty()
+	       && deferred_extents.find(const_cast<Object*>(object)) != deferred_extents.end();
+}
+
+void Map::updateDeferredObjects(const QRectF& area)
+{
+	if (!deferred_object_updates)
+		return;
+	
+	std::vector<Object*> objects;
+	for (auto it = deferred_extents.begin(); it != deferred_extents.end(); )
+	{
+		if (it->second.intersects(area))
+		{
+			if (it->first->isOutputDirty())
+				objects.push_back(it->first);
+			it = deferred_extents.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	updateObjects(objects);
+}
+
+void Map::finishDeferredObjectUpdates()
+{
+	if (!deferred_object_updates)
+		return;
+	
+	std::vector<Object*> objects;
+	objects.reserve(deferred_extents.size());
+	for (const auto& entry : deferred_extents)
+	{
+		if (entry.first->isOutputDirty())
+			objects.push_back(entry.first);
+	}
+	deferred_extents.clear();
+	std::vector<std::pair<Object*, QPointF>>().swap(deferred_queue);
+	deferred_object_updates = false;
+	updateObjects(objects);
+}
+
+void Map::dropDeferredObjectUpdate(const Object* object)
+{
+	if (deferred_object_updates)
+		deferred_extents.erase(const_cast<Object*>(object));
+}
+
+bool Map::isProcessingObjects() const
+{
+	return processing_objects;
+}
+
+void Map::setProcessingObjects(bool value)
+{
+	processing_objects = value;
+}
+
+void Map::updateNextDeferredObjects()
+{
+	if (!deferred_object_updates)
+		return;
+	
+	if (processing_objects)
+	{
+		// The objects are in use. Try again later.
+		QTimer::singleShot(int(progress_interval), this, &Map::updateNextDeferredObjects);
+		return;
+	}
+	
+	// Nearest objects last. The queue is sorted again only when the drawn
+	// area has moved, not for every chunk. Entries of objects which were
+	// updated or removed meanwhile are dropped here.
+	if (!deferred_queue_sorted || deferred_queue_center != deferred_updates_center)
+	{
+		deferred_queue.erase(std::remove_if(begin(deferred_queue), end(deferred_queue), [this](const auto& entry) {
+			return deferred_extents.find(entry.first) == deferred_extents.end();
+		}), end(deferred_queue));
+		auto const center = deferred_updates_center;
+		std::sort(begin(deferred_queue), end(deferred_queue), [center](const auto& a, const auto& b) {
+			auto const offset_a = a.second - center;
+			auto const offset_b = b.second - center;
+			return QPointF::dotProduct(offset_a, offset_a) > QPointF::dotProduct(offset_b, offset_b);
+		});
+		deferred_queue_center = center;
+		deferred_queue_sorted = true;
+	}
+	
+	std::vector<Object*> objects;
+	objects.reserve(deferred_updates_chunk_size);
+	while (!deferred_queue.empty() && objects.size() < deferred_updates_chunk_size)
+	{
+		auto const object = deferred_queue.back().first;
+		deferred_queue.pop_back();
+		auto const found = deferred_extents.find(object);
+		if (found == deferred_extents.end())
+			continue;  // updated or removed meanwhile
+		
+		deferred_extents.erase(found);
+		if (object->isOutputDirty())
+			objects.push_back(object);
+	}
+	updateObjects(objects);
+	
+	if (deferred_extents.empty())
+	{
+		std::vector<std::pair<Object*, QPointF>>().swap(deferred_queue);
+		deferred_object_updates = false;
+	}
+	else
+	{
+		QTimer::singleShot(0, this, &Map::updateNextDeferredObjects);
+	}
 }
 
 void Map::updateAllObjectsWithSymbol(const Symbol* symbol)
 {
-	applyOnMatchingObjects(&Object::forceUpdate, ObjectOp::HasSymbol{symbol});
+	for (auto part : parts)
+	{
+		for (auto object : part->objectsWithSymbol(symbol))
+			object->forceUpdate();
+	}
 }
 
 void Map::changeSymbolForAllObjects(const Symbol* old_symbol, const Symbol* new_symbol)
 {
-	applyOnMatchingObjects(ObjectOp::ChangeSymbol{new_symbol}, ObjectOp::HasSymbol{old_symbol});
+	for (auto part : parts)
+	{
+		// Copy: changing the symbol modifies the part's symbol index.
+		auto const objects = part->objectsWithSymbol(old_symbol);
+		for (auto object : objects)
+		{
+			if (!object->setSymbol(new_symbol, false))
+				part->deleteObject(object, false);
+			else
+				object->update();
+		}
+	}
 }
 
 bool Map::deleteAllObjectsWithSymbol(const Symbol* symbol)
 {
-	bool exists = existsObject(ObjectOp::HasSymbol{symbol});
+	bool exists = existsObjectWithSymbol(symbol);
 	if (exists)
 	{
 		// Remove objects from selection
 		removeSymbolFromSelection(symbol, true);
 	
 		// Delete objects from map
-		applyOnMatchingObjects(ObjectOp::Delete(), ObjectOp::HasSymbol{symbol});
+		for (auto part : parts)
+		{
+			// Copy: deleting objects modifies the part's symbol index.
+			auto const objects = part->objectsWithSymbol(symbol);
+			part->deleteObjects(begin(objects), end(objects), false);
+		}
 	}
 	return exists;
 }
 
 bool Map::existsObjectWithSymbol(const Symbol* symbol) const
 {
-	return existsObject(ObjectOp::HasSymbol{symbol});
+	return std::any_of(begin(parts), end(parts), [symbol](auto part) { return part->existsObjectWithSymbol(symbol); });
 }
 
 void Map::setGeoreferencing(const Georeferencing& georeferencing)
@@ -2644,17 +3201,28 @@ void Map::setHasUnsavedChanges(bool has_unsaved_changes)
 			emit hasUnsavedChanged(unsaved_changes);
 		}
 	}
-	else if (!unsaved_changes)
+	else
 	{
-		unsaved_changes = true;
-		emit hasUnsavedChanged(unsaved_changes);
+		modifiedWhileSaving();
+		if (!unsaved_changes)
+		{
+			unsaved_changes = true;
+			emit hasUnsavedChanged(unsaved_changes);
+		}
 	}
 }
 
+void Map::modifiedWhileSaving()
+{
+	if (async_save)
+		async_save->modified = true;
+}
+
 void Map::setOtherDirty()
 {
 	other_dirty = true;
 	setHasUnsavedChanges(true);
+	emit propertiesModified();
 }
 
 // slot
@@ -25,7 +25,10 @@
 #include <algorithm>
 #include <cstddef>
 #include <functional>
+#include <memory>
 #include <set>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <QtGlobal>
@@ -35,15 +38,19 @@
 #include <QMetaType>
 #include <QObject>
 #include <QPointer>
+#include <QPointF>
+#include <QRect>
 #include <QRectF>
 #include <QScopedPointer>
 #include <QSharedData>
 #include <QString>
 #include <QTransform>
+#include <QUuid>
 
 #include "core/map_coord.h"
 #include "core/map_grid.h"
 #include "core/map_part.h"
+#include "core/objects/object_selection.h"
 
 class QIODevice;
 class QPainter;
@@ -95,8 +102,8 @@ friend class NativeFileExport;
 friend class XMLFileImporter;
 friend class XMLFileExporter;
 public:
-	/** A set of selected objects represented by a std::set of object pointers. */
-	typedef std::set<Object*> ObjectSelection;
+	/** A set of selected objects with constant-time lookup and deterministic order. */
+	typedef ::ObjectSelection ObjectSelection;
 	
 	/**
 	 * Different strategies for importing elements from another map.
@@ -125,6 +132,14 @@ public:
 		IgnoreVisibilty
 	};	
 	
+	/**
+	 * A function which is notified about the progress of a long-running operation.
+	 * 
+	 * The arguments are the number of processed items and the total number
+	 * of items. The function may return false to request cancellation.
+	 */
+	typedef std::function< bool (int, int) > ProgressObserver;
+	
 	
 	/** Creates a new, empty map. */
 	Map();
@@ -177,6 +192,39 @@ public:
 	              MapView* view = nullptr,
 	              const FileFormat* format = nullptr);
 	
+	/**
+	 * Saves the map to the given file, writing the file on a worker thread.
+	 * 
+	 * The state of the map is captured before this function returns. So the
+	 * map may be modified while the file is written. saveFinished() is emitted
+	 * when writing is finished. Only then the map is marked as saved, unless
+	 * it was modified in the meantime. If writing fails, the error is reported,
+	 * and the map keeps its unsaved changes.
+	 * 
+	 * Capturing the state copies all objects and the symbols they use on the
+	 * calling thread. This cost is linear in the number of objects and
+	 * coordinates, but it doesn't include formatting, encoding and writing
+	 * the data, which is left to the worker thread.
+	 * 
+	 * If the file format does not support capturing the state of the map,
+	 * the map is saved by saveTo().
+	 */
+	bool saveToAsync(const QString& path,
+	                 MapView* view);
+	
+	/**
+	 * Returns true while a file started by saveToAsync() is not finished.
+	 */
+	bool isSaving() const;
+	
+	/**
+	 * Waits until a file started by saveToAsync() is written completely,
+	 * and reports the result.
+	 * 
+	 * Returns false if writing the file failed.
+	 */
+	bool finishSaving();
+	
 	/**
 	 * Attempts to load the map from the specified path. Returns true on success.
 	 * 
@@ -319,6 +367,15 @@ public:
 	 */
 	void updateObjects();
 	
+	/**
+	 * Updates the renderables and extent of the changed objects which may
+	 * intersect the given area.
+	 * 
+	 * Unless object updates are deferred, this is the same as updateObjects().
+	 * This is automatically called by draw(), you normally do not need to call it directly.
+	 */
+	void updateObjects(const QRectF& area);
+	
 	/** 
 	 * Calculates the extent of all map elements. 
 	 * 
@@ -511,6 +568,15 @@ public:
 	/** Sets the symbol set ID. */
 	void setSymbolSetId(const QString& id);
 	
+	/**
+	 * Returns a unique ID of the symbol instances of this map.
+	 * 
+	 * A new ID is created when the map is cleared, and when a symbol is
+	 * replaced or deleted. Unlike addresses, the ID is never reused. So it
+	 * identifies data which refers to the symbols of this map.
+	 */
+	QUuid symbolsSessionId() const;
+	
 	
 	/** Returns the number of symbols in this map. */
 	int getNumSymbols() const;
@@ -804,7 +870,7 @@ public:
 	 * 
 	 * @return The index of the first object which has been reassigned.
 	 */
-	std::size_t reassignObjectsToMapPart(std::set<Object*>::const_iterator begin, std::set<Object*>::const_iterator end, std::size_t source, std::size_t destination);
+	std::size_t reassignObjectsToMapPart(ObjectSelection::const_iterator begin, ObjectSelection::const_iterator end, std::size_t source, std::size_t destination);
 	
 	/**
 	 * Moves all specified objects from the source to the target map part.
@@ -960,9 +1026,80 @@ public:
 	/** Rotates all objects by the given rotation angle (in radians). */
 	void rotateAllObjects(double rotation, const MapCoord& center);
 	
-	/** Forces an update of all objects, i.e. calls update(true) on each map object. */
+	/**
+	 * Forces an update of all objects.
+	 * 
+	 * The output of the objects is regenerated concurrently.
+	 */
 	void updateAllObjects();
 	
+	/**
+	 * Updates the given objects of this map if their output is dirty.
+	 * 
+	 * This is equivalent to calling Object::update() for each object, but the
+	 * output of the objects is regenerated concurrently.
+	 */
+	void updateObjects(const std::vector<Object*>& objects);
+	
+	/**
+	 * Defers the update of all objects whose output is dirty.
+	 * 
+	 * Drawing updates only the objects which may intersect the drawn area.
+	 * The other objects are updated in the background, in chunks, starting
+	 * next to the most recently drawn area. This reduces the time until a
+	 * large map is displayed after loading.
+	 * 
+	 * The extents of the objects are estimated once, from the coordinates
+	 * plus a margin. Hit tests and extent queries of MapPart update the
+	 * deferred objects which they need on demand.
+	 */
+	void deferObjectUpdates();
+	
+	/**
+	 * Returns true while there are deferred object updates.
+	 */
+	bool hasDeferredObjectUpdates() const;
+	
+	/**
+	 * Returns true if the object's update is deferred and still pending.
+	 */
+	bool isObjectUpdateDeferred(const Object* object) const;
+	
+	/**
+	 * Updates the deferred objects which may intersect the given area.
+	 * 
+	 * Does nothing unless object updates are deferred.
+	 */
+	void updateDeferredObjects(const QRectF& area);
+	
+	/**
+	 * Updates all deferred objects now.
+	 * 
+	 * Does nothing unless object updates are deferred.
+	 */
+	void finishDeferredObjectUpdates();
+	
+	/**
+	 * Forgets the deferred update of an object which is removed from the map.
+	 */
+	void dropDeferredObjectUpdate(const Object* object);
+	
+	/**
+	 * Returns true while objects are processed in worker threads.
+	 * 
+	 * Long-running operations may run the event loop for reporting progress.
+	 * Until such an operation has finished, objects must not be updated or
+	 * drawn, and the map must not be saved.
+	 */
+	bool isProcessingObjects() const;
+	
+	/**
+	 * Marks the begin or the end of processing objects in worker threads.
+	 * 
+	 * @see isProcessingObjects()
+	 */
+	void setProcessingObjects(bool value);
+	
 	/** Forces an update of all objects with the given symbol. */
 	void updateAllObjectsWithSymbol(const Symbol* symbol);
 	
@@ -1076,9 +1213,12 @@ public:
 	 *     Of the selection renderables. TODO: HACK
 	 * @param draw_normal If set to true, draws the objects like normal objects,
 	 *     otherwise draws transparent highlights.
+	 * @param viewport_rect The area to be drawn, in viewport coordinates.
+	 *     A null rect selects the widget's rect.
 	 */
 	void drawSelection(QPainter* painter, bool force_min_size, MapWidget* widget,
-		MapRenderables* replacement_renderables = nullptr, bool draw_normal = false);
+		MapRenderables* replacement_renderables = nullptr, bool draw_normal = false,
+		const QRect& viewport_rect = {});
 	
 	/**
 	 * Adds the given object to the selection.
@@ -1151,10 +1291,14 @@ public:
 	 * @param scale_objects Whether to scale the map object coordinates.
 	 * @param scale_georeferencing Whether to adjust the map's georeferencing reference point.
 	 * @param scale_templates Whether to scale non-georeferenced templates.
+	 * @param observer If set, is notified about the progress of processing the objects.
+	 *                 Cancellation is possible only if symbols are not scaled.
+	 * @return False if the operation was canceled and the map was left unchanged.
 	 */
-	void changeScale(unsigned int new_scale_denominator,
+	bool changeScale(unsigned int new_scale_denominator,
 		const MapCoord& scaling_center, bool scale_symbols, bool scale_objects,
-		bool scale_georeferencing, bool scale_templates);
+		bool scale_georeferencing, bool scale_templates,
+		const ProgressObserver& observer = {});
 	
 	
 	/**
@@ -1165,10 +1309,12 @@ public:
 	 * @param adjust_georeferencing Whether to adjust the georeferencing reference point.
 	 * @param adjust_declination Whether to adjust the georeferencing declination.
 	 * @param adjust_templates Whether to adjust non-georeferenced templates.
+	 * @param observer If set, is notified about the progress of processing the objects.
+	 * @return False if the operation was canceled and the map was left unchanged.
 	 */
-	void rotateMap(double rotation, const MapCoord& center,
+	bool rotateMap(double rotation, const MapCoord& center,
 		bool adjust_georeferencing, bool adjust_declination,
-		bool adjust_templates);
+		bool adjust_templates, const ProgressObserver& observer = {});
 	
 	
 	/** Returns the map notes string. */
@@ -1345,6 +1491,20 @@ signals:
 	 */
 	void hasUnsavedChanged(bool is_clean);
 	
+	/**
+	 * Emitted when writing a file started by saveToAsync() is finished.
+	 */
+	void saveFinished(const QString& path, bool success);
+	
+	/**
+	 * Emitted when colors, symbols, templates or other properties of the map
+	 * are marked as modified.
+	 * 
+	 * Changes to objects are not covered by this signal. They are tracked by
+	 * the steps pushed to the undoManager().
+	 */
+	void propertiesModified();
+	
 	
 	/** Emitted when a color is added to the map, gives the color's index and pointer. */
 	void colorAdded(int pos, const MapColor* color);
@@ -1437,6 +1597,11 @@ protected slots:
 	
 	void undoCleanChanged(bool is_clean);
 	
+	/**
+	 * Updates the next chunk of objects when object updates are deferred.
+	 */
+	void updateNextDeferredObjects();
+	
 private:
 	typedef std::vector<MapColor*> ColorVector;
 	typedef std::vector<Symbol*> SymbolVector;
@@ -1498,15 +1663,44 @@ private:
 	);
 	
 	
+	/**
+	 * Marks the current state of the map as saved.
+	 */
+	void markAsSaved();
+	
+	/**
+	 * Takes note of a modification while a file is written by saveToAsync().
+	 */
+	void modifiedWhileSaving();
+	
+	
 	void addSelectionRenderables(const Object* object);
 	void updateSelectionRenderables(const Object* object);
 	void removeSelectionRenderables(const Object* object);
 	
+	/**
+	 * Applies a transformation to all objects and regenerates their output.
+	 * 
+	 * The objects are processed concurrently. The transformation must modify
+	 * only the given object, and it must not call Object::update().
+	 * 
+	 * If an observer is set, it is notified about the progress from the
+	 * calling thread. If the operation is cancelable and the observer
+	 * requests cancellation, all objects are restored to their original
+	 * state, and false is returned. While the objects are processed,
+	 * isProcessingObjects() returns true.
+	 */
+	bool transformAllObjects(const std::function<void (Object*)>& transform, const ProgressObserver& observer, bool cancelable);
+	
+	/** Scales all symbols by the given factor, without updating the objects. */
+	void scaleSymbols(double factor);
+	
 	static void initStatic();
 	
 	QExplicitlySharedDataPointer<MapColorSet> color_set;
 	bool has_spot_colors;
 	QString symbol_set_id;
+	QUuid symbols_session_id;
 	SymbolVector symbols;
 	mutable qreal symbol_icon_scale = 0;
 	TemplateVector templates;
@@ -1545,6 +1739,18 @@ private:
 	
 	std::set<Object*> irregular_objects;
 	
+	bool processing_objects = false;  // objects are in use by worker threads
+	
+	bool deferred_object_updates = false;
+	QPointF deferred_updates_center;  // where to continue with deferred updates
+	std::unordered_map<Object*, QRectF> deferred_extents;     // pending objects, estimated extents
+	std::vector<std::pair<Object*, QPointF>> deferred_queue;  // objects and their centers, nearest last
+	QPointF deferred_queue_center;    // the center for which the queue is sorted
+	bool deferred_queue_sorted = false;
+	
+	struct AsyncSave;
+	std::unique_ptr<AsyncSave> async_save;  // the file being written by saveToAsync()
+	
 	// Static
 	
 	static bool static_initialized;
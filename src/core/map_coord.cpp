@@ -31,6 +31,11 @@
 #include <QLineF>
 #include <QStringRef>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define MAPPER_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
 #include "util/xml_stream_util.h"
 
 
@@ -181,6 +186,158 @@ void ensureBoundsForQint32(qint64 x64, qint64 y64)
 	}
 }
 
+
+// Pairs of decimal digits, for formatting two digits at once
+const char digit_pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+/**
+ * Writes the decimal digits of value to buffer, and returns the end.
+ */
+inline
+char* writeDecimal(char* buffer, quint32 value)
+{
+	int num_digits = 1;
+	for (quint32 limit = 10; num_digits < 10 && value >= limit; limit *= 10)
+		++num_digits;
+	
+	auto const end = buffer + num_digits;
+	auto p = end;
+	while (value >= 100)
+	{
+		auto const pair = digit_pairs + 2 * (value % 100);
+		value /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	if (value >= 10)
+	{
+		auto const pair = digit_pairs + 2 * value;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	else
+	{
+		*--p = char('0' + value);
+	}
+	return end;
+}
+
+/**
+ * Writes the sign and decimal digits of value to buffer, and returns the end.
+ */
+inline
+char* writeDecimal(char* buffer, qint32 value)
+{
+	auto magnitude = quint32(value);
+	if (value < 0)
+	{
+		*buffer++ = '-';
+		magnitude = 0u - magnitude;
+	}
+	return writeDecimal(buffer, magnitude);
+}
+
+
+/**
+ * Returns the number of decimal digits at the beginning of [data, end).
+ */
+inline
+int countDigits(const ushort* data, const ushort* end)
+{
+	int count = 0;
+#ifdef MAPPER_USE_SSE2
+	// Classify eight characters at once. Characters beyond the ASCII range
+	// are negative as signed 16 bit integers, and thus no digits.
+	auto const below_zero = _mm_set1_epi16('0' - 1);
+	auto const above_nine = _mm_set1_epi16('9' + 1);
+	for (; end - data >= 8; data += 8)
+	{
+		auto const chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		auto const is_digit = _mm_and_si128(_mm_cmpgt_epi16(chars, below_zero),
+		                                    _mm_cmplt_epi16(chars, above_nine));
+		auto mask = unsigned(_mm_movemask_epi8(is_digit));
+		if (mask != 0xffffu)
+		{
+			// Two bits per character
+			for (; mask & 1u; mask >>= 2)
+				++count;
+			return count;
+		}
+		count += 8;
+	}
+#endif
+	for (; data != end && *data >= '0' && *data <= '9'; ++data)
+		++count;
+	return count;
+}
+
+/**
+ * Returns the value of the decimal digits in [first, last).
+ * 
+ * The range must not contain more than eight digits. With SSE2, the eight
+ * characters before last are loaded at once if they are within the buffer
+ * starting at begin.
+ */
+inline
+qint64 digitsValue(const ushort* first, const ushort* last, const ushort* begin)
+{
+#ifdef MAPPER_USE_SSE2
+	if (last - begin >= 8)
+	{
+		auto const count = short(last - first);
+		auto const chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(last - 8));
+		auto const lanes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+		auto const is_digit = _mm_cmpgt_epi16(lanes, _mm_set1_epi16(7 - count));
+		auto const digits = _mm_and_si128(_mm_sub_epi16(chars, _mm_set1_epi16('0')), is_digit);
+		// Combine adjacent digits to values of two digits, and then of four digits.
+		auto const pairs = _mm_madd_epi16(digits, _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1));
+		auto const quads = _mm_madd_epi16(_mm_packs_epi32(pairs, pairs),
+		                                  _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+		return qint64(_mm_cvtsi128_si32(quads)) * 10000
+		       + _mm_cvtsi128_si32(_mm_srli_si128(quads, 4));
+	}
+#else
+	Q_UNUSED(begin)
+#endif
+	qint64 value = 0;
+	for (; first != last; ++first)
+		value = 10*value + *first - '0';
+	return value;
+}
+
+/**
+ * Parses a decimal number of at most eight digits, with optional sign.
+ * 
+ * Returns the end of the number, or nullptr if there is no such number at data.
+ */
+inline
+const ushort* parseNumber(const ushort* data, const ushort* begin, const ushort* end, qint64& value)
+{
+	auto const negative = data != end && *data == '-';
+	if (negative)
+		++data;
+	
+	auto const count = countDigits(data, end);
+	if (count == 0 || count > 8)
+		return nullptr;
+	
+	auto const last = data + count;
+	value = digitsValue(data, last, begin);
+	if (negative)
+		value = -value;
+	return last;
+}
+
 } // namespace
 
 
@@ -360,6 +517,21 @@ QString MapCoord::toString() const
 	return QString(buffer+j, buf_size-j);
 }
 
+char* MapCoord::toUtf8(char* buffer) const
+{
+	buffer = writeDecimal(buffer, xp);
+	*buffer++ = ' ';
+	buffer = writeDecimal(buffer, yp);
+	auto const flags = Flags::Int(fp);
+	if (flags > 0)
+	{
+		*buffer++ = ' ';
+		buffer = writeDecimal(buffer, quint32(flags));
+	}
+	*buffer++ = ';';
+	return buffer;
+}
+
 MapCoord::MapCoord(QStringRef& text)
 : MapCoord{}
 {
@@ -456,3 +628,47 @@ MapCoord::MapCoord(QStringRef& text)
 	++i;
 	text = text.mid(i, len-i);
 }
+
+void MapCoord::parseRun(QStringRef text, std::vector<MapCoord>& coords)
+{
+	auto const begin = reinterpret_cast<const ushort*>(text.constData());
+	auto const end = begin + text.length();
+	auto data = begin;
+	while (data != end)
+	{
+		// Fast path for "x y[ flags];", with at most eight digits per number
+		qint64 x64, y64;
+		auto p = parseNumber(data, begin, end, x64);
+		if (p && p != end && *p == ' ')
+			p = parseNumber(p + 1, begin, end, y64);
+		else
+			p = nullptr;
+		
+		auto flags = Flags();
+		if (p && p != end && *p == ' ')
+		{
+			++p;
+			auto const count = countDigits(p, end);
+			if (count == 0 || count > 3)
+				p = nullptr;
+			else
+				for (auto const last = p + count; p != last; ++p)
+					flags = Flags(10*int(flags) + *p - '0');
+		}
+		
+		if (Q_UNLIKELY(!p || p == end || *p != ';'))
+		{
+			// Anything else is left to the regular constructor,
+			// including the detection of invalid data.
+			auto remaining = text.mid(int(data - begin));
+			coords.emplace_back(remaining);
+			data = end - remaining.length();
+			continue;
+		}
+		
+		handleBoundsOffset(x64, y64);
+		ensureBoundsForQint32(x64, y64);
+		coords.push_back(fromNative(static_cast<qint32>(x64), static_cast<qint32>(y64), flags));
+		data = p + 1;
+	}
+}
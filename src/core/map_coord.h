@@ -23,6 +23,7 @@
 #define OPENORIENTEERING_MAP_COORD_H
 
 #include <cmath>
+#include <cstddef>
 #include <vector>
 
 #include <QtGlobal>
@@ -407,6 +408,20 @@ public:
 	 */
 	QString toString() const;
 	
+	/**
+	 * The maximum number of bytes written by toUtf8().
+	 */
+	static constexpr std::size_t max_utf8_size = 28;
+	
+	/**
+	 * Writes raw coordinates and flags to a buffer, in the same format as
+	 * toString(), encoded in UTF-8.
+	 * 
+	 * The buffer must have room for max_utf8_size bytes.
+	 * Returns a pointer to the end of the written data.
+	 */
+	char* toUtf8(char* buffer) const;
+	
 	/**
 	 * Constructs the MapCoord from the beginning of text, and moves the 
 	 * reference to behind the this coordinates data.
@@ -421,6 +436,16 @@ public:
 	 */
 	MapCoord(QStringRef& text);
 	
+	/**
+	 * Parses all coordinates from text and appends them to coords.
+	 * 
+	 * This has the same effect as constructing MapCoords from text until the
+	 * text is exhausted, including the exceptions and the handling of the
+	 * boundsOffset(). But it is faster for long runs of coordinates: Where
+	 * available, SSE2 is used to classify and to accumulate the digits.
+	 */
+	static void parseRun(QStringRef text, std::vector<MapCoord>& coords);
+	
 	
 	/** Saves the MapCoord in xml format to the stream. */
 	void save(QXmlStreamWriter& xml) const;
@@ -22,12 +22,18 @@
 #include "map_part.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iterator>
+#include <numeric>
+#include <utility>
+#include <vector>
 
+#include <QtConcurrentMap>
 #include <QtGlobal>
 #include <QIODevice>
 #include <QLatin1String>
 #include <QObject>
+#include <QPoint>
 #include <QStringRef>
 #include <QTransform>
 #include <QXmlStreamReader>
@@ -36,6 +42,7 @@
 #include "core/map_coord.h"
 #include "core/objects/object.h"
 #include "core/symbols/symbol.h"
+#include "fileformats/file_format.h"
 #include "undo/object_undo.h"
 #include "util/util.h"
 #include "util/xml_stream_util.h"
@@ -51,6 +58,10 @@ namespace literal
 }
 
 
+constexpr qreal MapPart::spatial_cell_size;
+constexpr int MapPart::max_spatial_cells;
+
+
 MapPart::MapPart(const QString& name, Map* map)
 : name(name)
 , map(map)
@@ -82,16 +93,17 @@ bool MapPart::load(QIODevice* file, int version, Map* map)
 	
 	int size;
 	file->read((char*)&size, sizeof(int));
-	objects.resize(size, nullptr);
+	objects.reserve(size);
 	
-	for (Object*& object : objects)
+	for (int i = 0; i < size; ++i)
 	{
 		int save_type;
 		file->read((char*)&save_type, sizeof(int));
-		object = Object::getObjectForType(static_cast<Object::Type>(save_type), nullptr);
+		auto object = Object::getObjectForType(static_cast<Object::Type>(save_type), nullptr);
 		if (!object)
 			return false;
 		object->load(file, version, map);
+		appendObject(object);
 	}
 	return true;
 }
@@ -131,13 +143,25 @@ MapPart* MapPart::load(QXmlStreamReader& xml, Map& map, SymbolDictionary& symbol
 			if (num_objects > 0)
 				part->objects.reserve(qMin(num_objects, std::size_t(20000))); // 20000 is not a limit
 			
+			// Reading the stream is sequential, but the bulk of the work,
+			// parsing the coordinates, is done concurrently afterwards.
+			std::vector<DeferredCoords> deferred_coords;
+			deferred_coords.reserve(part->objects.capacity());
+			
 			while (xml.readNextStartElement())
 			{
 				if (xml.name() == literal::object)
-					part->objects.push_back(Object::load(xml, &map, symbol_dict));
+				{
+					deferred_coords.emplace_back();
+					part->appendObject(Object::load(xml, &map, symbol_dict, deferred_coords.back()));
+				}
 				else
+				{
 					xml.skipCurrentElement(); // unknown
+				}
 			}
+			
+			part->finishLoading(deferred_coords);
 		}
 		else
 			xml.skipCurrentElement(); // unknown
@@ -146,13 +170,46 @@ MapPart* MapPart::load(QXmlStreamReader& xml, Map& map, SymbolDictionary& symbol
 	return part;
 }
 
+void MapPart::finishLoading(const std::vector<DeferredCoords>& deferred_coords)
+{
+	Q_ASSERT(deferred_coords.size() <= objects.size());
+	auto const first = objects.size() - deferred_coords.size();
+	
+	// Exceptions must not escape from the worker threads. The first error
+	// in document order is reported, as if loading was sequential.
+	std::vector<QString> errors(deferred_coords.size());
+	auto indices = std::vector<std::size_t>(deferred_coords.size());
+	std::iota(begin(indices), end(indices), std::size_t(0));
+	QtConcurrent::blockingMap(indices, [this, first, &deferred_coords, &errors](std::size_t i) {
+		try
+		{
+			objects[first + i]->finishLoading(deferred_coords[i]);
+		}
+		catch (FileFormatException& e)
+		{
+			errors[i] = e.message();
+		}
+	});
+	
+	auto const error = std::find_if(begin(errors), end(errors), [](const QString& message) {
+		return !message.isEmpty();
+	});
+	if (error != end(errors))
+		throw FileFormatException(*error);
+	
+	for (auto i = first; i < objects.size(); ++i)
+	{
+		if (objects[i]->isIrregular())
+			map->markAsIrregular(objects[i]);
+	}
+}
+
 int MapPart::findObjectIndex(const Object* object) const
 {
-	int size = objects.size();
-	for (int i = size - 1; i >= 0; --i)
+	if (object->map_part == this)
 	{
-		if (objects[i] == object)
-			return i;
+		Q_ASSERT(objects[object->map_part_pos] == object);
+		return int(object->map_part_pos);
 	}
 	Q_ASSERT(false);
 	return -1;
@@ -161,10 +218,14 @@ int MapPart::findObjectIndex(const Object* object) const
 void MapPart::setObject(Object* object, int pos, bool delete_old)
 {
 	map->removeRenderablesOfObject(objects[pos], true);
+	map->dropDeferredObjectUpdate(objects[pos]);
+	removeFromIndexes(objects[pos], objects[pos]->getSymbol());
 	if (delete_old)
 		delete objects[pos];
 	
 	objects[pos] = object;
+	addToIndexes(object);
+	object->map_part_pos = std::size_t(pos);
 	object->setMap(map);
 	object->update();
 	map->setObjectsDirty(); // TODO: remove from here, dirty state handling should be separate
@@ -178,6 +239,8 @@ void MapPart::addObject(Object* object)
 void MapPart::addObject(Object* object, int pos)
 {
 	objects.insert(objects.begin() + pos, object);
+	addToIndexes(object);
+	renumberObjects(std::size_t(pos));
 	object->setMap(map);
 	object->update();
 	
@@ -188,11 +251,14 @@ void MapPart::addObject(Object* object, int pos)
 void MapPart::deleteObject(int pos, bool remove_only)
 {
 	map->removeRenderablesOfObject(objects[pos], true);
+	map->dropDeferredObjectUpdate(objects[pos]);
+	removeFromIndexes(objects[pos], objects[pos]->getSymbol());
 	if (remove_only)
 		objects[pos]->setMap(nullptr);
 	else
 		delete objects[pos];
 	objects.erase(objects.begin() + pos);
+	renumberObjects(std::size_t(pos));
 	
 	if (objects.empty() && map->getNumObjects() == 0)
 		map->updateAllMapWidgets();
@@ -200,21 +266,68 @@ void MapPart::deleteObject(int pos, bool remove_only)
 
 bool MapPart::deleteObject(Object* object, bool remove_only)
 {
-	int size = objects.size();
-	for (int i = size - 1; i >= 0; --i)
+	if (object->map_part != this)
+		return false;
+	
+	deleteObject(int(object->map_part_pos), remove_only);
+	return true;
+}
+
+void MapPart::insertObjects(const std::vector<std::pair<int, Object*>>& indexed_objects)
+{
+	if (indexed_objects.empty())
+		return;
+	
+	Q_ASSERT(std::is_sorted(begin(indexed_objects), end(indexed_objects), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	}));
+	
+	// Merge the existing and the new objects in a single pass.
+	ObjectList merged;
+	merged.reserve(objects.size() + indexed_objects.size());
+	auto existing = begin(objects);
+	for (const auto& item : indexed_objects)
 	{
-		if (objects[i] == object)
-		{
-			deleteObject(i, remove_only);
-			return true;
-		}
+		Q_ASSERT(item.first >= int(merged.size()));
+		while (int(merged.size()) < item.first && existing != end(objects))
+			merged.push_back(*existing++);
+		merged.push_back(item.second);
 	}
-	return false;
+	merged.insert(end(merged), existing, end(objects));
+	objects.swap(merged);
+	
+	for (const auto& item : indexed_objects)
+		addToIndexes(item.second);
+	renumberObjects(std::size_t(indexed_objects.front().first));
+	
+	for (const auto& item : indexed_objects)
+	{
+		item.second->setMap(map);
+		item.second->update();
+	}
+	
+	if (objects.size() == indexed_objects.size() && map->getNumObjects() == int(objects.size()))
+		map->updateAllMapWidgets();
 }
 
 void MapPart::importPart(const MapPart* other, const QHash<const Symbol*, Symbol*>& symbol_map, const QTransform& transform, bool select_new_objects)
 {
-	if (other->getNumObjects() == 0)
+	std::vector<Object*> new_objects;
+	new_objects.reserve(other->objects.size());
+	for (const Object* object: other->objects)
+	{
+		Object* new_object = object->duplicate();
+		if (symbol_map.contains(new_object->getSymbol()))
+			new_object->setSymbol(symbol_map.value(new_object->getSymbol()), true);
+		new_object->transform(transform);
+		new_objects.push_back(new_object);
+	}
+	importObjects(std::move(new_objects), select_new_objects);
+}
+
+void MapPart::importObjects(std::vector<Object*>&& new_objects, bool select_new_objects)
+{
+	if (new_objects.empty())
 		return;
 	
 	bool first_objects = map->getNumObjects() == 0;
@@ -222,20 +335,18 @@ void MapPart::importPart(const MapPart* other, const QHash<const Symbol*, Symbol
 	if (select_new_objects)
 		map->clearObjectSelection(false);
 	
-	objects.reserve(objects.size() + other->objects.size());
-	for (const Object* object: other->objects)
+	objects.reserve(objects.size() + new_objects.size());
+	for (auto new_object : new_objects)
 	{
-		Object* new_object = object->duplicate();
-		if (symbol_map.contains(new_object->getSymbol()))
-			new_object->setSymbol(symbol_map.value(new_object->getSymbol()), true);
-		new_object->transform(transform);
-		
-		objects.push_back(new_object);
+		appendObject(new_object);
 		new_object->setMap(map);
-		new_object->update();
-		
 		undo_step->addObject((int)objects.size() - 1);
-		if (select_new_objects)
+	}
+	
+	map->updateObjects(new_objects);
+	if (select_new_objects)
+	{
+		for (auto new_object : new_objects)
 			map->addObjectToSelection(new_object, false);
 	}
 	
@@ -260,12 +371,15 @@ void MapPart::findObjectsAt(
         bool include_protected_objects,
         SelectionInfoVector& out ) const
 {
+	map->updateDeferredObjects(QRectF(coord.x() - qreal(tolerance), coord.y() - qreal(tolerance), 2 * qreal(tolerance), 2 * qreal(tolerance)));
 	for (Object* object : objects)
 	{
 		if (!include_hidden_objects && object->getSymbol()->isHidden())
 			continue;
 		if (!include_protected_objects && object->getSymbol()->isProtected())
 			continue;
+		if (map->isObjectUpdateDeferred(object))
+			continue;  // not near coord
 		
 		object->update();
 		int selected_type = object->isPointOnObject(coord, tolerance, treat_areas_as_paths, extended_selection);
@@ -282,12 +396,15 @@ void MapPart::findObjectsAtBox(
         std::vector< Object* >& out ) const
 {
 	auto rect = QRectF(corner1, corner2).normalized();
+	map->updateDeferredObjects(rect);
 	for (Object* object : objects)
 	{
 		if (!include_hidden_objects && object->getSymbol()->isHidden())
 			continue;
 		if (!include_protected_objects && object->getSymbol()->isProtected())
 			continue;
+		if (map->isObjectUpdateDeferred(object))
+			continue;  // not in rect
 		
 		object->update();
 		if (rect.intersects(object->getExtent()) && object->intersectsBox(rect))
@@ -297,11 +414,14 @@ void MapPart::findObjectsAtBox(
 
 int MapPart::countObjectsInRect(const QRectF& map_coord_rect, bool include_hidden_objects) const
 {
+	map->updateDeferredObjects(map_coord_rect);
 	int count = 0;
 	for (const Object* object : objects)
 	{
 		if (object->getSymbol()->isHidden() && !include_hidden_objects)
 			continue;
+		if (map->isObjectUpdateDeferred(object))
+			continue;  // not in rect
 		object->update();
 		if (object->getExtent().intersects(map_coord_rect))
 			++count;
@@ -311,6 +431,7 @@ int MapPart::countObjectsInRect(const QRectF& map_coord_rect, bool include_hidde
 
 QRectF MapPart::calculateExtent(bool include_helper_symbols) const
 {
+	map->finishDeferredObjectUpdates();
 	QRectF rect;
 	for (const auto object : objects)
 	{
@@ -326,6 +447,81 @@ QRectF MapPart::calculateExtent(bool include_helper_symbols) const
 
 
 
+std::vector<Object*> MapPart::findObjectsInRect(const QRectF& rect) const
+{
+	map->updateDeferredObjects(rect);
+	updateSpatialIndex();
+	
+	std::vector<Object*> result;
+	auto const query = spatialCells(rect);
+	auto add_entry = [this, &rect, &query, &result](const SpatialEntry& entry, int x, int y) {
+		// Report an object only in the first cell which it shares with the query.
+		if (x == std::max(entry.cells.left(), query.left())
+		    && y == std::max(entry.cells.top(), query.top())
+		    && entry.object->getExtent().intersects(rect))
+		{
+			result.push_back(objects[entry.object->map_part_pos]);
+		}
+	};
+	
+	if (qint64(query.width()) * query.height() <= qint64(spatial_cells.size()))
+	{
+		for (auto y = query.top(); y <= query.bottom(); ++y)
+		{
+			for (auto x = query.left(); x <= query.right(); ++x)
+			{
+				auto const cell = spatial_cells.find(spatialCellKey(x, y));
+				if (cell == spatial_cells.end())
+					continue;
+				for (const auto& entry : cell->second)
+					add_entry(entry, x, y);
+			}
+		}
+	}
+	else
+	{
+		// The query covers more cells than there are occupied cells.
+		for (const auto& cell : spatial_cells)
+		{
+			auto const x = int(quint64(cell.first) >> 32);
+			auto const y = int(quint32(cell.first));
+			if (!query.contains(x, y))
+				continue;
+			for (const auto& entry : cell.second)
+				add_entry(entry, x, y);
+		}
+	}
+	
+	for (const auto& entry : large_objects)
+	{
+		if (entry.cells.intersects(query) && entry.object->getExtent().intersects(rect))
+			result.push_back(objects[entry.object->map_part_pos]);
+	}
+	
+	std::sort(begin(result), end(result), [](const Object* a, const Object* b) {
+		return a->map_part_pos < b->map_part_pos;
+	});
+	return result;
+}
+
+QRectF MapPart::indexedExtent() const
+{
+	map->finishDeferredObjectUpdates();
+	updateSpatialIndex();
+	return spatial_extent;
+}
+
+
+
+const std::vector<Object*>& MapPart::objectsWithSymbol(const Symbol* symbol) const
+{
+	static const ObjectList no_objects;
+	auto entry = objects_by_symbol.find(symbol);
+	return entry == objects_by_symbol.end() ? no_objects : entry->second;
+}
+
+
+
 bool MapPart::existsObject(const std::function<bool(const Object*)>& condition) const
 {
 	return std::any_of(begin(objects), end(objects), condition);
@@ -367,3 +563,196 @@ void MapPart::applyOnAllObjects(const std::function<void (Object*, MapPart*, int
 		operation(objects[i], this, int(i));
 	}
 }
+
+
+
+bool MapPart::releaseObject(Object* object, bool remove_only)
+{
+	if (object->map_part != this)
+		return false;
+	
+	auto const pos = object->map_part_pos;
+	Q_ASSERT(objects[pos] == object);
+	map->removeRenderablesOfObject(object, true);
+	map->dropDeferredObjectUpdate(object);
+	removeFromIndexes(object, object->getSymbol());
+	if (remove_only)
+		object->setMap(nullptr);
+	else
+		delete object;
+	objects[pos] = nullptr;
+	return true;
+}
+
+
+void MapPart::finishRelease(const std::vector<Object*>& released, bool remove_only)
+{
+	compactObjects();
+	if (!remove_only)
+	{
+		for (auto object : released)
+			delete object;
+	}
+}
+
+
+void MapPart::compactObjects()
+{
+	auto first_gap = std::find(begin(objects), end(objects), nullptr);
+	auto const first = std::size_t(std::distance(begin(objects), first_gap));
+	objects.erase(std::remove(first_gap, end(objects), nullptr), end(objects));
+	renumberObjects(first);
+	
+	if (objects.empty() && map->getNumObjects() == 0)
+		map->updateAllMapWidgets();
+}
+
+
+void MapPart::renumberObjects(std::size_t first)
+{
+	for (auto i = first; i < objects.size(); ++i)
+		objects[i]->map_part_pos = i;
+}
+
+
+void MapPart::appendObject(Object* object)
+{
+	objects.push_back(object);
+	addToIndexes(object);
+	object->map_part_pos = objects.size() - 1;
+}
+
+
+void MapPart::addToIndexes(Object* object)
+{
+	Q_ASSERT(!object->map_part);
+	auto& list = objects_by_symbol[object->getSymbol()];
+	object->map_part = this;
+	object->symbol_index_pos = list.size();
+	list.push_back(object);
+	
+	objectExtentChanged(object);
+}
+
+
+void MapPart::removeFromIndexes(Object* object, const Symbol* symbol)
+{
+	Q_ASSERT(object->map_part == this);
+	auto entry = objects_by_symbol.find(symbol);
+	Q_ASSERT(entry != objects_by_symbol.end());
+	
+	// Swap with the last element, then drop the last element.
+	auto& list = entry->second;
+	auto const pos = object->symbol_index_pos;
+	Q_ASSERT(pos < list.size() && list[pos] == object);
+	list[pos] = list.back();
+	list[pos]->symbol_index_pos = pos;
+	list.pop_back();
+	if (list.empty())
+		objects_by_symbol.erase(entry);
+	
+	{
+		std::lock_guard<std::mutex> lock(changed_extents_mutex);
+		changed_extents.erase(object);
+	}
+	removeFromSpatialIndex(object);
+	
+	object->map_part = nullptr;
+}
+
+
+void MapPart::objectSymbolChanged(Object* object, const Symbol* old_symbol)
+{
+	removeFromIndexes(object, old_symbol);
+	addToIndexes(object);
+}
+
+
+void MapPart::objectExtentChanged(const Object* object)
+{
+	std::lock_guard<std::mutex> lock(changed_extents_mutex);
+	changed_extents.insert(object);
+}
+
+
+void MapPart::updateSpatialIndex() const
+{
+	std::vector<const Object*> changed;
+	{
+		std::lock_guard<std::mutex> lock(changed_extents_mutex);
+		changed.assign(begin(changed_extents), end(changed_extents));
+		changed_extents.clear();
+	}
+	
+	for (auto object : changed)
+	{
+		removeFromSpatialIndex(object);
+		
+		const auto& extent = object->getExtent();
+		if (!extent.isValid())
+			continue;  // not updated yet
+		
+		auto const cells = spatialCells(extent);
+		spatial_ranges.emplace(object, cells);
+		rectIncludeSafe(spatial_extent, extent);
+		if (qint64(cells.width()) * cells.height() > max_spatial_cells)
+		{
+			large_objects.push_back({ object, cells });
+			continue;
+		}
+		for (auto y = cells.top(); y <= cells.bottom(); ++y)
+		{
+			for (auto x = cells.left(); x <= cells.right(); ++x)
+				spatial_cells[spatialCellKey(x, y)].push_back({ object, cells });
+		}
+	}
+}
+
+
+void MapPart::removeFromSpatialIndex(const Object* object) const
+{
+	auto const range = spatial_ranges.find(object);
+	if (range == spatial_ranges.end())
+		return;
+	
+	auto const cells = range->second;
+	spatial_ranges.erase(range);
+	if (spatial_ranges.empty())
+		spatial_extent = QRectF();
+	
+	auto const matches = [object](const SpatialEntry& entry) { return entry.object == object; };
+	if (qint64(cells.width()) * cells.height() > max_spatial_cells)
+	{
+		large_objects.erase(std::remove_if(begin(large_objects), end(large_objects), matches), end(large_objects));
+		return;
+	}
+	for (auto y = cells.top(); y <= cells.bottom(); ++y)
+	{
+		for (auto x = cells.left(); x <= cells.right(); ++x)
+		{
+			auto const cell = spatial_cells.find(spatialCellKey(x, y));
+			if (cell == spatial_cells.end())
+				continue;
+			auto& entries = cell->second;
+			entries.erase(std::remove_if(begin(entries), end(entries), matches), end(entries));
+			if (entries.empty())
+				spatial_cells.erase(cell);
+		}
+	}
+}
+
+
+QRect MapPart::spatialCells(const QRectF& rect)
+{
+	// Limited to a range which cannot overflow in the cell computations.
+	auto const cell = [](qreal value) {
+		return int(std::floor(qBound(qreal(-1e9), value / spatial_cell_size, qreal(1e9))));
+	};
+	return QRect(QPoint(cell(rect.left()), cell(rect.top())), QPoint(cell(rect.right()), cell(rect.bottom())));
+}
+
+
+qint64 MapPart::spatialCellKey(int x, int y)
+{
+	return qint64((quint64(quint32(x)) << 32) | quint32(y));
+}
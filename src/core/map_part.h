@@ -24,10 +24,15 @@
 
 #include <cstddef>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 
+#include <QtGlobal>
 #include <QHash>
+#include <QRect>
 #include <QRectF>
 #include <QString>
 
@@ -41,6 +46,7 @@ class Map;
 class MapCoordF;
 class Object;
 class Symbol;
+struct DeferredCoords;
 using SymbolDictionary = QHash<QString, Symbol*>; // from symbol.h
 
 
@@ -63,6 +69,8 @@ using SelectionInfoVector = std::vector<std::pair<int, Object*>> ;
  */
 class MapPart
 {
+friend class BinaryFileImporter;
+friend class Object;
 friend class OCAD8FileImport;
 public:
 	/**
@@ -127,7 +135,7 @@ public:
 	/**
 	 * Returns the index of the object.
 	 * 
-	 * Loops over all objects in the part and looks for the given pointer.
+	 * This is a constant-time lookup.
 	 * The object must be contained in this part,
 	 * otherwise an assert is triggered (in debug builds),
 	 * or -1 is returned (release builds).
@@ -170,6 +178,30 @@ public:
 	 */
 	bool deleteObject(Object* object, bool remove_only);
 	
+	/**
+	 * Deletes the objects from the given range.
+	 * 
+	 * The object list is compacted in a single pass after all objects were
+	 * taken out, so this is much faster than deleting the objects one by one.
+	 * Objects which are not contained in this part are ignored.
+	 * The range may contain duplicates. Each object is deleted only once.
+	 * The range must not be invalidated by the deletion, so it must not be
+	 * a list returned by objectsWithSymbol().
+	 * If remove_only is set, does not call "delete object".
+	 * Returns the number of objects which were deleted from this part.
+	 */
+	template <class Iterator>
+	std::size_t deleteObjects(Iterator first, Iterator last, bool remove_only);
+	
+	/**
+	 * Inserts multiple objects at the given indices, in a single pass.
+	 * 
+	 * The indices refer to the positions after insertion, i.e. this has the
+	 * same effect as calling addObject() for each element in increasing
+	 * order of indices. The list must be sorted by index.
+	 */
+	void insertObjects(const std::vector<std::pair<int, Object*>>& indexed_objects);
+	
 	
 	/**
 	 * Imports the contents another part into this part.
@@ -181,6 +213,14 @@ public:
 	void importPart(const MapPart* other, const QHash<const Symbol*, Symbol*>& symbol_map,
 		const QTransform& transform, bool select_new_objects);
 	
+	/**
+	 * Appends the given objects to this part, as a single undo step.
+	 * 
+	 * The part takes ownership of the objects. Their output is generated
+	 * concurrently.
+	 */
+	void importObjects(std::vector<Object*>&& new_objects, bool select_new_objects);
+	
 	
 	/**
 	 * @see Map::findObjectsAt().
@@ -206,6 +246,42 @@ public:
 	 */
 	QRectF calculateExtent(bool include_helper_symbols) const;
 	
+	/**
+	 * Returns the objects whose extent intersects the given rectangle,
+	 * in the order of this part.
+	 * 
+	 * The objects are found with a spatial index of the object extents.
+	 * So the cost depends on the number of objects near the rectangle,
+	 * not on the total number of objects. Deferred object updates within
+	 * the rectangle are done first. Other objects are not updated, and
+	 * hidden symbols are not filtered.
+	 */
+	std::vector<Object*> findObjectsInRect(const QRectF& rect) const;
+	
+	/**
+	 * Returns a rectangle which contains the extents of all objects.
+	 * 
+	 * Unlike calculateExtent(), this does not iterate over the objects,
+	 * and it includes hidden and helper symbols. After objects were moved
+	 * or deleted, the rectangle may be larger than necessary.
+	 */
+	QRectF indexedExtent() const;
+	
+	
+	/**
+	 * Returns the objects in this part which have the given symbol.
+	 * 
+	 * This list is maintained when objects are added or removed, and when
+	 * they change their symbol. The order of the objects is unspecified.
+	 * Callers which modify or delete the objects must iterate over a copy.
+	 */
+	const std::vector<Object*>& objectsWithSymbol(const Symbol* symbol) const;
+	
+	/**
+	 * Returns true if there is at least one object with the given symbol.
+	 */
+	bool existsObjectWithSymbol(const Symbol* symbol) const;
+	
 	
 	/**
 	 * Applies a condition on all objects (until the first match is found).
@@ -241,9 +317,121 @@ public:
 	
 private:
 	typedef std::vector<Object*> ObjectList;
-
+	typedef std::unordered_map<const Symbol*, ObjectList> SymbolIndex;
+	
+	/**
+	 * Takes the object out of the list, leaving a nullptr at its position.
+	 * 
+	 * Returns false if the object is not contained in this part.
+	 * Call compactObjects() to remove the nullptr elements.
+	 */
+	bool releaseObject(Object* object, bool remove_only);
+	
+	/**
+	 * Calls compactObjects() after releasing the given objects, and deletes
+	 * the objects unless remove_only is set.
+	 */
+	void finishRelease(const std::vector<Object*>& released, bool remove_only);
+	
+	/**
+	 * Removes nullptr elements left by releaseObject().
+	 */
+	void compactObjects();
+	
+	/**
+	 * Updates the stored positions of the objects from the given index on.
+	 */
+	void renumberObjects(std::size_t first);
+	
+	/**
+	 * Appends the object at the end, without updating it.
+	 * 
+	 * This is meant for importers which build up a new part.
+	 */
+	void appendObject(Object* object);
+	
+	/**
+	 * Parses the deferred coordinates of the last objects, concurrently.
+	 * 
+	 * The vector's elements correspond to the last objects of this part.
+	 * Throws FileFormatException for the first object which fails.
+	 */
+	void finishLoading(const std::vector<DeferredCoords>& deferred_coords);
+	
+	/**
+	 * Adds the object to the symbol index, and schedules it for the spatial index.
+	 */
+	void addToIndexes(Object* object);
+	
+	/**
+	 * Removes the object from the symbol index, using the given symbol as key,
+	 * and from the spatial index.
+	 */
+	void removeFromIndexes(Object* object, const Symbol* symbol);
+	
+	/**
+	 * Moves the object to the index entry of its current symbol.
+	 * 
+	 * Called by Object when the symbol of an object in this part changes.
+	 */
+	void objectSymbolChanged(Object* object, const Symbol* old_symbol);
+	
+	/**
+	 * Schedules the object to be moved in the spatial index.
+	 * 
+	 * Called by Object when the extent of an object in this part changes.
+	 * This may be called from worker threads.
+	 */
+	void objectExtentChanged(const Object* object);
+	
+	/**
+	 * Moves the objects with changed extents in the spatial index.
+	 */
+	void updateSpatialIndex() const;
+	
+	/**
+	 * Removes the object from the cells of the spatial index.
+	 */
+	void removeFromSpatialIndex(const Object* object) const;
+	
+	/**
+	 * Returns the range of spatial index cells covered by the rectangle.
+	 */
+	static QRect spatialCells(const QRectF& rect);
+	
+	static qint64 spatialCellKey(int x, int y);
+	
+	
+	/**
+	 * An entry of the spatial index.
+	 * 
+	 * An object is listed in every cell which its extent covers. The range
+	 * of cells allows to report the object only once per query.
+	 */
+	struct SpatialEntry
+	{
+		const Object* object;
+		QRect cells;
+	};
+	
+	/** The size of the spatial index cells, in mm. */
+	static constexpr qreal spatial_cell_size = 10;
+	
+	/** Objects covering more cells are kept in a single list. */
+	static constexpr int max_spatial_cells = 256;
+	
 	QString name;
-	ObjectList objects;  ///< @todo This could be a spatial representation optimized for quick access
+	ObjectList objects;
+	SymbolIndex objects_by_symbol;
+	
+	// The spatial index is brought up to date when it is queried.
+	mutable std::unordered_map<qint64, std::vector<SpatialEntry>> spatial_cells;
+	mutable std::vector<SpatialEntry> large_objects;
+	mutable std::unordered_map<const Object*, QRect> spatial_ranges;
+	mutable QRectF spatial_extent;
+	mutable std::unordered_set<const Object*> changed_extents;
+	mutable std::mutex changed_extents_mutex;
+	
 	Map* const map;
 };
 
@@ -275,5 +463,28 @@ const Object* MapPart::getObject(int i) const
 	return objects[std::size_t(i)];
 }
 
+inline
+bool MapPart::existsObjectWithSymbol(const Symbol* symbol) const
+{
+	return objects_by_symbol.find(symbol) != objects_by_symbol.end();
+}
+
+template <class Iterator>
+std::size_t MapPart::deleteObjects(Iterator first, Iterator last, bool remove_only)
+{
+	// A released object no longer belongs to this part, so duplicates are
+	// skipped. The objects are deleted only after the whole range was seen.
+	std::vector<Object*> released;
+	for (; first != last; ++first)
+	{
+		Object* object = *first;
+		if (releaseObject(object, true))
+			released.push_back(object);
+	}
+	if (!released.empty())
+		finishRelease(released, remove_only);
+	return released.size();
+}
+
 
 #endif
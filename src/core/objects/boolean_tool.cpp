@@ -24,13 +24,24 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <numeric>
 #include <stdexcept>
 #include <type_traits>
 
 #include <QtGlobal>
+#include <QtConcurrentMap>
 #include <QDebug>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QPointF>
+#include <QRectF>
 #include <QScopedPointer>
+#include <QTimer>
 
 #include "core/map.h"
 #include "core/map_coord.h"
@@ -94,6 +105,207 @@ bool operator==(const ClipperLib::IntPoint& lhs, const MapCoord& rhs)
 
 
 
+namespace {
+
+/**
+ * The minimum number of objects for which the Union is executed in tiles.
+ */
+constexpr std::size_t tiled_union_threshold = 256;
+
+/**
+ * The maximum number of objects in a tile of the tiled Union.
+ */
+constexpr std::size_t tiled_union_tile_size = 64;
+
+/**
+ * The minimum number of objects for which progress is reported.
+ */
+constexpr int progress_threshold = 1000;
+
+/**
+ * The interval of progress reports, in milliseconds.
+ */
+constexpr int progress_interval = 100;
+
+
+/**
+ * Returns the extent of the object's path, updating the object if needed.
+ * 
+ * Unlike Object::getExtent(), the result does not depend on the symbol.
+ * It is slightly enlarged so that it also covers the rounding to native
+ * coordinates.
+ */
+QRectF pathExtent(const PathObject* object)
+{
+	object->update();
+	QRectF extent;
+	for (const auto& part : object->parts())
+		rectIncludeSafe(extent, part.calculateExtent());
+	if (extent.isValid())
+		extent.adjust(-0.001, -0.001, 0.001, 0.001);
+	return extent;
+}
+
+/**
+ * Returns true if the given extents overlap or touch each other.
+ * 
+ * In contrast to QRectF::intersects(), touching edges count as interaction.
+ */
+bool interacts(const QRectF& a, const QRectF& b)
+{
+	return a.left() <= b.right() && b.left() <= a.right()
+	       && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+/**
+ * Splits objects into clusters of objects with interacting extents.
+ * 
+ * Two objects are in the same cluster if there is a chain of objects with
+ * pairwise interacting extents between them. The clusters are found by a
+ * sweep over the extents sorted by their left edge.
+ * 
+ * The clusters, and the objects in each cluster, keep the order of the
+ * input objects.
+ */
+std::vector<BooleanTool::PathObjects> findClusters(const BooleanTool::PathObjects& objects)
+{
+	auto const count = objects.size();
+	
+	std::vector<QRectF> extents;
+	extents.reserve(count);
+	for (auto object : objects)
+		extents.push_back(pathExtent(object));
+	
+	// Union-find with path halving
+	std::vector<std::size_t> parent(count);
+	for (std::size_t i = 0; i < count; ++i)
+		parent[i] = i;
+	auto find_root = [&parent](std::size_t i) {
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+	
+	std::vector<std::size_t> sorted(count);
+	for (std::size_t i = 0; i < count; ++i)
+		sorted[i] = i;
+	std::sort(begin(sorted), end(sorted), [&extents](std::size_t a, std::size_t b) {
+		return extents[a].left() < extents[b].left();
+	});
+	
+	std::vector<std::size_t> active;
+	for (auto i : sorted)
+	{
+		auto const& extent = extents[i];
+		auto const left = extent.left();
+		active.erase(std::remove_if(begin(active), end(active), [&extents, left](std::size_t j) {
+			return extents[j].right() < left;
+		}), end(active));
+		for (auto j : active)
+		{
+			if (interacts(extent, extents[j]))
+				parent[find_root(i)] = find_root(j);
+		}
+		active.push_back(i);
+	}
+	
+	std::vector<BooleanTool::PathObjects> clusters;
+	QHash<std::size_t, std::size_t> cluster_index;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		auto const root = find_root(i);
+		auto found = cluster_index.constFind(root);
+		if (found == cluster_index.constEnd())
+		{
+			found = cluster_index.insert(root, clusters.size());
+			clusters.emplace_back();
+		}
+		clusters[*found].push_back(objects[i]);
+	}
+	return clusters;
+}
+
+/**
+ * A range of object indices which are merged together by the tiled Union.
+ */
+struct UnionTile
+{
+	std::vector<std::size_t>::const_iterator first;
+	std::vector<std::size_t>::const_iterator last;
+	ClipperLib::Paths result;
+	bool success;
+};
+
+/**
+ * Divides object indices into tiles of limited size.
+ * 
+ * The range is split recursively at the median of the objects' centers,
+ * along the axis with the larger spread. Thus neighbouring tiles are
+ * spatially close.
+ */
+void splitIntoTiles(
+        std::vector<std::size_t>::iterator first,
+        std::vector<std::size_t>::iterator last,
+        const std::vector<QPointF>& centers,
+        std::vector<UnionTile>& tiles )
+{
+	auto const size = std::size_t(std::distance(first, last));
+	if (size <= tiled_union_tile_size)
+	{
+		tiles.push_back({ first, last, {}, false });
+		return;
+	}
+	
+	QRectF spread;
+	for (auto current = first; current != last; ++current)
+		rectIncludeSafe(spread, centers[*current]);
+	
+	auto middle = first + std::ptrdiff_t(size / 2);
+	if (spread.width() >= spread.height())
+	{
+		std::nth_element(first, middle, last, [&centers](std::size_t a, std::size_t b) {
+			return centers[a].x() < centers[b].x();
+		});
+	}
+	else
+	{
+		std::nth_element(first, middle, last, [&centers](std::size_t a, std::size_t b) {
+			return centers[a].y() < centers[b].y();
+		});
+	}
+	splitIntoTiles(first, middle, centers, tiles);
+	splitIntoTiles(middle, last, centers, tiles);
+}
+
+/**
+ * Merges two sets of polygons which are in normalized orientation.
+ */
+bool unitePolygons(const ClipperLib::Paths& first, const ClipperLib::Paths& second, ClipperLib::Paths& result)
+{
+	ClipperLib::Clipper clipper;
+	clipper.AddPaths(first, ClipperLib::ptSubject, true);
+	clipper.AddPaths(second, ClipperLib::ptClip, true);
+	return clipper.Execute(ClipperLib::ctUnion, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+}
+
+/**
+ * A single run of a boolean operation, for concurrent processing.
+ */
+struct BooleanTask
+{
+	PathObject* subject;
+	BooleanTool::PathObjects in_objects;
+	BooleanTool::PathObjects out_objects;
+	bool success;
+};
+
+}  // namespace
+
+
+
 //### BooleanTool ###
 
 BooleanTool::BooleanTool(Operation op, Map* map)
@@ -103,6 +315,11 @@ BooleanTool::BooleanTool(Operation op, Map* map)
 	; // nothing
 }
 
+void BooleanTool::setProgressObserver(const ProgressObserver& observer)
+{
+	progress_observer = observer;
+}
+
 bool BooleanTool::execute()
 {
 	// Check basic prerequisite
@@ -146,53 +363,116 @@ bool BooleanTool::execute()
 
 bool BooleanTool::executePerSymbol()
 {
-	PathObjects backlog;
-	backlog.reserve(map->getNumSelectedObjects());
-	
-	// Filter area objects into initial backlog
+	// Filter area objects into groups by symbol, keeping the selection order
+	std::vector<PathObjects> groups;
+	QHash<const Symbol*, std::size_t> group_index;
 	for (Object* object : map->selectedObjects())
 	{
-		if (object->getSymbol()->getContainedTypes() & Symbol::Area)
-			backlog.push_back(object->asPath());
+		const Symbol* const symbol = object->getSymbol();
+		if (!(symbol->getContainedTypes() & Symbol::Area))
+			continue;
+		
+		PathObject* const path = object->asPath();
+		if (op == MergeHoles && path->parts().size() <= 1)
+			continue;
+		
+		auto found = group_index.constFind(symbol);
+		if (found == group_index.constEnd())
+		{
+			found = group_index.insert(symbol, groups.size());
+			groups.emplace_back();
+		}
+		groups[*found].push_back(path);
 	}
 	
-	QScopedPointer<CombinedUndoStep> undo_step(new CombinedUndoStep(map));
-	PathObjects new_backlog;
-	new_backlog.reserve(backlog.size()/2);
-	PathObjects in_objects;
-	in_objects.reserve(backlog.size()/2);
-	PathObjects out_objects;
-	while (!backlog.empty())
+	// Split the groups into independent tasks
+	std::vector<BooleanTask> tasks;
+	auto add_task = [&tasks](PathObjects& objects) {
+		// Short cut for single object
+		if (objects.size() > 1)
+			tasks.push_back({ objects.front(), std::move(objects), {}, false });
+	};
+	for (auto& group : groups)
 	{
-		PathObject* const primary_object = backlog.front();
-		const Symbol* const symbol = primary_object->getSymbol();
-		
-		// Filter objects by symbol into in_objects or new_backlog, respectively
-		new_backlog.clear();
-		in_objects.clear();
-		for (PathObject* object : backlog)
+		if (op == Union)
+		{
+			// Objects with disjoint extents do not affect each other.
+			for (auto& cluster : findClusters(group))
+				add_task(cluster);
+		}
+		else
 		{
-			if (object->getSymbol() == symbol)
+			for (auto object : group)
+				object->update();
+			add_task(group);
+		}
+	}
+	
+	// Perform the core operation. The objects are up-to-date now, and
+	// each object belongs to a single task.
+	auto const work = [this](BooleanTask& task) {
+		task.success = executeForObjects(task.subject, task.in_objects, task.out_objects);
+	};
+	auto const total = std::accumulate(begin(tasks), end(tasks), 0, [](int sum, const BooleanTask& task) {
+		return sum + int(task.in_objects.size());
+	});
+	if (!progress_observer || total < progress_threshold)
+	{
+		QtConcurrent::blockingMap(tasks, work);
+	}
+	else
+	{
+		// The observer may run the event loop.
+		map->setProcessingObjects(true);
+		progress.store(0);
+		auto canceled = false;
+		auto future = QtConcurrent::map(tasks, work);
+		auto const report = [this, &canceled, &future, total]() {
+			if (!canceled && !progress_observer(progress.load(), total))
 			{
-				if (op != MergeHoles || (object->getSymbol()->getContainedTypes() & Symbol::Area && object->parts().size() > 1 ))
-				{
-					in_objects.push_back(object);
-				}
+				canceled = true;
+				future.cancel();
 			}
-			else
+		};
+		report();
+		
+		// Wait in a local event loop which is left when the work is finished,
+		// and report the progress periodically.
+		QEventLoop loop;
+		QFutureWatcher<void> watcher;
+		QObject::connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+		QTimer timer;
+		QObject::connect(&timer, &QTimer::timeout, report);
+		watcher.setFuture(future);
+		if (!future.isFinished())
+		{
+			timer.start(progress_interval);
+			loop.exec();
+			timer.stop();
+		}
+		future.waitForFinished();
+		map->setProcessingObjects(false);
+		
+		if (canceled)
+		{
+			// The map is still unchanged. Discard all results.
+			for (auto& task : tasks)
 			{
-				new_backlog.push_back(object);
+				for (auto object : task.out_objects)
+					delete object;
 			}
+			return false;
 		}
-		backlog.swap(new_backlog);
-		
-		// Short cut for single object of given symbol
-		if (in_objects.size() == 1)
-			continue;
-		
-		// Perform the core operation
-		out_objects.clear();
-		executeForObjects(primary_object, in_objects, out_objects, *undo_step);
+		progress_observer(total, total);
+	}
+	
+	QScopedPointer<CombinedUndoStep> undo_step(new CombinedUndoStep(map));
+	for (auto& task : tasks)
+	{
+		if (task.success)
+			commitObjects(task.subject, task.in_objects, task.out_objects, *undo_step);
+		else
+			Q_ASSERT(task.out_objects.empty());
 	}
 	
 	bool const have_changes = undo_step->getNumSubSteps() > 0;
@@ -214,24 +494,30 @@ bool BooleanTool::executeForObjects(PathObject* subject, PathObjects& in_objects
 		return false; // in release build
 	}
 	
+	commitObjects(subject, in_objects, out_objects, undo_step);
+	return true;
+}
+
+void BooleanTool::commitObjects(PathObject* subject, const PathObjects& in_objects, const PathObjects& out_objects, CombinedUndoStep& undo_step)
+{
 	// Add original objects to undo step, and remove them from map.
 	QScopedPointer<AddObjectsUndoStep> add_step(new AddObjectsUndoStep(map));
+	PathObjects removed_objects;
+	removed_objects.reserve(in_objects.size());
 	for (PathObject* object : in_objects)
 	{
 		if (op != Difference || object == subject)
 		{
 			add_step->addObject(object, object);
+			map->removeObjectFromSelection(object, false);
+			removed_objects.push_back(object);
 		}
 	}
-	// Keep as separate loop to get the correct index in the previous loop
-	for (PathObject* object : in_objects)
+	// Remove after adding all objects to get the correct indices
+	map->getCurrentPart()->deleteObjects(begin(removed_objects), end(removed_objects), true);
+	for (PathObject* object : removed_objects)
 	{
-		if (op != Difference || object == subject)
-		{
-			map->removeObjectFromSelection(object, false);
-			map->getCurrentPart()->deleteObject(object, true);
-			object->setMap(map); // necessary so objects are saved correctly
-		}
+		object->setMap(map); // necessary so objects are saved correctly
 	}
 	
 	// Add resulting objects to map, and create delete step for them
@@ -250,11 +536,13 @@ bool BooleanTool::executeForObjects(PathObject* subject, PathObjects& in_objects
 	
 	undo_step.push(add_step.take());
 	undo_step.push(delete_step.take());
-	return true;
 }
 
 bool BooleanTool::executeForObjects(PathObject* subject, PathObjects& in_objects, PathObjects& out_objects)
 {
+	if (op == Union && in_objects.size() >= tiled_union_threshold)
+		return executeTiledUnion(subject, in_objects, out_objects);
+	
 	// Convert the objects to Clipper polygons and
 	// create a hash map, mapping point positions to the PathCoords.
 	// These paths are to be regarded as closed.
@@ -263,11 +551,18 @@ bool BooleanTool::executeForObjects(PathObject* subject, PathObjects& in_objects
 	ClipperLib::Paths subject_polygons;
 	pathObjectToPolygons(subject, subject_polygons, polymap);
 	
+	// For intersection and difference, clip objects which do not interact
+	// with the subject cannot affect the result.
+	auto const filter_by_extent = (op == Intersection || op == Difference);
+	auto const subject_extent = filter_by_extent ? pathExtent(subject) : QRectF();
+	
 	ClipperLib::Paths clip_polygons;
 	for (PathObject* object : in_objects)
 	{
 		if (object != subject)
 		{
+			if (filter_by_extent && !interacts(subject_extent, pathExtent(object)))
+				continue;
 			pathObjectToPolygons(object, clip_polygons, polymap);
 		}
 	}
@@ -304,9 +599,147 @@ bool BooleanTool::executeForObjects(PathObject* subject, PathObjects& in_objects
 		polyTreeToPathObjects(solution, out_objects, subject, polymap);
 	}
 	
+	progress.fetchAndAddRelaxed(int(in_objects.size()));
+	return success;
+}
+
+bool BooleanTool::executeTiledUnion(PathObject* subject, PathObjects& in_objects, PathObjects& out_objects)
+{
+	auto const count = in_objects.size();
+	
+	std::vector<QPointF> centers;
+	centers.reserve(count);
+	for (auto object : in_objects)
+		centers.push_back(pathExtent(object).center());
+	
+	std::vector<std::size_t> order(count);
+	std::iota(begin(order), end(order), std::size_t(0));
+	std::vector<UnionTile> tiles;
+	tiles.reserve(2 * count / tiled_union_tile_size + 1);
+	splitIntoTiles(begin(order), end(order), centers, tiles);
+	
+	// Half of the progress is reported for merging the tiles, the rest
+	// for the stitching passes and the final merge.
+	auto remaining_progress = int(count);
+	for (const auto& tile : tiles)
+		remaining_progress -= int(std::distance(tile.first, tile.last)) / 2;
+	
+	// Merge the objects of each tile. The polymap of each result is limited
+	// to the locations which are still present, so the memory for the input
+	// is released while proceeding.
+	std::vector<std::size_t> indices(tiles.size());
+	std::iota(begin(indices), end(indices), std::size_t(0));
+	std::vector<PolyMap> polymaps(tiles.size());
+	QtConcurrent::blockingMap(indices, [this, &in_objects, &tiles, &polymaps](std::size_t i) {
+		auto& tile = tiles[i];
+		PolyMap polymap;
+		ClipperLib::Paths polygons;
+		for (auto current = tile.first; current != tile.last; ++current)
+			pathObjectToPolygons(in_objects[*current], polygons, polymap);
+		
+		ClipperLib::Clipper clipper;
+		clipper.AddPaths(polygons, ClipperLib::ptSubject, true);
+		ClipperLib::Paths().swap(polygons);
+		tile.success = clipper.Execute(ClipperLib::ctUnion, tile.result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		polymaps[i] = retainedPolyMap(tile.result, polymap);
+		progress.fetchAndAddRelaxed(int(std::distance(tile.first, tile.last)) / 2);
+	});
+	
+	// Stitch neighbouring results pairwise, until at most two are left.
+	std::vector<ClipperLib::Paths> results;
+	results.reserve(tiles.size());
+	for (auto& tile : tiles)
+	{
+		if (!tile.success)
+			return false;
+		results.push_back(std::move(tile.result));
+	}
+	std::vector<UnionTile>().swap(tiles);
+	
+	auto steps = 1;
+	for (auto size = results.size(); size > 2; size = (size + 1) / 2)
+		++steps;
+	auto const report_step = [this, &remaining_progress, &steps]() {
+		auto const step = remaining_progress / steps;
+		progress.fetchAndAddRelaxed(step);
+		remaining_progress -= step;
+		--steps;
+	};
+	
+	std::vector<std::size_t> pairs;
+	while (results.size() > 2)
+	{
+		pairs.resize(results.size() / 2);
+		std::iota(begin(pairs), end(pairs), std::size_t(0));
+		std::vector<ClipperLib::Paths> merged(pairs.size());
+		std::vector<PolyMap> merged_polymaps(pairs.size());
+		std::vector<char> success(pairs.size());
+		QtConcurrent::blockingMap(pairs, [&results, &polymaps, &merged, &merged_polymaps, &success](std::size_t i) {
+			success[i] = unitePolygons(results[2*i], results[2*i+1], merged[i]);
+			ClipperLib::Paths().swap(results[2*i]);
+			ClipperLib::Paths().swap(results[2*i+1]);
+			merged_polymaps[i] = retainedPolyMap(merged[i], polymaps[2*i], polymaps[2*i+1]);
+			PolyMap().swap(polymaps[2*i]);
+			PolyMap().swap(polymaps[2*i+1]);
+		});
+		if (std::find(begin(success), end(success), 0) != end(success))
+			return false;
+		
+		if (results.size() % 2 == 1)
+		{
+			merged.push_back(std::move(results.back()));
+			merged_polymaps.push_back(std::move(polymaps.back()));
+		}
+		results.swap(merged);
+		polymaps.swap(merged_polymaps);
+		report_step();
+	}
+	
+	// Do the final merge, and convert the solution polygons to objects.
+	ClipperLib::Clipper clipper;
+	clipper.AddPaths(results.front(), ClipperLib::ptSubject, true);
+	if (results.size() > 1)
+		clipper.AddPaths(results.back(), ClipperLib::ptClip, true);
+	std::vector<ClipperLib::Paths>().swap(results);
+	
+	auto polymap = std::move(polymaps.front());
+	if (polymaps.size() > 1)
+		polymap.unite(polymaps.back());
+	std::vector<PolyMap>().swap(polymaps);
+	
+	ClipperLib::PolyTree solution;
+	bool success = clipper.Execute(ClipperLib::ctUnion, solution, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+	if (success)
+	{
+		polyTreeToPathObjects(solution, out_objects, subject, polymap);
+	}
+	report_step();
+	
 	return success;
 }
 
+BooleanTool::PolyMap BooleanTool::retainedPolyMap(const ClipperLib::Paths& polygons, const PolyMap& polymap, const PolyMap& more_polymap)
+{
+	PolyMap retained;
+	for (const auto& polygon : polygons)
+	{
+		for (const auto& point : polygon)
+		{
+			if (retained.contains(point))
+				continue;
+			
+			// values() returns the most recently inserted value first.
+			for (const auto* source : { &polymap, &more_polymap })
+			{
+				auto const values = source->values(point);
+				for (auto i = values.size(); i > 0; --i)
+					retained.insertMulti(point, values[i-1]);
+			}
+		}
+	}
+	return retained;
+}
+
 void BooleanTool::polyTreeToPathObjects(const ClipperLib::PolyTree& tree, PathObjects& out_objects, const PathObject* proto, const PolyMap& polymap)
 {
 	for (int i = 0, count = tree.ChildCount(); i < count; ++i)
@@ -22,9 +22,11 @@
 #ifndef OPENORIENTEERING_BOOLEAN_TOOL_H
 #define OPENORIENTEERING_BOOLEAN_TOOL_H
 
+#include <functional>
 #include <utility>
 #include <vector>
 
+#include <QAtomicInt>
 #include <QHash>
 
 #include <clipper.hpp>
@@ -55,6 +57,15 @@ public:
 	 */
 	typedef std::vector< PathObject* > PathObjects;
 	
+	/**
+	 * A function which is notified about the progress of an operation.
+	 * 
+	 * The arguments are the number of processed objects and the total number
+	 * of objects. The function may return false to request cancellation.
+	 * This is the same type as Map::ProgressObserver.
+	 */
+	typedef std::function< bool (int, int) > ProgressObserver;
+	
 	/**
 	 * Types of boolean operation.
 	 */
@@ -74,6 +85,17 @@ public:
 	 */
 	BooleanTool(Operation op, Map* map);
 	
+	/**
+	 * Sets a function which is notified about the progress of executePerSymbol().
+	 * 
+	 * The function is called periodically from the thread which executes
+	 * executePerSymbol(), and only for operations on many objects. When the
+	 * operation is finished, the function is called with the total number
+	 * of objects as value. If the function requests cancellation, the map
+	 * remains unchanged.
+	 */
+	void setProgressObserver(const ProgressObserver& observer);
+	
 	/**
 	 * Executes the operation on the selected objects in the map.
 	 * 
@@ -94,6 +116,11 @@ public:
 	 * operation failed for remain unchanged. The operation continues for other
 	 * groups of objects.
 	 * 
+	 * For the Union operation, each group is further split into clusters of
+	 * objects with interacting extents. Objects which do not interact with
+	 * any other object of the same symbol remain unchanged. The groups and
+	 * clusters are processed concurrently.
+	 * 
 	 * @return True if the map was changed, false otherwise.
 	 */
 	bool executePerSymbol();
@@ -104,6 +131,15 @@ public:
 	 * This function does not (actively) change the collection of objects in the map
 	 * or the selection.
 	 * 
+	 * For the Intersection and Difference operations, objects whose extent does
+	 * not interact with the subject's extent are not passed to Clipper.
+	 * 
+	 * The Union of many objects is executed in spatial tiles, cf.
+	 * executeTiledUnion().
+	 * 
+	 * This function may run concurrently for disjoint sets of objects, provided
+	 * that the objects' output is up-to-date (cf. Object::update()).
+	 * 
 	 * @param subject               The primary affected object.
 	 * @param in_objects            All objects to operate on. Must contain subject.
 	 * @param out_objects           The resulting collection of objects.
@@ -146,6 +182,45 @@ private:
 	        PathObjects& out_objects,
 	        CombinedUndoStep& undo_step );
 	
+	/**
+	 * Executes the Union operation in spatial tiles.
+	 * 
+	 * The objects are ordered by recursive median splits of their centers,
+	 * and divided into tiles of limited size. The objects of each tile are
+	 * merged, and then neighbouring results are merged pairwise until a
+	 * single result remains. So each Clipper run is limited in size and
+	 * locality, and the runs of each level are processed concurrently.
+	 * Curves are reconstructed only for the final result. The locations
+	 * needed for this reconstruction are retained only as long as they are
+	 * present in an intermediate result. Progress is reported for the tiles,
+	 * for each stitching level, and for the final merge.
+	 * 
+	 * @param subject               The object which serves as prototype for the result.
+	 * @param in_objects            All objects to operate on. Must contain subject.
+	 * @param out_objects           The resulting collection of objects.
+	 */
+	bool executeTiledUnion(
+	        PathObject* subject,
+	        PathObjects& in_objects,
+	        PathObjects& out_objects );
+	
+	/**
+	 * Replaces the input objects in the map with the output objects, and
+	 * provides undo steps.
+	 * 
+	 * This function changes the collection of objects in the map and the selection.
+	 * 
+	 * @param subject               The primary affected object.
+	 * @param in_objects            All objects which were operated on.
+	 * @param out_objects           The resulting collection of objects.
+	 * @param undo_step             A combined undo step which will be filled with sub steps.
+	 */
+	void commitObjects(
+	        PathObject* subject,
+	        const PathObjects& in_objects,
+	        const PathObjects& out_objects,
+	        CombinedUndoStep& undo_step );
+	
 	/**
 	 * Converts a ClipperLib::PolyTree to PathObjects.
 	 * 
@@ -170,6 +245,17 @@ private:
 	        const PathObject* proto,
 	        const PolyMap& polymap );
 	
+	/**
+	 * Returns the entries of the polymaps for the locations in the polygons.
+	 * 
+	 * Only these entries are needed to reconstruct curves for the polygons.
+	 * Entries from more_polymap take precedence.
+	 */
+	static PolyMap retainedPolyMap(
+	        const ClipperLib::Paths& polygons,
+	        const PolyMap& polymap,
+	        const PolyMap& more_polymap = {} );
+	
 	/**
 	 * Constructs ClipperLib::Paths from a PathObject.
 	 */
@@ -263,6 +349,8 @@ private:
 	
 	const Operation op;
 	Map* const map;
+	ProgressObserver progress_observer;
+	QAtomicInt progress;  ///< The number of processed objects
 };
 
 #endif
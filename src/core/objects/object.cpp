@@ -21,10 +21,19 @@
 
 #include "object.h"
 
+#include <algorithm>
 #include <cmath>
-
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <utility>
+
+#include <QtConcurrentMap>
 #include <QtMath>
 #include <QtNumeric>
+#include <QDataStream>
 #include <QIODevice>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
@@ -33,6 +42,7 @@
 
 #include "settings.h"
 #include "core/map.h"
+#include "core/map_part.h"
 #include "core/objects/text_object.h"
 #include "core/renderables/renderable.h"
 #include "core/symbols/line_symbol.h"
@@ -115,12 +125,16 @@ void Object::copyFrom(const Object& other)
 	if (type != other.type)
 		throw std::invalid_argument(Q_FUNC_INFO);
 	
+	auto const old_symbol = symbol;
 	symbol = other.symbol;
+	if (map_part && symbol != old_symbol)
+		map_part->objectSymbolChanged(this, old_symbol);
 	coords = other.coords;
 	// map unchanged!
 	object_tags = other.object_tags;
 	output_dirty = true;
 	extent = other.extent;
+	extentChanged();
 }
 
 bool Object::equals(const Object* other, bool compare_symbol) const
@@ -345,12 +359,14 @@ void Object::load(QIODevice* file, int version, Map* map)
 #endif
 
 void Object::save(QXmlStreamWriter& xml) const
+{
+	save(xml, map ? map->findSymbolIndex(symbol) : -1);
+}
+
+void Object::save(QXmlStreamWriter& xml, int symbol_index) const
 {
 	XmlElementWriter object_element(xml, literal::object);
 	object_element.writeAttribute(literal::type, type);
-	int symbol_index = -1;
-	if (map)
-		symbol_index = map->findSymbolIndex(symbol);
 	if (symbol_index != -1)
 		object_element.writeAttribute(literal::symbol, symbol_index);
 	
@@ -395,7 +411,153 @@ void Object::save(QXmlStreamWriter& xml) const
 	}
 }
 
+void Object::saveBinary(QDataStream& stream) const
+{
+	stream << qint8(type);
+	if (type == Point)
+	{
+		const PointObject* point = static_cast<const PointObject*>(this);
+		stream << point->getRotation();
+	}
+	else if (type == Path)
+	{
+		const PathObject* path = static_cast<const PathObject*>(this);
+		auto const origin = path->getPatternOrigin();
+		stream << path->getPatternRotation() << origin.nativeX() << origin.nativeY();
+	}
+	else if (type == Text)
+	{
+		const TextObject* text = static_cast<const TextObject*>(this);
+		stream << text->getRotation()
+		       << qint8(text->getHorizontalAlignment())
+		       << qint8(text->getVerticalAlignment())
+		       << text->getText();
+	}
+	
+	stream << object_tags;
+	
+	stream << quint32(coords.size());
+	for (const auto& coord : coords)
+		stream << coord.nativeX() << coord.nativeY() << quint8(coord.flags());
+}
+
+Object* Object::loadBinary(QDataStream& stream, const Symbol* symbol)
+{
+	qint8 object_type;
+	stream >> object_type;
+	if (object_type != Point && object_type != Path && object_type != Text)
+		return nullptr;
+	
+	std::unique_ptr<Object> object { getObjectForType(Type(object_type), symbol) };
+	if (!symbol || !symbol->isTypeCompatibleTo(object.get()))
+		return nullptr;
+	
+	if (object_type == Point)
+	{
+		float rotation;
+		stream >> rotation;
+		if (symbol->asPoint()->isRotatable())
+			static_cast<PointObject*>(object.get())->setRotation(rotation);
+	}
+	else if (object_type == Path)
+	{
+		float rotation;
+		qint32 x, y;
+		stream >> rotation >> x >> y;
+		auto path = static_cast<PathObject*>(object.get());
+		path->setPatternRotation(rotation);
+		path->setPatternOrigin(MapCoord::fromNative(x, y));
+	}
+	else if (object_type == Text)
+	{
+		float rotation;
+		qint8 h_align, v_align;
+		QString text_string;
+		stream >> rotation >> h_align >> v_align >> text_string;
+		auto text = static_cast<TextObject*>(object.get());
+		text->setRotation(rotation);
+		text->setHorizontalAlignment(TextObject::HorizontalAlignment(h_align));
+		text->setVerticalAlignment(TextObject::VerticalAlignment(v_align));
+		text->setText(text_string);
+	}
+	
+	stream >> object->object_tags;
+	
+	quint32 num_coords;
+	stream >> num_coords;
+	if (stream.status() != QDataStream::Ok)
+		return nullptr;
+	
+	object->coords.clear();
+	object->coords.reserve(num_coords);
+	for (quint32 i = 0; i < num_coords && stream.status() == QDataStream::Ok; ++i)
+	{
+		qint32 x, y;
+		quint8 flags;
+		stream >> x >> y >> flags;
+		auto coord = MapCoord::fromNative(x, y);
+		coord.setFlags(flags);
+		object->coords.push_back(coord);
+	}
+	if (stream.status() != QDataStream::Ok)
+		return nullptr;
+	
+	if (object_type == Path)
+		static_cast<PathObject*>(object.get())->recalculateParts();
+	object->setOutputDirty();
+	return object.release();
+}
+
 Object* Object::load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, const Symbol* symbol)
+{
+	auto object = loadElement(xml, map, symbol_dict, symbol, nullptr);
+	
+	if (object->getType() == Path)
+	{
+		PathObject* path = reinterpret_cast<PathObject*>(object);
+		path->recalculateParts();
+	}
+	
+	if (map && object->isIrregular())
+		map->markAsIrregular(object);
+	
+	return object;
+}
+
+Object* Object::load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, DeferredCoords& deferred_coords)
+{
+	return loadElement(xml, map, symbol_dict, nullptr, &deferred_coords);
+}
+
+void Object::finishLoading(const DeferredCoords& deferred_coords)
+{
+	if (!deferred_coords.text.isEmpty())
+	{
+		try {
+			deferred_coords.parse(coords);
+		}
+		catch (FileFormatException& e)
+		{
+			throw FileFormatException(ImportExport::tr("Error while loading an object of type %1 at %2:%3: %4").
+			  arg(type).arg(deferred_coords.line).arg(deferred_coords.column).arg(e.message()));
+		}
+	}
+	
+	if (type == Path)
+	{
+		PathObject* path = reinterpret_cast<PathObject*>(this);
+		path->recalculateParts();
+	}
+}
+
+bool Object::isIrregular() const
+{
+	return coords.empty()
+	       || !coords.front().isRegular()
+	       || !coords.back().isRegular();
+}
+
+Object* Object::loadElement(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, const Symbol* symbol, DeferredCoords* deferred_coords)
 {
 	Q_ASSERT(xml.name() == literal::object);
 	
@@ -408,6 +570,9 @@ Object* Object::load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& sy
 	
 	object->map = map;
 	
+	if (deferred_coords)
+		*deferred_coords = DeferredCoords{};
+	
 	if (symbol)
 		object->symbol = symbol;
 	else
@@ -464,7 +629,10 @@ Object* Object::load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& sy
 		{
 			XmlElementReader coords_element(xml);
 			try {
-				coords_element.read(object->coords);
+				if (deferred_coords)
+					coords_element.read(object->coords, *deferred_coords);
+				else
+					coords_element.read(object->coords);
 			}
 			catch (FileFormatException& e)
 			{
@@ -510,21 +678,8 @@ Object* Object::load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& sy
 			xml.skipCurrentElement(); // unknown
 	}
 	
-	if (object_type == Path)
-	{
-		PathObject* path = reinterpret_cast<PathObject*>(object);
-		path->recalculateParts();
-	}
 	object->output_dirty = true;
 	
-	if (map &&
-	    ( object->coords.empty()
-	      || !object->coords.front().isRegular()
-	      || !object->coords.back().isRegular() ) )
-	{
-		map->markAsIrregular(object);
-	}
-	
 	return object;
 }
 
@@ -547,6 +702,23 @@ bool Object::update() const
 			map->setObjectAreaDirty(extent);
 	}
 	
+	updateDetached(options);
+	
+	if (map)
+	{
+		map->insertRenderablesOfObject(this);
+		if (extent.isValid())
+			map->setObjectAreaDirty(extent);
+	}
+	
+	return true;
+}
+
+bool Object::updateDetached(Symbol::RenderableOptions options) const
+{
+	if (!output_dirty)
+		return false;
+	
 	output.deleteRenderables();
 	
 	extent = QRectF();
@@ -557,13 +729,7 @@ bool Object::update() const
 	
 	Q_ASSERT(extent.right() < 60000000);	// assert if bogus values are returned
 	output_dirty = false;
-	
-	if (map)
-	{
-		map->insertRenderablesOfObject(this);
-		if (extent.isValid())
-			map->setObjectAreaDirty(extent);
-	}
+	extentChanged();
 	
 	return true;
 }
@@ -592,7 +758,7 @@ void Object::move(qint32 dx, qint32 dy)
 		coord.setNativeY(dy + coord.nativeY());
 	}
 	
-	setOutputDirty();
+	translateOutput(MapCoordF(MapCoord::fromNative(dx, dy)));
 }
 
 void Object::move(MapCoord offset)
@@ -606,7 +772,41 @@ void Object::move(MapCoord offset)
 		coord += offset;
 	}
 	
-	setOutputDirty();
+	translateOutput(MapCoordF(offset));
+}
+
+void Object::translateOutput(const MapCoordF& offset)
+{
+	// The options which update() uses for the current output
+	auto const options = map ? Symbol::RenderableOptions(QFlag(map->renderableOptions())) : Symbol::RenderableOptions(Symbol::RenderNormal);
+	if (output_dirty || !extent.isValid() || !symbol || symbol->dependsOnAbsolutePosition(options))
+	{
+		setOutputDirty();
+		return;
+	}
+	
+	// A pure translation doesn't change the symbol's geometry.
+	if (map)
+		map->setObjectAreaDirty(extent);
+	
+	output.translate(offset);
+	translateEvent(offset);
+	extentChanged();
+	
+	if (map)
+		map->setObjectAreaDirty(extent);
+}
+
+void Object::extentChanged() const
+{
+	if (map_part)
+		map_part->objectExtentChanged(this);
+}
+
+void Object::translateEvent(const MapCoordF& offset)
+{
+	Q_UNUSED(offset)
+	// nothing here
 }
 
 void Object::scale(MapCoordF center, double factor)
@@ -750,12 +950,14 @@ int Object::isPointOnObject(MapCoordF coord, float tolerance, bool treat_areas_a
 void Object::takeRenderables()
 {
 	output.takeRenderables();
+	output_dirty = true;
 }
 
 void Object::clearRenderables()
 {
 	output.deleteRenderables();
 	extent = QRectF();
+	extentChanged();
 }
 
 bool Object::setSymbol(const Symbol* new_symbol, bool no_checks)
@@ -766,7 +968,10 @@ bool Object::setSymbol(const Symbol* new_symbol, bool no_checks)
 			return false;
 	}
 	
+	auto const old_symbol = symbol;
 	symbol = new_symbol;
+	if (map_part && symbol != old_symbol)
+		map_part->objectSymbolChanged(this, old_symbol);
 	setOutputDirty();
 	return true;
 }
@@ -2230,215 +2435,402 @@ int PathObject::convertRangeToCurves(const PathPart& part, MapCoordVector::size_
 	return end_index;
 }
 
-bool PathObject::simplify(PathObject** undo_duplicate, double threshold)
+namespace {
+
+/**
+ * Returns the distance of point p from the line segment (a, b).
+ */
+double distanceToSegment(const MapCoordF& p, const MapCoordF& a, const MapCoordF& b)
+{
+	auto const ab = b - a;
+	auto const ap = p - a;
+	auto const length_sq = ab.lengthSquared();
+	if (length_sq == 0)
+		return ap.length();
+	
+	auto const t = qBound(0.0, MapCoordF::dotProduct(ap, ab) / length_sq, 1.0);
+	return (ap - ab * t).length();
+}
+
+
+/**
+ * Marks the points in [first, last] which are to be kept by
+ * the Douglas-Peucker algorithm. first and last are always kept.
+ * 
+ * This uses an explicit stack so that long tracks cannot exhaust the call stack.
+ */
+void markDouglasPeucker(const MapCoord* points, std::size_t first, std::size_t last, double threshold, std::vector<bool>& keep)
+{
+	std::vector<std::pair<std::size_t, std::size_t>> ranges;
+	ranges.emplace_back(first, last);
+	while (!ranges.empty())
+	{
+		auto const range = ranges.back();
+		ranges.pop_back();
+		
+		keep[range.first] = true;
+		keep[range.second] = true;
+		
+		auto const a = MapCoordF(points[range.first]);
+		auto const b = MapCoordF(points[range.second]);
+		auto max_distance = threshold;
+		auto split = range.first;
+		for (auto i = range.first + 1; i < range.second; ++i)
+		{
+			auto const distance = distanceToSegment(MapCoordF(points[i]), a, b);
+			if (distance > max_distance)
+			{
+				max_distance = distance;
+				split = i;
+			}
+		}
+		
+		if (split != range.first)
+		{
+			ranges.emplace_back(range.first, split);
+			ranges.emplace_back(split, range.second);
+		}
+	}
+}
+
+
+/**
+ * Simplifies a part which consists of straight segments only.
+ * 
+ * Uses the Douglas-Peucker algorithm which keeps every original point within
+ * threshold of the simplified polyline. Open parts keep their end points,
+ * closed parts keep at least three distinct points.
+ */
+void simplifyPolylinePart(const MapCoordVector& coords, const PathPart& part, double threshold, MapCoordVector& out)
+{
+	auto const points = coords.data() + part.first_index;
+	auto const last = part.last_index - part.first_index;
+	
+	std::vector<bool> keep(last + 1, false);
+	if (!part.isClosed())
+	{
+		markDouglasPeucker(points, 0, last, threshold, keep);
+	}
+	else if (last < 4)
+	{
+		// Closed parts with three points cannot be simplified.
+		std::fill(begin(keep), end(keep), true);
+	}
+	else
+	{
+		// The closing point is at the same position as the first point.
+		// Anchor the first split at the point farthest away from it.
+		auto const start = MapCoordF(points[0]);
+		auto split = std::size_t(1);
+		for (auto i = split + 1; i < last; ++i)
+		{
+			if (start.distanceSquaredTo(MapCoordF(points[i])) > start.distanceSquaredTo(MapCoordF(points[split])))
+				split = i;
+		}
+		markDouglasPeucker(points, 0, split, threshold, keep);
+		markDouglasPeucker(points, split, last, threshold, keep);
+		
+		if (std::count(begin(keep), end(keep), true) < 4)
+		{
+			// Keep a third point in order to retain an area.
+			auto const b = MapCoordF(points[split]);
+			auto third = std::size_t(0);
+			auto max_distance = -1.0;
+			for (auto i = std::size_t(1); i < last; ++i)
+			{
+				auto const distance = distanceToSegment(MapCoordF(points[i]), start, b);
+				if (i != split && distance > max_distance)
+				{
+					max_distance = distance;
+					third = i;
+				}
+			}
+			keep[third] = true;
+		}
+	}
+	
+	for (auto i = std::size_t(0); i <= last; ++i)
+	{
+		if (keep[i])
+			out.push_back(points[i]);
+	}
+}
+
+
+/**
+ * A regular node of a path part during simplification.
+ * 
+ * The node owns the segment which starts at its coordinate.
+ */
+struct SimplifyNode
 {
-	// A copy for reference and undo while this is modified.
-	QScopedPointer<PathObject> original(new PathObject(*this));
+	MapCoord coord;
+	MapCoord handles[2];
+	MapCoord merged_handles[2];   ///< The handles of the segment replacing prev's and this node's segments.
+	MapCoordVector::size_type index;  ///< The index in the original coords.
+	std::size_t prev;
+	std::size_t next;
+	unsigned int version;
+	bool curve;
+	bool merged_curve;
+	bool removed;
+};
+
+struct SimplifyCandidate
+{
+	double cost;
+	std::size_t node;
+	unsigned int version;
 	
-	// original_indices provides a mapping from this object's indices to the
-	// equivalent original object indices in order to extract the relevant
-	// parts of the original object later for cost calculation.
-	// Note: curve handle indices may become incorrect, we don't need them.
-	std::vector<MapCoordVector::size_type> original_indices;
-	original_indices.resize(coords.size());
-	for (std::size_t i = 0, end = coords.size(); i < end; ++i)
-		original_indices[i] = i;
+	bool operator>(const SimplifyCandidate& other) const
+	{
+		return cost > other.cost;
+	}
+};
+
+
+struct SimplifyTask
+{
+	PathObject* object;
+	PathObject* undo_duplicate;
+	bool changed;
+};
+
+
+}  // namespace
+
+
+/**
+ * Nodes are removed in the order of the shape deviation which their removal
+ * causes. The costs are kept in a priority queue, and only the neighbours of
+ * a removed node need to be evaluated again. Outdated queue entries are
+ * recognized by their version and skipped.
+ */
+void PathObject::simplifyCurvedPart(const PathPart& part, double threshold, MapCoordVector& out) const
+{
+	auto const none = std::numeric_limits<std::size_t>::max();
+	auto const closed = part.isClosed();
+	
+	std::vector<SimplifyNode> nodes;
+	nodes.reserve(part.size());
+	for (auto i = part.first_index; closed ? i < part.last_index : i <= part.last_index; )
+	{
+		SimplifyNode node;
+		node.coord = coords[i];
+		node.index = i;
+		node.prev = nodes.empty() ? none : nodes.size() - 1;
+		node.next = none;
+		node.version = 0;
+		node.curve = coords[i].isCurveStart() && i + 3 <= part.last_index;
+		node.merged_curve = false;
+		node.removed = false;
+		if (node.curve)
+		{
+			node.handles[0] = coords[i + 1];
+			node.handles[1] = coords[i + 2];
+		}
+		if (!nodes.empty())
+			nodes.back().next = nodes.size();
+		nodes.push_back(node);
+		i += node.curve ? 3 : 1;
+	}
 	
-	// A high value indicating an cost of deletion which is unknown.
-	auto const undetermined_cost = std::numeric_limits<double>::max();
+	auto remaining = nodes.size();
+	auto const minimum_size = std::size_t(closed ? 3 : 2);
+	if (remaining <= minimum_size)
+	{
+		out.insert(end(out), begin(coords) + part.first_index, begin(coords) + part.last_index + 1);
+		return;
+	}
 	
-	// This vector provides the costs of deleting individual nodes.
-	std::vector<double> costs;
-	costs.resize(coords.size(), undetermined_cost);
+	if (closed)
+	{
+		nodes.front().prev = nodes.size() - 1;
+		nodes.back().next = 0;
+	}
 	
 	// The empty LineSymbol will not generate any renderables,
 	// thus reducing the cost of update().
 	// The temp object will be reused (but not reallocated) many times.
 	LineSymbol empty_symbol;
 	PathObject temp { &empty_symbol };
-	temp.coords.reserve(10); // enough for two bezier edges.
+	auto& temp_coords = temp.coords;
+	temp_coords.reserve(10); // enough for two bezier edges.
+	
+	auto appendSegment = [&temp_coords](const SimplifyNode& node) {
+		auto coord = node.coord;
+		coord.setFlags(0);
+		coord.setCurveStart(node.curve);
+		temp_coords.push_back(coord);
+		if (node.curve)
+		{
+			temp_coords.push_back(node.handles[0]);
+			temp_coords.push_back(node.handles[1]);
+		}
+	};
 	
-	for (auto part = path_parts.rbegin(); part != path_parts.rend(); ++part)
-	{
-		// Don't simplify parts which would get deleted.
-		MapCoordVector::size_type minimum_part_size = part->isClosed() ? 4 : 3;
-		auto minimumPartSizeReached = [&part, minimum_part_size]() -> bool
+	// Determines the cost of removing the node, and the merged segment.
+	auto evaluate = [&](SimplifyNode& node) -> double {
+		const auto& prev = nodes[node.prev];
+		const auto& next = nodes[node.next];
+		temp_coords.clear();
+		appendSegment(prev);
+		appendSegment(node);
+		auto end_coord = next.coord;
+		end_coord.setFlags(0);
+		end_coord.setHolePoint(true);
+		temp_coords.push_back(end_coord);
+		temp.recalculateParts();
+		temp.deleteCoordinate(prev.curve ? 3 : 1, true, Settings::DeleteBezierPoint_RetainExistingShape);
+		
+		node.merged_curve = temp_coords.front().isCurveStart();
+		if (node.merged_curve)
 		{
-			return (part->size() <= 7 && part->countRegularNodes() < minimum_part_size);
-		};
+			node.merged_handles[0] = temp_coords[1];
+			node.merged_handles[1] = temp_coords[2];
+		}
+		
+		// The node at the start of a closed part is also at the closing point.
+		auto end_index = next.index == part.first_index ? part.last_index : next.index;
+		return calcMaximumDistanceTo(prev.index, end_index, &temp, 0, temp_coords.size()-1);
+	};
+	
+	auto isRemovable = [none](const SimplifyNode& node) {
+		return node.prev != none && node.next != none;
+	};
+	
+	std::priority_queue<SimplifyCandidate, std::vector<SimplifyCandidate>, std::greater<SimplifyCandidate>> queue;
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		if (isRemovable(nodes[i]))
+			queue.push({ evaluate(nodes[i]), i, 0 });
+	}
+	
+	while (remaining > minimum_size && !queue.empty())
+	{
+		auto const candidate = queue.top();
+		queue.pop();
 		
-		auto minimum_cost_step = threshold / qMax(std::log2(part->size() / 64.0), 4.0);
-		auto minimum_cost = 0.0;
+		auto& node = nodes[candidate.node];
+		if (node.removed || node.version != candidate.version)
+			continue;
+		if (candidate.cost > threshold)
+			break;
+		
+		auto& prev = nodes[node.prev];
+		auto& next = nodes[node.next];
+		prev.curve = node.merged_curve;
+		prev.handles[0] = node.merged_handles[0];
+		prev.handles[1] = node.merged_handles[1];
+		prev.next = node.next;
+		next.prev = node.prev;
+		node.removed = true;
+		--remaining;
 		
-		// Delete nodes in max n runs (where n = max. part.end_index - part.start_index)
-		for (auto run = part->last_index; run > part->first_index; --run)
+		for (auto neighbour : { node.prev, node.next })
 		{
-			if (minimumPartSizeReached())
-				break;
-			
-			// Determine the costs of node deletion
-			{
-				auto extract_start = part->first_index;
-				auto index = part->nextCoordIndex(extract_start);
-				while (index < part->last_index)
-				{
-					auto extract_end = part->nextCoordIndex(index);
-					if (costs[index] == undetermined_cost)
-					{
-						temp.assignCoordinates(*this, extract_start, extract_end);
-						temp.deleteCoordinate(index - extract_start, true, Settings::DeleteBezierPoint_RetainExistingShape);
-						// Debug check: start and end coords of the extracts should be at the same position
-						Q_ASSERT(coords[extract_start].isPositionEqualTo(temp.coords.front()));
-						Q_ASSERT(coords[extract_end].isPositionEqualTo(temp.coords.back()));
-						costs[index] = original->calcMaximumDistanceTo(original_indices[extract_start],
-						                                               original_indices[extract_end],
-						                                               &temp,
-						                                               0,
-						                                               temp.coords.size()-1);
-					}
-					extract_start = index;
-					index = extract_end;
-				}
-				
-				if (costs[part->first_index] == undetermined_cost && extract_start < part->last_index)
-				{
-					if (part->isClosed())
-					{
-						auto extract_end = part->nextCoordIndex(part->first_index);
-						temp.assignCoordinates(*this, extract_start, extract_end);
-						temp.deleteCoordinate(part->last_index - extract_start, true, Settings::DeleteBezierPoint_RetainExistingShape);
-						// Debug check: start and end coords of the extracts should be at the same position
-						Q_ASSERT(coords[extract_start].isPositionEqualTo(temp.coords.front()));
-						Q_ASSERT(coords[extract_end].isPositionEqualTo(temp.coords.back()));
-						costs[part->first_index] = original->calcMaximumDistanceTo(original_indices[extract_start],
-						                                                           original_indices[extract_end],
-						                                                           &temp,
-						                                                           0,
-						                                                           temp.coords.size()-1);
-					}
-					else
-					{
-						costs[part->first_index] = threshold * 2;
-					}
-				}
-				
-				costs[part->last_index] = undetermined_cost;
-			}
-			
-			// Find an upper bound for the acceptable cost in the current run
-			auto cost_bound = threshold * 2;
-			for (auto index = part->first_index; index < part->last_index; ++index)
-			{
-				if (costs[index] <= cost_bound)
-				{
-					cost_bound = costs[index];
-					if (cost_bound <= minimum_cost)
-					{
-						// short-cut on minimal costs
-						cost_bound = minimum_cost;
-						break;
-					}
-				}
-			}
-			
-			if (cost_bound > threshold)
-				break;
-			
-			while (minimum_cost <= cost_bound)
-				minimum_cost += minimum_cost_step;
-			if (minimum_cost > threshold)
-				minimum_cost = threshold;
-			
-			// Start at the end, in order to shorten the vector quickly
-			auto index = part->last_index;
-			do
-			{
-				if (costs[index] <= cost_bound)
-				{
-					auto extract_start = part->prevCoordIndex(index);
-					auto extract_end   = part->nextCoordIndex(index);
-					Q_ASSERT(original->coords[original_indices[extract_start]].isPositionEqualTo(coords[extract_start]));
-					Q_ASSERT(original->coords[original_indices[extract_end]].isPositionEqualTo(coords[extract_end]));
-					deleteCoordinate(index, true, Settings::DeleteBezierPoint_RetainExistingShape);
-					
-					if (index > part->first_index)
-					{
-						// Deleted inner point
-						auto new_extract_end = part->nextCoordIndex(extract_start);
-						auto original_start = begin(original_indices) + extract_start;
-						original_indices.erase(original_start + 1,
-						                       original_start + 1 + (extract_end - new_extract_end));
-						Q_ASSERT(original_indices.size() == coords.size());
-						Q_ASSERT(original->coords[original_indices[extract_start]].isPositionEqualTo(coords[extract_start]));
-						Q_ASSERT(original->coords[original_indices[new_extract_end]].isPositionEqualTo(coords[new_extract_end]));
-						
-						costs.erase(begin(costs) + extract_start + 1,
-						            begin(costs) + extract_start + 1 + (extract_end - new_extract_end));
-						Q_ASSERT(costs.size() == coords.size());
-						
-						costs[extract_start] = undetermined_cost;
-						
-						if (new_extract_end == part->last_index)
-						{
-							costs[part->first_index] = undetermined_cost;
-						}
-						else
-						{
-							costs[new_extract_end] = undetermined_cost;
-						}
-						Q_ASSERT(costs[part->last_index] > threshold);
-						
-						index = part->prevCoordIndex(extract_start);
-						
-						if (minimumPartSizeReached())
-							break;
-					}
-					else if (part->isClosed())
-					{
-						Q_ASSERT(index == part->first_index);
-						
-						// Deleted start point of closed path
-						// This must match PathObject::deleteCoordinate
-						extract_start = part->prevCoordIndex(part->last_index);
-						auto original_begin = begin(original_indices);
-						original_indices.erase(original_begin + part->first_index,
-						                       original_begin + extract_end);
-						original_indices.resize(coords.size());
-						original_indices[part->last_index] = original_indices[part->first_index];
-						Q_ASSERT(original->coords[original_indices[extract_start]].isPositionEqualTo(coords[extract_start]));
-						Q_ASSERT(original->coords[original_indices[part->last_index]].isPositionEqualTo(coords[part->last_index]));
-						Q_ASSERT(original->coords[original_indices[part->first_index]].isPositionEqualTo(coords[part->first_index]));
-						
-						costs.erase(begin(costs) + part->first_index,
-						            begin(costs) + extract_end);
-						costs.resize(coords.size(), undetermined_cost);
-						costs[extract_start] = undetermined_cost;
-						costs[part->first_index] = undetermined_cost;
-						Q_ASSERT(costs[part->last_index] > threshold);
-					}
-					else
-					{
-						Q_ASSERT(index == part->first_index);
-					}
-				}
-				else if (index != part->first_index)
-				{
-					--index;
-				}
-			}
-			while (index != part->first_index);
+			auto& n = nodes[neighbour];
+			++n.version;
+			if (isRemovable(n) && remaining > minimum_size)
+				queue.push({ evaluate(n), neighbour, n.version });
 		}
 	}
 	
-	bool removed_a_point = (coords.size() != original->coords.size());
-	if (removed_a_point && undo_duplicate)
+	// Rebuild the part, starting at the first remaining node.
+	auto start = std::size_t(0);
+	while (nodes[start].removed)
+		++start;
+	
+	auto index = start;
+	do
+	{
+		const auto& node = nodes[index];
+		auto coord = node.coord;
+		coord.setCurveStart(node.curve);
+		out.push_back(coord);
+		if (node.curve)
+		{
+			out.push_back(node.handles[0]);
+			out.push_back(node.handles[1]);
+		}
+		index = node.next;
+	}
+	while (index != none && index != start);
+	
+	if (closed)
+	{
+		// Restore the closing point.
+		auto coord = (start == 0) ? coords[part.last_index] : nodes[start].coord;
+		coord.setCurveStart(false);
+		coord.setHolePoint(true);
+		coord.setClosePoint(true);
+		out.push_back(coord);
+	}
+	else
+	{
+		// The last node is kept, and it carries the hole point flag.
+		Q_ASSERT(out.back().isHolePoint());
+	}
+}
+
+
+bool PathObject::simplify(PathObject** undo_duplicate, double threshold)
+{
+	// A reference for cost calculation while this is modified.
+	// The empty LineSymbol will not generate any renderables,
+	// thus reducing the cost of update().
+	LineSymbol empty_symbol;
+	PathObject reference { &empty_symbol, coords };
+	
+	MapCoordVector simplified;
+	simplified.reserve(coords.size());
+	for (const auto& part : reference.path_parts)
+	{
+		auto has_curves = std::any_of(begin(coords) + part.first_index, begin(coords) + part.last_index, [](const MapCoord& coord) {
+			return coord.isCurveStart();
+		});
+		if (has_curves)
+			reference.simplifyCurvedPart(part, threshold, simplified);
+		else
+			simplifyPolylinePart(coords, part, threshold, simplified);
+	}
+	
+	bool removed_a_point = (simplified.size() != coords.size());
+	if (removed_a_point)
 	{
-		*undo_duplicate = original.take();
+		if (undo_duplicate)
+			*undo_duplicate = new PathObject(*this);
+		
+		coords.swap(simplified);
+		recalculateParts();
 	}
 	
 	return removed_a_point;
 }
 
+// static
+std::size_t PathObject::simplifyAll(const std::vector<PathObject*>& objects, std::vector<PathObject*>* undo_duplicates, double threshold)
+{
+	std::vector<SimplifyTask> tasks;
+	tasks.reserve(objects.size());
+	for (auto object : objects)
+		tasks.push_back({ object, nullptr, false });
+	
+	auto const want_undo = undo_duplicates != nullptr;
+	QtConcurrent::blockingMap(tasks, [threshold, want_undo](SimplifyTask& task) {
+		task.changed = task.object->simplify(want_undo ? &task.undo_duplicate : nullptr, threshold);
+	});
+	
+	if (undo_duplicates)
+	{
+		undo_duplicates->clear();
+		undo_duplicates->reserve(tasks.size());
+		for (const auto& task : tasks)
+			undo_duplicates->push_back(task.undo_duplicate);
+	}
+	return std::size_t(std::count_if(begin(tasks), end(tasks), [](const SimplifyTask& task) { return task.changed; }));
+}
+
 int PathObject::isPointOnPath(MapCoordF coord, float tolerance, bool treat_areas_as_paths, bool extended_selection) const
 {
 	float side_tolerance = tolerance;
@@ -3072,6 +3464,24 @@ void PathObject::clearCoordinates()
 	setOutputDirty();
 }
 
+void PathObject::replaceCoordinateRange(MapCoordVector::size_type first, MapCoordVector::size_type count, const MapCoordVector& new_coords)
+{
+	Q_ASSERT(first + count <= coords.size());
+	
+	auto const begin = coords.begin() + std::ptrdiff_t(first);
+	if (count == new_coords.size())
+	{
+		std::copy(new_coords.begin(), new_coords.end(), begin);
+	}
+	else
+	{
+		coords.erase(begin, begin + std::ptrdiff_t(count));
+		coords.insert(coords.begin() + std::ptrdiff_t(first), new_coords.begin(), new_coords.end());
+	}
+	recalculateParts();
+	setOutputDirty();
+}
+
 void PathObject::assignCoordinates(const PathObject& proto, MapCoordVector::size_type first, MapCoordVector::size_type last)
 {
 	Q_ASSERT(last < proto.coords.size());
@@ -3166,6 +3576,15 @@ void PathObject::updateEvent() const
 	updatePathCoords();
 }
 
+void PathObject::translateEvent(const MapCoordF& offset)
+{
+	for (auto& part : path_parts)
+	{
+		for (auto& path_coord : part.path_coords)
+			path_coord.pos += offset;
+	}
+}
+
 void PathObject::createRenderables(ObjectRenderables& output, Symbol::RenderableOptions options) const
 {
 	symbol->createRenderables(this, path_parts, output, options);
@@ -23,6 +23,7 @@
 #define OPENORIENTEERING_OBJECT_H
 
 #include <algorithm>
+#include <cstddef>
 #include <limits>
 #include <vector>
 
@@ -38,6 +39,7 @@
 #include "core/renderables/renderable.h"
 #include "core/symbols/symbol.h"
 
+class QDataStream;
 class QIODevice;
 class QTransform;
 class QXmlStreamReader;
@@ -45,10 +47,12 @@ class QXmlStreamWriter;
 // IWYU pragma: no_forward_declare QRectF
 
 class Map;
+class MapPart;
 class PointObject;
 class PathObject;
 class TextObject;
 class VirtualCoordVector;
+struct DeferredCoords;
 
 
 /**
@@ -64,7 +68,10 @@ class VirtualCoordVector;
  */
 class Object  // clazy:exclude=copyable-polymorphic
 {
+friend class BinaryFileImporter;
+friend class MapPart;
 friend class ObjectRenderables;
+friend class ObjectSelection;
 friend class OCAD8FileImport;
 friend class XMLImportExport;
 public:
@@ -149,6 +156,14 @@ public:
 	
 	/** Saves the object in xml format to the given stream. */
 	void save(QXmlStreamWriter& xml) const;
+	
+	/**
+	 * Saves the object in xml format to the given stream,
+	 * with the given index for referring to the symbol.
+	 * 
+	 * This does not depend on the map which the object belongs to.
+	 */
+	void save(QXmlStreamWriter& xml, int symbol_index) const;
 	/**
 	 * Loads the object in xml format from the given stream.
 	 * @param xml The stream to load the object from, must be at the correct tag.
@@ -160,6 +175,36 @@ public:
 	 *               than reading the symbol from the stream.
 	 */
 	static Object* load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, const Symbol* symbol = nullptr);
+	/**
+	 * Loads the object in xml format, but defers parsing the coordinates.
+	 * 
+	 * Coordinates in the simple text format are returned in deferred_coords.
+	 * They must be passed to finishLoading() before the object is used.
+	 * Irregular objects are not marked in the map.
+	 */
+	static Object* load(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, DeferredCoords& deferred_coords);
+	/**
+	 * Parses the deferred coordinates from load().
+	 * 
+	 * This function does not access the map, so it may be called concurrently
+	 * for different objects. Throws FileFormatException on error.
+	 */
+	void finishLoading(const DeferredCoords& deferred_coords);
+	
+	/**
+	 * Saves the object in a compact binary format to the given stream.
+	 * 
+	 * The symbol is not saved. The caller must record it separately.
+	 * This format is meant for transient data such as the clipboard.
+	 */
+	void saveBinary(QDataStream& stream) const;
+	/**
+	 * Loads an object saved by saveBinary() from the given stream.
+	 * 
+	 * The object is given the symbol, but no map.
+	 * Returns nullptr if the stream's data is corrupt.
+	 */
+	static Object* loadBinary(QDataStream& stream, const Symbol* symbol);
 	
 	
 	/**
@@ -174,14 +219,33 @@ public:
 	 */
 	void forceUpdate() const;
 	
+	/**
+	 * If the output_dirty flag is set, regenerates output and extent,
+	 * but leaves the object's map alone.
+	 * 
+	 * This function modifies only the object itself. So it may be called
+	 * concurrently for distinct objects, provided that the object's
+	 * renderables are not in use elsewhere. The caller is responsible for
+	 * inserting the renderables into the map and for marking the affected
+	 * areas as dirty.
+	 * 
+	 * Returns true if output was dirty.
+	 */
+	bool updateDetached(Symbol::RenderableOptions options) const;
+	
 	
 	/** Moves the whole object
+	 * 
+	 * If the output is up to date and the symbol doesn't depend on the
+	 * absolute position, the existing renderables are translated in place
+	 * instead of marking the output as dirty.
+	 * 
 	 * @param dx X offset in native map coordinates.
 	 * @param dy Y offset in native map coordinates.
 	 */
 	void move(qint32 dx, qint32 dy);
 	
-	/** Moves the whole object by the given offset. */
+	/** Moves the whole object by the given offset. See move(qint32, qint32). */
 	void move(MapCoord offset);
 	
 	/** Scales all coordinates, with the given scaling center */
@@ -223,7 +287,7 @@ public:
 	 */
 	virtual bool intersectsBox(const QRectF& box) const = 0;
 	
-	/** Takes ownership of the renderables */
+	/** Takes ownership of the renderables, and marks the output as dirty. */
 	void takeRenderables();
 	
 	/** Deletes the renderables (and extent), undoing update() */
@@ -300,8 +364,21 @@ public:
 protected:
 	virtual void updateEvent() const;
 	
+	/**
+	 * Called by move() after the renderables were translated in place.
+	 * 
+	 * Inheriting classes must move any other cached geometry.
+	 */
+	virtual void translateEvent(const MapCoordF& offset);
+	
 	virtual void createRenderables(ObjectRenderables& output, Symbol::RenderableOptions options) const;
 	
+	/**
+	 * Translates the output by the given offset after the coordinates were moved,
+	 * or marks the output as dirty if the renderables cannot be reused.
+	 */
+	void translateOutput(const MapCoordF& offset);
+	
 	Type type;
 	const Symbol* symbol;
 	MapCoordVector coords;
@@ -309,9 +386,34 @@ protected:
 	Tags object_tags;
 	
 private:
+	/**
+	 * Reads the object element. Coordinates are deferred if deferred_coords is set.
+	 * 
+	 * Path parts are not yet recalculated.
+	 */
+	static Object* loadElement(QXmlStreamReader& xml, Map* map, const SymbolDictionary& symbol_dict, const Symbol* symbol, DeferredCoords* deferred_coords);
+	
+	/**
+	 * Returns true if the object has no coordinates, or if its first or last
+	 * coordinate is not regular.
+	 */
+	bool isIrregular() const;
+	
+	/**
+	 * Lets the map part move this object in its spatial index.
+	 * 
+	 * Must be called whenever the extent changes.
+	 */
+	void extentChanged() const;
+	
 	mutable bool output_dirty;        // does the output have to be re-generated because of changes?
 	mutable QRectF extent;            // only valid after calling update()
 	mutable ObjectRenderables output; // only valid after calling update()
+	
+	MapPart* map_part = nullptr;      // the part which contains this object
+	std::size_t map_part_pos = 0;     // position in the part's object list, if map_part is set
+	std::size_t symbol_index_pos = 0; // position in the part's symbol index, if map_part is set
+	std::size_t selection_pos = 0;    // position in the map's object selection, if selected
 };
 
 
@@ -543,6 +645,15 @@ public:
 	/** Deletes all coordinates of the object. */
 	void clearCoordinates();
 	
+	/**
+	 * Replaces count coordinates, starting at index first, by new_coords.
+	 * 
+	 * This is a low-level operation for restoring a previous state of the
+	 * object, e.g. by undo steps. The coordinate flags are taken as given,
+	 * and the parts are recalculated.
+	 */
+	void replaceCoordinateRange(MapCoordVector::size_type first, MapCoordVector::size_type count, const MapCoordVector& new_coords);
+	
 	/**
 	 * Assigns the given prototype's coordinates subset to this object's coordinates.
 	 *
@@ -781,9 +892,27 @@ public:
 	 * Tries to remove points while retaining the path shape as much as possible.
 	 * If at least one point is changed, returns true and
 	 * returns an undo duplicate if the corresponding pointer is set.
+	 * 
+	 * Parts without curves are simplified with the Douglas-Peucker algorithm.
+	 * Other parts drop their cheapest nodes first, reevaluating only the
+	 * neighbours of each removed node.
+	 * 
+	 * This function does not call update(). It may be run concurrently
+	 * for different objects.
 	 */
 	bool simplify(PathObject** undo_duplicate, double threshold);
 	
+	/**
+	 * Simplifies the given objects concurrently.
+	 * 
+	 * If undo_duplicates is not null, it receives one entry per object:
+	 * the undo duplicate, or nullptr if the object was not changed.
+	 * The caller is responsible for calling update() on the objects.
+	 * 
+	 * Returns the number of changed objects.
+	 */
+	static std::size_t simplifyAll(const std::vector<PathObject*>& objects, std::vector<PathObject*>* undo_duplicates, double threshold);
+	
 	/** See Object::isPointOnObject() */
 	int isPointOnPath(
 	        MapCoordF coord,
@@ -895,8 +1024,18 @@ protected:
 	 */
 	void setClosingPoint(MapCoordVector::size_type index, MapCoord coord);
 	
+	/**
+	 * Called by simplify() for parts which contain curves.
+	 * 
+	 * Appends the simplified part to out. This object serves as
+	 * the unmodified reference for measuring the shape deviation.
+	 */
+	void simplifyCurvedPart(const PathPart& part, double threshold, MapCoordVector& out) const;
+	
 	void updateEvent() const override;
 	
+	void translateEvent(const MapCoordF& offset) override;
+	
 	void createRenderables(ObjectRenderables& output, Symbol::RenderableOptions options) const override;
 	
 private:
@@ -0,0 +1,345 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "object_clipboard.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include <QtGlobal>
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QIODevice>
+#include <QRectF>
+#include <QUuid>
+
+#include "core/map.h"
+#include "core/map_color.h"
+#include "core/objects/object.h"
+#include "core/objects/object_selection.h"
+#include "core/symbols/symbol.h"
+#include "util/util.h"
+
+
+namespace ObjectClipboard
+{
+
+namespace
+{
+	/// Identifies the format and its version.
+	constexpr quint32 magic = 0x4f4d4f33;  // "OMO3"
+	
+	constexpr auto stream_version = QDataStream::Qt_5_3;
+	
+	
+	/**
+	 * A reference to a symbol which can be resolved in any map.
+	 */
+	struct SymbolKey
+	{
+		qint32 index;       ///< The index in the source map.
+		quint64 address;    ///< The address in the source map.
+		QString number;
+		qint32 type;
+		QString name;
+		std::vector<std::pair<qint32, QString>> colors;  ///< Priority and name.
+		qint32 definition;  ///< The index in the symbol definitions.
+	};
+	
+	QDataStream& operator<<(QDataStream& stream, const SymbolKey& key)
+	{
+		stream << key.index << key.address << key.number << key.type << key.name;
+		stream << quint32(key.colors.size());
+		for (auto const& color : key.colors)
+			stream << color.first << color.second;
+		return stream << key.definition;
+	}
+	
+	QDataStream& operator>>(QDataStream& stream, SymbolKey& key)
+	{
+		stream >> key.index >> key.address >> key.number >> key.type >> key.name;
+		quint32 num_colors;
+		stream >> num_colors;
+		for (quint32 i = 0; i < num_colors && stream.status() == QDataStream::Ok; ++i)
+		{
+			qint32 priority;
+			QString name;
+			stream >> priority >> name;
+			key.colors.emplace_back(priority, name);
+		}
+		return stream >> key.definition;
+	}
+	
+	
+	/**
+	 * Finds a color by name, preferring the color at the given priority.
+	 */
+	const MapColor* findColor(const Map& map, qint32 priority, const QString& name)
+	{
+		if (priority >= 0 && priority < map.getNumColors()
+		    && map.getColor(priority)->getName() == name)
+		{
+			return map.getColor(priority);
+		}
+		for (int i = 0; i < map.getNumColors(); ++i)
+		{
+			if (map.getColor(i)->getName() == name)
+				return map.getColor(i);
+		}
+		return nullptr;
+	}
+	
+	/**
+	 * Finds the symbol with the given number, type and name, using colors
+	 * with the same names.
+	 */
+	const Symbol* findSymbol(const Map& map, const SymbolKey& key)
+	{
+		for (int i = 0; i < map.getNumSymbols(); ++i)
+		{
+			auto const symbol = map.getSymbol(i);
+			if (symbol->getNumberAsString() != key.number
+			    || qint32(symbol->getType()) != key.type
+			    || symbol->getName() != key.name)
+			{
+				continue;
+			}
+			auto const same_colors = std::all_of(begin(key.colors), end(key.colors), [&](auto const& color) {
+				auto const map_color = findColor(map, color.first, color.second);
+				return map_color && symbol->containsColor(map_color);
+			});
+			if (same_colors)
+				return symbol;
+		}
+		return nullptr;
+	}
+	
+}  // namespace
+
+
+
+QString mimeType()
+{
+	return QStringLiteral("application/x-openorienteering-objects");
+}
+
+
+QByteArray save(const Map& map, const ObjectSelection& objects)
+{
+	// The symbol table maps the references in the object data to the
+	// symbols. The source map's indices and addresses allow to detect
+	// stale references when pasting into the same map.
+	std::unordered_map<const Symbol*, qint32> symbol_refs;
+	std::vector<const Symbol*> symbols;
+	std::vector<bool> symbol_filter(std::size_t(map.getNumSymbols()), false);
+	QRectF extent;
+	for (const auto object : objects)
+	{
+		if (symbol_refs.emplace(object->getSymbol(), qint32(symbols.size())).second)
+		{
+			symbols.push_back(object->getSymbol());
+			auto const index = map.findSymbolIndex(object->getSymbol());
+			if (index >= 0)
+				symbol_filter[std::size_t(index)] = true;
+		}
+		object->update();
+		rectIncludeSafe(extent, object->getExtent());
+	}
+	
+	// The symbol definitions allow to create symbols missing in the target
+	// map. They are parsed only if needed.
+	Map definitions;
+	definitions.setScaleDenominator(map.getScaleDenominator());
+	auto const symbol_map = definitions.importMap(map, Map::MinimalSymbolImport, &symbol_filter);
+	QBuffer definitions_buffer;
+	if (!definitions.exportToIODevice(&definitions_buffer))
+		return {};
+	
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream.setVersion(stream_version);
+	stream << magic
+	       << qint64(QCoreApplication::applicationPid())
+	       << map.symbolsSessionId()
+	       << quint32(map.getScaleDenominator())
+	       << extent;
+	
+	stream << quint32(symbols.size());
+	for (const auto symbol : symbols)
+	{
+		SymbolKey key = { qint32(map.findSymbolIndex(symbol)), quint64(quintptr(symbol)), {}, -1, {}, {}, -1 };
+		if (symbol)
+		{
+			key.number = symbol->getNumberAsString();
+			key.type = qint32(symbol->getType());
+			key.name = symbol->getName();
+			for (int i = 0; i < map.getNumColors(); ++i)
+			{
+				auto const color = map.getColor(i);
+				if (symbol->containsColor(color))
+					key.colors.emplace_back(qint32(color->getPriority()), color->getName());
+			}
+			key.definition = qint32(definitions.findSymbolIndex(symbol_map.value(symbol)));
+		}
+		stream << key;
+	}
+	stream << definitions_buffer.data();
+	
+	stream << quint32(objects.size());
+	for (const auto object : objects)
+	{
+		stream << symbol_refs[object->getSymbol()];
+		object->saveBinary(stream);
+	}
+	
+	return data;
+}
+
+
+std::vector<Object*> load(const QByteArray& data, Map& map, QRectF& extent)
+{
+	std::vector<Object*> objects;
+	if (data.isEmpty())
+		return objects;
+	
+	QDataStream stream(data);
+	stream.setVersion(stream_version);
+	
+	// Addresses may be reused after a map or a symbol is deleted, so the
+	// map is identified by the session ID of its symbols.
+	quint32 data_magic;
+	qint64 pid;
+	QUuid session_id;
+	quint32 scale_denominator;
+	stream >> data_magic >> pid >> session_id >> scale_denominator >> extent;
+	if (stream.status() != QDataStream::Ok
+	    || data_magic != magic)
+	{
+		return objects;
+	}
+	
+	auto const same_map = pid == qint64(QCoreApplication::applicationPid())
+	                      && session_id == map.symbolsSessionId();
+	if (!same_map && scale_denominator != map.getScaleDenominator())
+	{
+		// Rescaling is left to the full import.
+		return objects;
+	}
+	
+	// Resolve the symbol references. For the same map, they are verified
+	// against the source map. Otherwise they are looked up by number, type
+	// and name, and missing symbols are imported from the definitions.
+	quint32 num_symbols;
+	stream >> num_symbols;
+	std::vector<SymbolKey> keys;
+	std::vector<const Symbol*> symbols;
+	bool missing_symbols = false;
+	for (quint32 i = 0; i < num_symbols && stream.status() == QDataStream::Ok; ++i)
+	{
+		SymbolKey key;
+		stream >> key;
+		const Symbol* symbol = nullptr;
+		if (same_map)
+		{
+			if (key.index < 0 || key.index >= map.getNumSymbols())
+				return objects;
+			
+			symbol = map.getSymbol(key.index);
+			if (quint64(quintptr(symbol)) != key.address
+			    || symbol->getNumberAsString() != key.number)
+			{
+				return objects;
+			}
+		}
+		else
+		{
+			if (key.definition < 0)
+				return objects;
+			
+			symbol = findSymbol(map, key);
+			missing_symbols |= !symbol;
+		}
+		keys.push_back(std::move(key));
+		symbols.push_back(symbol);
+	}
+	
+	QByteArray definitions_data;
+	stream >> definitions_data;
+	if (stream.status() != QDataStream::Ok)
+		return objects;
+	
+	if (missing_symbols)
+	{
+		QBuffer buffer(&definitions_data);
+		buffer.open(QIODevice::ReadOnly);
+		Map definitions;
+		if (!definitions.importFromIODevice(&buffer))
+			return objects;
+		
+		// Like Map::MinimalObjectImport, this merges duplicate symbols
+		// and imports only the colors needed.
+		std::vector<bool> filter(std::size_t(definitions.getNumSymbols()), false);
+		for (std::size_t i = 0; i < symbols.size(); ++i)
+		{
+			if (symbols[i])
+				continue;
+			if (keys[i].definition >= definitions.getNumSymbols())
+				return objects;
+			filter[std::size_t(keys[i].definition)] = true;
+		}
+		auto const symbol_map = map.importMap(definitions, Map::MinimalSymbolImport, &filter);
+		for (std::size_t i = 0; i < symbols.size(); ++i)
+		{
+			if (!symbols[i])
+				symbols[i] = symbol_map.value(definitions.getSymbol(keys[i].definition));
+		}
+	}
+	
+	quint32 num_objects;
+	stream >> num_objects;
+	if (stream.status() != QDataStream::Ok)
+		return objects;
+	
+	objects.reserve(num_objects);
+	for (quint32 i = 0; i < num_objects; ++i)
+	{
+		qint32 symbol_ref;
+		stream >> symbol_ref;
+		auto object = (symbol_ref >= 0 && std::size_t(symbol_ref) < symbols.size())
+		              ? Object::loadBinary(stream, symbols[std::size_t(symbol_ref)])
+		              : nullptr;
+		if (!object)
+		{
+			for (auto loaded_object : objects)
+				delete loaded_object;
+			objects.clear();
+			break;
+		}
+		objects.push_back(object);
+	}
+	
+	return objects;
+}
+
+
+}  // namespace ObjectClipboard
@@ -0,0 +1,76 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_OBJECT_CLIPBOARD_H
+#define OPENORIENTEERING_OBJECT_CLIPBOARD_H
+
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+class QRectF;
+
+class Map;
+class Object;
+class ObjectSelection;
+
+
+/**
+ * A compact binary clipboard format for objects.
+ * 
+ * The objects refer to their symbols by number, type and name, and by the
+ * names and priorities of the symbols' colors. Thus the objects can be
+ * recreated in any map with the same scale without parsing and importing a
+ * complete map. The definitions of the symbols are included, in order to
+ * create symbols which are missing in the target map. For external
+ * consumers, the objects must be offered in the XML format, too.
+ */
+namespace ObjectClipboard
+{
+	/**
+	 * Returns the MIME type of the binary format.
+	 */
+	QString mimeType();
+	
+	/**
+	 * Returns the binary representation of the given objects of the map.
+	 */
+	QByteArray save(const Map& map, const ObjectSelection& objects);
+	
+	/**
+	 * Recreates the objects from the binary representation.
+	 * 
+	 * For the map which the data was created from, the symbols are used
+	 * directly. For other maps, the symbols are resolved by their keys, and
+	 * missing symbols and colors are imported like Map::MinimalObjectImport
+	 * does.
+	 * 
+	 * Returns an empty list if the data is invalid, or if the scale of the
+	 * target map is different. Otherwise, the caller takes ownership of the
+	 * returned objects, and the extent of the objects in the source map is
+	 * stored in extent.
+	 */
+	std::vector<Object*> load(const QByteArray& data, Map& map, QRectF& extent);
+
+}  // namespace ObjectClipboard
+
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_OBJECT_SELECTION_H
+#define OPENORIENTEERING_OBJECT_SELECTION_H
+
+#include <cstddef>
+#include <vector>
+
+#include "core/objects/object.h"
+
+
+/**
+ * A set of selected objects.
+ * 
+ * The objects are kept in a dense vector, and each object remembers its
+ * position in this vector. Thus membership tests, insertion and removal take
+ * constant time and do not allocate memory per object.
+ * 
+ * Removal moves the last object to the vacated position. So the iteration
+ * order depends only on the sequence of operations, not on object addresses.
+ * 
+ * An object can be a member of only one selection at a time, because it
+ * stores only a single position. That's why this class is not copyable.
+ */
+class ObjectSelection
+{
+public:
+	using value_type     = Object*;
+	using size_type      = std::size_t;
+	using const_iterator = std::vector<Object*>::const_iterator;
+	
+	ObjectSelection() = default;
+	ObjectSelection(const ObjectSelection&) = delete;
+	ObjectSelection(ObjectSelection&&) = delete;
+	~ObjectSelection() = default;
+	
+	ObjectSelection& operator=(const ObjectSelection&) = delete;
+	ObjectSelection& operator=(ObjectSelection&&) = delete;
+	
+	
+	/** Returns true if no object is selected. */
+	bool empty() const noexcept;
+	
+	/** Returns the number of selected objects. */
+	size_type size() const noexcept;
+	
+	const_iterator begin() const noexcept;
+	const_iterator end() const noexcept;
+	const_iterator cbegin() const noexcept;
+	const_iterator cend() const noexcept;
+	
+	/** Returns true if the given object is selected. */
+	bool contains(const Object* object) const noexcept;
+	
+	/**
+	 * Adds an object to the selection.
+	 * 
+	 * Returns false if the object was already selected.
+	 */
+	bool insert(Object* object);
+	
+	/**
+	 * Removes an object from the selection.
+	 * 
+	 * Returns false if the object was not selected.
+	 */
+	bool erase(const Object* object);
+	
+	/** Removes all objects from the selection. */
+	void clear() noexcept;
+	
+	/** Reserves space for the given number of objects. */
+	void reserve(size_type size);
+	
+private:
+	std::vector<Object*> objects;
+};
+
+
+
+// ### ObjectSelection inline code ###
+
+inline
+bool ObjectSelection::empty() const noexcept
+{
+	return objects.empty();
+}
+
+inline
+ObjectSelection::size_type ObjectSelection::size() const noexcept
+{
+	return objects.size();
+}
+
+inline
+ObjectSelection::const_iterator ObjectSelection::begin() const noexcept
+{
+	return objects.cbegin();
+}
+
+inline
+ObjectSelection::const_iterator ObjectSelection::end() const noexcept
+{
+	return objects.cend();
+}
+
+inline
+ObjectSelection::const_iterator ObjectSelection::cbegin() const noexcept
+{
+	return objects.cbegin();
+}
+
+inline
+ObjectSelection::const_iterator ObjectSelection::cend() const noexcept
+{
+	return objects.cend();
+}
+
+inline
+bool ObjectSelection::contains(const Object* object) const noexcept
+{
+	// A stale position is harmless: it cannot refer to this very object.
+	auto const pos = object->selection_pos;
+	return pos < objects.size() && objects[pos] == object;
+}
+
+inline
+bool ObjectSelection::insert(Object* object)
+{
+	if (contains(object))
+		return false;
+	
+	object->selection_pos = objects.size();
+	objects.push_back(object);
+	return true;
+}
+
+inline
+bool ObjectSelection::erase(const Object* object)
+{
+	if (!contains(object))
+		return false;
+	
+	auto const pos = object->selection_pos;
+	objects[pos] = objects.back();
+	objects[pos]->selection_pos = pos;
+	objects.pop_back();
+	return true;
+}
+
+inline
+void ObjectSelection::clear() noexcept
+{
+	objects.clear();
+}
+
+inline
+void ObjectSelection::reserve(size_type size)
+{
+	objects.reserve(size);
+}
+
+
+#endif
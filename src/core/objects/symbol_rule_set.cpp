@@ -22,11 +22,12 @@
 
 #include <algorithm>
 #include <cstddef>
-#include <functional>
 #include <iterator>
 #include <memory>
 #include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #include <QtGlobal>
 #include <QChar>
@@ -37,8 +38,11 @@
 #include <QTextStream>
 
 #include "core/map.h"
+#include "core/map_part.h"
 #include "core/objects/object.h"
 #include "core/symbols/symbol.h"
+#include "undo/object_undo.h"
+#include "undo/undo.h"
 #include "undo/undo_manager.h"
 
 
@@ -319,6 +323,83 @@ void SymbolRuleSet::operator()(Object* object) const
 }
 
 
+namespace {
+
+/**
+ * Applies the matching rules to all objects in the map.
+ * 
+ * Rules with symbol queries are looked up by the object's symbol instead of
+ * being evaluated for every object. Only the other rules which take
+ * precedence are evaluated. The objects' output is not updated.
+ * 
+ * Returns an undo step for the changes, or nullptr if no object was changed.
+ */
+std::unique_ptr<UndoStep> switchSymbols(const SymbolRuleSet& rules, Map& map)
+{
+	std::unordered_map<const Symbol*, std::size_t> symbol_rules;
+	std::vector<std::size_t> other_rules;
+	for (std::size_t i = 0; i < rules.size(); ++i)
+	{
+		const auto& rule = rules[i];
+		if (!rule.symbol)
+			continue;
+		if (rule.query.getOperator() == ObjectQuery::OperatorSymbol)
+			symbol_rules.emplace(rule.query.symbolOperand(), i);  // keeps the first rule
+		else
+			other_rules.push_back(i);
+	}
+	
+	std::vector<std::unique_ptr<SwitchSymbolUndoStep>> part_steps;
+	for (int part_index = 0; part_index < map.getNumParts(); ++part_index)
+	{
+		auto part = map.getPart(part_index);
+		auto step = std::make_unique<SwitchSymbolUndoStep>(&map);
+		step->setPartIndex(part_index);
+		for (int i = 0; i < part->getNumObjects(); ++i)
+		{
+			auto object = part->getObject(i);
+			auto rule_index = rules.size();
+			auto symbol_rule = symbol_rules.find(object->getSymbol());
+			if (symbol_rule != symbol_rules.end())
+				rule_index = symbol_rule->second;
+			for (auto other_rule : other_rules)
+			{
+				if (other_rule >= rule_index)
+					break;
+				if (rules[other_rule].query(object))
+				{
+					rule_index = other_rule;
+					break;
+				}
+			}
+			if (rule_index == rules.size())
+				continue;
+			
+			auto const old_symbol = object->getSymbol();
+			if (old_symbol != rules[rule_index].symbol
+			    && object->setSymbol(rules[rule_index].symbol, false))
+			{
+				step->addObject(i, old_symbol);
+			}
+		}
+		if (!step->isEmpty())
+			part_steps.push_back(std::move(step));
+	}
+	
+	if (part_steps.empty())
+		return {};
+	if (part_steps.size() == 1)
+		return std::move(part_steps.front());
+	
+	auto combined_step = std::make_unique<CombinedUndoStep>(&map);
+	for (auto& step : part_steps)
+		combined_step->push(step.release());
+	return std::move(combined_step);
+}
+
+}  // namespace
+
+
 void SymbolRuleSet::apply(Map& object_map, const Map& symbol_set, Options options)
 {
 	std::unordered_set<const Symbol*> old_symbols;
@@ -369,7 +450,7 @@ void SymbolRuleSet::apply(Map& object_map, const Map& symbol_set, Options option
 	}
 	
 	// Change symbols for all objects
-	object_map.applyOnAllObjects(std::cref(*this));
+	auto undo_step = switchSymbols(*this, object_map);
 	
 	// Delete unused old symbols
 	if (!old_symbols.empty())
@@ -410,4 +491,8 @@ void SymbolRuleSet::apply(Map& object_map, const Map& symbol_set, Options option
 	object_map.setObjectsDirty();
 	object_map.setSymbolsDirty();
 	object_map.undoManager().clear();
+	
+	// The switch can be undone unless the original symbols were deleted.
+	if (undo_step && undo_step->isValid())
+		object_map.undoManager().push(std::move(undo_step));
 }
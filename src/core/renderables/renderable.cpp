@@ -85,6 +85,11 @@ static_assert(false, "This file needs to be modified for correct printing on And
 
 Renderable::~Renderable() = default;
 
+void Renderable::translate(const QPointF& offset)
+{
+	extent.translate(offset);
+}
+
 
 
 // ### SharedRenderables ###
@@ -216,6 +221,20 @@ void ObjectRenderables::deleteRenderables()
 	}
 }
 
+void ObjectRenderables::translate(const QPointF& offset)
+{
+	for (auto& color : *this)
+	{
+		for (auto& renderables : *color.second)
+		{
+			for (auto renderable : renderables.second)
+				renderable->translate(offset);
+		}
+	}
+	if (extent.isValid())
+		extent.translate(offset);
+}
+
 
 
 // ### MapRenderables ###
@@ -26,6 +26,7 @@
 
 #include <QtGlobal>
 #include <QFlags>
+#include <QPointF>
 #include <QRectF>
 #include <QSharedData>
 #include <QExplicitlySharedDataPointer>
@@ -151,6 +152,14 @@ public:
 	 */
 	virtual void render(QPainter& painter, const RenderConfig& config) const = 0;
 	
+	/**
+	 * Moves the renderable by the given offset (in map coordinates).
+	 * 
+	 * Inheriting classes must move their geometry and call this
+	 * implementation which moves the extent.
+	 */
+	virtual void translate(const QPointF& offset);
+	
 protected:
 	/** The color priority is a major attribute and cannot be modified. */
 	const int color_priority;
@@ -282,6 +291,14 @@ public:
 	
 	const QRectF& getExtent() const;
 	
+	/**
+	 * Moves all renderables and the extent by the given offset.
+	 * 
+	 * The renderables are shared with the map's collections,
+	 * so these collections need no update.
+	 */
+	void translate(const QPointF& offset);
+	
 private:
 	QRectF& extent;
 	const QPainterPath* clip_path = nullptr; // no memory management here!
@@ -139,6 +139,12 @@ void CircleRenderable::render(QPainter &painter, const RenderConfig &config) con
 		painter.drawEllipse(rect);
 }
 
+void CircleRenderable::translate(const QPointF& offset)
+{
+	rect.translate(offset);
+	Renderable::translate(offset);
+}
+
 
 
 // ### LineRenderable ###
@@ -427,6 +433,12 @@ PainterConfig LineRenderable::getPainterConfig(const QPainterPath* clip_path) co
 	return { color_priority, PainterConfig::PenOnly, line_width, clip_path };
 }
 
+void LineRenderable::translate(const QPointF& offset)
+{
+	path.translate(offset);
+	Renderable::translate(offset);
+}
+
 void LineRenderable::render(QPainter &painter, const RenderConfig &config) const
 {
 	QPen pen(painter.pen());
@@ -650,6 +662,12 @@ PainterConfig AreaRenderable::getPainterConfig(const QPainterPath* clip_path) co
 	return { color_priority, PainterConfig::BrushOnly, 0, clip_path };
 }
 
+void AreaRenderable::translate(const QPointF& offset)
+{
+	path.translate(offset);
+	Renderable::translate(offset);
+}
+
 void AreaRenderable::render(QPainter &painter, const RenderConfig &/*config*/) const
 {
 	painter.drawPath(path);
@@ -736,6 +754,14 @@ PainterConfig TextRenderable::getPainterConfig(const QPainterPath* clip_path) co
 	return { color_priority, PainterConfig::BrushOnly, 0.0, clip_path };
 }
 
+void TextRenderable::translate(const QPointF& offset)
+{
+	// The path is given in text coordinates, relative to the anchor.
+	anchor_x += offset.x();
+	anchor_y += offset.y();
+	Renderable::translate(offset);
+}
+
 void TextRenderable::render(QPainter &painter, const RenderConfig &config) const
 {
 	painter.save();
@@ -60,6 +60,7 @@ public:
 	CircleRenderable(const PointSymbol* symbol, MapCoordF coord);
 	void render(QPainter& painter, const RenderConfig& config) const override;
 	PainterConfig getPainterConfig(const QPainterPath* clip_path = nullptr) const override;
+	void translate(const QPointF& offset) override;
 	
 protected:
 	const qreal line_width;
@@ -74,6 +75,7 @@ public:
 	LineRenderable(const LineSymbol* symbol, QPointF first, QPointF second);
 	void render(QPainter& painter, const RenderConfig& config) const override;
 	PainterConfig getPainterConfig(const QPainterPath* clip_path = nullptr) const override;
+	void translate(const QPointF& offset) override;
 	
 protected:
 	void extentIncludeCap(quint32 i, qreal half_line_width, bool end_cap, const LineSymbol* symbol, const VirtualPath& path);
@@ -94,6 +96,7 @@ public:
 	AreaRenderable(const AreaSymbol* symbol, const VirtualPath& path);
 	void render(QPainter& painter, const RenderConfig& config) const override;
 	PainterConfig getPainterConfig(const QPainterPath* clip_path = nullptr) const override;
+	void translate(const QPointF& offset) override;
 	
 	inline const QPainterPath* painterPath() const;
 	
@@ -110,6 +113,7 @@ public:
 	TextRenderable(const TextSymbol* symbol, const TextObject* text_object, const MapColor* color, double anchor_x, double anchor_y);
 	PainterConfig getPainterConfig(const QPainterPath* clip_path = nullptr) const override;
 	void render(QPainter& painter, const RenderConfig& config) const override;
+	void translate(const QPointF& offset) override;
 	
 protected:
 	void renderCommon(QPainter& painter, const RenderConfig& config) const;
@@ -793,6 +793,16 @@ qreal AreaSymbol::dimensionForIcon() const
 	return size;
 }
 
+bool AreaSymbol::dependsOnAbsolutePosition(RenderableOptions options) const
+{
+	// Patterns are aligned to the pattern origin, not to the object.
+	if (options == RenderNormal)
+		return !patterns.empty();
+	
+	// The hatching is a line pattern, too. Cf. createRenderables().
+	return options.testFlag(RenderAreasHatched) && guessDominantColor();
+}
+
 
 
 bool AreaSymbol::hasRotatableFillPattern() const
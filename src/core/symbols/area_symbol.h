@@ -270,6 +270,8 @@ public:
 	
 	qreal dimensionForIcon() const override;
 	
+	bool dependsOnAbsolutePosition(RenderableOptions options) const override;
+	
 	// Getters / Setters
 	inline const MapColor* getColor() const {return color;}
 	inline void setColor(const MapColor* color) {this->color = color;}
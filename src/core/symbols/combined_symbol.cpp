@@ -374,6 +374,14 @@ qreal CombinedSymbol::calculateLargestLineExtent() const
 	});
 }
 
+bool CombinedSymbol::dependsOnAbsolutePosition(RenderableOptions options) const
+{
+	return std::any_of(begin(parts), end(parts), [options](auto subsymbol)
+	{
+		return subsymbol && subsymbol->dependsOnAbsolutePosition(options);
+	});
+}
+
 
 
 void CombinedSymbol::setPart(int i, const Symbol* symbol, bool is_private)
@@ -91,6 +91,8 @@ public:
 	
     qreal calculateLargestLineExtent() const override;
 	
+	bool dependsOnAbsolutePosition(RenderableOptions options) const override;
+	
 	// Getters / Setter
 	inline int getNumParts() const {return (int)parts.size();}
 	inline void setNumParts(int num) {parts.resize(num, nullptr); private_parts.resize(num, false);}
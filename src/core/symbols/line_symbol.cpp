@@ -1698,6 +1698,16 @@ qreal LineSymbol::calculateLargestLineExtent() const
 	return result;
 }
 
+bool LineSymbol::dependsOnAbsolutePosition(RenderableOptions options) const
+{
+	for (auto symbol : { start_symbol, mid_symbol, end_symbol, dash_symbol })
+	{
+		if (symbol && symbol->dependsOnAbsolutePosition(options))
+			return true;
+	}
+	return false;
+}
+
 
 
 void LineSymbol::setStartSymbol(PointSymbol* symbol)
@@ -170,6 +170,8 @@ public:
 	 */
 	qreal calculateLargestLineExtent() const override;
 	
+	bool dependsOnAbsolutePosition(RenderableOptions options) const override;
+	
 	
 	
 	/**
@@ -588,6 +588,14 @@ qreal PointSymbol::dimensionForIcon() const
 	return size;
 }
 
+bool PointSymbol::dependsOnAbsolutePosition(RenderableOptions options) const
+{
+	return std::any_of(begin(symbols), end(symbols), [options](auto symbol)
+	{
+		return symbol->dependsOnAbsolutePosition(options);
+	});
+}
+
 
 
 #ifndef NO_NATIVE_FILE_FORMAT
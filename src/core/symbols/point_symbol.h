@@ -90,6 +90,8 @@ public:
 	
 	qreal dimensionForIcon() const override;
 	
+	bool dependsOnAbsolutePosition(RenderableOptions options) const override;
+	
 	// Contained objects and symbols (elements)
 	
 	/** Returns the number of contained elements. */
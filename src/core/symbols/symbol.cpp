@@ -354,6 +354,12 @@ bool Symbol::containsSymbol(const Symbol* symbol) const
 	return false;
 }
 
+bool Symbol::dependsOnAbsolutePosition(RenderableOptions options) const
+{
+	Q_UNUSED(options);
+	return false;
+}
+
 QImage Symbol::getIcon(const Map* map) const
 {
 	if (icon.isNull() && map)
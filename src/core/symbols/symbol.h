@@ -300,6 +300,18 @@ public:
 	 */
 	virtual qreal calculateLargestLineExtent() const;
 	
+	/**
+	 * Returns true if the renderables of an object depend on the object's
+	 * absolute position, not only on its shape.
+	 * 
+	 * This is the case for fill patterns which are aligned to the map grid,
+	 * and for the hatching of areas. Renderables of other symbols may simply
+	 * be translated when an object is moved.
+	 * 
+	 * The options are the ones used for creating the renderables.
+	 */
+	virtual bool dependsOnAbsolutePosition(RenderableOptions options) const;
+	
 	
 	// Getters / Setters
 	
@@ -0,0 +1,677 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "binary_file_format.h"
+#include "binary_file_format_p.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <QtConcurrentMap>
+#include <QtEndian>
+#include <QBuffer>
+#include <QFileDevice>
+#include <QHash>
+#include <QIODevice>
+#include <QLatin1String>
+#include <QString>
+#include <QVariant>
+#include <QXmlStreamWriter>
+
+#include "core/map.h"
+#include "core/map_coord.h"
+#include "core/map_part.h"
+#include "core/objects/object.h"
+#include "core/objects/text_object.h"
+#include "core/symbols/point_symbol.h"
+#include "core/symbols/symbol.h"
+#include "fileformats/file_format.h"
+#include "fileformats/file_import_export.h"
+#include "util/xml_stream_util.h"
+
+
+namespace literal
+{
+	static const QLatin1String parts("parts");
+	static const QLatin1String part("part");
+	static const QLatin1String objects("objects");
+	static const QLatin1String name("name");
+	static const QLatin1String count("count");
+	static const QLatin1String current("current");
+	
+	static const QLatin1String compress_blocks("compressBlocks");
+}
+
+
+
+namespace
+{
+	/*
+	 * File layout, all numbers in little-endian byte order:
+	 * 
+	 * File header (32 bytes)
+	 *   char[8]  magic
+	 *   quint32  container version
+	 *   quint32  number of object blocks
+	 *   quint64  size of the XML part
+	 *   quint64  reserved
+	 * XML part, padded to a multiple of 8 bytes
+	 * Object blocks, each:
+	 *   Block header (32 bytes)
+	 *     quint32  part index
+	 *     quint32  number of objects
+	 *     quint32  number of coordinates
+	 *     quint32  flags
+	 *     quint64  size of the raw data
+	 *     quint64  size of the stored data
+	 *   Stored data, padded to a multiple of 8 bytes
+	 * 
+	 * Raw block data:
+	 *   Object records (40 bytes each)
+	 *     quint8   type
+	 *     quint8   horizontal alignment (text)
+	 *     quint8   vertical alignment (text)
+	 *     quint8   reserved
+	 *     qint32   symbol index, or -1
+	 *     float    rotation (point, text) or pattern rotation (path)
+	 *     qint32   pattern origin x (path)
+	 *     qint32   pattern origin y (path)
+	 *     quint32  number of coordinates
+	 *     quint32  size of the UTF-8 text (text)
+	 *     quint32  number of tags
+	 *     quint32  size of the object's string data
+	 *     quint32  reserved
+	 *   Coordinate records (12 bytes each)
+	 *     qint32   x
+	 *     qint32   y
+	 *     quint32  flags
+	 *   String data, for each object:
+	 *     UTF-8 text
+	 *     for each tag: quint32 key size, UTF-8 key, quint32 value size, UTF-8 value
+	 */
+	
+	constexpr char magic[8] = { 'O', 'M', 'A', 'P', 'B', 'I', 'N', '\x1a' };
+	
+	constexpr int file_header_size   = 32;
+	constexpr int block_header_size  = 32;
+	constexpr int object_record_size = 40;
+	constexpr int coord_record_size  = 12;
+	
+	constexpr quint32 block_compressed = 0x01;
+	
+	constexpr std::size_t objects_per_block = 4096;
+	
+	
+	qint64 padding(qint64 size)
+	{
+		return (8 - (size % 8)) % 8;
+	}
+	
+	template <class T>
+	void appendLittleEndian(QByteArray& data, T value)
+	{
+		uchar bytes[sizeof(T)];
+		qToLittleEndian(value, bytes);
+		data.append(reinterpret_cast<const char*>(bytes), int(sizeof(T)));
+	}
+	
+	void appendFloat(QByteArray& data, float value)
+	{
+		quint32 bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		appendLittleEndian(data, bits);
+	}
+	
+	float readFloat(const uchar* src)
+	{
+		auto const bits = qFromLittleEndian<quint32>(src);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	
+	void appendString(QByteArray& data, const QString& string)
+	{
+		auto const utf8 = string.toUtf8();
+		appendLittleEndian(data, quint32(utf8.size()));
+		data.append(utf8);
+	}
+	
+	QString readString(const uchar*& pos, const uchar* end)
+	{
+		if (end - pos < 4)
+			throw FileFormatException(BinaryFileImporter::tr("The file is corrupt."));
+		auto const size = qFromLittleEndian<quint32>(pos);
+		pos += 4;
+		if (quint64(end - pos) < size)
+			throw FileFormatException(BinaryFileImporter::tr("The file is corrupt."));
+		auto const string = QString::fromUtf8(reinterpret_cast<const char*>(pos), int(size));
+		pos += size;
+		return string;
+	}
+	
+	
+	/**
+	 * Unmaps the memory when the file import is finished.
+	 */
+	struct Unmapper
+	{
+		QFileDevice* file;
+		void operator()(uchar* data) const { file->unmap(data); }
+	};
+	
+}  // namespace
+
+
+
+// ### BinaryFileFormat ###
+
+const quint32 BinaryFileFormat::current_version = 1;
+
+BinaryFileFormat::BinaryFileFormat()
+ : FileFormat(MapFile, "Binary", ImportExport::tr("OpenOrienteering Mapper binary"), QString::fromLatin1("omapb"),
+              ImportSupported | ExportSupported)
+{
+	// Nothing
+}
+
+bool BinaryFileFormat::understands(const unsigned char* buffer, std::size_t sz) const
+{
+	return sz >= sizeof(magic) && std::memcmp(buffer, magic, sizeof(magic)) == 0;
+}
+
+Importer* BinaryFileFormat::createImporter(QIODevice* stream, Map* map, MapView* view) const
+{
+	return new BinaryFileImporter(stream, map, view);
+}
+
+Exporter* BinaryFileFormat::createExporter(QIODevice* stream, Map* map, MapView* view) const
+{
+	return new BinaryFileExporter(stream, map, view);
+}
+
+
+
+// ### BinaryFileExporter ###
+
+BinaryFileExporter::BinaryFileExporter(QIODevice* stream, Map* map, MapView* view)
+ : XMLFileExporter(stream, map, view)
+{
+	setOption(literal::compress_blocks, false);
+	setOption(QString::fromLatin1("compressed"), false);  // for the XML part
+}
+
+BinaryFileExporter::~BinaryFileExporter() = default;
+
+
+bool BinaryFileExporter::takeSnapshot()
+{
+	return false;
+}
+
+
+void BinaryFileExporter::doExport()
+{
+	// The XML part, without the objects
+	QBuffer xml_buffer;
+	xml_buffer.open(QIODevice::WriteOnly);
+	xml.setDevice(&xml_buffer);
+	XMLFileExporter::doExport();
+	xml.setDevice(nullptr);
+	auto const xml_data = xml_buffer.data();
+	
+	// The object blocks
+	struct Block
+	{
+		quint32 part_index;
+		quint32 num_coords;
+		std::vector<Object*> objects;
+		QByteArray data;
+		quint64 raw_size;
+		quint32 flags;
+	};
+	std::vector<Block> blocks;
+	for (int i = 0; i < map->getNumParts(); ++i)
+	{
+		auto const part = map->getPart(i);
+		auto const num_objects = std::size_t(part->getNumObjects());
+		for (std::size_t first = 0; first < num_objects; first += objects_per_block)
+		{
+			Block block = { quint32(i), 0, {}, {}, 0, 0 };
+			auto const last = std::min(num_objects, first + objects_per_block);
+			block.objects.reserve(last - first);
+			for (auto j = first; j < last; ++j)
+			{
+				auto object = part->getObject(int(j));
+				block.num_coords += quint32(object->getRawCoordinateVector().size());
+				block.objects.push_back(object);
+			}
+			blocks.push_back(std::move(block));
+		}
+	}
+	
+	QHash<const Symbol*, int> symbol_indices;
+	symbol_indices.reserve(map->getNumSymbols());
+	for (int i = 0; i < map->getNumSymbols(); ++i)
+		symbol_indices.insert(map->getSymbol(i), i);
+		
+	auto const compress = option(literal::compress_blocks).toBool();
+	QtConcurrent::blockingMap(blocks, [this, compress, &symbol_indices](Block& block) {
+		block.data = encodeBlock(block.objects, symbol_indices);
+		block.raw_size = quint64(block.data.size());
+		if (compress)
+		{
+			auto compressed = qCompress(block.data);
+			if (compressed.size() < block.data.size())
+			{
+				block.data = compressed;
+				block.flags |= block_compressed;
+			}
+		}
+	});
+	
+	// The container
+	QByteArray header;
+	header.reserve(file_header_size);
+	header.append(magic, int(sizeof(magic)));
+	appendLittleEndian(header, BinaryFileFormat::current_version);
+	appendLittleEndian(header, quint32(blocks.size()));
+	appendLittleEndian(header, quint64(xml_data.size()));
+	appendLittleEndian(header, quint64(0));
+	Q_ASSERT(header.size() == file_header_size);
+	write(header.constData(), header.size());
+	
+	static const char zeros[8] = {};
+	write(xml_data.constData(), xml_data.size());
+	write(zeros, padding(xml_data.size()));
+	
+	for (const auto& block : blocks)
+	{
+		QByteArray block_header;
+		block_header.reserve(block_header_size);
+		appendLittleEndian(block_header, block.part_index);
+		appendLittleEndian(block_header, quint32(block.objects.size()));
+		appendLittleEndian(block_header, block.num_coords);
+		appendLittleEndian(block_header, block.flags);
+		appendLittleEndian(block_header, block.raw_size);
+		appendLittleEndian(block_header, quint64(block.data.size()));
+		Q_ASSERT(block_header.size() == block_header_size);
+		write(block_header.constData(), block_header.size());
+		write(block.data.constData(), block.data.size());
+		write(zeros, padding(block.data.size()));
+	}
+}
+
+
+void BinaryFileExporter::exportMapParts()
+{
+	XmlElementWriter parts_element(xml, literal::parts);
+	
+	auto num_parts = std::size_t(map->getNumParts());
+	parts_element.writeAttribute(literal::count, num_parts);
+	parts_element.writeAttribute(literal::current, map->getCurrentPartIndex());
+	for (auto i = 0u; i < num_parts; ++i)
+	{
+		writeLineBreak(xml);
+		XmlElementWriter part_element(xml, literal::part);
+		part_element.writeAttribute(literal::name, map->getPart(i)->getName());
+		{
+			// The objects are stored in the binary blocks.
+			XmlElementWriter objects_element(xml, literal::objects);
+			objects_element.writeAttribute(literal::count, 0);
+		}
+	}
+	writeLineBreak(xml);
+}
+
+
+QByteArray BinaryFileExporter::encodeBlock(const std::vector<Object*>& objects, const QHash<const Symbol*, int>& symbol_indices) const
+{
+	QByteArray records;
+	QByteArray coords;
+	QByteArray strings;
+	records.reserve(int(objects.size()) * object_record_size);
+	
+	for (const auto object : objects)
+	{
+		quint8 h_align = 0;
+		quint8 v_align = 0;
+		float rotation = 0;
+		auto pattern_origin = MapCoord{};
+		auto const string_data_start = strings.size();
+		
+		switch (object->getType())
+		{
+		case Object::Point:
+			rotation = object->asPoint()->getRotation();
+			break;
+		case Object::Path:
+			rotation = object->asPath()->getPatternRotation();
+			pattern_origin = object->asPath()->getPatternOrigin();
+			break;
+		case Object::Text:
+			rotation = object->asText()->getRotation();
+			h_align = quint8(object->asText()->getHorizontalAlignment());
+			v_align = quint8(object->asText()->getVerticalAlignment());
+			strings.append(object->asText()->getText().toUtf8());
+			break;
+		}
+		auto const text_size = strings.size() - string_data_start;
+		
+		const auto& tags = object->tags();
+		for (auto tag = tags.constBegin(); tag != tags.constEnd(); ++tag)
+		{
+			appendString(strings, tag.key());
+			appendString(strings, tag.value());
+		}
+		
+		const auto& object_coords = object->getRawCoordinateVector();
+		
+		records.append(char(object->getType()));
+		records.append(char(h_align));
+		records.append(char(v_align));
+		records.append(char(0));
+		appendLittleEndian(records, qint32(symbol_indices.value(object->getSymbol(), -1)));
+		appendFloat(records, rotation);
+		appendLittleEndian(records, pattern_origin.nativeX());
+		appendLittleEndian(records, pattern_origin.nativeY());
+		appendLittleEndian(records, quint32(object_coords.size()));
+		appendLittleEndian(records, quint32(text_size));
+		appendLittleEndian(records, quint32(tags.size()));
+		appendLittleEndian(records, quint32(strings.size() - string_data_start));
+		appendLittleEndian(records, quint32(0));
+		
+		for (const auto& coord : object_coords)
+		{
+			appendLittleEndian(coords, coord.nativeX());
+			appendLittleEndian(coords, coord.nativeY());
+			appendLittleEndian(coords, quint32(coord.flags()));
+		}
+	}
+	
+	return records + coords + strings;
+}
+
+
+void BinaryFileExporter::write(const char* data, qint64 size)
+{
+	if (size > 0 && stream->write(data, size) != size)
+		throw FileFormatException(stream->errorString());
+}
+
+
+
+// ### BinaryFileImporter ###
+
+BinaryFileImporter::BinaryFileImporter(QIODevice* stream, Map* map, MapView* view)
+ : XMLFileImporter(stream, map, view)
+{
+	// Nothing
+}
+
+BinaryFileImporter::~BinaryFileImporter() = default;
+
+
+void BinaryFileImporter::import(bool load_symbols_only)
+{
+	// Map the file if possible. Otherwise, read it into memory.
+	std::unique_ptr<uchar, Unmapper> mapping { nullptr, Unmapper{ nullptr } };
+	QByteArray buffer;
+	const uchar* data = nullptr;
+	qint64 size = 0;
+	if (auto file = qobject_cast<QFileDevice*>(stream))
+	{
+		size = file->size() - file->pos();
+		mapping = std::unique_ptr<uchar, Unmapper>(file->map(file->pos(), size), Unmapper{ file });
+		data = mapping.get();
+	}
+	if (!data)
+	{
+		buffer = stream->readAll();
+		data = reinterpret_cast<const uchar*>(buffer.constData());
+		size = buffer.size();
+	}
+	
+	if (size < file_header_size || std::memcmp(data, magic, sizeof(magic)) != 0)
+		throw FileFormatException(Importer::tr("Unsupported file format."));
+		
+	auto const version = qFromLittleEndian<quint32>(data + 8);
+	if (version < 1)
+		throw FileFormatException(Importer::tr("Invalid file format version."));
+	else if (version > BinaryFileFormat::current_version)
+		throw FileFormatException(tr("The file was created by a newer version of the program."));
+		
+	auto const num_blocks = qFromLittleEndian<quint32>(data + 12);
+	auto const xml_size = qFromLittleEndian<quint64>(data + 16);
+	if (xml_size > quint64(size - file_header_size))
+		throw FileFormatException(tr("The file is corrupt."));
+		
+	// The XML part
+	auto xml_data = QByteArray::fromRawData(reinterpret_cast<const char*>(data + file_header_size), int(xml_size));
+	QBuffer xml_buffer(&xml_data);
+	xml_buffer.open(QIODevice::ReadOnly);
+	xml.setDevice(&xml_buffer);
+	XMLFileImporter::import(load_symbols_only);
+	xml.setDevice(nullptr);
+	
+	if (!load_symbols_only)
+	{
+		auto const blocks_offset = std::min(size, qint64(file_header_size + xml_size) + padding(qint64(xml_size)));
+		importObjects(data + blocks_offset, data + size, num_blocks);
+	}
+}
+
+
+void BinaryFileImporter::importObjects(const uchar* data, const uchar* data_end, quint32 num_blocks)
+{
+	struct Block
+	{
+		quint32 part_index;
+		quint32 num_objects;
+		quint32 num_coords;
+		quint32 flags;
+		quint64 raw_size;
+		QByteArray data;
+		std::vector<Object*> objects;
+		QString error;
+	};
+	
+	std::vector<Block> blocks;
+	blocks.reserve(std::min(num_blocks, quint32((data_end - data) / block_header_size)));
+	for (quint32 i = 0; i < num_blocks; ++i)
+	{
+		if (data_end - data < block_header_size)
+			throw FileFormatException(tr("The file is corrupt."));
+			
+		Block block;
+		block.part_index = qFromLittleEndian<quint32>(data);
+		block.num_objects = qFromLittleEndian<quint32>(data + 4);
+		block.num_coords = qFromLittleEndian<quint32>(data + 8);
+		block.flags = qFromLittleEndian<quint32>(data + 12);
+		block.raw_size = qFromLittleEndian<quint64>(data + 16);
+		auto const stored_size = qFromLittleEndian<quint64>(data + 24);
+		data += block_header_size;
+		
+		if (stored_size > quint64(data_end - data)
+		    || block.part_index >= std::size_t(map->getNumParts()))
+		{
+			throw FileFormatException(tr("The file is corrupt."));
+		}
+		
+		// Uncompressed data is used in place.
+		block.data = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(stored_size));
+		data += std::min(qint64(stored_size) + padding(qint64(stored_size)), qint64(data_end - data));
+		blocks.push_back(std::move(block));
+	}
+	
+	std::vector<const Symbol*> symbols;
+	symbols.reserve(std::size_t(map->getNumSymbols()));
+	for (int i = 0; i < map->getNumSymbols(); ++i)
+		symbols.push_back(map->getSymbol(i));
+		
+	// Exceptions must not escape from the worker threads.
+	QtConcurrent::blockingMap(blocks, [this, &symbols](Block& block) {
+		try
+		{
+			if (block.flags & block_compressed)
+				block.data = qUncompress(block.data);
+			if (quint64(block.data.size()) != block.raw_size)
+				throw FileFormatException(tr("The file is corrupt."));
+			block.objects = decodeBlock(block.data, block.num_objects, block.num_coords, symbols);
+		}
+		catch (FileFormatException& e)
+		{
+			block.error = e.message();
+		}
+	});
+	
+	auto const failed = std::find_if(begin(blocks), end(blocks), [](const Block& block) {
+		return !block.error.isEmpty();
+	});
+	if (failed != end(blocks))
+	{
+		for (const auto& block : blocks)
+		{
+			for (auto object : block.objects)
+				delete object;
+		}
+		throw FileFormatException(failed->error);
+	}
+	
+	for (const auto& block : blocks)
+	{
+		auto part = map->getPart(block.part_index);
+		for (auto object : block.objects)
+		{
+			part->appendObject(object);
+			object->map = map;
+			if (object->isIrregular())
+				map->markAsIrregular(object);
+		}
+	}
+}
+
+
+std::vector<Object*> BinaryFileImporter::decodeBlock(const QByteArray& raw, quint32 num_objects, quint32 num_coords, const std::vector<const Symbol*>& symbols) const
+{
+	auto const records_size = quint64(num_objects) * object_record_size;
+	auto const coords_size = quint64(num_coords) * coord_record_size;
+	if (records_size + coords_size > quint64(raw.size()))
+		throw FileFormatException(tr("The file is corrupt."));
+		
+	auto record = reinterpret_cast<const uchar*>(raw.constData());
+	auto coord = record + records_size;
+	auto const coords_end = coord + coords_size;
+	auto strings = coords_end;
+	auto const end = record + raw.size();
+	
+	std::vector<Object*> objects;
+	objects.reserve(num_objects);
+	try
+	{
+		for (quint32 i = 0; i < num_objects; ++i, record += object_record_size)
+		{
+			auto const type = Object::Type(record[0]);
+			if (type != Object::Point && type != Object::Path && type != Object::Text)
+				throw FileFormatException(tr("The file is corrupt."));
+				
+			auto const symbol_index = qFromLittleEndian<qint32>(record + 4);
+			auto symbol = (symbol_index >= 0 && std::size_t(symbol_index) < symbols.size())
+			              ? symbols[std::size_t(symbol_index)]
+			              : nullptr;
+			auto object = Object::getObjectForType(type, symbol);
+			objects.push_back(object);
+			
+			if (!symbol || !symbol->isTypeCompatibleTo(object))
+			{
+				// Like XMLFileImporter, use the symbols for undefined objects.
+				switch (type)
+				{
+				case Object::Point:
+					object->symbol = Map::getUndefinedPoint();
+					break;
+				case Object::Path:
+					object->symbol = Map::getUndefinedLine();
+					break;
+				case Object::Text:
+					object->symbol = Map::getUndefinedText();
+					break;
+				}
+			}
+			
+			auto const rotation = readFloat(record + 8);
+			auto const text_size = qFromLittleEndian<quint32>(record + 24);
+			auto const num_tags = qFromLittleEndian<quint32>(record + 28);
+			auto const strings_size = qFromLittleEndian<quint32>(record + 32);
+			if (strings_size > quint64(end - strings) || text_size > strings_size)
+				throw FileFormatException(tr("The file is corrupt."));
+				
+			switch (type)
+			{
+			case Object::Point:
+				if (static_cast<const PointSymbol*>(object->getSymbol())->isRotatable())
+					object->asPoint()->setRotation(rotation);
+				break;
+			case Object::Path:
+				object->asPath()->setPatternRotation(rotation);
+				object->asPath()->setPatternOrigin(MapCoord::fromNative(qFromLittleEndian<qint32>(record + 12), qFromLittleEndian<qint32>(record + 16)));
+				break;
+			case Object::Text:
+				object->asText()->setRotation(rotation);
+				object->asText()->setHorizontalAlignment(TextObject::HorizontalAlignment(record[1]));
+				object->asText()->setVerticalAlignment(TextObject::VerticalAlignment(record[2]));
+				object->asText()->setText(QString::fromUtf8(reinterpret_cast<const char*>(strings), int(text_size)));
+				break;
+			}
+			
+			auto pos = strings + text_size;
+			strings += strings_size;
+			for (quint32 j = 0; j < num_tags; ++j)
+			{
+				auto key = readString(pos, strings);
+				object->object_tags.insert(key, readString(pos, strings));
+			}
+			
+			auto const object_num_coords = qFromLittleEndian<quint32>(record + 20);
+			if (object_num_coords > quint64(coords_end - coord) / coord_record_size)
+				throw FileFormatException(tr("The file is corrupt."));
+			object->coords.clear();
+			object->coords.reserve(object_num_coords);
+			for (quint32 j = 0; j < object_num_coords; ++j, coord += coord_record_size)
+			{
+				auto map_coord = MapCoord::fromNative(qFromLittleEndian<qint32>(coord), qFromLittleEndian<qint32>(coord + 4));
+				map_coord.setFlags(MapCoord::Flags::Int(qFromLittleEndian<quint32>(coord + 8)));
+				object->coords.push_back(map_coord);
+			}
+			
+			if (type == Object::Path)
+				object->asPath()->recalculateParts();
+		}
+	}
+	catch (FileFormatException&)
+	{
+		for (auto object : objects)
+			delete object;
+		throw;
+	}
+	
+	return objects;
+}
@@ -0,0 +1,82 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_BINARY_FILE_FORMAT_H
+#define OPENORIENTEERING_BINARY_FILE_FORMAT_H
+
+#include <cstddef>
+
+#include <QtGlobal>
+
+#include "fileformats/file_format.h"
+
+class QIODevice;
+
+class Exporter;
+class Importer;
+class Map;
+class MapView;
+
+
+/**
+ * A binary container format for maps.
+ * 
+ * The container starts with a fixed-size header, followed by the map without
+ * any objects in the XML format. This part carries the colors, symbols,
+ * templates, and all other map properties. The objects follow in blocks of
+ * fixed-layout little-endian records. The coordinates are stored as raw arrays.
+ * Each block may be compressed.
+ * 
+ * Uncompressed blocks are read directly from the memory-mapped file.
+ */
+class BinaryFileFormat : public FileFormat
+{
+public:
+	/**
+	 * The version of the container which is created by this implementation.
+	 */
+	static const quint32 current_version;
+	
+	/**
+	 * Creates a new file format of type binary map.
+	 */
+	BinaryFileFormat();
+	
+	/**
+	 * Returns true if the file starts with the binary container's magic bytes.
+	 */
+	bool understands(const unsigned char* buffer, std::size_t sz) const override;
+	
+	/**
+	 * Creates an importer for binary map files.
+	 */
+	Importer* createImporter(QIODevice* stream, Map* map, MapView* view) const override;
+	
+	/**
+	 * Creates an exporter for binary map files.
+	 * 
+	 * The exporter's option "compressBlocks" enables compression of the object
+	 * blocks. It is disabled by default so that files can be memory-mapped.
+	 */
+	Exporter* createExporter(QIODevice* stream, Map* map, MapView* view) const override;
+};
+
+
+#endif
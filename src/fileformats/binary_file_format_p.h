@@ -0,0 +1,101 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_BINARY_FILE_FORMAT_P_H
+#define OPENORIENTEERING_BINARY_FILE_FORMAT_P_H
+
+#include <cstddef>
+#include <vector>
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QHash>
+
+#include "fileformats/xml_file_format_p.h"
+
+class QIODevice;
+
+class Map;
+class MapView;
+class Object;
+class Symbol;
+
+
+/**
+ * Map exporter for the binary container format.
+ * 
+ * The XML part is written by the XMLFileExporter, without the objects.
+ */
+class BinaryFileExporter : public XMLFileExporter
+{
+	Q_DECLARE_TR_FUNCTIONS(BinaryFileExporter)
+	
+public:
+	BinaryFileExporter(QIODevice* stream, Map* map, MapView* view);
+	~BinaryFileExporter() override;
+	
+	void doExport() override;
+	
+	/** Returns false: This exporter does not support snapshots. */
+	bool takeSnapshot() override;
+	
+protected:
+	/** Writes the map parts without objects. */
+	void exportMapParts() override;
+	
+	/** Returns the raw data of a block of objects from the given part. */
+	QByteArray encodeBlock(const std::vector<Object*>& objects, const QHash<const Symbol*, int>& symbol_indices) const;
+	
+	/** Writes the given data to the stream, or throws FileFormatException. */
+	void write(const char* data, qint64 size);
+};
+
+
+/**
+ * Map importer for the binary container format.
+ * 
+ * The XML part is read by the XMLFileImporter, before the objects.
+ */
+class BinaryFileImporter : public XMLFileImporter
+{
+	Q_DECLARE_TR_FUNCTIONS(BinaryFileImporter)
+	
+public:
+	BinaryFileImporter(QIODevice* stream, Map* map, MapView* view);
+	~BinaryFileImporter() override;
+	
+protected:
+	void import(bool load_symbols_only) override;
+	
+	/** Imports the objects from the blocks which follow the XML part. */
+	void importObjects(const uchar* data, const uchar* data_end, quint32 num_blocks);
+	
+	/**
+	 * Creates the objects from the raw data of a block.
+	 * 
+	 * This function does not modify the map, so it may be called concurrently
+	 * for different blocks. Throws FileFormatException on error.
+	 */
+	std::vector<Object*> decodeBlock(const QByteArray& raw, quint32 num_objects, quint32 num_coords, const std::vector<const Symbol*>& symbols) const;
+};
+
+
+#endif
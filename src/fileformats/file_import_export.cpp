@@ -171,3 +171,8 @@ void Importer::finishImport()
 // ### Exporter ###
 
 Exporter::~Exporter() = default;
+
+bool Exporter::takeSnapshot()
+{
+	return false;
+}
@@ -173,7 +173,8 @@ private:
  *     should also set default values for any options it will read. The base class
  *     will throw an exception if the exporter reads an option that does not have a value.
  *  2. setOption() will be called zero or more times to customize the options.
- *  3. doExport() will be called to perform the export.
+ *  3. takeSnapshot() may be called to capture the state of the map and view.
+ *  4. doExport() will be called to perform the export.
  */
 class Exporter : public ImportExport
 {
@@ -194,6 +195,17 @@ public:
 	 *  addWarning() with a translated, useful description of the issue.
 	 */
 	virtual void doExport() = 0;
+	
+	/** Captures the state of the map and view for a subsequent doExport().
+	 * 
+	 *  After successful return, doExport() does not access the map and the
+	 *  view. Thus it may run on another thread while the map is modified.
+	 *  This method may throw FileFormatException, like doExport().
+	 * 
+	 *  The default implementation returns false, meaning that this exporter
+	 *  does not support snapshots.
+	 */
+	virtual bool takeSnapshot();
 };
 
 
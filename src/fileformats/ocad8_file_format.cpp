@@ -298,7 +298,7 @@ void OCAD8FileImport::import(bool load_symbols_only)
 				{
 					Object *object = importObject(ocad_obj, part);
 					if (object) {
-						part->objects.push_back(object);
+						part->appendObject(object);
 					}
 				}
 			}
@@ -1094,7 +1094,7 @@ bool OCAD8FileImport::importRectangleObject(const OCADObject* ocad_object, MapPa
 	}
 	PathObject *border_path = new PathObject(rect.border_line, coords, map);
 	border_path->parts().front().setClosed(true, false);
-	part->objects.push_back(border_path);
+	part->appendObject(border_path);
 	
 	if (rect.has_grid && rect.cell_width > 0 && rect.cell_height > 0)
 	{
@@ -1115,7 +1115,7 @@ bool OCAD8FileImport::importRectangleObject(const OCADObject* ocad_object, MapPa
 			coords[1] = MapCoord(bottom_left_f + x * cell_width * right);
 			
 			PathObject *path = new PathObject(rect.inner_line, coords, map);
-			part->objects.push_back(path);
+			part->appendObject(path);
 		}
 		for (int y = 1; y < num_cells_y; ++y)
 		{
@@ -1123,7 +1123,7 @@ bool OCAD8FileImport::importRectangleObject(const OCADObject* ocad_object, MapPa
 			coords[1] = MapCoord(top_right_f + y * cell_height * down);
 			
 			PathObject *path = new PathObject(rect.inner_line, coords, map);
-			part->objects.push_back(path);
+			part->appendObject(path);
 		}
 		
 		// Create grid text
@@ -1155,7 +1155,7 @@ bool OCAD8FileImport::importRectangleObject(const OCADObject* ocad_object, MapPa
 					double position_x = (x + 0.07f) * cell_width;
 					double position_y = (y + 0.04f) * cell_height + rect.text->getFontMetrics().ascent() / rect.text->calculateInternalScaling() - rect.text->getFontSize();
 					object->setAnchorPosition(top_left_f + position_x * right + position_y * down);
-					part->objects.push_back(object);
+					part->appendObject(object);
 					
 					//pts[0].Y -= rectinfo.gridText.FontAscent - rectinfo.gridText.FontEmHeight;
 				}
@@ -25,15 +25,18 @@
 #include <algorithm>
 #include <cmath>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <type_traits>
 #include <vector>
 
+#include <QtConcurrentMap>
 #include <QBuffer>
 #include <QChar>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
+#include <QFileDevice>
 #include <QFileInfo>
 #include <QFontMetricsF>
 #include <QIODevice>
@@ -83,6 +86,19 @@ static QTextCodec* codecFromSettings()
 	return Util::codecForName(name);
 }	
 
+
+/**
+ * Unmaps the memory when the file import is finished.
+ * 
+ * The buffer which refers to the mapped memory is cleared first.
+ */
+struct Unmapper
+{
+	QFileDevice* file;
+	QByteArray* buffer;
+	void operator()(uchar* data) const { buffer->clear(); file->unmap(data); }
+};
+
 } // namespace
 
 
@@ -611,36 +627,64 @@ void OcdFileImport::resolveSubsymbols()
 
 void OcdFileImport::importObjects(const OcdFile<Ocd::FormatV8>& file)
 {
-	auto ocd_version = file.header()->version;
-	MapPart* part = map->getCurrentPart();
-	Q_ASSERT(part);
-	
+	std::vector<const Ocd::FormatV8::Object*> ocd_objects;
 	for (const auto& object_entry : file.objects())
 	{
 		if (object_entry.symbol)
-		{
-			if (auto object = importObject(file[object_entry], part, ocd_version))
-				part->addObject(object, part->getNumObjects());
-		}
+			ocd_objects.push_back(&file[object_entry]);
 	}
+	importObjects(ocd_objects, file.header()->version);
 }
 
 template< class F >
 void OcdFileImport::importObjects(const OcdFile< F >& file)
 {
-	auto ocd_version = file.header()->version;
-	MapPart* part = map->getCurrentPart();
-	Q_ASSERT(part);
-	
+	std::vector<const typename F::Object*> ocd_objects;
 	for (const auto& object_entry : file.objects())
 	{
 		if ( object_entry.symbol
 		     && object_entry.status != Ocd::ObjectDeleted
 		     && object_entry.status != Ocd::ObjectDeletedForUndo )
 		{
-			if (auto object = importObject(file[object_entry], part, ocd_version))
-				part->addObject(object, part->getNumObjects());
+			ocd_objects.push_back(&file[object_entry]);
+		}
+	}
+	importObjects(ocd_objects, file.header()->version);
+}
+
+template< class O >
+void OcdFileImport::importObjects(const std::vector<const O*>& ocd_objects, int ocd_version)
+{
+	MapPart* part = map->getCurrentPart();
+	Q_ASSERT(part);
+	
+	// The symbols are complete at this point. Objects which don't modify
+	// the importer or the symbols are converted in parallel chunks.
+	constexpr std::size_t chunk_size = 1000;
+	std::vector<std::size_t> chunks;
+	for (std::size_t i = 0; i < ocd_objects.size(); i += chunk_size)
+		chunks.push_back(i);
+	
+	std::vector<Object*> objects(ocd_objects.size(), nullptr);
+	std::vector<char> converted(ocd_objects.size(), false);
+	QtConcurrent::blockingMap(chunks, [&](std::size_t first) {
+		auto const last = std::min(first + chunk_size, ocd_objects.size());
+		for (auto i = first; i < last; ++i)
+		{
+			if (isIndependentObject(*ocd_objects[i]))
+			{
+				objects[i] = importObject(*ocd_objects[i], part, ocd_version);
+				converted[i] = true;
+			}
 		}
+	});
+	
+	// The remaining objects are converted in order, while merging.
+	for (std::size_t i = 0; i < ocd_objects.size(); ++i)
+	{
+		auto object = converted[i] ? objects[i] : importObject(*ocd_objects[i], part, ocd_version);
+		if (object)
+			part->addObject(object, part->getNumObjects());
 	}
 }
 
@@ -1562,7 +1606,7 @@ Object* OcdFileImport::importObject(const O& ocd_object, MapPart* part, int ocd_
 	Symbol* symbol = nullptr;
 	if (ocd_object.symbol >= 0)
 	{
-		symbol = symbol_index[ocd_object.symbol];
+		symbol = symbol_index.value(ocd_object.symbol);
 	}
 	
 	if (!symbol)
@@ -1655,6 +1699,30 @@ Object* OcdFileImport::importObject(const O& ocd_object, MapPart* part, int ocd_
 	return nullptr;
 }
 
+template< class O >
+bool OcdFileImport::isIndependentObject(const O& ocd_object) const
+{
+	auto const symbol = (ocd_object.symbol >= 0) ? symbol_index.value(ocd_object.symbol) : nullptr;
+	if (!symbol)
+		return false;
+	
+	switch (symbol->getType())
+	{
+	case Symbol::Point:
+		// Rotated objects may make the symbol rotatable.
+		return ocd_object.angle == 0 || symbol->asPoint()->isRotatable();
+	case Symbol::Line:
+		// Rectangles add the grid objects to the map part.
+		return !rectangle_info.contains(ocd_object.symbol);
+	case Symbol::Area:
+	case Symbol::Combined:
+		return true;
+	default:
+		// Text objects may add warnings, and they use fonts.
+		return false;
+	}
+}
+
 QString OcdFileImport::getObjectText(const Ocd::ObjectV8& ocd_object, int ocd_version) const
 {
 	auto input  = ocd_object.coords + ocd_object.num_items;
@@ -2056,8 +2124,24 @@ void OcdFileImport::import(bool load_symbols_only)
 {
 	Q_ASSERT(buffer.isEmpty());
 	
-	buffer.clear();
-	buffer.append(stream->readAll());
+	// Map the file if possible, so that the data isn't copied.
+	// Otherwise, read it into memory.
+	std::unique_ptr<uchar, Unmapper> mapping { nullptr, Unmapper{ nullptr, nullptr } };
+	if (auto file = qobject_cast<QFileDevice*>(stream))
+	{
+		auto const size = file->size() - file->pos();
+		if (size > 0 && size <= std::numeric_limits<int>::max())
+		{
+			mapping = std::unique_ptr<uchar, Unmapper>(file->map(file->pos(), size), Unmapper{ file, &buffer });
+			if (mapping)
+				buffer = QByteArray::fromRawData(reinterpret_cast<const char*>(mapping.get()), int(size));
+		}
+	}
+	if (!mapping)
+	{
+		buffer.clear();
+		buffer.append(stream->readAll());
+	}
 	if (buffer.isEmpty())
 		throw FileFormatException(Importer::tr("Could not read file: %1").arg(stream->errorString()));
 	
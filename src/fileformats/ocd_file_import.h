@@ -26,6 +26,7 @@
 #include <cstddef>
 #include <initializer_list>
 #include <limits>
+#include <vector>
 
 #include <QtGlobal>
 #include <QtMath>
@@ -219,6 +220,15 @@ protected:
 	template< class F >
 	void importObjects(const OcdFile< F >& file);
 	
+	/**
+	 * Imports the given objects into the current map part, in order.
+	 * 
+	 * Objects which can be converted independently are converted in parallel
+	 * chunks. All other objects are converted sequentially afterwards.
+	 */
+	template< class O >
+	void importObjects(const std::vector<const O*>& ocd_objects, int ocd_version);
+	
 	
 	template< class F >
 	void importTemplates(const OcdFile< F >& file);
@@ -298,6 +308,16 @@ protected:
 	template< class O >
 	Object* importObject(const O& ocd_object, MapPart* part, int ocd_version);
 	
+	/**
+	 * Returns true if importObject() may be called for this object
+	 * concurrently with other such objects.
+	 * 
+	 * This is the case for objects which neither modify the importer, the
+	 * symbols or the map, nor use fonts.
+	 */
+	template< class O >
+	bool isIndependentObject(const O& ocd_object) const;
+	
 	QString getObjectText(const Ocd::ObjectV8& ocd_object, int ocd_version) const;
 	
 	template< class O >
@@ -328,6 +348,7 @@ protected:
 	/// The locale is used for number formatting.
 	QLocale locale;
 	
+	/// The file data. During import(), it may refer to the mapped file.
 	QByteArray buffer;
 	
 	QScopedPointer< OCAD8FileImport > delegate;
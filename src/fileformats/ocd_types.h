@@ -515,7 +515,8 @@ public:
 	 * Constructs a new object for the file contents given by data.
 	 * 
 	 * We try to avoid copying the data by using the implicit sharing provided
-	 * by QByteArray.
+	 * by QByteArray. The data may also be raw data, e.g. from a memory-mapped
+	 * file, which must stay valid as long as this object is used.
 	 */
 	OcdFile(const QByteArray& data);
 	
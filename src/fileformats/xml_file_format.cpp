@@ -22,17 +22,21 @@
 #include "xml_file_format.h"
 #include "xml_file_format_p.h"
 
+#include <cstddef>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <QtGlobal>
 #include <QByteArray>
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDir>
 #include <QExplicitlySharedDataPointer>
 #include <QFileDevice>
 #include <QFileInfo>
 #include <QFlags>
+#include <QHash>
 #include <QIODevice>
 #include <QLatin1String>
 #include <QObject>
@@ -53,12 +57,14 @@
 #include "core/map_part.h"
 #include "core/map_printer.h"  // IWYU pragma: keep
 #include "core/map_view.h"
+#include "core/objects/object.h"
 #include "core/symbols/line_symbol.h"
 #include "core/symbols/point_symbol.h"
 #include "core/symbols/symbol.h"
 #include "fileformats/file_import_export.h"
 #include "templates/template.h"
 #include "undo/undo_manager.h"
+#include "util/deflate_device.h"
 #include "util/xml_stream_util.h"
 
 
@@ -94,7 +100,8 @@ XMLFileFormat::XMLFileFormat()
 bool XMLFileFormat::understands(const unsigned char *buffer, std::size_t sz) const
 {
 	static const uint len = qstrlen(magic_string);
-	return (sz >= len && qstrncmp(reinterpret_cast<const char*>(buffer), magic_string, len) == 0);
+	return (sz >= len && qstrncmp(reinterpret_cast<const char*>(buffer), magic_string, len) == 0)
+	       || InflateDevice::isCompressed(buffer, sz);
 }
 
 Importer *XMLFileFormat::createImporter(QIODevice* stream, Map *map, MapView *view) const
@@ -154,6 +161,7 @@ namespace literal
 	
 	static const QLatin1String parts("parts");
 	static const QLatin1String part("part");
+	static const QLatin1String objects("objects");
 	
 	static const QLatin1String templates("templates");
 	static const QLatin1String template_string("template");
@@ -181,6 +189,29 @@ namespace literal
 
 // ### XMLFileExporter definition ###
 
+/**
+ * The map state captured by XMLFileExporter::takeSnapshot().
+ * 
+ * The objects are copies, referring to copies of their symbols, so that they
+ * are not affected by any later changes to the map.
+ */
+struct XMLFileExporter::Snapshot
+{
+	struct Part
+	{
+		QString name;
+		std::vector<std::unique_ptr<Object>> objects;
+		std::vector<int> symbol_indices;
+	};
+	
+	QByteArray xml_data;   ///< The document without the map parts
+	qint64 parts_offset = 0;
+	std::size_t current_part_index = 0;
+	std::vector<Part> parts;
+	std::vector<std::unique_ptr<Symbol>> symbols;
+};
+
+
 XMLFileExporter::XMLFileExporter(QIODevice* stream, Map *map, MapView *view)
 : Exporter(stream, map, view),
   xml(stream)
@@ -189,13 +220,68 @@ XMLFileExporter::XMLFileExporter(QIODevice* stream, Map *map, MapView *view)
 	auto file = qobject_cast<const QFileDevice*>(stream);
 	bool auto_formatting = (file && file->fileName().contains(QLatin1String(".xmap")));
 	setOption(QString::fromLatin1("autoFormatting"), auto_formatting);
+	
+	// .xmap files are meant to be human-readable, and thus never compressed.
+	bool compressed = (file && !auto_formatting && Settings::getInstance().getSetting(Settings::General_CompressMapFiles).toBool());
+	setOption(QString::fromLatin1("compressed"), compressed);
 }
 
+XMLFileExporter::~XMLFileExporter() = default;
+
 void XMLFileExporter::doExport()
 {
 	if (option(QString::fromLatin1("autoFormatting")).toBool())
 		xml.setAutoFormatting(true);
 	
+	auto const target = xml.device();
+	std::unique_ptr<DeflateDevice> compressor;
+	if (option(QString::fromLatin1("compressed")).toBool())
+	{
+		compressor.reset(new DeflateDevice(target));
+		compressor->open(QIODevice::WriteOnly);
+		xml.setDevice(compressor.get());
+	}
+	
+	if (snapshot)
+		exportSnapshot();
+	else
+		exportDocument();
+	
+	if (compressor)
+	{
+		xml.setDevice(target);
+		if (!compressor->finish())
+			throw FileFormatException(compressor->errorString());
+	}
+}
+
+bool XMLFileExporter::takeSnapshot()
+{
+	// Splicing the parts into the document relies on the absence of indentation.
+	if (option(QString::fromLatin1("autoFormatting")).toBool())
+		return false;
+	
+	snapshot.reset(new Snapshot());
+	QBuffer buffer(&snapshot->xml_data);
+	buffer.open(QIODevice::WriteOnly);
+	auto const target = xml.device();
+	xml.setDevice(&buffer);
+	try
+	{
+		exportDocument();
+	}
+	catch (...)
+	{
+		xml.setDevice(target);
+		snapshot.reset();
+		throw;
+	}
+	xml.setDevice(target);
+	return true;
+}
+
+void XMLFileExporter::exportDocument()
+{
 #ifdef MAPPER_ENABLE_COMPATIBILITY
 	int current_version = XMLFileFormat::current_version;
 	bool retain_compatibility = Settings::getInstance().getSetting(Settings::General_RetainCompatiblity).toBool();
@@ -268,6 +354,42 @@ void XMLFileExporter::doExport()
 	xml.writeEndDocument();
 }
 
+void XMLFileExporter::exportSnapshot()
+{
+	auto const device = xml.device();
+	auto write = [device](const char* data, qint64 size) {
+		if (device->write(data, size) != size)
+			throw FileFormatException(device->errorString());
+	};
+	
+	auto const& data = snapshot->xml_data;
+	write(data.constData(), snapshot->parts_offset);
+	{
+		// Cf. exportMapParts() and MapPart::save()
+		XmlElementWriter parts_element(xml, literal::parts);
+		parts_element.writeAttribute(literal::count, snapshot->parts.size());
+		parts_element.writeAttribute(literal::current, snapshot->current_part_index);
+		for (auto const& part : snapshot->parts)
+		{
+			writeLineBreak(xml);
+			XmlElementWriter part_element(xml, literal::part);
+			part_element.writeAttribute(literal::name, part.name);
+			{
+				XmlElementWriter objects_element(xml, literal::objects);
+				objects_element.writeAttribute(literal::count, part.objects.size());
+				for (std::size_t i = 0; i < part.objects.size(); ++i)
+				{
+					writeLineBreak(xml);
+					part.objects[i]->save(xml, part.symbol_indices[i]);
+				}
+				writeLineBreak(xml);
+			}
+		}
+		writeLineBreak(xml);
+	}
+	write(data.constData() + snapshot->parts_offset, data.size() - snapshot->parts_offset);
+}
+
 void XMLFileExporter::exportGeoreferencing()
 {
 	map->getGeoreferencing().save(xml);
@@ -372,6 +494,44 @@ void XMLFileExporter::exportSymbols()
 
 void XMLFileExporter::exportMapParts()
 {
+	if (snapshot)
+	{
+		// Capture the parts, to be spliced into the document by exportSnapshot().
+		snapshot->parts_offset = xml.device()->pos();
+		snapshot->current_part_index = map->current_part_index;
+		
+		QHash<const Symbol*, Symbol*> symbol_copies;
+		snapshot->parts.resize(std::size_t(map->getNumParts()));
+		for (std::size_t i = 0; i < snapshot->parts.size(); ++i)
+		{
+			auto const part = map->getPart(int(i));
+			auto& part_snapshot = snapshot->parts[i];
+			part_snapshot.name = part->getName();
+			part_snapshot.objects.reserve(std::size_t(part->getNumObjects()));
+			part_snapshot.symbol_indices.reserve(std::size_t(part->getNumObjects()));
+			for (int j = 0; j < part->getNumObjects(); ++j)
+			{
+				auto const object = part->getObject(j);
+				auto const symbol = object->getSymbol();
+				auto copy = std::unique_ptr<Object>(object->duplicate());
+				auto const index = map->findSymbolIndex(symbol);
+				if (index >= 0)
+				{
+					auto& symbol_copy = symbol_copies[symbol];
+					if (!symbol_copy)
+					{
+						symbol_copy = symbol->duplicate();
+						snapshot->symbols.emplace_back(symbol_copy);
+					}
+					copy->setSymbol(symbol_copy, true);
+				}
+				part_snapshot.objects.push_back(std::move(copy));
+				part_snapshot.symbol_indices.push_back(index);
+			}
+		}
+		return;
+	}
+	
 	XmlElementWriter parts_element(xml, literal::parts);
 	
 	auto num_parts = std::size_t(map->getNumParts());
@@ -482,9 +642,17 @@ XMLFileImporter::XMLFileImporter(QIODevice* stream, Map *map, MapView *view)
 : Importer(stream, map, view),
   xml(stream)
 {
-	//NOP
+	auto const header = stream->peek(3);
+	if (InflateDevice::isCompressed(reinterpret_cast<const unsigned char*>(header.constData()), std::size_t(header.size())))
+	{
+		decompressor.reset(new InflateDevice(stream));
+		decompressor->open(QIODevice::ReadOnly);
+		xml.setDevice(decompressor.get());
+	}
 }
 
+XMLFileImporter::~XMLFileImporter() = default;
+
 void XMLFileImporter::addWarningUnsupportedElement()
 {
 	addWarning(tr("Unsupported element: %1 (line %2 column %3)").
@@ -601,6 +769,9 @@ void XMLFileImporter::importElements(bool load_symbols_only)
 		}
 	}
 	
+	if (decompressor && decompressor->hasError())
+		throw FileFormatException(decompressor->errorString());
+	
 	if (xml.error())
 		throw FileFormatException(
 		        tr("Error at line %1 column %2: %3")
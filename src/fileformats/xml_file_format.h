@@ -41,7 +41,8 @@ public:
 	 */
 	XMLFileFormat();
 	
-	/** @brief Returns true if the file starts with the character sequence "<?xml".
+	/** @brief Returns true if the file starts with the character sequence "<?xml",
+	 *         or with the magic bytes of gzip compressed data.
 	 * 
 	 *  @todo Needs to deal with different encodings. Provide test cases.
 	 */
@@ -52,6 +53,9 @@ public:
 	Importer *createImporter(QIODevice* stream, Map *map, MapView *view) const override;
 	
 	/** @brief Creates an exporter for XML files.
+	 * 
+	 *  The exporter's option "compressed" enables gzip compression of the
+	 *  output. For .omap files, the default is taken from the settings.
 	 */
 	Exporter *createExporter(QIODevice* stream, Map *map, MapView *view) const override;
 	
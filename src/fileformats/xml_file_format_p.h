@@ -21,6 +21,8 @@
 #ifndef OPENORIENTEERING_FILE_FORMAT_XML_P_H
 #define OPENORIENTEERING_FILE_FORMAT_XML_P_H
 
+#include <memory>
+
 #include <QCoreApplication>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
@@ -28,6 +30,8 @@
 #include "core/symbols/symbol.h"
 #include "fileformats/file_import_export.h"
 
+class InflateDevice;
+
 
 /** Map exporter for the xml based map format. */
 class XMLFileExporter : public Exporter
@@ -36,23 +40,41 @@ class XMLFileExporter : public Exporter
 	
 public:
 	XMLFileExporter(QIODevice* stream, Map *map, MapView *view);
-	~XMLFileExporter() override {}
+	~XMLFileExporter() override;
 	
 	void doExport() override;
 	
+	/**
+	 * Captures the map state, for a doExport() on another thread.
+	 * 
+	 * Everything but the map parts is serialized immediately. The objects are
+	 * copied, together with the symbols they refer to. Returns false when
+	 * auto-formatting is enabled.
+	 */
+	bool takeSnapshot() override;
+	
 protected:
+	/** Writes the complete document. */
+	void exportDocument();
+	
+	/** Writes the complete document from the snapshot. */
+	void exportSnapshot();
+	
 	void exportGeoreferencing();
 	void exportColors();
 	void exportSymbols();
-	void exportMapParts();
+	virtual void exportMapParts();
 	void exportTemplates();
 	void exportView();
 	void exportPrint();
 	void exportUndo();
 	void exportRedo();
 	
-private:
 	QXmlStreamWriter xml;
+	
+private:
+	struct Snapshot;
+	std::unique_ptr<Snapshot> snapshot;
 };
 
 
@@ -63,7 +85,7 @@ class XMLFileImporter : public Importer
 	
 public:
 	XMLFileImporter(QIODevice* stream, Map *map, MapView *view);
-	~XMLFileImporter() override {}
+	~XMLFileImporter() override;
 
 protected:
 	void import(bool load_symbols_only) override;
@@ -82,6 +104,7 @@ protected:
 	void importUndo();
 	void importRedo();
 	
+	std::unique_ptr<InflateDevice> decompressor;
 	QXmlStreamReader xml;
 	SymbolDictionary symbol_dict;
 	bool georef_offset_adjusted;
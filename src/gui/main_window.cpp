@@ -548,6 +548,11 @@ void MainWindow::keyReleaseEvent(QKeyEvent* event)
 
 bool MainWindow::showSaveOnCloseDialog()
 {
+	// A file which is still being written must be complete before closing.
+	// If writing fails, the map keeps its unsaved changes.
+	if (controller)
+		controller->finishSaving();
+	
 	if (has_opened_file && (has_unsaved_changes || has_autosave_conflict))
 	{
 		// Show the window in case it is minimized
@@ -583,7 +588,7 @@ bool MainWindow::showSaveOnCloseDialog()
 			break;
 			
 		case QMessageBox::Save:
-			if (!save())
+			if (!save() || !controller->finishSaving())
 				return false;
 			// fall through 
 			
@@ -942,7 +947,7 @@ Autosave::AutosaveResult MainWindow::autosave()
 	else
 	{
 		showStatusBarMessage(tr("Autosaving..."), 0);
-		if (controller->exportTo(autosavePath(currentPath())))
+		if (controller->autosave(autosavePath(currentPath())))
 		{
 			// Success
 			clearStatusBarMessage();
@@ -982,20 +987,37 @@ bool MainWindow::savePath(const QString &path)
 	if (!controller->save(path))
 		return false;
 	
+	// Asynchronous saving is completed in saveFinished().
+	if (!controller->isSaving())
+	{
+		setHasUnsavedChanges(false);
+		saveFinished(path, true);
+	}
+	
+	return true;
+}
+
+void MainWindow::saveFinished(const QString& path, bool success)
+{
+	if (!success)
+		return;
+	
 	setMostRecentlyUsedFile(path);
 	
-	setHasAutosaveConflict(false);
-	removeAutosaveFile();
+	// The autosave file may hold changes made while writing the file.
+	auto const remove_autosave_file = !has_unsaved_changes;
+	if (remove_autosave_file)
+	{
+		setHasAutosaveConflict(false);
+		removeAutosaveFile();
+	}
 	
 	if (path != currentPath())
 	{
 		setCurrentPath(path);
-		removeAutosaveFile();
+		if (remove_autosave_file)
+			removeAutosaveFile();
 	}
-	
-	setHasUnsavedChanges(false);
-	
-	return true;
 }
 
 QString MainWindow::getOpenFileName(QWidget* parent, const QString& title, FileFormat::FileTypes types)
@@ -198,6 +198,15 @@ public:
 	 */ 
 	bool savePath(const QString &path);
 	
+	/** Completes saving when the file has been written.
+	 *  When the controller writes the file asynchronously, this must be
+	 *  called when writing is finished. Until then, the autosave file is
+	 *  kept, and the window cannot be closed.
+	 *  @param path the path where the file was saved.
+	 *  @param success true if the file was written successfully.
+	 */
+	void saveFinished(const QString& path, bool success);
+	
 	/** Shows the open file dialog for the given file type(s) and returns the chosen file
 	 *  or an empty string if the dialog is aborted.
 	 */
@@ -44,6 +44,21 @@ bool MainWindowController::exportTo(const QString& path, const FileFormat* forma
 	return false;
 }
 
+bool MainWindowController::isSaving() const
+{
+	return false;
+}
+
+bool MainWindowController::finishSaving()
+{
+	return true;
+}
+
+bool MainWindowController::autosave(const QString& path)
+{
+	return exportTo(path);
+}
+
 bool MainWindowController::load(const QString& path, QWidget* dialog_parent)
 {
 	Q_UNUSED(path);
@@ -48,6 +48,17 @@ public:
 	 *  @return true if saving was sucessful, false on errors
 	 */
 	virtual bool save(const QString& path);
+	
+	/** Returns true while a file started by save() is still being written.
+	 *  The default implementation returns false.
+	 */
+	virtual bool isSaving() const;
+	
+	/** Waits until a file started by save() is written completely.
+	 *  The default implementation returns true.
+	 *  @return false if writing the file failed
+	 */
+	virtual bool finishSaving();
 
 	/** Export to a file, but don't change modified state
 	 *  with regard to the original file.
@@ -56,6 +67,13 @@ public:
 	 *  @return true if saving was sucessful, false on errors
 	 */
 	virtual bool exportTo(const QString& path, const FileFormat* format = nullptr);
+	
+	/** Autosave to a file, without changing the modified state.
+	 *  The default implementation calls exportTo().
+	 *  @param path the path of the autosave file
+	 *  @return true if saving was sucessful, false on errors
+	 */
+	virtual bool autosave(const QString& path);
 
 	/** Load from a file.
 	 *  @param path the path to load from
@@ -29,6 +29,7 @@
 #include <QFormLayout>
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QProgressDialog>
 #include <QRadioButton>
 #include <QSpacerItem>
 
@@ -159,6 +160,15 @@ void RotateMapDialog::okClicked()
 	else if (center_other_radio->isChecked())
 		center = MapCoord(other_x_edit->value(), -1 * other_y_edit->value());
 	
-	map->rotateMap(rotation, center, adjust_georeferencing_check->isChecked(), adjust_declination_check->isChecked(), adjust_templates_check->isChecked());
-	accept();
+	QProgressDialog progress(tr("Rotating map..."), tr("Cancel"), 0, 0, this);
+	progress.setWindowModality(Qt::ApplicationModal);
+	progress.setMinimumDuration(1000);
+	auto const observer = [&progress](int value, int maximum) {
+		progress.setMaximum(maximum);
+		progress.setValue(value);
+		return !progress.wasCanceled();
+	};
+	
+	if (map->rotateMap(rotation, center, adjust_georeferencing_check->isChecked(), adjust_declination_check->isChecked(), adjust_templates_check->isChecked(), observer))
+		accept();
 }
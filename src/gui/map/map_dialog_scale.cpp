@@ -26,6 +26,7 @@
 #include <QFormLayout>
 #include <QLabel>
 #include <QLineEdit>
+#include <QProgressDialog>
 #include <QRadioButton>
 
 #include "core/georeferencing.h"
@@ -136,6 +137,17 @@ void ScaleMapDialog::okClicked()
 	else if (center_other_radio->isChecked())
 		center = MapCoord(other_x_edit->value(), -1 * other_y_edit->value());
 	
-	map->changeScale(scale, center, adjust_symbols_check->isChecked(), adjust_objects_check->isChecked(), adjust_georeferencing_check->isChecked(), adjust_templates_check->isChecked());
-	accept();
+	// Scaled symbols cannot be restored, so there is no cancel button then.
+	auto const adjust_symbols = adjust_symbols_check->isChecked();
+	QProgressDialog progress(tr("Scaling map..."), adjust_symbols ? QString{} : tr("Cancel"), 0, 0, this);
+	progress.setWindowModality(Qt::ApplicationModal);
+	progress.setMinimumDuration(1000);
+	auto const observer = [&progress](int value, int maximum) {
+		progress.setMaximum(maximum);
+		progress.setValue(value);
+		return !progress.wasCanceled();
+	};
+	
+	if (map->changeScale(scale, center, adjust_symbols, adjust_objects_check->isChecked(), adjust_georeferencing_check->isChecked(), adjust_templates_check->isChecked(), observer))
+		accept();
 }
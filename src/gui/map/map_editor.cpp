@@ -28,6 +28,7 @@
 #include <iterator>
 #include <limits>
 #include <set>
+#include <utility>
 #include <vector>
 // IWYU pragma: no_include <ext/alloc_traits.h>
 
@@ -72,6 +73,7 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QPoint>
+#include <QProgressDialog>
 #include <QPushButton>
 #include <QRect>
 #include <QRectF>
@@ -96,6 +98,7 @@
 #endif
 
 #include "settings.h"
+#include "core/autosave_journal.h"
 #include "core/georeferencing.h"
 #include "core/map.h"
 #include "core/map_coord.h"
@@ -103,6 +106,7 @@
 #include "core/map_view.h"
 #include "core/objects/boolean_tool.h"
 #include "core/objects/object.h"
+#include "core/objects/object_clipboard.h"
 #include "core/objects/object_operations.h"
 #include "core/symbols/point_symbol.h"
 #include "core/symbols/area_symbol.h"
@@ -252,6 +256,8 @@ MapEditorController::MapEditorController(OperatingMode mode, Map* map, MapView*
 	
 	cut_hole_menu = nullptr;
 	
+	connect(&Settings::getInstance(), &Settings::settingsChanged, this, &MapEditorController::updateUndoMemoryBudget);
+	
 	if (map)
 		setMapAndView(map, map_view ? map_view : new MapView(this, map));
 	
@@ -459,7 +465,7 @@ void MapEditorController::setEditingInProgress(bool value)
 
 bool MapEditorController::isEditingInProgress() const
 {
-	return editing_in_progress;
+	return editing_in_progress || (map && map->isProcessingObjects());
 }
 
 
@@ -546,8 +552,12 @@ bool MapEditorController::save(const QString& path)
 			QMessageBox::warning(window, tr("Editing in progress"), tr("The map is currently being edited. Please finish the edit operation before saving."));
 			return false;
 		}
-		bool success = map->saveTo(path, main_view);
+		bool success = map->saveToAsync(path, main_view);
 		if (success)
+			autosave_journal->setBaseFile(path);
+		if (success && map->isSaving())
+			window->showStatusBarMessage(tr("Saving..."), 0);
+		else if (success)
 			window->showStatusBarMessage(tr("Map saved"), 1000);
 		return success;
 	}
@@ -555,6 +565,16 @@ bool MapEditorController::save(const QString& path)
 		return false;
 }
 
+bool MapEditorController::isSaving() const
+{
+	return map && map->isSaving();
+}
+
+bool MapEditorController::finishSaving()
+{
+	return !map || map->finishSaving();
+}
+
 bool MapEditorController::exportTo(const QString& path, const FileFormat* format)
 {
 	if (map && !editing_in_progress)
@@ -565,6 +585,16 @@ bool MapEditorController::exportTo(const QString& path, const FileFormat* format
 	return false;
 }
 
+bool MapEditorController::autosave(const QString& path)
+{
+	if (map && !editing_in_progress)
+	{
+		return autosave_journal->write(path, main_view);
+	}
+	
+	return false;
+}
+
 bool MapEditorController::load(const QString& path, QWidget* dialog_parent)
 {
 	if (!dialog_parent)
@@ -580,6 +610,7 @@ bool MapEditorController::load(const QString& path, QWidget* dialog_parent)
 	if (success)
 	{
 		setMapAndView(map, main_view);
+		autosave_journal->setBaseFile(path);
 	}
 	else
 	{
@@ -605,6 +636,13 @@ void MapEditorController::attach(MainWindow* window)
 		window->setHasUnsavedChanges(map->hasUnsavedChanges());
 	}
 	connect(map, &Map::hasUnsavedChanged, window, &MainWindow::setHasUnsavedChanges);
+	connect(map, &Map::saveFinished, window, [window](const QString& path, bool success) {
+		if (success)
+			window->showStatusBarMessage(tr("Map saved"), 1000);
+		else
+			window->clearStatusBarMessage();
+		window->saveFinished(path, success);
+	});
 	
 #ifdef Q_OS_ANDROID
 	QAndroidJniObject::callStaticMethod<void>("org/openorienteering/mapper/MapperActivity",
@@ -1663,9 +1701,10 @@ void MapEditorController::copy()
 		return;
 	}
 	
-	// Put buffer into clipboard
+	// Put buffer into clipboard, together with the fast format for Mapper
 	auto mime_data = new QMimeData();
 	mime_data->setData(MimeType::OpenOrienteeringObjects(), buffer.data());
+	mime_data->setData(ObjectClipboard::mimeType(), ObjectClipboard::save(*map, map->selectedObjects()));
 	QApplication::clipboard()->setMimeData(mime_data);
 	
 	// Show message
@@ -1677,14 +1716,33 @@ void MapEditorController::paste()
 {
 	if (editing_in_progress)
 		return;
-	if (!QApplication::clipboard()->mimeData()->hasFormat(MimeType::OpenOrienteeringObjects()))
+	auto const mime_data = QApplication::clipboard()->mimeData();
+	if (!mime_data->hasFormat(MimeType::OpenOrienteeringObjects()))
 	{
 		QMessageBox::warning(nullptr, tr("Error"), tr("There are no objects in clipboard which could be pasted!"));
 		return;
 	}
 	
+	// Objects copied from a map with the same scale can be recreated directly.
+	QRectF extent;
+	auto objects = ObjectClipboard::load(mime_data->data(ObjectClipboard::mimeType()), *map, extent);
+	if (!objects.empty())
+	{
+		// Move the objects so that their bounding box center is at the viewport center.
+		auto offset = main_view->center() - extent.center();
+		for (auto object : objects)
+			object->move(offset);
+		
+		auto const num_objects = int(objects.size());
+		map->getCurrentPart()->importObjects(std::move(objects), true);
+		map->ensureVisibilityOfSelectedObjects(Map::FullVisibility);
+		
+		window->showStatusBarMessage(tr("Pasted %n object(s)", nullptr, num_objects), 2000);
+		return;
+	}
+	
 	// Get buffer from clipboard
-	QByteArray byte_array = QApplication::clipboard()->mimeData()->data(MimeType::OpenOrienteeringObjects());
+	QByteArray byte_array = mime_data->data(MimeType::OpenOrienteeringObjects());
 	QBuffer buffer(&byte_array);
 	buffer.open(QIODevice::ReadOnly);
 	
@@ -2385,6 +2443,15 @@ void MapEditorController::undoStepAvailabilityChanged()
 	clear_undo_redo_history_act->setEnabled(undo_act->isEnabled() || redo_act->isEnabled());
 }
 
+void MapEditorController::updateUndoMemoryBudget()
+{
+	if (!map)
+		return;
+	
+	auto const budget_mib = Settings::getInstance().getSetting(Settings::General_UndoMemoryBudget).toInt();
+	map->undoManager().setMemoryBudget(std::size_t(qMax(0, budget_mib)) << 20);
+}
+
 void MapEditorController::clipboardChanged(QClipboard::Mode mode)
 {
 	if (mode == QClipboard::Clipboard)
@@ -2574,10 +2641,7 @@ void MapEditorController::switchSymbolClicked()
 	if (split_up)	
 	{
 		map->clearObjectSelection(false);
-		for (auto object : old_objects)
-		{
-			map->deleteObject(object, true);
-		}
+		map->getCurrentPart()->deleteObjects(begin(old_objects), end(old_objects), true);
 		for (auto object : new_objects)
 		{
 			map->addObject(object);
@@ -2750,12 +2814,14 @@ void MapEditorController::selectNothing()
 
 void MapEditorController::invertSelection()
 {
-	auto selection = Map::ObjectSelection{ map->selectedObjects() };
-	map->clearObjectSelection(false);
-	map->getCurrentPart()->applyOnAllObjects([this, &selection](Object* object) {
-		if (selection.find(object) == end(selection))
-			map->addObjectToSelection(object, false);
+	std::vector<Object*> unselected_objects;
+	map->getCurrentPart()->applyOnAllObjects([this, &unselected_objects](Object* object) {
+		if (!map->isObjectSelected(object))
+			unselected_objects.push_back(object);
 	});
+	map->clearObjectSelection(false);
+	for (auto object : unselected_objects)
+		map->addObjectToSelection(object, false);
 	
 	if (map->getCurrentPart()->getNumObjects() > 0)
 	{
@@ -3069,7 +3135,18 @@ void MapEditorController::measureClicked(bool checked)
 
 void MapEditorController::booleanUnionClicked()
 {
-	if (!BooleanTool(BooleanTool::Union, map).executePerSymbol())
+	// The progress dialog runs the event loop while the map is busy.
+	QProgressDialog progress(tr("Unifying areas..."), tr("Cancel"), 0, 0, window);
+	progress.setWindowModality(Qt::ApplicationModal);
+	progress.setMinimumDuration(1000);
+	
+	BooleanTool tool(BooleanTool::Union, map);
+	tool.setProgressObserver([&progress](int value, int maximum) {
+		progress.setMaximum(maximum);
+		progress.setValue(value);
+		return !progress.wasCanceled();
+	});
+	if (!tool.executePerSymbol() && !progress.wasCanceled())
 		QMessageBox::warning(window, tr("Error"), tr("Unification failed."));
 }
 
@@ -3105,6 +3182,7 @@ void MapEditorController::convertToCurvesClicked()
 	auto undo_step = new ReplaceObjectsUndoStep(map);
 	MapPart* part = map->getCurrentPart();
 	
+	std::vector<PathObject*> converted;
 	for (const auto object : map->selectedObjects())
 	{
 		if (object->getType() != Object::Path)
@@ -3115,13 +3193,17 @@ void MapEditorController::convertToCurvesClicked()
 		if (path->convertToCurves(&undo_duplicate))
 		{
 			undo_step->addObject(part->findObjectIndex(path), undo_duplicate);
-			// TODO: make threshold configurable?
-			const auto threshold = 0.08;
-			path->simplify(nullptr, threshold);
+			converted.push_back(path);
 		}
-		path->update();
 	}
 	
+	// TODO: make threshold configurable?
+	const auto threshold = 0.08;
+	PathObject::simplifyAll(converted, nullptr, threshold);
+	
+	for (const auto object : map->selectedObjects())
+		object->update();
+	
 	if (undo_step->isEmpty())
 		delete undo_step;
 	else
@@ -3137,19 +3219,24 @@ void MapEditorController::simplifyPathClicked()
 	// TODO: make threshold configurable!
 	const auto threshold = 0.1;
 	
-	auto undo_step = new ReplaceObjectsUndoStep(map);
+	auto undo_step = new ModifyObjectsUndoStep(map);
 	MapPart* part = map->getCurrentPart();
 	
+	std::vector<PathObject*> paths;
 	for (const auto object : map->selectedObjects())
 	{
-		if (object->getType() != Object::Path)
-			continue;
-		
-		PathObject* path = object->asPath();
-		PathObject* undo_duplicate = nullptr;
-		if (path->simplify(&undo_duplicate, threshold))
-			undo_step->addObject(part->findObjectIndex(path), undo_duplicate);
-		path->update();
+		if (object->getType() == Object::Path)
+			paths.push_back(object->asPath());
+	}
+	
+	std::vector<PathObject*> undo_duplicates;
+	PathObject::simplifyAll(paths, &undo_duplicates, threshold);
+	
+	for (std::size_t i = 0; i < paths.size(); ++i)
+	{
+		if (undo_duplicates[i])
+			undo_step->addObject(part->findObjectIndex(paths[i]), undo_duplicates[i]);
+		paths[i]->update();
 	}
 	
 	if (undo_step->isEmpty())
@@ -3782,6 +3869,7 @@ void MapEditorController::setMapAndView(Map* map, MapView* map_view)
 	
 	this->map = map;
 	this->main_view = map_view;
+	autosave_journal = std::make_unique<AutosaveJournal>(map);
 	
 	connect(&map->undoManager(), &UndoManager::canRedoChanged, this, &MapEditorController::undoStepAvailabilityChanged);
 	connect(&map->undoManager(), &UndoManager::canUndoChanged, this, &MapEditorController::undoStepAvailabilityChanged);
@@ -3795,6 +3883,8 @@ void MapEditorController::setMapAndView(Map* map, MapView* map_view)
 	connect(map, &Map::mapPartChanged, this, &MapEditorController::updateMapPartsUI);
 	connect(map, &Map::mapPartDeleted, this, &MapEditorController::updateMapPartsUI);
 	
+	updateUndoMemoryBudget();
+	
 	if (symbol_widget)
 	{
 		delete symbol_widget;
@@ -49,6 +49,7 @@ class QToolButton;
 class QWidget;
 
 class ActionGridBar;
+class AutosaveJournal;
 class CompassDisplay;
 class EditorDockWidget;
 class FileFormat;
@@ -229,8 +230,14 @@ public:
 	/** Override from MainWindowController */
 	bool save(const QString& path) override;
 	/** Override from MainWindowController */
+	bool isSaving() const override;
+	/** Override from MainWindowController */
+	bool finishSaving() override;
+	/** Override from MainWindowController */
 	bool exportTo(const QString& path, const FileFormat* format = nullptr) override;
 	/** Override from MainWindowController */
+	bool autosave(const QString& path) override;
+	/** Override from MainWindowController */
 	bool load(const QString& path, QWidget* dialog_parent = nullptr) override;
 	
 	/** Override from MainWindowController */
@@ -349,6 +356,8 @@ public slots:
 	
 	/** Adjusts the enabled state of the undo / redo actions. */
 	void undoStepAvailabilityChanged();
+	/** Applies the undo memory limit from the settings to the map's undo manager. */
+	void updateUndoMemoryBudget();
 	/** Adjusts the enabled state of the paste action (specific signature required). */
 	void clipboardChanged(QClipboard::Mode mode);
 	/** Adjusts the enabled state of the paste action. */
@@ -603,6 +612,7 @@ private:
 	Map* map;
 	MapView* main_view;
 	MapWidget* map_widget;
+	std::unique_ptr<AutosaveJournal> autosave_journal;
 	
 	OperatingMode mode;
 	bool mobile_mode;
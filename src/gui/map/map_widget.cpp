@@ -794,9 +794,13 @@ void MapWidget::paintEvent(QPaintEvent* event)
 	
 	QTransform transform = painter.worldTransform();
 	
+	// While objects are processed in worker threads, only the caches are drawn.
+	auto const map_busy = view->getMap()->isProcessingObjects();
+	
 	// Update all dirty caches
 	// TODO: It would be an idea to do these updates in a background thread and use the old caches in the meantime
-	updateAllDirtyCaches();
+	if (!map_busy)
+		updateAllDirtyCaches();
 	
 	QRect target = exposed;
 	if (pinching)
@@ -859,10 +863,10 @@ void MapWidget::paintEvent(QPaintEvent* event)
 	//painter.setClipRect(exposed);
 	
 	// Show current drawings
-	if (activity_dirty_rect.isValid())
+	if (activity_dirty_rect.isValid() && !map_busy)
 		activity->draw(&painter, this);
 	
-	if (drawing_dirty_rect.isValid())
+	if (drawing_dirty_rect.isValid() && !map_busy)
 		tool->draw(&painter, this);
 	
 	
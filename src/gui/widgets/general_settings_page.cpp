@@ -134,6 +134,13 @@ GeneralSettingsPage::GeneralSettingsPage(QWidget* parent)
 	undo_check = new QCheckBox(tr("Save undo/redo history"));
 	layout->addRow(undo_check);
 	
+	compress_check = new QCheckBox(tr("Compress %1 files").arg(QLatin1String(".omap")));
+	layout->addRow(compress_check);
+	
+	undo_memory_edit = Util::SpinBox::create(0, 16384, tr("MiB", "unit mebibyte"), 16);
+	undo_memory_edit->setSpecialValueText(tr("No limit"));
+	layout->addRow(tr("Undo/redo history memory limit:"), undo_memory_edit);
+	
 	autosave_check = new QCheckBox(tr("Save information for automatic recovery"));
 	layout->addRow(autosave_check);
 	
@@ -232,6 +239,8 @@ void GeneralSettingsPage::apply()
 	setSetting(Settings::General_NewOcd8Implementation, ocd_importer_check->isChecked());
 	setSetting(Settings::General_RetainCompatiblity, compatibility_check->isChecked());
 	setSetting(Settings::General_SaveUndoRedo, undo_check->isChecked());
+	setSetting(Settings::General_CompressMapFiles, compress_check->isChecked());
+	setSetting(Settings::General_UndoMemoryBudget, undo_memory_edit->value());
 	setSetting(Settings::General_PixelsPerInch, ppi_edit->value());
 	
 	auto encoding = encoding_box->currentText().toLatin1();
@@ -292,6 +301,8 @@ void GeneralSettingsPage::updateWidgets()
 	tips_visible_check->setChecked(getSetting(Settings::HomeScreen_TipsVisible).toBool());
 	compatibility_check->setChecked(getSetting(Settings::General_RetainCompatiblity).toBool());
 	undo_check->setChecked(getSetting(Settings::General_SaveUndoRedo).toBool());
+	compress_check->setChecked(getSetting(Settings::General_CompressMapFiles).toBool());
+	undo_memory_edit->setValue(getSetting(Settings::General_UndoMemoryBudget).toInt());
 	int autosave_interval = getSetting(Settings::General_AutosaveInterval).toInt();
 	autosave_check->setChecked(autosave_interval > 0);
 	autosave_interval_edit->setEnabled(autosave_interval > 0);
@@ -83,6 +83,8 @@ private:
 	
 	QCheckBox* compatibility_check;
 	QCheckBox* undo_check;
+	QCheckBox* compress_check;
+	QSpinBox*  undo_memory_edit;
 	QCheckBox* autosave_check;
 	QSpinBox*  autosave_interval_edit;
 	
@@ -129,6 +129,8 @@ Settings::Settings()
 	
 	registerSetting(General_RetainCompatiblity, "retainCompatiblity", false);
 	registerSetting(General_SaveUndoRedo, "saveUndoRedo", true);
+	registerSetting(General_CompressMapFiles, "compressMapFiles", false);
+	registerSetting(General_UndoMemoryBudget, "undoMemoryBudget", 256); // unit: MiB
 	registerSetting(General_AutosaveInterval, "autosave", 15); // unit: minutes
 	registerSetting(General_Language, "language", QLocale::system().name().left(2));
 	registerSetting(General_PixelsPerInch, "pixelsPerInch", ppi);
@@ -58,6 +58,8 @@ public:
 		ActionGridBar_ButtonSizeMM,
 		General_RetainCompatiblity,
 		General_SaveUndoRedo,
+		General_CompressMapFiles,
+		General_UndoMemoryBudget,
 		General_AutosaveInterval,
 		General_Language,
 		General_PixelsPerInch,
@@ -230,7 +230,7 @@ void CutHoleTool::pathFinished(PathObject* hole_path)
 		out_objects.pop_back();
 	}
 	
-	auto undo_step = new ReplaceObjectsUndoStep(map());
+	auto undo_step = new ModifyObjectsUndoStep(map());
 	undo_step->addObject(edited_object, undo_duplicate);
 	map()->push(undo_step);
 	map()->setObjectsDirty();
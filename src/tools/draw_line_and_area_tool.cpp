@@ -252,7 +252,7 @@ void DrawLineAndAreaTool::finishDrawing(PathObject* append_to_object)
 			map()->addObjectToSelection(append_to_object, true);
 			
 			auto cur_part = map()->getCurrentPart();
-			auto undo_step = new ReplaceObjectsUndoStep(map());
+			auto undo_step = new ModifyObjectsUndoStep(map());
 			undo_step->addObject(cur_part->findObjectIndex(append_to_object), undo_duplicate);
 			map()->push(undo_step);
 		}
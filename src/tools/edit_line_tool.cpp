@@ -34,6 +34,7 @@
 #include <QKeyEvent>
 #include <QLocale>
 #include <QMouseEvent>
+#include <QPainter>
 #include <QPoint>
 #include <QPointF>
 #include <QPointer>
@@ -225,6 +226,9 @@ void EditLineTool::dragStart()
 		{
 			for (auto object : map->selectedObjects())
 				object_mover->addObject(object);
+			
+			// Moving many objects as a whole: show a cheap raster preview.
+			startDragPreview();
 		}
 		else
 		{
@@ -285,17 +289,15 @@ void EditLineTool::dragMove()
 			handle_offset = MapCoordF(0, 0);
 		}
 		
-		qint32 dx, dy;
-		object_mover->move(constrained_pos_map, false, &dx, &dy);
-		if (highlight_object)
+		if (dragPreviewActive())
 		{
-			highlight_renderables->removeRenderablesOfObject(highlight_object, false);
-			highlight_object->move(dx, dy);
-			highlight_object->update();
-			highlight_renderables->insertRenderablesOfObject(highlight_object);
+			setDragPreviewOffset(constrained_pos_map - click_pos_map);
+		}
+		else
+		{
+			moveEditedObjects();
+			updatePreviewObjectsAsynchronously();
 		}
-		
-		updatePreviewObjectsAsynchronously();
 	}
 	else if (box_selection)
 	{
@@ -303,10 +305,29 @@ void EditLineTool::dragMove()
 	}
 }
 
+void EditLineTool::moveEditedObjects()
+{
+	qint32 dx, dy;
+	object_mover->move(constrained_pos_map, false, &dx, &dy);
+	if (highlight_object)
+	{
+		highlight_renderables->removeRenderablesOfObject(highlight_object, false);
+		highlight_object->move(dx, dy);
+		highlight_object->update();
+		highlight_renderables->insertRenderablesOfObject(highlight_object);
+	}
+}
+
 void EditLineTool::dragFinish()
 {
 	if (editingInProgress())
 	{
+		if (dragPreviewActive())
+		{
+			// Apply the final offset to the real objects.
+			moveEditedObjects();
+			finishDragPreview();
+		}
 		finishEditing();
 		angle_helper->setActive(false);
 		snap_helper->setFilter(SnappingToolHelper::NoSnapping);
@@ -324,6 +345,7 @@ void EditLineTool::dragCanceled()
 	if (editingInProgress())
 	{
 		updateDirtyRect(); // Catch the selection extent including the highlight_object
+		finishDragPreview();
 		abortEditing();
 		angle_helper->setActive(false);
 		snap_helper->setFilter(SnappingToolHelper::NoSnapping);
@@ -427,6 +449,8 @@ int EditLineTool::updateDirtyRectImpl(QRectF& rect)
 	
 	selection_extent = QRectF();
 	map()->includeSelectionRect(selection_extent);
+	if (dragPreviewActive())
+		selection_extent.translate(dragPreviewOffset());
 	
 	rectInclude(rect, selection_extent);
 	int pixel_border = show_object_points ? pointHandles().displayRadius() : 1;
@@ -477,7 +501,14 @@ void EditLineTool::drawImpl(QPainter* painter, MapWidget* widget)
 		}
 		
 		if (!highlight_renderables->empty())
+		{
+			// The highlight object is not moved while the drag preview is active.
+			painter->save();
+			if (dragPreviewActive())
+				painter->translate(widget->mapToViewport(dragPreviewOffset()) - widget->mapToViewport(MapCoordF{}));
 			map()->drawSelection(painter, true, widget, highlight_renderables.data(), true);
+			painter->restore();
+		}
 	}
 	
 	// Box selection
@@ -88,6 +88,9 @@ protected:
 	
 	bool hoveringOverFrame() const;
 	
+	/** Moves the edited objects and the highlight object to the current position. */
+	void moveEditedObjects();
+	
 private:
 	/** Measures the time a click takes to decide whether to do selection. */
 	QElapsedTimer click_timer;
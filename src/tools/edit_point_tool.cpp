@@ -340,6 +340,10 @@ void EditPointTool::dragStart()
 		startEditing(map()->selectedObjects());
 		startEditingSetup();
 		
+		// Moving many objects as a whole: show a cheap raster preview.
+		if (hover_state == OverFrame)
+			startDragPreview();
+		
 		if (active_modifiers & Qt::ControlModifier)
 			activateAngleHelperWhileEditing();
 		if (active_modifiers & Qt::ShiftModifier && !hoveringOverCurveHandle())
@@ -360,8 +364,15 @@ void EditPointTool::dragMove()
 			handle_offset = MapCoordF(0, 0);
 		}
 		
-		object_mover->move(constrained_pos_map, moveOppositeHandle());
-		updatePreviewObjectsAsynchronously();
+		if (dragPreviewActive())
+		{
+			setDragPreviewOffset(constrained_pos_map - click_pos_map);
+		}
+		else
+		{
+			object_mover->move(constrained_pos_map, moveOppositeHandle());
+			updatePreviewObjectsAsynchronously();
+		}
 	}
 	else if (box_selection)
 	{
@@ -373,6 +384,12 @@ void EditPointTool::dragFinish()
 {
 	if (editingInProgress())
 	{
+		if (dragPreviewActive())
+		{
+			// Apply the final offset to the real objects.
+			object_mover->move(constrained_pos_map, moveOppositeHandle());
+			finishDragPreview();
+		}
 		finishEditing();
 		angle_helper->setActive(false);
 		snap_helper->setFilter(SnappingToolHelper::NoSnapping);
@@ -388,6 +405,7 @@ void EditPointTool::dragCanceled()
 {
 	if (editingInProgress())
 	{
+		finishDragPreview();
 		abortEditing();
 		angle_helper->setActive(false);
 		snap_helper->setFilter(SnappingToolHelper::NoSnapping);
@@ -568,6 +586,8 @@ int EditPointTool::updateDirtyRectImpl(QRectF& rect)
 	
 	selection_extent = QRectF();
 	map()->includeSelectionRect(selection_extent);
+	if (dragPreviewActive())
+		selection_extent.translate(dragPreviewOffset());
 	
 	rectInclude(rect, selection_extent);
 	int pixel_border = show_object_points ? pointHandles().displayRadius() : 1;
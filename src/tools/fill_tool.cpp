@@ -22,11 +22,14 @@
 #include "fill_tool.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <type_traits>
+#include <unordered_map>
 
 #include <QtGlobal>
 #include <QCursor>
@@ -38,6 +41,7 @@
 #include <QPoint>
 #include <QPointF>
 #include <QRect>
+#include <QRectF>
 #include <QRgb>
 #include <QSize>
 #include <QString>
@@ -57,6 +61,7 @@
 #include "tools/tool.h"
 #include "tools/tool_base.h"
 #include "undo/object_undo.h"
+#include "util/util.h"
 
 
 // Uncomment this to generate an image file of the rasterized map
@@ -85,10 +90,715 @@ struct PathSection
 
 constexpr auto background = QRgb(0xffffffffu);
 
+
+/**
+ * Appends a section of a path to the given path object.
+ */
+void appendSection(PathObject* path, const PathSection& section)
+{
+	if (!section.object)
+		return;
+	
+	const auto& part = section.object->parts()[section.part];
+	if (section.end_clen == section.start_clen)
+	{
+		path->addCoordinate(MapCoord(SplitPathCoord::at(section.start_clen, SplitPathCoord::begin(part.path_coords)).pos));
+		return;
+	}
+	
+	PathObject part_copy { part };
+	if (section.end_clen < section.start_clen)
+	{
+		part_copy.changePathBounds(0, section.end_clen, section.start_clen);
+		part_copy.reverse();
+	}
+	else
+	{
+		part_copy.changePathBounds(0, section.start_clen, section.end_clen);
+	}
+	
+	if (path->getCoordinateCount() == 0)
+		path->appendPath(&part_copy);
+	else
+		path->connectPathParts(0, &part_copy, 0, false, false);
+}
+
+
+
+/**
+ * A planar arrangement of the path parts of some objects.
+ * 
+ * The path parts are split at their mutual intersections, so that the edges
+ * of the arrangement meet only at vertices. Each edge remembers the section
+ * of the original path part. This allows to find the face which contains a
+ * given position, and to construct its boundary from the original paths,
+ * independent of any rasterization.
+ * 
+ * Intersections are found with the help of a uniform grid of segments.
+ * 
+ * The arrangement is built from the centerlines. Where the strokes of
+ * segments overlap although the segments do not meet, the arrangement
+ * records a stroke contact. A face which contains such a contact may be
+ * split by the strokes, so its centerline boundary is not reliable.
+ */
+class PathArrangement
+{
+public:
+	/** The result of findFace(). */
+	enum FaceResult
+	{
+		NoFace,        ///< There is no bounded face which contains the position.
+		Face,          ///< The face was found.
+		NarrowedFace,  ///< The face was found, but strokes touch inside of it.
+	};
+	
+	/**
+	 * Adds a path part to the arrangement.
+	 * 
+	 * The half width is the largest extent of the stroke from the centerline.
+	 */
+	void addPart(PathObject* object, PathPartVector::size_type part_index, qreal half_width);
+	
+	/**
+	 * Splits the segments at their intersections and builds the edges.
+	 * 
+	 * This must be called after adding all parts, before findFace().
+	 */
+	void build();
+	
+	/**
+	 * Finds the outer boundary of the face which contains pos.
+	 * 
+	 * Returns NoFace if there is no bounded face which contains pos.
+	 * Otherwise, the boundary is returned as a sequence of sections of the
+	 * original paths, together with its extent. NarrowedFace is returned
+	 * if a stroke contact lies inside the outer boundary.
+	 */
+	FaceResult findFace(MapCoordF pos, std::vector<PathSection>& out_boundary, QRectF& out_extent) const;
+	
+private:
+	using VertexIndex = std::size_t;
+	
+	/** A straight segment of a path part, and the splitting parameters. */
+	struct Segment
+	{
+		MapCoordF start;
+		MapCoordF end;
+		PathObject* object;
+		PathPartVector::size_type part;
+		PathCoord::length_type start_clen;
+		PathCoord::length_type end_clen;
+		qreal half_width;
+		std::vector<double> splits;
+	};
+	
+	/** An edge between two vertices. */
+	struct Edge
+	{
+		VertexIndex from;
+		VertexIndex to;
+		PathObject* object;
+		PathPartVector::size_type part;
+		PathCoord::length_type from_clen;
+		PathCoord::length_type to_clen;
+	};
+	
+	/**
+	 * Returns the index of the vertex at pos, creating it if necessary.
+	 * 
+	 * Positions which differ by less than the tolerance are merged.
+	 */
+	VertexIndex vertexAt(MapCoordF pos);
+	
+	/**
+	 * Records the intersections of two segments.
+	 * 
+	 * Returns false if the segments do not meet.
+	 */
+	bool intersect(Segment& a, Segment& b);
+	
+	/** Records a stroke contact of two segments which do not meet. */
+	void touch(const Segment& a, const Segment& b);
+	
+	/** Returns the half-edge which follows h on the boundary of its left face. */
+	std::size_t nextHalfEdge(std::size_t h) const;
+	
+	/** Returns the start vertex of the half-edge h. */
+	VertexIndex tail(std::size_t h) const;
+	
+	/** Returns the end vertex of the half-edge h. */
+	VertexIndex head(std::size_t h) const;
+	
+	static qint64 vertexKey(qint64 x, qint64 y);
+	
+	/** The distance within which positions are regarded as equal, in mm. */
+	static constexpr double tolerance = 0.001;
+	
+	std::vector<Segment> segments;
+	std::vector<MapCoordF> stroke_contacts;
+	std::vector<MapCoordF> vertices;
+	std::unordered_multimap<qint64, VertexIndex> vertex_grid;
+	std::vector<Edge> edges;
+	
+	// The half-edges of edge e are 2*e (from -> to) and 2*e+1 (to -> from).
+	std::vector<std::vector<std::size_t>> outgoing;  ///< per vertex, sorted by angle
+	std::vector<std::size_t> outgoing_pos;           ///< per half-edge
+};
+
+
+constexpr double PathArrangement::tolerance;
+
+
+qint64 PathArrangement::vertexKey(qint64 x, qint64 y)
+{
+	return (x << 32) ^ (y & 0xffffffff);
+}
+
+PathArrangement::VertexIndex PathArrangement::vertexAt(MapCoordF pos)
+{
+	auto const x = qint64(std::floor(pos.x() / tolerance));
+	auto const y = qint64(std::floor(pos.y() / tolerance));
+	for (auto dx = -1; dx <= 1; ++dx)
+	{
+		for (auto dy = -1; dy <= 1; ++dy)
+		{
+			auto range = vertex_grid.equal_range(vertexKey(x + dx, y + dy));
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if ((vertices[it->second] - pos).manhattanLength() < 2 * tolerance)
+					return it->second;
+			}
+		}
+	}
+	vertex_grid.emplace(vertexKey(x, y), vertices.size());
+	vertices.push_back(pos);
+	return vertices.size() - 1;
+}
+
+void PathArrangement::addPart(PathObject* object, PathPartVector::size_type part_index, qreal half_width)
+{
+	const auto& path_coords = object->parts()[part_index].path_coords;
+	for (std::size_t i = 1; i < path_coords.size(); ++i)
+	{
+		const auto& start = path_coords[i-1];
+		const auto& end = path_coords[i];
+		if (start.pos == end.pos)
+			continue;
+		segments.push_back({ start.pos, end.pos, object, part_index, start.clen, end.clen, half_width, {} });
+	}
+}
+
+bool PathArrangement::intersect(Segment& a, Segment& b)
+{
+	auto const r = a.end - a.start;
+	auto const s = b.end - b.start;
+	auto const qp = b.start - a.start;
+	auto const denominator = r.x() * s.y() - r.y() * s.x();
+	auto const r_length = r.length();
+	auto const s_length = s.length();
+	
+	if (std::abs(denominator) <= 1e-9 * r_length * s_length)
+	{
+		// Parallel segments: split each at the other's end points if collinear.
+		if (std::abs(qp.x() * r.y() - qp.y() * r.x()) > tolerance * r_length)
+			return false;
+		
+		auto split_at = [](Segment& segment, MapCoordF point, const MapCoordF& direction, double length) {
+			auto t = MapCoordF::dotProduct(point - segment.start, direction) / (length * length);
+			if (t > 0 && t < 1)
+				segment.splits.push_back(t);
+		};
+		split_at(a, b.start, r, r_length);
+		split_at(a, b.end, r, r_length);
+		split_at(b, a.start, s, s_length);
+		split_at(b, a.end, s, s_length);
+		// Collinear segments which do not overlap may still have a gap.
+		return false;
+	}
+	
+	auto const t = (qp.x() * s.y() - qp.y() * s.x()) / denominator;
+	auto const u = (qp.x() * r.y() - qp.y() * r.x()) / denominator;
+	auto const t_tolerance = tolerance / r_length;
+	auto const u_tolerance = tolerance / s_length;
+	if (t >= -t_tolerance && t <= 1 + t_tolerance
+	    && u >= -u_tolerance && u <= 1 + u_tolerance)
+	{
+		a.splits.push_back(qBound(0.0, t, 1.0));
+		b.splits.push_back(qBound(0.0, u, 1.0));
+		return true;
+	}
+	return false;
+}
+
+void PathArrangement::touch(const Segment& a, const Segment& b)
+{
+	auto const reach = a.half_width + b.half_width;
+	if (reach <= tolerance)
+		return;
+	
+	if (a.object == b.object && a.part == b.part)
+	{
+		// Sections which are connected by a short piece of the path
+		// do not enclose a relevant area.
+		const auto& part = a.object->parts()[a.part];
+		auto gap = std::max(b.start_clen - a.end_clen, a.start_clen - b.end_clen);
+		if (part.isClosed())
+			gap = std::min(gap, part.length() - (std::max(a.end_clen, b.end_clen) - std::min(a.start_clen, b.start_clen)));
+		if (gap < 2 * reach)
+			return;
+	}
+	
+	// For segments which do not cross, the shortest distance is found
+	// at one of the end points.
+	auto closest_point = [](MapCoordF pos, const Segment& segment) {
+		auto const direction = segment.end - segment.start;
+		auto const t = MapCoordF::dotProduct(pos - segment.start, direction) / direction.lengthSquared();
+		return MapCoordF(segment.start + direction * qBound(0.0, t, 1.0));
+	};
+	MapCoordF const candidates[4][2] = {
+	    { a.start, closest_point(a.start, b) },
+	    { a.end, closest_point(a.end, b) },
+	    { b.start, closest_point(b.start, a) },
+	    { b.end, closest_point(b.end, a) },
+	};
+	auto const nearest = std::min_element(std::begin(candidates), std::end(candidates), [](const auto& first, const auto& second) {
+		return first[0].distanceSquaredTo(first[1]) < second[0].distanceSquaredTo(second[1]);
+	});
+	auto const distance = (*nearest)[0].distanceTo((*nearest)[1]);
+	if (distance > tolerance && distance < reach)
+		stroke_contacts.push_back((*nearest)[0] + ((*nearest)[1] - (*nearest)[0]) * 0.5);
+}
+
+void PathArrangement::build()
+{
+	if (segments.empty())
+		return;
+	
+	// Build a uniform grid of the segments, including their strokes.
+	QRectF bounds;
+	for (const auto& segment : segments)
+	{
+		rectIncludeSafe(bounds, segment.start);
+		rectIncludeSafe(bounds, segment.end);
+	}
+	auto const cell_size = std::max(std::sqrt(bounds.width() * bounds.height() / segments.size()) * 2, 1.0);
+	auto const columns = qint64(bounds.width() / cell_size) + 1;
+	auto const rows = qint64(bounds.height() / cell_size) + 1;
+	
+	std::unordered_map<qint64, std::vector<std::size_t>> grid;
+	for (std::size_t i = 0; i < segments.size(); ++i)
+	{
+		const auto& segment = segments[i];
+		auto const margin = segment.half_width + tolerance;
+		auto const left   = qint64(std::floor((std::min(segment.start.x(), segment.end.x()) - bounds.left() - margin) / cell_size));
+		auto const right  = qint64(std::floor((std::max(segment.start.x(), segment.end.x()) - bounds.left() + margin) / cell_size));
+		auto const top    = qint64(std::floor((std::min(segment.start.y(), segment.end.y()) - bounds.top() - margin) / cell_size));
+		auto const bottom = qint64(std::floor((std::max(segment.start.y(), segment.end.y()) - bounds.top() + margin) / cell_size));
+		for (auto x = qMax(left, qint64(0)); x <= qMin(right, columns); ++x)
+		{
+			for (auto y = qMax(top, qint64(0)); y <= qMin(bottom, rows); ++y)
+				grid[y * (columns + 1) + x].push_back(i);
+		}
+	}
+	
+	// Find the intersections and stroke contacts. Pairs sharing multiple
+	// cells are tested multiple times, but duplicate splits are removed
+	// below, and duplicate contacts do no harm.
+	for (auto& cell : grid)
+	{
+		auto const& members = cell.second;
+		for (std::size_t i = 0; i < members.size(); ++i)
+		{
+			for (std::size_t j = i + 1; j < members.size(); ++j)
+			{
+				auto& a = segments[members[i]];
+				auto& b = segments[members[j]];
+				if (!intersect(a, b))
+					touch(a, b);
+			}
+		}
+	}
+	
+	// Split the segments into edges.
+	std::unordered_map<qint64, std::size_t> edge_keys;
+	for (auto& segment : segments)
+	{
+		auto& splits = segment.splits;
+		splits.push_back(0.0);
+		splits.push_back(1.0);
+		std::sort(begin(splits), end(splits));
+		
+		auto previous_vertex = vertexAt(segment.start);
+		auto previous_clen = segment.start_clen;
+		for (auto t : splits)
+		{
+			auto const vertex = (t == 1.0) ? vertexAt(segment.end) : vertexAt(segment.start + (segment.end - segment.start) * t);
+			if (vertex == previous_vertex)
+				continue;
+			
+			auto const clen = PathCoord::length_type(segment.start_clen + (segment.end_clen - segment.start_clen) * t);
+			auto const key = vertexKey(qint64(std::min(vertex, previous_vertex)), qint64(std::max(vertex, previous_vertex)));
+			if (edge_keys.emplace(key, edges.size()).second)
+				edges.push_back({ previous_vertex, vertex, segment.object, segment.part, previous_clen, clen });
+			previous_vertex = vertex;
+			previous_clen = clen;
+		}
+		std::vector<double>().swap(splits);
+	}
+	
+	// Sort the outgoing half-edges of each vertex by angle.
+	outgoing.resize(vertices.size());
+	for (std::size_t e = 0; e < edges.size(); ++e)
+	{
+		outgoing[edges[e].from].push_back(2 * e);
+		outgoing[edges[e].to].push_back(2 * e + 1);
+	}
+	outgoing_pos.resize(2 * edges.size());
+	for (auto& half_edges : outgoing)
+	{
+		std::sort(begin(half_edges), end(half_edges), [this](std::size_t a, std::size_t b) {
+			auto const da = vertices[head(a)] - vertices[tail(a)];
+			auto const db = vertices[head(b)] - vertices[tail(b)];
+			return std::atan2(da.y(), da.x()) < std::atan2(db.y(), db.x());
+		});
+		for (std::size_t i = 0; i < half_edges.size(); ++i)
+			outgoing_pos[half_edges[i]] = i;
+	}
+}
+
+PathArrangement::VertexIndex PathArrangement::tail(std::size_t h) const
+{
+	const auto& edge = edges[h / 2];
+	return (h % 2) ? edge.to : edge.from;
+}
+
+PathArrangement::VertexIndex PathArrangement::head(std::size_t h) const
+{
+	const auto& edge = edges[h / 2];
+	return (h % 2) ? edge.from : edge.to;
+}
+
+std::size_t PathArrangement::nextHalfEdge(std::size_t h) const
+{
+	// At the head of h, take the clockwise neighbour of the twin of h.
+	auto const twin = h ^ 1;
+	const auto& half_edges = outgoing[head(h)];
+	auto const pos = outgoing_pos[twin];
+	return half_edges[(pos + half_edges.size() - 1) % half_edges.size()];
+}
+
+PathArrangement::FaceResult PathArrangement::findFace(MapCoordF pos, std::vector<PathSection>& out_boundary, QRectF& out_extent) const
+{
+	// Returns the x coordinate where the edge of the half-edge crosses the
+	// horizontal line through pos, or NaN.
+	auto crossing = [this, pos](std::size_t h) {
+		const auto& a = vertices[tail(h)];
+		const auto& b = vertices[head(h)];
+		if ((a.y() > pos.y()) == (b.y() > pos.y()))
+			return std::numeric_limits<double>::quiet_NaN();
+		return a.x() + (pos.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y());
+	};
+	
+	// Go to the right and find crossings with edges. For every crossing,
+	// trace the boundary of the face on the near side of the edge, and
+	// check whether pos is inside this boundary.
+	std::vector<std::size_t> face;
+	auto x0 = pos.x();
+	for (;;)
+	{
+		auto nearest = std::numeric_limits<double>::infinity();
+		auto start = edges.size() * 2;
+		for (std::size_t e = 0; e < edges.size(); ++e)
+		{
+			auto const x = crossing(2 * e);
+			if (x > x0 && x < nearest)
+			{
+				nearest = x;
+				start = 2 * e;
+			}
+		}
+		if (start == edges.size() * 2)
+			return NoFace;
+		
+		// Select the half-edge which has pos on its left side.
+		const auto& a = vertices[tail(start)];
+		const auto& b = vertices[head(start)];
+		auto const ab = b - a;
+		auto const ap = pos - a;
+		if (ab.x() * ap.y() - ab.y() * ap.x() < 0)
+			start ^= 1;
+		
+		face.clear();
+		auto h = start;
+		do
+		{
+			face.push_back(h);
+			h = nextHalfEdge(h);
+			if (face.size() > edges.size() * 2)
+				return NoFace;  // not expected
+		}
+		while (h != start);
+		
+		bool inside = false;
+		auto next_x0 = nearest;
+		for (auto half_edge : face)
+		{
+			auto const x = crossing(half_edge);
+			if (x > pos.x())
+				inside = !inside;
+			if (x > next_x0)
+				next_x0 = x;
+		}
+		if (inside)
+			break;
+		
+		// The boundary does not contain pos.
+		// Skip over the rest of the floating objects.
+		x0 = next_x0;
+	}
+	
+	// Remove dangling edges which are traversed back and forth.
+	std::vector<std::size_t> boundary;
+	boundary.reserve(face.size());
+	for (auto h : face)
+	{
+		if (!boundary.empty() && boundary.back() == (h ^ 1))
+			boundary.pop_back();
+		else
+			boundary.push_back(h);
+	}
+	while (boundary.size() > 1 && boundary.front() == (boundary.back() ^ 1))
+	{
+		boundary.pop_back();
+		boundary.erase(boundary.begin());
+	}
+	if (boundary.size() < 2)
+		return NoFace;
+	
+	// Don't let the boundary start in the middle of a path section.
+	auto same_section = [this](std::size_t h1, std::size_t h2) {
+		const auto& e1 = edges[h1 / 2];
+		const auto& e2 = edges[h2 / 2];
+		auto const end_clen = (h1 % 2) ? e1.from_clen : e1.to_clen;
+		auto const start_clen = (h2 % 2) ? e2.to_clen : e2.from_clen;
+		return e1.object == e2.object && e1.part == e2.part && end_clen == start_clen;
+	};
+	auto first = std::size_t(0);
+	while (first < boundary.size() && same_section(boundary[(first + boundary.size() - 1) % boundary.size()], boundary[first]))
+		++first;
+	if (first < boundary.size())
+		std::rotate(begin(boundary), begin(boundary) + std::ptrdiff_t(first), end(boundary));
+	
+	out_boundary.clear();
+	out_extent = QRectF();
+	for (std::size_t i = 0; i < boundary.size(); ++i)
+	{
+		auto const h = boundary[i];
+		const auto& edge = edges[h / 2];
+		auto const start_clen = (h % 2) ? edge.to_clen : edge.from_clen;
+		auto const end_clen = (h % 2) ? edge.from_clen : edge.to_clen;
+		if (i > 0 && same_section(boundary[i-1], h))
+			out_boundary.back().end_clen = end_clen;
+		else
+			out_boundary.push_back({ edge.object, edge.part, start_clen, end_clen });
+		rectIncludeSafe(out_extent, vertices[tail(h)]);
+	}
+	
+	// Strokes which touch inside the outer boundary may split the face.
+	// (Contacts inside of islands are counted, too. This is conservative.)
+	auto narrowed = std::any_of(begin(stroke_contacts), end(stroke_contacts), [this, &boundary, &out_extent](const MapCoordF& contact) {
+		if (!out_extent.contains(contact))
+			return false;
+		bool inside = false;
+		for (auto h : boundary)
+		{
+			const auto& a = vertices[tail(h)];
+			const auto& b = vertices[head(h)];
+			if ((a.y() > contact.y()) != (b.y() > contact.y())
+			    && contact.x() < a.x() + (contact.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y()))
+				inside = !inside;
+		}
+		return inside;
+	});
+	return narrowed ? NarrowedFace : Face;
+}
+
+
 }  // namespace
 
 
 
+/**
+ * A rasterized map part which is rendered lazily in tiles.
+ * 
+ * All tiles share a common pixel grid. A tile is rendered when one of its
+ * pixels is accessed for the first time. So the time and memory needed
+ * depend on the region which is actually visited, not on the bounds.
+ */
+class FillTool::RasterTiles
+{
+public:
+	/** A function which renders the given rectangle of the pixel grid. */
+	using Renderer = std::function<QImage (const QRect&)>;
+	
+	RasterTiles(const QRect& bounds, const Renderer& renderer);
+	
+	/** Returns the bounds of the raster in the pixel grid. */
+	const QRect& rect() const;
+	
+	/**
+	 * Returns the pixel at the given position, rendering its tile if needed.
+	 * 
+	 * Pixels outside the bounds are background.
+	 */
+	QRgb pixel(QPoint pos) const;
+	
+private:
+	static constexpr int tile_size = 256;
+	
+	QRect bounds;
+	Renderer renderer;
+	mutable std::unordered_map<qint64, QImage> tiles;
+	mutable const QImage* last_tile = nullptr;
+	mutable qint64 last_key = 0;
+};
+
+
+constexpr int FillTool::RasterTiles::tile_size;
+
+
+FillTool::RasterTiles::RasterTiles(const QRect& bounds, const Renderer& renderer)
+: bounds(bounds)
+, renderer(renderer)
+{
+	// nothing else
+}
+
+const QRect& FillTool::RasterTiles::rect() const
+{
+	return bounds;
+}
+
+QRgb FillTool::RasterTiles::pixel(QPoint pos) const
+{
+	if (!bounds.contains(pos))
+		return background;
+	
+	// Integer division rounding towards negative infinity
+	auto floor_div = [](int value) {
+		return (value >= 0 ? value : value - tile_size + 1) / tile_size;
+	};
+	auto const tile_x = floor_div(pos.x());
+	auto const tile_y = floor_div(pos.y());
+	auto const key = (qint64(tile_x) << 32) ^ (qint64(tile_y) & 0xffffffff);
+	if (!last_tile || key != last_key)
+	{
+		auto found = tiles.find(key);
+		if (found == tiles.end())
+		{
+			auto const tile_rect = QRect(tile_x * tile_size, tile_y * tile_size, tile_size, tile_size);
+			found = tiles.emplace(key, renderer(tile_rect)).first;
+		}
+		last_tile = &found->second;
+		last_key = key;
+	}
+	return last_tile->pixel(pos.x() - tile_x * tile_size, pos.y() - tile_y * tile_size);
+}
+
+
+
+/**
+ * The objects for a tile are taken from the spatial index of the map part,
+ * and they are updated when a tile needs them first. The raster is drawn
+ * in up to two passes: in baseline view (unless the map is already in
+ * baseline view), and in the map's view but without area hatching. For a
+ * pass which doesn't use the map's renderable options, the output is
+ * generated for a detached copy of the object, once. So the map's objects
+ * and options are never changed.
+ */
+class FillTool::RasterObjects
+{
+public:
+	using DrawList = std::vector<std::pair<int, const Object*>>;
+	
+	/** Prepares drawing the path objects of the current map part. */
+	explicit RasterObjects(Map& map);
+	
+	/** Returns the number of passes. */
+	int numPasses() const;
+	
+	/**
+	 * Returns the objects which intersect the extent, with their IDs,
+	 * with output for the given pass.
+	 */
+	DrawList objectsAt(const QRectF& extent, int pass);
+	
+private:
+	MapPart* part;
+	std::unordered_map<const Object*, std::unique_ptr<Object>> copies[2];
+	Symbol::RenderableOptions map_options;
+	Symbol::RenderableOptions pass_options[2];
+	int num_passes;
+};
+
+
+FillTool::RasterObjects::RasterObjects(Map& map)
+: part(map.getCurrentPart())
+, map_options(QFlag(map.renderableOptions()))
+{
+	// Drawing the baselines in advance to normal rendering makes it
+	// possible to fill areas bounded by e.g. dashed paths.
+	auto const normal_options = map_options & ~Symbol::RenderAreasHatched;
+	num_passes = 0;
+	if (!map_options.testFlag(Symbol::RenderBaselines))
+		pass_options[num_passes++] = Symbol::RenderBaselines;
+	pass_options[num_passes++] = normal_options;
+}
+
+int FillTool::RasterObjects::numPasses() const
+{
+	return num_passes;
+}
+
+FillTool::RasterObjects::DrawList FillTool::RasterObjects::objectsAt(const QRectF& extent, int pass)
+{
+	Q_ASSERT(pass >= 0 && pass < num_passes);
+	auto const options = pass_options[pass];
+	
+	DrawList result;
+	for (auto object : part->findObjectsInRect(extent))
+	{
+		if (object->getType() != Object::Path)
+			continue;
+		if (auto symbol = object->getSymbol())
+		{
+			if (symbol->isHidden())
+				continue;
+		}
+		auto const id = part->findObjectIndex(object);
+		if (id >= int(RGB_MASK))
+			continue;
+		
+		object->update();
+		if (options == map_options)
+		{
+			result.emplace_back(id, object);
+			continue;
+		}
+		
+		auto& copy = copies[pass][object];
+		if (!copy)
+		{
+			copy.reset(object->duplicate());
+			copy->updateDetached(options);
+		}
+		result.emplace_back(id, copy.get());
+	}
+	return result;
+}
+
+
+
 FillTool::FillTool(MapEditorController* editor, QAction* tool_action)
 : MapEditorToolBase(QCursor(QPixmap(QString::fromLatin1(":/images/cursor-fill.png")), 11, 11), Other, editor, tool_action)
 {
@@ -121,17 +831,13 @@ void FillTool::setDrawingSymbol(const Symbol* symbol)
 
 void FillTool::clickPress()
 {
-	// First try to apply with current viewport only as extent (for speed)
-	auto widget = editor->getMainWidget();
-	QRectF viewport_extent = widget->getMapView()->calculateViewedRect(widget->viewportToView(widget->geometry()));
-	int result = fill(viewport_extent);
+	// First try to find the enclosing face from the paths' geometry
+	int result = fillVector();
 	if (result == -1 || result == 1)
 		return;
 	
-	// If not successful, try again with rasterizing the whole map part
-	QRectF map_part_extent = map()->getCurrentPart()->calculateExtent(true);
-	if (viewport_extent.united(map_part_extent) != viewport_extent)
-		result = fill(map_part_extent);
+	// Then try to apply with the rasterized map
+	result = fill();
 	if (result == -1 || result == 1)
 		return;
 	
@@ -142,29 +848,130 @@ void FillTool::clickPress()
 	);
 }
 
-int FillTool::fill(const QRectF& extent)
+int FillTool::fillVector()
 {
-	constexpr auto extent_area_warning_threshold = qreal(600 * 600); // 60 cm x 60 cm
+	constexpr auto initial_search_radius = qreal(10); // 1 cm
+	
+	auto const click_pos_map = cur_map_widget->viewportToMapF(click_pos);
+	auto part = map()->getCurrentPart();
+	auto const part_extent = part->indexedExtent();
+	if (!part_extent.contains(click_pos_map))
+		return 0;
 	
-	// Warn if desired extent is large
-	if (extent.width() * extent.height() > extent_area_warning_threshold)
+	auto const usable_path = [](Object* object) -> PathObject* {
+		if (object->getType() != Object::Path)
+			return nullptr;
+		auto symbol = object->getSymbol();
+		if (symbol && symbol->isHidden())
+			return nullptr;
+		return object->asPath();
+	};
+	
+	// Check that the click position is not inside an area.
+	auto const click_extent = QRectF(click_pos_map.x() - 0.001, click_pos_map.y() - 0.001, 0.002, 0.002);
+	for (auto object : part->findObjectsInRect(click_extent))
 	{
-		if (QMessageBox::question(
-			window(),
-			tr("Warning"),
-			tr("The map area is large. Use of the fill tool may be very slow. Do you want to use it anyway?"),
-			QMessageBox::No | QMessageBox::Yes) == QMessageBox::No)
+		auto path = usable_path(object);
+		if (!path || !path->getSymbol() || !(path->getSymbol()->getContainedTypes() & Symbol::Area))
+			continue;
+		
+		path->update();
+		if (path->isPointInsideArea(click_pos_map))
 		{
+			QMessageBox::warning(
+				window(),
+				tr("Error"),
+				tr("The clicked position is not free, cannot use the fill tool there.")
+			);
 			return -1;
 		}
 	}
 	
-	// Rasterize map into image
+	// Take the paths near the click position, and find the enclosing face.
+	// If the face is not entirely within the search area, paths outside the
+	// search area might cross it. Then search again in a larger area.
+	auto search_radius = initial_search_radius;
+	for (;;)
+	{
+		auto const search_extent = QRectF(click_pos_map.x() - search_radius, click_pos_map.y() - search_radius, 2 * search_radius, 2 * search_radius);
+		
+		PathArrangement arrangement;
+		for (auto object : part->findObjectsInRect(search_extent))
+		{
+			auto path = usable_path(object);
+			if (!path)
+				continue;
+			
+			path->update();
+			auto const half_width = path->getSymbol() ? path->getSymbol()->calculateLargestLineExtent() : qreal(0);
+			for (PathPartVector::size_type p = 0; p < path->parts().size(); ++p)
+			{
+				// The margin keeps straight parts of zero width.
+				auto const margin = half_width + 0.001;
+				auto const extent = path->parts()[p].calculateExtent().adjusted(-margin, -margin, margin, margin);
+				if (extent.intersects(search_extent))
+					arrangement.addPart(path, p, half_width);
+			}
+		}
+		arrangement.build();
+		
+		std::vector<PathSection> boundary;
+		QRectF face_extent;
+		auto const result = arrangement.findFace(click_pos_map, boundary, face_extent);
+		auto const complete = search_extent.contains(part_extent);
+		if (result != PathArrangement::NoFace && (complete || search_extent.contains(face_extent)))
+		{
+			// The strokes may close gaps which the centerlines leave open.
+			// Let the raster fill handle this face.
+			if (result == PathArrangement::NarrowedFace)
+				return 0;
+			
+			auto path = new PathObject(drawing_symbol);
+			for (const auto& section : boundary)
+				appendSection(path, section);
+			if (!addFillObject(path))
+			{
+				QMessageBox::warning(
+					window(),
+					tr("Error"),
+					tr("Failed to create the fill object.")
+				);
+				return -1;
+			}
+			return 1;
+		}
+		if (complete)
+			return 0;
+		
+		search_radius *= 2;
+	}
+}
+
+int FillTool::fill()
+{
+	constexpr auto zoom_level = qreal(4);
+	
+	// Set up a pixel grid with the origin at the click position,
+	// limited to the extent of the map part.
+	MapView view{ map() };
+	view.setZoom(zoom_level);
+	auto const zoom_factor = view.calculateFinalZoomFactor();
+	auto const click_pos_map = cur_map_widget->viewportToMapF(click_pos);
 	QTransform transform;
-	QImage image = rasterizeMap(extent, transform);
+	transform.scale(zoom_factor, zoom_factor);
+	transform.translate(-click_pos_map.x(), -click_pos_map.y());
 	
-	// Calculate click position in image and check if it is inside the map area and free
-	QPoint clicked_pixel = transform.map(cur_map_widget->viewportToMapF(click_pos)).toPoint();
+	// Only the tiles which are visited are rendered, with the objects from
+	// the spatial index. So the map part's size doesn't matter.
+	auto const map_part_extent = map()->getCurrentPart()->indexedExtent();
+	RasterObjects objects { *map() };
+	auto const bounds = transform.mapRect(map_part_extent).toAlignedRect().adjusted(-1, -1, 1, 1);
+	RasterTiles image { bounds, [this, &transform, &objects](const QRect& rect) {
+		return rasterizeMap(rect, transform, objects);
+	} };
+	
+	// Check if the click position is inside the map area and free
+	auto const clicked_pixel = QPoint(0, 0);
 	if (!image.rect().contains(clicked_pixel, true))
 		return 0;
 	if (image.pixel(clicked_pixel) != background)
@@ -181,7 +988,7 @@ int FillTool::fill(const QRectF& extent)
 	// For every collision, trace the boundary of the collision object
 	// and check whether the click position is inside the boundary.
 	// If it is, the correct outline was found which is then filled.
-	for (QPoint free_pixel = clicked_pixel; free_pixel.x() < image.width() - 1; free_pixel += QPoint(1, 0))
+	for (QPoint free_pixel = clicked_pixel; free_pixel.x() < image.rect().right(); free_pixel += QPoint(1, 0))
 	{
 		// Check if there is a collision to the right
 		QPoint boundary_pixel = free_pixel + QPoint(1, 0);
@@ -206,7 +1013,7 @@ int FillTool::fill(const QRectF& extent)
 			
 			// Skip over the rest of the floating object.
 			free_pixel += QPoint(1, 0);
-			while (free_pixel.x() < image.width() - 1
+			while (free_pixel.x() < image.rect().right()
 				&& image.pixel(free_pixel) != background)
 				free_pixel += QPoint(1, 0);
 			free_pixel -= QPoint(1, 0);
@@ -244,7 +1051,7 @@ void FillTool::objectSelectionChangedImpl()
 {
 }
 
-QImage FillTool::rasterizeMap(const QRectF& extent, QTransform& out_transform)
+QImage FillTool::rasterizeMap(const QRect& pixel_rect, const QTransform& transform, RasterObjects& objects)
 {
 	// Draw map into a QImage with the following settings:
 	// - specific zoom factor (resolution)
@@ -253,58 +1060,32 @@ QImage FillTool::rasterizeMap(const QRectF& extent, QTransform& out_transform)
 	// - draw baselines in advance to normal rendering
 	//   This makes it possible to fill areas bounded by e.g. dashed paths.
 	
-	constexpr auto zoom_level = qreal(4);
-	
-	// Create map view centered on the extent
-	MapView view{ map() };
-	view.setCenter(MapCoord{ extent.center() });
-	view.setZoom(zoom_level);
-	
 	// Allocate the image
-	auto image_size = view.calculateViewBoundingBox(extent).toAlignedRect().size();
-	QImage image = QImage(image_size, QImage::Format_RGB32);
+	QImage image = QImage(pixel_rect.size(), QImage::Format_RGB32);
 	image.fill(background);
 	
-	// Draw map
+	// Only the objects which intersect the extent need to be drawn.
+	auto const extent = transform.inverted().mapRect(QRectF(pixel_rect.adjusted(-1, -1, 1, 1)));
 	RenderConfig::Options options = RenderConfig::DisableAntialiasing | RenderConfig::ForceMinSize;
-	RenderConfig config = { *map(), extent, view.calculateFinalZoomFactor(), options, 1.0 };
+	RenderConfig config = { *map(), extent, transform.m11(), options, 1.0 };
 	
 	QPainter painter;
-	painter.begin(&image);
-	painter.translate(image_size.width() / 2.0, image_size.height() / 2.0);
-	painter.setWorldTransform(view.worldTransform(), true);
-	
-	auto original_area_hatching = map()->isAreaHatchingEnabled();
-	if (original_area_hatching)
-	{
-		map()->setAreaHatchingEnabled(false);
-	}
-	
-	if (!map()->isBaselineViewEnabled())
-	{
-		// Temporarily enable baseline view and draw map once.
-		map()->setBaselineViewEnabled(true);
-		map()->getCurrentPart()->applyOnAllObjects(&Object::forceUpdate);
-		drawObjectIDs(map(), &painter, config);
-		map()->setBaselineViewEnabled(false);
-		map()->getCurrentPart()->applyOnAllObjects(&Object::forceUpdate);
-	}
-	else if (original_area_hatching)
-	{
-		map()->getCurrentPart()->applyOnAllObjects(&Object::forceUpdate);
-	}
-	
-	// Draw the map in original mode (but without area hatching)
-	drawObjectIDs(map(), &painter, config);
-	
-	if (original_area_hatching)
+	for (int pass = 0; pass < objects.numPasses(); ++pass)
 	{
-		map()->setAreaHatchingEnabled(original_area_hatching);
-		map()->getCurrentPart()->applyOnAllObjects(&Object::forceUpdate);
+		auto const draw_list = objects.objectsAt(extent, pass);
+		if (draw_list.empty())
+			break;
+		
+		if (!painter.isActive())
+		{
+			painter.begin(&image);
+			painter.translate(-pixel_rect.topLeft());
+			painter.setWorldTransform(transform, true);
+		}
+		drawObjectIDs(map(), &painter, config, draw_list);
 	}
-	
-	out_transform = painter.combinedTransform();
-	painter.end();
+	if (painter.isActive())
+		painter.end();
 	
 #ifdef FILLTOOL_DEBUG_IMAGE
 	image.save(QDir::temp().absoluteFilePath(QString::fromLatin1(FILLTOOL_DEBUG_IMAGE)));
@@ -313,50 +1094,34 @@ QImage FillTool::rasterizeMap(const QRectF& extent, QTransform& out_transform)
 	return image;
 }
 
-void FillTool::drawObjectIDs(Map* map, QPainter* painter, const RenderConfig &config)
+void FillTool::drawObjectIDs(Map* map, QPainter* painter, const RenderConfig &config, const std::vector<std::pair<int, const Object*>>& objects)
 {
 	Q_STATIC_ASSERT(MapColor::Reserved == -1);
-	Q_ASSERT(!map->isAreaHatchingEnabled());
 	
-	auto part = map->getCurrentPart();
-	auto num_objects = qMin(part->getNumObjects(), int(RGB_MASK));
 	auto num_colors = map->getNumColors();
 	for (auto c = num_colors-1; c >= MapColor::Reserved; --c)
 	{
 		auto map_color = map->getColor(c);
-		for (int o = 0; o < num_objects; ++o)
+		for (const auto& entry : objects)
 		{
-			auto object = part->getObject(o);
-			if (object->getType() != Object::Path)
-				continue;
+			auto object = entry.second;
 			if (auto symbol = object->getSymbol())
 			{
-				if (symbol->isHidden())
-					continue;
 				if (symbol->getType() == Symbol::Area
 				    && static_cast<const AreaSymbol*>(symbol)->getColor() != map_color)
 					continue;
 			}
 			
-			object->update();
-			object->renderables().draw(c, QRgb(o) | ~RGB_MASK, painter, config);
+			object->renderables().draw(c, QRgb(entry.first) | ~RGB_MASK, painter, config);
 		}
 	}
 }
 
-int FillTool::traceBoundary(const QImage& image, QPoint free_pixel, QPoint boundary_pixel, std::vector<QPoint>& out_boundary)
+int FillTool::traceBoundary(const RasterTiles& image, QPoint free_pixel, QPoint boundary_pixel, std::vector<QPoint>& out_boundary)
 {
 	Q_ASSERT(image.pixel(free_pixel) == background);
 	Q_ASSERT(image.pixel(boundary_pixel) != background);
 	
-#ifdef FILLTOOL_DEBUG_IMAGE
-	{
-		auto debugImage = image.copy();
-		debugImage.setPixel(free_pixel, qRgb(255, 0, 0));
-		debugImage.save(QDir::temp().absoluteFilePath(QString::fromLatin1(FILLTOOL_DEBUG_IMAGE)));
-	}
-#endif
-	
 	out_boundary.clear();
 	out_boundary.reserve(4096);
 	out_boundary.push_back(boundary_pixel);
@@ -416,37 +1181,9 @@ int FillTool::traceBoundary(const QImage& image, QPoint free_pixel, QPoint bound
 	return inside ? 1 : 0;
 }
 
-bool FillTool::fillBoundary(const QImage& image, const std::vector<QPoint>& boundary, const QTransform& image_to_map)
+bool FillTool::fillBoundary(const RasterTiles& image, const std::vector<QPoint>& boundary, const QTransform& image_to_map)
 {
 	auto path = new PathObject(drawing_symbol);
-	auto append_section = [path](const PathSection& section)
-	{
-		if (!section.object)
-			return;
-		
-		const auto& part = section.object->parts()[section.part];
-		if (section.end_clen == section.start_clen)
-		{
-			path->addCoordinate(MapCoord(SplitPathCoord::at(section.start_clen, SplitPathCoord::begin(part.path_coords)).pos));
-			return;
-		}
-		
-		PathObject part_copy { part };
-		if (section.end_clen < section.start_clen)
-		{
-			part_copy.changePathBounds(0, section.end_clen, section.start_clen);
-			part_copy.reverse();
-		}
-		else
-		{
-			part_copy.changePathBounds(0, section.start_clen, section.end_clen);
-		}
-		
-		if (path->getCoordinateCount() == 0)
-			path->appendPath(&part_copy);
-		else
-			path->connectPathParts(0, &part_copy, 0, false, false);
-	};
 	
 	auto last_pixel = background; // no object
 	const auto pixel_length = PathCoord::length_type((image_to_map.map(QPointF(0, 0)) - image_to_map.map(QPointF(1, 1))).manhattanLength());
@@ -465,7 +1202,7 @@ bool FillTool::fillBoundary(const QImage& image, const std::vector<QPoint>& boun
 		if (pixel != last_pixel)
 		{
 			// Change of object
-			append_section(section);
+			appendSection(path, section);
 			
 			section.object = map()->getCurrentPart()->getObject(int(pixel & RGB_MASK))->asPath();
 			section.object->calcClosestPointOnPath(map_pos, distance_sq, path_coord);
@@ -482,7 +1219,7 @@ bool FillTool::fillBoundary(const QImage& image, const std::vector<QPoint>& boun
 		if (Q_UNLIKELY(part != section.part))
 		{
 			// Change of path part
-			append_section(section);
+			appendSection(path, section);
 			
 			section.part = part;
 			section.start_clen = path_coord.clen;
@@ -495,21 +1232,26 @@ bool FillTool::fillBoundary(const QImage& image, const std::vector<QPoint>& boun
 		{
 			// Forward over closing point
 			section.end_clen = section.object->parts()[section.part].length();
-			append_section(section);
+			appendSection(path, section);
 			section.start_clen = 0;
 		}
 		else if (path_coord.clen - section.end_clen >= threshold)
 		{
 			// Backward over closing point
 			section.end_clen = 0;
-			append_section(section);
+			appendSection(path, section);
 			section.start_clen = section.object->parts()[section.part].length();
 		}
 		section.end_clen = path_coord.clen;
 	}
 	// Final section
-	append_section(section);
+	appendSection(path, section);
 	
+	return addFillObject(path);
+}
+
+bool FillTool::addFillObject(PathObject* path)
+{
 	if (path->getCoordinateCount() < 2)
 	{
 		delete path;
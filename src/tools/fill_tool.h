@@ -22,11 +22,11 @@
 #ifndef OPENORIENTEERING_FILL_TOOL_H
 #define OPENORIENTEERING_FILL_TOOL_H
 
+#include <utility>
 #include <vector>
 
 #include <QImage>
 #include <QObject>
-// IWYU pragma: no_include <QRectF>
 #include <QTransform>
 
 #include "tool_base.h"
@@ -34,10 +34,12 @@
 class QAction;
 class QPainter;
 class QPoint;
-class QRectF;
+class QRect;
 
 class Map;
 class MapEditorController;
+class Object;
+class PathObject;
 class RenderConfig;
 class Symbol;
 
@@ -62,23 +64,60 @@ protected:
 	
 	/**
 	 * Tries to apply the fill tool at the current click position,
-	 * rasterizing the given extent of the map.
+	 * using the geometry of the paths near the click position.
+	 * 
+	 * The paths are split at their intersections, and the boundary of the
+	 * face which contains the click position is constructed from the
+	 * original path sections. The search area starts around the click
+	 * position and grows until it contains the face. The paths are taken
+	 * from the spatial index of the map part, so the cost depends on the
+	 * size of the face, not on the size of the map part.
+	 * 
+	 * If the strokes of the paths touch inside the face although their
+	 * centerlines do not meet, the face may be split by the line widths.
+	 * Then this function is unsuccesful, leaving the face to fill().
+	 * 
+	 * Returns -1 for abort, 0 for unsuccesful, 1 for succesful.
+	 */
+	int fillVector();
+	
+	/**
+	 * A rasterized map part which is rendered lazily in tiles.
+	 */
+	class RasterTiles;
+	
+	/**
+	 * The objects of the map part which may be drawn into the raster.
+	 */
+	class RasterObjects;
+	
+	/**
+	 * Tries to apply the fill tool at the current click position,
+	 * rasterizing the map part.
+	 * 
+	 * The map is rasterized lazily in tiles, as far as needed for finding
+	 * and tracing the boundary around the click position. The objects for
+	 * a tile are taken from the spatial index of the map part.
+	 * 
 	 * Returns -1 for abort, 0 for unsuccesful, 1 for succesful.
 	 */
-	int fill(const QRectF& extent);
+	int fill();
 	
 	/**
-	 * Rasterizes an area of the current map part with the given extent into an image.
+	 * Rasterizes a rectangle of a pixel grid for the current map part.
 	 * 
+	 * The pixel grid is defined by the given map-to-pixel transform.
 	 * The pixels encodes object IDs (with alpha = 255). The background is white.
-	 * Returns the image and the used map-to-image transform.
+	 * Only the given objects which intersect the rectangle are drawn.
 	 */
-	QImage rasterizeMap(const QRectF& extent, QTransform& out_transform);
+	QImage rasterizeMap(const QRect& pixel_rect, const QTransform& transform, RasterObjects& objects);
 	
 	/**
 	 * Helper method for rasterizeMap().
+	 * 
+	 * Draws the given objects, using the given IDs (indices in the current map part).
 	 */
-	void drawObjectIDs(Map* map, QPainter* painter, const RenderConfig& config);
+	void drawObjectIDs(Map* map, QPainter* painter, const RenderConfig& config, const std::vector<std::pair<int, const Object*>>& objects);
 	
 	/**
 	 * Constructs the boundary around an area of free pixels in the given image.
@@ -93,13 +132,19 @@ protected:
 	 *  0 if the tracing fails because the start is not included in the shape,
 	 *  1 if the tracing succeeds.
 	 */
-	int traceBoundary(const QImage& image, QPoint free_pixel, QPoint boundary_pixel, std::vector<QPoint>& out_boundary);
+	int traceBoundary(const RasterTiles& image, QPoint free_pixel, QPoint boundary_pixel, std::vector<QPoint>& out_boundary);
 	
 	/**
 	 * Creates a fill object for the given image, boundary vector (of pixel positions) and transform.
 	 * Returns false if the creation fails.
 	 */
-	bool fillBoundary(const QImage& image, const std::vector<QPoint>& boundary, const QTransform& image_to_map);
+	bool fillBoundary(const RasterTiles& image, const std::vector<QPoint>& boundary, const QTransform& image_to_map);
+	
+	/**
+	 * Closes the given path, and adds it to the map as fill object.
+	 * Returns false (and deletes the path) if the path is too short.
+	 */
+	bool addFillObject(PathObject* path);
 	
 	const Symbol* drawing_symbol;
 };
@@ -21,17 +21,21 @@
 
 #include "tool_base.h"
 
+#include <cstddef>
 #include <iterator>
 #include <type_traits>
 
 #include <QtGlobal>
 #include <QMouseEvent>
+#include <QPainter>
 #include <QTimer>
 #include <QEvent>
 #include <QKeyEvent>
+#include <QRect>
 #include <QRectF>
 
 #include "core/map.h"
+#include "core/map_view.h"
 #include "core/objects/object.h"
 #include "core/renderables/renderable.h"
 #include "gui/map/map_editor.h"
@@ -39,6 +43,17 @@
 #include "gui/widgets/key_button_bar.h"  // IWYU pragma: keep
 #include "tools/tool_helpers.h"
 #include "undo/object_undo.h"
+#include "util/util.h"
+
+
+namespace
+{
+	/**
+	 * The minimum number of edited objects for which moving them
+	 * shows a drag preview image instead of updating the objects.
+	 */
+	constexpr std::size_t drag_preview_threshold = 100;
+}
 
 
 // ### MapEditorToolBase::EditedItem ###
@@ -321,6 +336,8 @@ void MapEditorToolBase::updateDirtyRect()
 	QRectF rect;
 	
 	map()->includeSelectionRect(rect);
+	if (drag_preview_active && rect.isValid())
+		rectInclude(rect, rect.translated(drag_preview_offset));
 	if (angle_helper->isActive())
 	{
 		angle_helper->includeDirtyRect(rect);
@@ -455,8 +472,8 @@ void MapEditorToolBase::updatePreviewObjects()
 	}
 	for (auto object : editedObjects())
 	{
-		object->forceUpdate(); /// @todo get rid of force if possible;
-		// NOTE: only necessary because of setMap(nullptr) in startEditing(..)
+		// Objects which were only moved keep their translated renderables.
+		object->update();
 		renderables->insertRenderablesOfObject(object);
 	}
 	updateDirtyRect();
@@ -479,7 +496,81 @@ void MapEditorToolBase::updatePreviewObjectsAsynchronously()
 
 void MapEditorToolBase::drawSelectionOrPreviewObjects(QPainter* painter, MapWidget* widget, bool draw_opaque)
 {
-	map()->drawSelection(painter, true, widget, renderables->empty() ? nullptr : renderables.get(), draw_opaque);
+	if (drag_preview_active)
+		drawDragPreview(painter, widget, draw_opaque);
+	else
+		map()->drawSelection(painter, true, widget, renderables->empty() ? nullptr : renderables.get(), draw_opaque);
+}
+
+
+bool MapEditorToolBase::startDragPreview()
+{
+	Q_ASSERT(editingInProgress());
+	
+	if (edited_items.size() < drag_preview_threshold)
+		return false;
+	
+	drag_preview_active = true;
+	drag_preview_offset = {};
+	drag_preview_images.clear();
+	return true;
+}
+
+
+void MapEditorToolBase::setDragPreviewOffset(const MapCoordF& offset)
+{
+	Q_ASSERT(drag_preview_active);
+	drag_preview_offset = offset;
+	updateDirtyRect();
+}
+
+
+void MapEditorToolBase::finishDragPreview()
+{
+	if (!drag_preview_active)
+		return;
+	
+	drag_preview_active = false;
+	drag_preview_offset = {};
+	drag_preview_images.clear();
+	updateDirtyRect();
+}
+
+
+void MapEditorToolBase::drawDragPreview(QPainter* painter, MapWidget* widget, bool draw_opaque)
+{
+	auto view = widget->getMapView();
+	auto& preview = drag_preview_images[widget];
+	if (preview.image.isNull()
+	    || !qFuzzyCompare(preview.zoom, view->getZoom())
+	    || !qFuzzyCompare(1.0 + preview.rotation, 1.0 + view->getRotation()))
+	{
+		// Render the objects at their original position, covering the
+		// selection but not more than the area around the viewport.
+		QRectF selection_rect;
+		map()->includeSelectionRect(selection_rect);
+		auto const margin = 2;
+		auto const width = widget->width();
+		auto const height = widget->height();
+		auto const pixel_rect = widget->mapToViewport(selection_rect).toAlignedRect()
+		                        .adjusted(-margin, -margin, margin, margin)
+		                        .intersected(widget->rect().adjusted(-width, -height, width, height));
+		
+		preview.zoom = view->getZoom();
+		preview.rotation = view->getRotation();
+		preview.origin = widget->viewportToMapF(pixel_rect.topLeft());
+		preview.image = QImage(pixel_rect.size(), QImage::Format_ARGB32_Premultiplied);
+		if (preview.image.isNull())
+			return;
+		
+		preview.image.fill(Qt::transparent);
+		QPainter image_painter(&preview.image);
+		image_painter.setRenderHints(painter->renderHints());
+		image_painter.translate(-pixel_rect.topLeft());
+		map()->drawSelection(&image_painter, true, widget, renderables->empty() ? nullptr : renderables.get(), draw_opaque, pixel_rect);
+	}
+	
+	painter->drawImage(widget->mapToViewport(preview.origin + drag_preview_offset), preview.image);
 }
 
 
@@ -514,7 +605,7 @@ void MapEditorToolBase::startEditing(Object* object)
 }
 
 
-void MapEditorToolBase::startEditing(const std::set<Object*>& objects)
+void MapEditorToolBase::startEditing(const ObjectSelection& objects)
 {
 	Q_ASSERT(!editingInProgress());
 	setEditingInProgress(true);
@@ -557,7 +648,7 @@ void MapEditorToolBase::finishEditing()
 	
 	if (!edited_items.empty())
 	{
-		auto undo_step = new ReplaceObjectsUndoStep(map());
+		auto undo_step = new ModifyObjectsUndoStep(map());
 		for (auto& edited_item : edited_items)
 		{
 			auto object = edited_item.active_object;
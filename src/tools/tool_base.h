@@ -23,12 +23,13 @@
 #define OPENORIENTEERING_MAP_EDITOR_TOOL_BASE_H
 
 #include <algorithm>
+#include <map>
 #include <memory>
-#include <set>
 #include <vector>
 
 #include <Qt>
 #include <QCursor>
+#include <QImage>
 #include <QObject>
 #include <QPoint>
 #include <QPointF>
@@ -37,6 +38,7 @@
 
 #include "core/map_coord.h"
 #include "core/objects/object.h"
+#include "core/objects/object_selection.h"
 #include "tools/tool.h"
 
 class QAction;
@@ -226,7 +228,7 @@ protected:
 	/// Takes care of the preview renderables handling, map dirty flag, and objects edited signal.
 	void startEditing();
 	void startEditing(Object* object);
-	void startEditing(const std::set<Object*>& objects);
+	void startEditing(const ObjectSelection& objects);
 	void abortEditing();
 	
 	ObjectsRange editedObjects() { return ObjectsRange { edited_items }; }
@@ -242,8 +244,36 @@ protected:
 	
 	/// If the tool created custom renderables (e.g. with updatePreviewObjects()), draws the preview renderables,
 	/// else draws the renderables of the selected map objects.
+	/// While a drag preview is active, draws the drag preview image instead.
 	void drawSelectionOrPreviewObjects(QPainter* painter, MapWidget* widget, bool draw_opaque = false);
 	
+	/**
+	 * Starts a drag preview for moving the edited objects as a whole.
+	 * 
+	 * While the preview is active, the objects are not modified. Instead, a
+	 * raster image of the objects is rendered once per map widget and shown
+	 * at the offset given by setDragPreviewOffset(). The tool must apply the
+	 * real change and call finishDragPreview() when the drag is finished.
+	 * Other decorations drawn by the tool, such as frames or highlight objects,
+	 * must be drawn at dragPreviewOffset() as well.
+	 * 
+	 * Returns false (and does not start the preview) if there are too few
+	 * edited objects to benefit from the preview.
+	 */
+	bool startDragPreview();
+	
+	/// Sets the offset (in map coordinates) at which the drag preview is shown.
+	void setDragPreviewOffset(const MapCoordF& offset);
+	
+	/// Stops the drag preview and releases the preview images.
+	void finishDragPreview();
+	
+	/// Returns true while a drag preview is active.
+	bool dragPreviewActive() const { return drag_preview_active; }
+	
+	/// Returns the current offset of the drag preview, or a null offset if it is not active.
+	MapCoordF dragPreviewOffset() const { return drag_preview_offset; }
+	
 	/// Activates or deactivates the angle helper, recalculates (un-)constrained cursor position,
 	/// and calls mouseMove() or dragMove() to update the tool.
 	void activateAngleHelperWhileEditing(bool enable = true);
@@ -307,11 +337,28 @@ protected:
 	QPointer<KeyButtonBar> key_button_bar;
 	
 private:
+	/**
+	 * A raster image of the edited objects, rendered for a particular map widget.
+	 */
+	struct DragPreviewImage
+	{
+		QImage image;
+		MapCoordF origin;  ///< The map position of the image's top left corner.
+		double zoom;       ///< The view's zoom at rendering time.
+		double rotation;   ///< The view's rotation at rendering time.
+	};
+	
+	/// Draws the drag preview image, rendering it first if needed.
+	void drawDragPreview(QPainter* painter, MapWidget* widget, bool draw_opaque);
+	
 	// Miscellaneous internals
 	QCursor cursor;
 	bool preview_update_triggered = false;
 	bool dragging                 = false;
 	bool dragging_canceled        = false;
+	bool drag_preview_active      = false;
+	MapCoordF drag_preview_offset;
+	std::map<const MapWidget*, DragPreviewImage> drag_preview_images;
 	std::unique_ptr<MapRenderables> renderables;
 	std::unique_ptr<MapRenderables> old_renderables;
 	std::vector<EditedItem> edited_items;
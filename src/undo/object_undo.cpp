@@ -22,11 +22,16 @@
 #include "object_undo.h"
 
 #include <algorithm>
+#include <iterator>
 
 #include <QIODevice>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include "core/map.h"
+#include "core/map_part.h"
 #include "core/objects/object.h"
+#include "core/objects/text_object.h"
 #include "core/symbols/symbol.h"
 #include "util/xml_stream_util.h"
 
@@ -34,8 +39,32 @@ namespace literal
 {
 	const QLatin1String source("source");
 	const QLatin1String part("part");
+	const QLatin1String deltas("deltas");
+	const QLatin1String delta("delta");
+	const QLatin1String symbol("symbol");
+	const QLatin1String first("first");
+	const QLatin1String coords("coords");
 }
 
+namespace
+{
+
+/**
+ * Returns an estimate of the memory occupied by the given object.
+ */
+std::size_t objectMemoryUsage(const Object* object)
+{
+	auto usage = sizeof(PathObject) + object->getRawCoordinateVector().capacity() * sizeof(MapCoord);
+	const auto& tags = object->tags();
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+		usage += std::size_t(tag.key().size() + tag.value().size()) * sizeof(QChar);
+	if (object->getType() == Object::Text)
+		usage += std::size_t(object->asText()->getText().size()) * sizeof(QChar);
+	return usage;
+}
+
+}  // namespace
+
 // ### ObjectModifyingUndoStep ###
 
 ObjectModifyingUndoStep::ObjectModifyingUndoStep(Type type, Map* map)
@@ -93,6 +122,11 @@ void ObjectModifyingUndoStep::getModifiedObjects(int part_index, ObjectSet& out)
 	}
 }
 
+std::size_t ObjectModifyingUndoStep::memoryUsage() const
+{
+	return sizeof(ObjectModifyingUndoStep) + modified_objects.capacity() * sizeof(int);
+}
+
 #ifndef NO_NATIVE_FILE_FORMAT
 
 bool ObjectModifyingUndoStep::load(QIODevice* file, int version)
@@ -198,6 +232,14 @@ void ObjectCreatingUndoStep::addObject(Object* existing, Object* object)
 	addObject(index, object);
 }
 
+std::size_t ObjectCreatingUndoStep::memoryUsage() const
+{
+	auto usage = ObjectModifyingUndoStep::memoryUsage() + objects.capacity() * sizeof(Object*);
+	for (const auto object : objects)
+		usage += objectMemoryUsage(object);
+	return usage;
+}
+
 #ifndef NO_NATIVE_FILE_FORMAT
 
 bool ObjectCreatingUndoStep::load(QIODevice* file, int version)
@@ -323,6 +365,279 @@ UndoStep* ReplaceObjectsUndoStep::undo()
 
 
 
+// ### ModifyObjectsUndoStep ###
+
+ModifyObjectsUndoStep::ModifyObjectsUndoStep(Map* map)
+: ObjectModifyingUndoStep(ModifyObjectsUndoStepType, map)
+, valid(true)
+{
+	connect(map, &Map::symbolChanged, this, &ModifyObjectsUndoStep::symbolChanged);
+	connect(map, &Map::symbolDeleted, this, &ModifyObjectsUndoStep::symbolDeleted);
+}
+
+ModifyObjectsUndoStep::~ModifyObjectsUndoStep()
+{
+	; // nothing
+}
+
+bool ModifyObjectsUndoStep::isValid() const
+{
+	return valid;
+}
+
+void ModifyObjectsUndoStep::addObject(int)
+{
+	qWarning("This implementation must not be called");
+	return;
+}
+
+void ModifyObjectsUndoStep::addObject(int existing_index, Object* original)
+{
+	ObjectModifyingUndoStep::addObject(existing_index);
+	auto const current = map->getPart(getPartIndex())->getObject(existing_index);
+	deltas.push_back(makeDelta(current, original));
+}
+
+void ModifyObjectsUndoStep::addObject(Object* existing, Object* original)
+{
+	int index = map->getPart(getPartIndex())->findObjectIndex(existing);
+	Q_ASSERT(index >= 0);
+	addObject(index, original);
+}
+
+// static
+ModifyObjectsUndoStep::ObjectDelta ModifyObjectsUndoStep::makeDelta(const Object* current, Object* original)
+{
+	ObjectDelta delta { std::unique_ptr<Object>(original), original->getSymbol(), 0, 0, {}, {}, false };
+	if (current->getType() != Object::Path || original->getType() != Object::Path)
+		return delta;
+	
+	auto const current_path = static_cast<const PathObject*>(current);
+	auto const original_path = static_cast<const PathObject*>(original);
+	if (current_path->getPatternRotation() != original_path->getPatternRotation()
+	    || current_path->getPatternOrigin() != original_path->getPatternOrigin())
+		return delta;
+	
+	// Find the range of coordinates which differs.
+	auto const& current_coords = current->getRawCoordinateVector();
+	auto const& original_coords = original->getRawCoordinateVector();
+	auto const common_size = std::min(current_coords.size(), original_coords.size());
+	auto const prefix = std::size_t(std::mismatch(
+	                        current_coords.begin(), current_coords.begin() + std::ptrdiff_t(common_size),
+	                        original_coords.begin()).first - current_coords.begin());
+	auto const suffix = std::size_t(std::mismatch(
+	                        current_coords.rbegin(), current_coords.rbegin() + std::ptrdiff_t(common_size - prefix),
+	                        original_coords.rbegin()).first - current_coords.rbegin());
+	
+	delta.first = prefix;
+	delta.count = current_coords.size() - prefix - suffix;
+	delta.coords.assign(original_coords.begin() + std::ptrdiff_t(prefix), original_coords.end() - std::ptrdiff_t(suffix));
+	if (current->tags() != original->tags())
+	{
+		delta.tags = original->tags();
+		delta.restore_tags = true;
+	}
+	delta.object.reset();
+	return delta;
+}
+
+UndoStep* ModifyObjectsUndoStep::undo()
+{
+	int const part_index = getPartIndex();
+	
+	MapPart* part = map->getPart(part_index);
+	
+	// Loaded deltas may not match the objects. Check before modifying any.
+	if (deltas.size() != modified_objects.size())
+		valid = false;
+	for (std::size_t i = 0; valid && i < deltas.size(); ++i)
+	{
+		auto const index = modified_objects[i];
+		if (index < 0 || index >= part->getNumObjects())
+		{
+			valid = false;
+		}
+		else if (!deltas[i].object)
+		{
+			auto const object = part->getObject(index);
+			valid = object->getType() == Object::Path
+			        && deltas[i].first + deltas[i].count <= object->getRawCoordinateVector().size();
+		}
+	}
+	if (!valid)
+	{
+		qWarning("ModifyObjectsUndoStep::undo(): The deltas do not match the objects");
+		return new NoOpUndoStep(map, false);
+	}
+	
+	auto undo_step = new ModifyObjectsUndoStep(map);
+	undo_step->setPartIndex(part_index);
+	undo_step->modified_objects.reserve(modified_objects.size());
+	undo_step->deltas.reserve(deltas.size());
+	
+	for (std::size_t i = 0; i < deltas.size(); ++i)
+	{
+		auto const index = modified_objects[i];
+		auto& delta = deltas[i];
+		auto object = part->getObject(index);
+		undo_step->modified_objects.push_back(index);
+		
+		if (delta.object)
+		{
+			auto const original = delta.object.release();
+			part->setObject(original, index, false);
+			undo_step->deltas.push_back({ std::unique_ptr<Object>(object), object->getSymbol(), 0, 0, {}, {}, false });
+			continue;
+		}
+		
+		Q_ASSERT(object->getType() == Object::Path);
+		auto const& coords = object->getRawCoordinateVector();
+		auto const first = coords.begin() + std::ptrdiff_t(delta.first);
+		ObjectDelta redo { {}, object->getSymbol(), delta.first, delta.coords.size(),
+		                   MapCoordVector(first, first + std::ptrdiff_t(delta.count)), {}, delta.restore_tags };
+		if (delta.restore_tags)
+			redo.tags = object->tags();
+		
+		object->setSymbol(delta.symbol, true);
+		static_cast<PathObject*>(object)->replaceCoordinateRange(delta.first, delta.count, delta.coords);
+		if (delta.restore_tags)
+			object->setTags(delta.tags);
+		object->update();
+		
+		undo_step->deltas.push_back(std::move(redo));
+	}
+	
+	return undo_step;
+}
+
+std::size_t ModifyObjectsUndoStep::memoryUsage() const
+{
+	auto usage = sizeof(ModifyObjectsUndoStep) + modified_objects.capacity() * sizeof(int)
+	             + deltas.capacity() * sizeof(ObjectDelta);
+	for (const auto& delta : deltas)
+	{
+		if (delta.object)
+			usage += objectMemoryUsage(delta.object.get());
+		usage += delta.coords.capacity() * sizeof(MapCoord);
+		for (auto tag = delta.tags.begin(); tag != delta.tags.end(); ++tag)
+			usage += std::size_t(tag.key().size() + tag.value().size()) * sizeof(QChar);
+	}
+	return usage;
+}
+
+void ModifyObjectsUndoStep::saveImpl(QXmlStreamWriter& xml) const
+{
+	ObjectModifyingUndoStep::saveImpl(xml);
+	
+	XmlElementWriter deltas_element(xml, literal::deltas);
+	deltas_element.writeAttribute(XmlStreamLiteral::count, deltas.size());
+	for (const auto& delta : deltas)
+	{
+		if (delta.object)
+		{
+			delta.object->setMap(map);	// IMPORTANT: only if the object's map pointer is set it will save its symbol index correctly
+			delta.object->save(xml);
+			continue;
+		}
+		
+		XmlElementWriter delta_element(xml, literal::delta);
+		delta_element.writeAttribute(literal::symbol, map->findSymbolIndex(delta.symbol));
+		delta_element.writeAttribute(literal::first, delta.first);
+		delta_element.writeAttribute(XmlStreamLiteral::count, delta.count);
+		{
+			XmlElementWriter coords_element(xml, literal::coords);
+			coords_element.write(delta.coords);
+		}
+		if (delta.restore_tags)
+		{
+			XmlElementWriter tags_element(xml, XmlStreamLiteral::tags);
+			tags_element.write(delta.tags);
+		}
+	}
+}
+
+void ModifyObjectsUndoStep::loadImpl(QXmlStreamReader& xml, SymbolDictionary& symbol_dict)
+{
+	if (xml.name() == literal::deltas)
+	{
+		XmlElementReader deltas_element(xml);
+		auto const size = deltas_element.attribute<std::size_t>(XmlStreamLiteral::count);
+		deltas.reserve(qMin(size, std::size_t(1000))); // 1000 is not a limit
+		while (xml.readNextStartElement())
+		{
+			if (xml.name() == XmlStreamLiteral::object)
+			{
+				auto object = Object::load(xml, map, symbol_dict);
+				deltas.push_back({ std::unique_ptr<Object>(object), object->getSymbol(), 0, 0, {}, {}, false });
+			}
+			else if (xml.name() == literal::delta)
+			{
+				XmlElementReader delta_element(xml);
+				// Like Object::load, use the undefined symbol for missing symbols.
+				// Deltas are made for path objects only.
+				const Symbol* symbol = symbol_dict.value(delta_element.attribute<QString>(literal::symbol));
+				if (!symbol || !(symbol->getType() & (Symbol::Line | Symbol::Area | Symbol::Combined)))
+					symbol = Map::getUndefinedLine();
+				ObjectDelta delta { {}, symbol,
+				                    delta_element.attribute<std::size_t>(literal::first),
+				                    delta_element.attribute<std::size_t>(XmlStreamLiteral::count),
+				                    {}, {}, false };
+				while (xml.readNextStartElement())
+				{
+					if (xml.name() == literal::coords)
+					{
+						XmlElementReader(xml).read(delta.coords);
+					}
+					else if (xml.name() == XmlStreamLiteral::tags)
+					{
+						XmlElementReader(xml).read(delta.tags);
+						delta.restore_tags = true;
+					}
+					else
+					{
+						xml.skipCurrentElement(); // unknown
+					}
+				}
+				deltas.push_back(std::move(delta));
+			}
+			else
+			{
+				xml.skipCurrentElement(); // unknown
+			}
+		}
+		if (deltas.size() != modified_objects.size())
+			valid = false;
+	}
+	else
+	{
+		ObjectModifyingUndoStep::loadImpl(xml, symbol_dict);
+	}
+}
+
+void ModifyObjectsUndoStep::symbolChanged(int pos, const Symbol* new_symbol, const Symbol* old_symbol)
+{
+	Q_UNUSED(pos);
+	for (auto& delta : deltas)
+	{
+		if (delta.symbol == old_symbol)
+			delta.symbol = new_symbol;
+		if (delta.object && delta.object->getSymbol() == old_symbol)
+			delta.object->setSymbol(new_symbol, true);
+	}
+}
+
+void ModifyObjectsUndoStep::symbolDeleted(int pos, const Symbol* old_symbol)
+{
+	Q_UNUSED(pos);
+	if (std::any_of(begin(deltas), end(deltas), [old_symbol](const ObjectDelta& delta) {
+	                return delta.symbol == old_symbol; }))
+	{
+		valid = false;
+	}
+}
+
+
+
 // ### DeleteObjectsUndoStep ###
 
 DeleteObjectsUndoStep::DeleteObjectsUndoStep(Map* map)
@@ -343,16 +658,18 @@ UndoStep* DeleteObjectsUndoStep::undo()
 	AddObjectsUndoStep* undo_step = new AddObjectsUndoStep(map);
 	undo_step->setPartIndex(part_index);
 	
-	// Make sure to delete the objects in the right order so the other objects' indices stay valid
 	std::sort(modified_objects.begin(), modified_objects.end(), std::greater<int>());
 	
 	MapPart* part = map->getPart(part_index);
-	int size = (int)modified_objects.size();
-	for (int i = 0; i < size; ++i)
+	std::vector<Object*> deleted_objects;
+	deleted_objects.reserve(modified_objects.size());
+	for (int index : modified_objects)
 	{
-		undo_step->addObject(modified_objects[i], part->getObject(modified_objects[i]));
-		part->deleteObject(modified_objects[i], true);
+		Object* object = part->getObject(index);
+		undo_step->addObject(index, object);
+		deleted_objects.push_back(object);
 	}
+	part->deleteObjects(deleted_objects.begin(), deleted_objects.end(), true);
 	
 	return undo_step;
 }
@@ -399,13 +716,14 @@ UndoStep* AddObjectsUndoStep::undo()
 		order[i] = std::pair<int, int>(i, modified_objects[i]);
 	std::sort(order.begin(), order.end(), sortOrder);
 	
-	MapPart* part = map->getPart(part_index);
-	int size = (int)objects.size();
-	for (int i = 0; i < size; ++i)
+	std::vector< std::pair<int, Object*> > indexed_objects;
+	indexed_objects.reserve(order.size());
+	for (const auto& item : order)
 	{
-		undo_step->addObject(modified_objects[order[i].first]);
-		part->addObject(objects[order[i].first], order[i].second);
+		undo_step->addObject(modified_objects[item.first]);
+		indexed_objects.emplace_back(item.second, objects[item.first]);
 	}
+	map->getPart(part_index)->insertObjects(indexed_objects);
 	
 	undone = true;
 	return undo_step;
@@ -414,18 +732,18 @@ UndoStep* AddObjectsUndoStep::undo()
 void AddObjectsUndoStep::removeContainedObjects(bool emit_selection_changed)
 {
 	MapPart* part = map->getPart(getPartIndex());
-	int size = (int)objects.size();
 	bool object_deselected = false;
-	for (int i = 0; i < size; ++i)
+	for (auto object : objects)
 	{
-		if (map->isObjectSelected(objects[i]))
+		if (map->isObjectSelected(object))
 		{
-			map->removeObjectFromSelection(objects[i], false);
+			map->removeObjectFromSelection(object, false);
 			object_deselected = true;
 		}
-		part->deleteObject(objects[i], true);
-		map->setObjectsDirty();
 	}
+	part->deleteObjects(objects.begin(), objects.end(), true);
+	if (!objects.empty())
+		map->setObjectsDirty();
 	if (object_deselected && emit_selection_changed)
 		map->emitSelectionChanged();
 }
@@ -544,6 +862,8 @@ UndoStep* SwitchSymbolUndoStep::undo()
 	
 	MapPart* part = map->getPart(part_index);
 	int size = (int)modified_objects.size();
+	std::vector<Object*> objects;
+	objects.reserve(modified_objects.size());
 	for (int i = 0; i < size; ++i)
 	{
 		Object* object = part->getObject(modified_objects[i]);
@@ -551,7 +871,10 @@ UndoStep* SwitchSymbolUndoStep::undo()
 		bool ok = object->setSymbol(target_symbols[i], false);
 		Q_ASSERT(ok);
 		Q_UNUSED(ok);
+		objects.push_back(object);
 	}
+	// Regenerate the output in bulk instead of when selecting the objects.
+	map->updateObjects(objects);
 	
 	return undo_step;
 }
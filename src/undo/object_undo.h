@@ -24,11 +24,13 @@
 
 #include <cstddef>
 #include <map>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include <QObject>
 
+#include "core/map_coord.h"
 #include "core/objects/object.h"
 #include "core/symbols/symbol.h"
 #include "undo/undo.h"
@@ -79,6 +81,11 @@ public:
 	 */
 	virtual bool isEmpty() const;
 	
+	/**
+	 * Returns the indices of the objects which are modified by this undo step.
+	 */
+	const std::vector<int>& modifiedObjectIndices() const;
+	
 	/**
 	 * Adds an object (by index) to this step.
 	 * 
@@ -101,6 +108,11 @@ public:
 	 */
 	void getModifiedObjects(int part_index, ObjectSet& out) const override;
 	
+	/**
+	 * @copybrief UndoStep::memoryUsage()
+	 */
+	std::size_t memoryUsage() const override;
+	
 	
 #ifndef NO_NATIVE_FILE_FORMAT
 	/**
@@ -198,11 +210,23 @@ public:
 	 */
 	void addObject(Object* existing, Object* object);
 	
+	/**
+	 * Returns the objects contained in this undo step.
+	 * 
+	 * The objects match the indices returned by modifiedObjectIndices().
+	 */
+	const std::vector<Object*>& containedObjects() const;
+	
 	/**
 	 * @copybrief ObjectModifyingUndoStep::getModifiedObjects
 	 */
 	void getModifiedObjects(int, ObjectSet&) const override;
 	
+	/**
+	 * Returns the memory usage including the stored objects.
+	 */
+	std::size_t memoryUsage() const override;
+	
 	
 #ifndef NO_NATIVE_FILE_FORMAT
 	/**
@@ -264,6 +288,111 @@ private:
 	bool undone;
 };
 
+/**
+ * Undo step which restores the previous state of modified objects in place.
+ * 
+ * Unlike ReplaceObjectsUndoStep, this step doesn't keep complete copies of
+ * path objects. Instead, it stores the difference to the current state of
+ * the object: the range of coordinates which differs, and the symbol and the
+ * tags. Other objects, and path objects with modified pattern properties,
+ * are stored as complete copies.
+ * 
+ * The differences are determined when an object is added. So the objects
+ * must already be in their modified state at this time.
+ */
+class ModifyObjectsUndoStep : public QObject, public ObjectModifyingUndoStep
+{
+Q_OBJECT
+public:
+	ModifyObjectsUndoStep(Map* map);
+	
+	~ModifyObjectsUndoStep() override;
+	
+	bool isValid() const override;
+	
+	/**
+	 * Must not be called.
+	 * 
+	 * Use the two-parameter signatures instead of this one.
+	 */
+	void addObject(int index) override;
+	
+	/**
+	 * Adds an object to the undo step.
+	 * 
+	 * The original is a copy of the object at the given index, in the state
+	 * which is to be restored by undo(). The step takes ownership of it.
+	 */
+	void addObject(int existing_index, Object* original);
+	
+	/**
+	 * Adds an object to the undo step with the index of the existing object.
+	 */
+	void addObject(Object* existing, Object* original);
+	
+	UndoStep* undo() override;
+	
+	/**
+	 * Returns the memory usage including the stored deltas.
+	 */
+	std::size_t memoryUsage() const override;
+	
+public slots:
+	/**
+	 * Adapts the symbol pointers referencing the changed symbol.
+	 */
+	virtual void symbolChanged(int pos, const Symbol* new_symbol, const Symbol* old_symbol);
+	
+	/**
+	 * Invalidates the undo step if it references the deleted symbol.
+	 */
+	virtual void symbolDeleted(int pos, const Symbol* old_symbol);
+	
+protected:
+	void saveImpl(QXmlStreamWriter& xml) const override;
+	
+	void loadImpl(QXmlStreamReader& xml, SymbolDictionary& symbol_dict) override;
+	
+	/**
+	 * The information needed to restore a single object.
+	 * 
+	 * If object is set, it is a complete copy of the original object.
+	 * Otherwise, count coordinates starting at first are to be replaced by
+	 * coords, and the symbol and (if restore_tags is set) the tags are to be
+	 * restored.
+	 */
+	struct ObjectDelta
+	{
+		std::unique_ptr<Object> object;
+		const Symbol* symbol;
+		MapCoordVector::size_type first;
+		MapCoordVector::size_type count;
+		MapCoordVector coords;
+		Object::Tags tags;
+		bool restore_tags;
+	};
+	
+	/**
+	 * Returns the information needed to restore the original from current.
+	 * 
+	 * Takes ownership of original.
+	 */
+	static ObjectDelta makeDelta(const Object* current, Object* original);
+	
+	/**
+	 * One delta per element of modified_objects.
+	 */
+	std::vector<ObjectDelta> deltas;
+	
+	/**
+	 * A flag indicating whether this step is still valid.
+	 * 
+	 * The step becomes invalid when a referenced symbol is deleted, or when
+	 * undo() finds that loaded deltas do not match the objects.
+	 */
+	bool valid;
+};
+
 /**
  * Map undo step which deletes the referenced objects.
  * 
@@ -438,5 +567,21 @@ int ObjectModifyingUndoStep::getPartIndex() const
 	return part_index;
 }
 
+inline
+const std::vector<int>& ObjectModifyingUndoStep::modifiedObjectIndices() const
+{
+	return modified_objects;
+}
+
+
+
+// ### ObjectCreatingUndoStep inline code ###
+
+inline
+const std::vector<Object*>& ObjectCreatingUndoStep::containedObjects() const
+{
+	return objects;
+}
+
 
 #endif
@@ -69,6 +69,9 @@ UndoStep* UndoStep::getUndoStepForType(Type type, Map* map)
 	case SwitchPartUndoStepType:
 		return new SwitchPartUndoStep(map);
 		
+	case ModifyObjectsUndoStepType:
+		return new ModifyObjectsUndoStep(map);
+		
 	case MapPartUndoStepType:
 		return new MapPartUndoStep(map);
 		
@@ -107,6 +110,11 @@ void UndoStep::getModifiedObjects(int, ObjectSet&) const
 	; // nothing
 }
 
+std::size_t UndoStep::memoryUsage() const
+{
+	return sizeof(UndoStep);
+}
+
 // static
 UndoStep* UndoStep::load(QXmlStreamReader& xml, Map* map, SymbolDictionary& symbol_dict)
 {
@@ -190,6 +198,14 @@ void CombinedUndoStep::getModifiedObjects(int part_index, ObjectSet &out) const
 	}
 }
 
+std::size_t CombinedUndoStep::memoryUsage() const
+{
+	auto usage = sizeof(CombinedUndoStep) + steps.capacity() * sizeof(UndoStep*);
+	for (const auto step : steps)
+		usage += step->memoryUsage();
+	return usage;
+}
+
 #ifndef NO_NATIVE_FILE_FORMAT
 
 bool CombinedUndoStep::load(QIODevice* file, int version)
@@ -24,6 +24,7 @@
 
 #include "core/symbols/symbol.h"
 
+#include <cstddef>
 #include <set>
 #include <vector>
 
@@ -65,6 +66,7 @@ public:
 		ObjectTagsUndoStepType     =   7,
 		MapPartUndoStepType        =   8,
 		SwitchPartUndoStepType     =   9,
+		ModifyObjectsUndoStepType  =  10,
 		InvalidUndoStepType        = 999
 	};
 	
@@ -154,6 +156,15 @@ public:
 	virtual void getModifiedObjects(int part_index, ObjectSet& out) const;
 	
 	
+	/**
+	 * Returns an estimate of the memory occupied by this step, in bytes.
+	 * 
+	 * The UndoManager uses this figure to keep the history within its memory
+	 * budget. The default implementation returns the size of the base class.
+	 */
+	virtual std::size_t memoryUsage() const;
+	
+	
 #ifndef NO_NATIVE_FILE_FORMAT
 	/**
 	 * Loads the undo step from the file in the old "native" format.
@@ -250,6 +261,11 @@ public:
 	 */
 	void getModifiedObjects(int part_index, ObjectSet& out) const override;
 	
+	/**
+	 * Returns the memory usage of all sub steps.
+	 */
+	std::size_t memoryUsage() const override;
+	
 	
 	/** 
 	 * Returns the number of sub steps.
@@ -24,16 +24,24 @@
 #include <algorithm>
 #include <iterator>
 #include <limits>
+#include <numeric>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include <QtGlobal>
+#include <QByteArray>
 #include <QFlags>
+#include <QHash>
 #include <QIODevice>
 #include <QLatin1String>
 #include <QMessageBox>
 #include <QString>
 #include <QStringRef>
+#include <QTemporaryFile>
+#include <QXmlStreamAttributes>
 #include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include "core/map.h"
 #include "undo/undo.h"
@@ -46,13 +54,183 @@ Q_STATIC_ASSERT(UndoManager::max_undo_steps < std::numeric_limits<int>::max());
 namespace
 {
 
+/**
+ * Returns a dictionary of the symbols referenced in the given step XML.
+ * 
+ * The keys are the symbol indices at the time of saving, so the dictionary
+ * remains usable for loading the step after changes to the symbol set.
+ */
+SymbolDictionary referencedSymbols(const QByteArray& data, Map* map)
+{
+	SymbolDictionary symbol_dict;
+	if (!map)
+		return symbol_dict;
+	
+	QXmlStreamReader xml(data);
+	while (!xml.atEnd())
+	{
+		if (xml.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		
+		auto const key = xml.attributes().value(QLatin1String("symbol"));
+		if (key.isEmpty() || symbol_dict.contains(key.toString()))
+			continue;
+		
+		auto const index = key.toInt();
+		symbol_dict.insert(key.toString(), (index >= 0 && index < map->getNumSymbols()) ? map->getSymbol(index) : nullptr);
+	}
+	return symbol_dict;
+}
+
+
+/**
+ * A placeholder for an undo step which was written to the journal.
+ * 
+ * The placeholder keeps track of the symbols referenced by the step,
+ * and it becomes invalid when one of them is deleted.
+ * It must be replaced by the loaded step before it is executed.
+ */
+class SpilledUndoStep : public QObject, public UndoStep
+{
+public:
+	SpilledUndoStep(Type type, Map* map, QIODevice* journal, qint64 offset, qint64 size, SymbolDictionary&& symbol_dict)
+	: UndoStep(type, map)
+	, journal(journal)
+	, offset(offset)
+	, size(size)
+	, symbol_dict(std::move(symbol_dict))
+	, valid(true)
+	{
+		if (!map)
+			return;
+		
+		connect(map, &Map::symbolChanged, this, [this](int /*pos*/, const Symbol* new_symbol, const Symbol* old_symbol) {
+			for (auto& symbol : this->symbol_dict)
+			{
+				if (symbol == old_symbol)
+					symbol = const_cast<Symbol*>(new_symbol);
+			}
+		});
+		connect(map, &Map::symbolDeleted, this, [this](int /*pos*/, const Symbol* old_symbol) {
+			for (const auto symbol : this->symbol_dict)
+			{
+				if (symbol == old_symbol)
+					valid = false;
+			}
+		});
+	}
+	
+	bool isValid() const override
+	{
+		return valid;
+	}
+	
+	UndoStep* undo() override
+	{
+		Q_ASSERT(!bool("A spilled step must be loaded before it is executed"));
+		return new NoOpUndoStep(map, false);
+	}
+	
+	std::size_t memoryUsage() const override
+	{
+		return sizeof(SpilledUndoStep) + std::size_t(symbol_dict.size()) * 2 * sizeof(void*);
+	}
+	
+#ifndef NO_NATIVE_FILE_FORMAT
+	bool load(QIODevice* /*file*/, int /*version*/) override
+	{
+		return false;
+	}
+#endif
+	
+	/**
+	 * Returns the size of the record in the journal.
+	 */
+	qint64 recordSize() const
+	{
+		return size;
+	}
+	
+	/**
+	 * Returns the compressed record from the journal.
+	 * 
+	 * Returns an empty array on error.
+	 */
+	QByteArray readRecord() const
+	{
+		if (!journal->seek(offset))
+			return {};
+		
+		auto record = journal->read(size);
+		if (record.size() != size)
+			return {};
+		
+		return record;
+	}
+	
+	/**
+	 * Moves the record to the given offset in the given journal.
+	 * 
+	 * The record must have been copied to the new location already.
+	 */
+	void relocate(QIODevice* new_journal, qint64 new_offset)
+	{
+		journal = new_journal;
+		offset = new_offset;
+	}
+	
+	/**
+	 * Loads the original step from the journal.
+	 * 
+	 * Returns nullptr on error.
+	 */
+	std::unique_ptr<UndoStep> restore() const
+	{
+		auto const data = qUncompress(readRecord());
+		QXmlStreamReader xml(data);
+		if (!xml.readNextStartElement() || xml.name() != QLatin1String("step"))
+			return {};
+		
+		auto loader_symbol_dict = symbol_dict;
+		auto step = std::unique_ptr<UndoStep>(UndoStep::load(xml, map, loader_symbol_dict));
+		if (xml.hasError())
+			return {};
+		
+		return step;
+	}
+	
+private:
+	QIODevice* journal;
+	qint64 offset;
+	qint64 const size;
+	SymbolDictionary symbol_dict;
+	bool valid;
+};
+
+
+/**
+ * Saves the given steps, loading spilled steps from the journal.
+ */
 template <class iterator>
 void saveSteps(QXmlStreamWriter& xml, iterator first, iterator last)
 {
 	for (auto step = first; step != last; ++step)
-		(*step)->save(xml);
+	{
+		if (auto spilled_step = dynamic_cast<const SpilledUndoStep*>(step->get()))
+		{
+			if (auto loaded_step = spilled_step->restore())
+				loaded_step->save(xml);
+			else
+				qWarning("Failed to load an undo step from the journal");
+		}
+		else
+		{
+			(*step)->save(xml);
+		}
+	}
 }
 
+
 }  // namespace
 
 
@@ -72,12 +250,16 @@ UndoManager::State::State(UndoManager const *manager)
 
 // ### UndoManager ###
 
+constexpr qint64 UndoManager::min_journal_compaction_size;
+
+
 UndoManager::UndoManager(Map* map)
 : QObject()
 , map(map)
 , current_index(0)
 , clean_state_index(-1)
 , loaded_state_index(-1)
+, memory_budget(0)
 {
 	undo_steps.reserve(max_undo_steps + 1);  // +1 is for push before trim
 }
@@ -105,6 +287,7 @@ void UndoManager::clear()
 	}
 	
 	Q_ASSERT(undo_steps.empty());
+	journal.reset();
 }
 
 
@@ -119,6 +302,8 @@ void UndoManager::push(std::unique_ptr<UndoStep>&& step)
 	undo_steps.emplace_back(std::move(step));
 	++current_index;
 	validateUndoSteps();
+	emit stepPushed(undo_steps.back().get());
+	applyMemoryBudget();
 	emitChangedSignals(old_state);
 }
 
@@ -156,11 +341,13 @@ bool UndoManager::undo(QWidget* dialog_parent)
 		}
 	}
 	
+	emit aboutToExecute(step);
 	UndoStep* redo_step = step->undo();
 	updateMapState(step);
 	
 	--current_index;
 	undo_steps[StepList::size_type(current_index)].reset(redo_step);
+	applyMemoryBudget();
 	
 	emitChangedSignals(old_state);
 	
@@ -193,11 +380,13 @@ bool UndoManager::redo(QWidget* dialog_parent)
 		return false;
 	}
 	
+	emit aboutToExecute(step);
 	UndoStep* undo_step = step->undo();
 	updateMapState(step);
 	
 	undo_steps[StepList::size_type(current_index)].reset(undo_step);
 	++current_index;
+	applyMemoryBudget();
 	
 	emitChangedSignals(old_state);
 	
@@ -468,6 +657,7 @@ void UndoManager::loadUndo(QXmlStreamReader& xml, SymbolDictionary& symbol_dict)
 	using std::swap;
 	swap(undo_steps, loaded_steps);
 	current_index = int(undo_steps.size());
+	applyMemoryBudget();
 	setLoaded();
 	setClean();
 	emitChangedSignals(old_state);
@@ -486,6 +676,7 @@ void UndoManager::loadRedo(QXmlStreamReader& xml, SymbolDictionary& symbol_dict)
 	clearRedoSteps();
 	UndoManager::State old_state(this);
 	std::move(loaded_steps.rbegin(), loaded_steps.rend(), std::back_inserter(undo_steps)); 
+	applyMemoryBudget();
 	emitChangedSignals(old_state);
 }
 
@@ -503,3 +694,185 @@ UndoManager::StepList UndoManager::loadSteps(QXmlStreamReader& xml, SymbolDictio
 	}
 	return steps;
 }
+
+
+
+std::size_t UndoManager::memoryBudget() const
+{
+	return memory_budget;
+}
+
+
+void UndoManager::setMemoryBudget(std::size_t budget)
+{
+	if (budget == memory_budget)
+		return;
+	
+	memory_budget = budget;
+	if (memory_budget == 0)
+	{
+		for (auto i = StepList::size_type(0); i < undo_steps.size(); ++i)
+			restoreStep(i);
+		journal.reset();
+	}
+	applyMemoryBudget();
+}
+
+
+std::size_t UndoManager::memoryUsage() const
+{
+	return std::accumulate(begin(undo_steps), end(undo_steps), std::size_t(0), [](auto usage, auto&& step) {
+		return usage + step->memoryUsage();
+	});
+}
+
+
+qint64 UndoManager::journalSize() const
+{
+	return journal ? journal->size() : 0;
+}
+
+
+void UndoManager::applyMemoryBudget()
+{
+	if (undo_steps.empty())
+		return;
+	
+	// The next undo step and the next redo step are always kept in memory.
+	auto const current = StepList::size_type(current_index);
+	if (current > 0)
+		restoreStep(current - 1);
+	if (current < undo_steps.size())
+		restoreStep(current);
+	
+	if (memory_budget == 0)
+		return;
+	
+	std::vector<std::size_t> usage;
+	usage.reserve(undo_steps.size());
+	std::transform(begin(undo_steps), end(undo_steps), std::back_inserter(usage), [](auto&& step) {
+		return step->memoryUsage();
+	});
+	auto total = std::accumulate(begin(usage), end(usage), std::size_t(0));
+	
+	// Spill the steps which are farthest from the current state first.
+	auto first = StepList::size_type(0);
+	auto last = undo_steps.size();
+	while (total > memory_budget)
+	{
+		auto const undo_distance = first + 1 < current ? current - 1 - first : 0;
+		auto const redo_distance = last > current + 1 ? last - 1 - current : 0;
+		if (undo_distance == 0 && redo_distance == 0)
+			break;
+		
+		auto const index = undo_distance >= redo_distance ? first++ : --last;
+		if (spillStep(index))
+			total = total - usage[index] + undo_steps[index]->memoryUsage();
+	}
+	
+	compactJournal();
+}
+
+
+void UndoManager::compactJournal()
+{
+	if (!journal)
+		return;
+	
+	std::vector<SpilledUndoStep*> spilled_steps;
+	qint64 used_size = 0;
+	for (auto& step : undo_steps)
+	{
+		if (auto spilled_step = dynamic_cast<SpilledUndoStep*>(step.get()))
+		{
+			spilled_steps.push_back(spilled_step);
+			used_size += spilled_step->recordSize();
+		}
+	}
+	
+	if (spilled_steps.empty())
+	{
+		journal.reset();
+		return;
+	}
+	
+	if (journal->size() <= std::max(2 * used_size, min_journal_compaction_size))
+		return;
+	
+	// Copy the records in use to a new journal. The placeholders are
+	// updated only when all records are copied.
+	auto compacted = std::make_unique<QTemporaryFile>();
+	if (!compacted->open())
+	{
+		qWarning("Cannot open the undo journal: %s", qPrintable(compacted->errorString()));
+		return;
+	}
+	
+	std::vector<qint64> offsets;
+	offsets.reserve(spilled_steps.size());
+	for (auto spilled_step : spilled_steps)
+	{
+		auto const record = spilled_step->readRecord();
+		offsets.push_back(compacted->pos());
+		if (record.isEmpty() || compacted->write(record) != record.size())
+			return;
+	}
+	
+	for (std::size_t i = 0; i < spilled_steps.size(); ++i)
+		spilled_steps[i]->relocate(compacted.get(), offsets[i]);
+	journal = std::move(compacted);
+}
+
+
+bool UndoManager::spillStep(StepList::size_type index)
+{
+	auto& step = undo_steps[index];
+	if (!step->isValid()
+	    || dynamic_cast<SpilledUndoStep*>(step.get())
+	    || step->memoryUsage() <= sizeof(SpilledUndoStep))
+	{
+		return false;
+	}
+	
+	if (!journal)
+	{
+		journal = std::make_unique<QTemporaryFile>();
+		if (!journal->open())
+		{
+			qWarning("Cannot open the undo journal: %s", qPrintable(journal->errorString()));
+			journal.reset();
+			return false;
+		}
+	}
+	
+	QByteArray buffer;
+	{
+		QXmlStreamWriter xml(&buffer);
+		step->save(xml);
+	}
+	
+	auto const data = qCompress(buffer);
+	auto const offset = journal->size();
+	if (!journal->seek(offset) || journal->write(data) != data.size())
+		return false;
+	
+	auto const type = step->getType();
+	step = std::make_unique<SpilledUndoStep>(type, map, journal.get(), offset, qint64(data.size()), referencedSymbols(buffer, map));
+	return true;
+}
+
+
+void UndoManager::restoreStep(StepList::size_type index)
+{
+	auto& step = undo_steps[index];
+	auto spilled_step = dynamic_cast<SpilledUndoStep*>(step.get());
+	if (!spilled_step)
+		return;
+	
+	std::unique_ptr<UndoStep> loaded_step;
+	if (spilled_step->isValid())
+		loaded_step = spilled_step->restore();
+	if (!loaded_step)
+		loaded_step = std::make_unique<NoOpUndoStep>(map, false);
+	step = std::move(loaded_step);
+}
@@ -32,6 +32,7 @@
 #include "core/symbols/symbol.h"
 
 class QIODevice;
+class QTemporaryFile;
 class QWidget;
 class QXmlStreamReader;
 class QXmlStreamWriter;
@@ -198,15 +199,54 @@ public:
 	void loadRedo(QXmlStreamReader& xml, SymbolDictionary& symbol_dict);
 	
 	
+	/**
+	 * Returns the memory budget for the steps kept in memory, in bytes.
+	 * 
+	 * A value of zero means that all steps are kept in memory.
+	 */
+	std::size_t memoryBudget() const;
+	
+	/**
+	 * Sets the memory budget for the steps kept in memory, in bytes.
+	 * 
+	 * When the steps occupy more memory than the budget, the steps which are
+	 * farthest from the current state are written to a compressed journal in
+	 * a temporary file. They are loaded back when they are needed for undo(),
+	 * redo() or saving. The next undo step and the next redo step are always
+	 * kept in memory. The journal is compacted when most of its records are
+	 * no longer in use, and it is removed by clear().
+	 * 
+	 * A budget of zero loads all steps back and disables the journal.
+	 */
+	void setMemoryBudget(std::size_t budget);
+	
+	/**
+	 * Returns the memory occupied by the steps kept in memory, in bytes.
+	 * 
+	 * @see UndoStep::memoryUsage()
+	 */
+	std::size_t memoryUsage() const;
+	
+	/**
+	 * Returns the size of the journal of spilled steps, in bytes.
+	 */
+	qint64 journalSize() const;
+	
+	
 	/**
 	 * The maximum number of steps kept for undo() and redo(), respectively.
 	 * 
-	 * This limits the amount of memory occupied by undo steps.
+	 * The memory occupied by these steps is limited by the memory budget.
 	 * 
-	 * @todo Make this configurable (maybe by used memory instead of step count)
+	 * @see setMemoryBudget()
 	 */
 	static constexpr std::size_t max_undo_steps = 128;
 	
+	/**
+	 * The minimum size of the journal of spilled steps for compaction.
+	 */
+	static constexpr qint64 min_journal_compaction_size = 1024 * 1024;
+	
 signals:
 	/**
 	 * This signal is emitted whenever the value of canUndo() changes.
@@ -228,6 +268,20 @@ signals:
 	 */
 	void loadedChanged(bool loaded);
 	
+	/**
+	 * This signal is emitted when a new step was pushed.
+	 * 
+	 * At this point, the map already contains the change which is reverted
+	 * by the step.
+	 */
+	void stepPushed(UndoStep* step);
+	
+	/**
+	 * This signal is emitted by undo() and redo() immediately before the
+	 * given step is executed.
+	 */
+	void aboutToExecute(UndoStep* step);
+	
 protected:
 	/**
 	 * A list of UndoSteps.
@@ -299,6 +353,36 @@ private:
 	
 	StepList loadSteps(QXmlStreamReader& xml, SymbolDictionary& symbol_dict) const;
 	
+	/**
+	 * Writes steps to the journal until the memory budget is met.
+	 * 
+	 * Loads the next undo step and the next redo step if they are spilled.
+	 */
+	void applyMemoryBudget();
+	
+	/**
+	 * Replaces the step at the given index by a placeholder for the journal.
+	 * 
+	 * Returns false if the step is not written to the journal.
+	 */
+	bool spillStep(StepList::size_type index);
+	
+	/**
+	 * Replaces a placeholder at the given index by the step from the journal.
+	 * 
+	 * If the step cannot be loaded, it is replaced by an invalid step.
+	 */
+	void restoreStep(StepList::size_type index);
+	
+	/**
+	 * Rewrites the journal with only the records of the spilled steps.
+	 * 
+	 * Steps which are loaded back leave unused records in the journal. The
+	 * journal is rewritten when these records occupy more than half of it.
+	 * It is removed when there are no spilled steps.
+	 */
+	void compactJournal();
+	
 	/**
 	 * The list of all steps available for undo() and redo().
 	 * 
@@ -340,6 +424,18 @@ private:
 	 */
 	int loaded_state_index;
 	
+	/**
+	 * The memory budget for the steps kept in memory.
+	 * 
+	 * @see setMemoryBudget()
+	 */
+	std::size_t memory_budget;
+	
+	/**
+	 * The journal of the spilled steps, created on demand.
+	 */
+	std::unique_ptr<QTemporaryFile> journal;
+	
 };
 
 
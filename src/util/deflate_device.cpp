@@ -0,0 +1,305 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "deflate_device.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+#include <zlib.h>
+
+
+namespace {
+
+/// The size of the chunks which are handed over to the worker thread.
+constexpr int chunk_size = 256 * 1024;
+
+/// The maximum number of chunks waiting for compression.
+constexpr std::size_t max_queued_chunks = 4;
+
+/// The size of the buffers for compressed data.
+constexpr int buffer_size = 64 * 1024;
+
+/// Selects the gzip wrapper for deflateInit2() and inflateInit2().
+constexpr int gzip_window_bits = 15 + 16;
+
+}  // namespace
+
+
+
+// ### DeflateDevice ###
+
+DeflateDevice::DeflateDevice(QIODevice* target, QObject* parent)
+: QIODevice(parent)
+, target(target)
+{
+	// nothing else
+}
+
+DeflateDevice::~DeflateDevice()
+{
+	close();
+}
+
+bool DeflateDevice::isSequential() const
+{
+	return true;
+}
+
+bool DeflateDevice::open(OpenMode mode)
+{
+	if (isOpen() || mode != WriteOnly || !target->isWritable())
+		return false;
+		
+	pending.reserve(chunk_size);
+	error.clear();
+	finishing = false;
+	QIODevice::open(mode);
+	worker = QtConcurrent::run(this, &DeflateDevice::compress);
+	return true;
+}
+
+void DeflateDevice::close()
+{
+	finish();
+}
+
+bool DeflateDevice::finish()
+{
+	if (!isOpen())
+		return error.isEmpty();
+		
+	{
+		QMutexLocker lock(&mutex);
+		if (!pending.isEmpty())
+		{
+			queue.emplace_back();
+			queue.back().swap(pending);
+		}
+		finishing = true;
+		condition.wakeAll();
+	}
+	worker.waitForFinished();
+	QIODevice::close();
+	
+	if (!error.isEmpty())
+	{
+		setErrorString(error);
+		return false;
+	}
+	return true;
+}
+
+qint64 DeflateDevice::readData(char* /*data*/, qint64 /*max_size*/)
+{
+	return -1;
+}
+
+qint64 DeflateDevice::writeData(const char* data, qint64 size)
+{
+	pending.append(data, int(size));
+	if (pending.size() >= chunk_size)
+	{
+		QMutexLocker lock(&mutex);
+		while (queue.size() >= max_queued_chunks && error.isEmpty())
+			condition.wait(&mutex);
+		if (!error.isEmpty())
+		{
+			setErrorString(error);
+			return -1;
+		}
+		queue.emplace_back();
+		queue.back().swap(pending);
+		pending.reserve(chunk_size);
+		condition.wakeAll();
+	}
+	return size;
+}
+
+void DeflateDevice::compress()
+{
+	auto fail = [this](const QString& message) {
+		QMutexLocker lock(&mutex);
+		error = message;
+		queue.clear();
+		condition.wakeAll();
+	};
+	
+	z_stream stream = {};
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		fail(tr("Failed to initialize the compression."));
+		return;
+	}
+	
+	QByteArray output(buffer_size, Qt::Uninitialized);
+	for (bool last_chunk = false; !last_chunk; )
+	{
+		QByteArray chunk;
+		{
+			QMutexLocker lock(&mutex);
+			while (queue.empty() && !finishing)
+				condition.wait(&mutex);
+			last_chunk = finishing && queue.size() <= 1;
+			if (!queue.empty())
+			{
+				chunk.swap(queue.front());
+				queue.pop_front();
+			}
+			condition.wakeAll();
+		}
+		
+		stream.next_in = reinterpret_cast<Bytef*>(chunk.data());
+		stream.avail_in = uInt(chunk.size());
+		do
+		{
+			stream.next_out = reinterpret_cast<Bytef*>(output.data());
+			stream.avail_out = uInt(output.size());
+			if (deflate(&stream, last_chunk ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR)
+			{
+				deflateEnd(&stream);
+				fail(tr("Failed to compress the data."));
+				return;
+			}
+			auto const size = qint64(output.size()) - stream.avail_out;
+			if (target->write(output.constData(), size) != size)
+			{
+				deflateEnd(&stream);
+				fail(target->errorString());
+				return;
+			}
+		}
+		while (stream.avail_out == 0);
+	}
+	deflateEnd(&stream);
+}
+
+
+
+// ### InflateDevice ###
+
+InflateDevice::InflateDevice(QIODevice* source, QObject* parent)
+: QIODevice(parent)
+, source(source)
+{
+	// nothing else
+}
+
+InflateDevice::~InflateDevice()
+{
+	close();
+}
+
+// static
+bool InflateDevice::isCompressed(const unsigned char* buffer, std::size_t size)
+{
+	return size >= 3 && buffer[0] == 0x1f && buffer[1] == 0x8b && buffer[2] == Z_DEFLATED;
+}
+
+bool InflateDevice::isSequential() const
+{
+	return true;
+}
+
+bool InflateDevice::open(OpenMode mode)
+{
+	if (isOpen() || mode != ReadOnly || !source->isReadable())
+		return false;
+		
+	stream.reset(new z_stream());
+	if (inflateInit2(stream.get(), gzip_window_bits) != Z_OK)
+	{
+		stream.reset();
+		setErrorString(tr("Failed to initialize the decompression."));
+		return false;
+	}
+	stream_end = false;
+	failed = false;
+	return QIODevice::open(mode);
+}
+
+void InflateDevice::close()
+{
+	if (stream)
+	{
+		inflateEnd(stream.get());
+		stream.reset();
+	}
+	input.clear();
+	QIODevice::close();
+}
+
+bool InflateDevice::hasError() const
+{
+	return failed;
+}
+
+bool InflateDevice::atEnd() const
+{
+	return stream_end && QIODevice::atEnd();
+}
+
+qint64 InflateDevice::readData(char* data, qint64 max_size)
+{
+	if (stream_end)
+		return 0;
+		
+	max_size = std::min(max_size, qint64(std::numeric_limits<uInt>::max()));
+	stream->next_out = reinterpret_cast<Bytef*>(data);
+	stream->avail_out = uInt(max_size);
+	while (stream->avail_out > 0 && !stream_end)
+	{
+		if (stream->avail_in == 0)
+		{
+			input = source->read(buffer_size);
+			if (input.isEmpty())
+			{
+				setErrorString(tr("Unexpected end of compressed data."));
+				failed = stream_end = true;
+				break;
+			}
+			stream->next_in = reinterpret_cast<Bytef*>(input.data());
+			stream->avail_in = uInt(input.size());
+		}
+		
+		switch (inflate(stream.get(), Z_NO_FLUSH))
+		{
+			case Z_STREAM_END:
+				stream_end = true;
+				break;
+			case Z_OK:
+			case Z_BUF_ERROR:
+				break;
+			default:
+				setErrorString(stream->msg ? QString::fromLatin1(stream->msg) : tr("Invalid compressed data."));
+				failed = stream_end = true;
+		}
+	}
+	return max_size - stream->avail_out;
+}
+
+qint64 InflateDevice::writeData(const char* /*data*/, qint64 /*size*/)
+{
+	return -1;
+}
@@ -0,0 +1,173 @@
+/*
+ *    Copyright 2026 agent
+ * 
+ *    This file is part of OpenOrienteering.
+ * 
+ *    OpenOrienteering is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ * 
+ *    OpenOrienteering is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ * 
+ *    You should have received a copy of the GNU General Public License
+ *    along with OpenOrienteering.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENORIENTEERING_UTIL_DEFLATE_DEVICE_H
+#define OPENORIENTEERING_UTIL_DEFLATE_DEVICE_H
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QFuture>
+#include <QIODevice>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QWaitCondition>
+
+struct z_stream_s;
+
+
+/**
+ * A write-only device which compresses all data in the gzip format.
+ * 
+ * The data is collected in chunks. The chunks are compressed and written to
+ * the target device on a worker thread, so that compression overlaps with
+ * the production of the data. The target device must not be accessed by
+ * other code until the device is closed.
+ */
+class DeflateDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	/**
+	 * Constructs a new device which writes to the given target.
+	 * 
+	 * The target must be open for writing.
+	 */
+	explicit DeflateDevice(QIODevice* target, QObject* parent = nullptr);
+	
+	/**
+	 * Destroys the device, finishing the compressed stream if still open.
+	 */
+	~DeflateDevice() override;
+	
+	/**
+	 * Returns true.
+	 */
+	bool isSequential() const override;
+	
+	/**
+	 * Opens the device. Only QIODevice::WriteOnly is supported.
+	 */
+	bool open(OpenMode mode) override;
+	
+	/**
+	 * Finishes the compressed stream and closes the device.
+	 */
+	void close() override;
+	
+	/**
+	 * Finishes the compressed stream and closes the device.
+	 * 
+	 * Returns false if the data could not be compressed or written completely.
+	 * In this case, errorString() describes the error.
+	 */
+	bool finish();
+	
+protected:
+	qint64 readData(char* data, qint64 max_size) override;
+	
+	qint64 writeData(const char* data, qint64 size) override;
+	
+private:
+	/** Compresses queued chunks until the device is closed. */
+	void compress();
+	
+	QIODevice* target;
+	QByteArray pending;
+	
+	QMutex mutex;
+	QWaitCondition condition;
+	std::deque<QByteArray> queue;  // guarded by mutex
+	QString error;                 // guarded by mutex
+	bool finishing = false;        // guarded by mutex
+	
+	QFuture<void> worker;
+};
+
+
+/**
+ * A read-only device which decompresses data in the gzip format.
+ * 
+ * The data is decompressed on demand while it is read from this device.
+ * Invalid or truncated compressed data ends the data prematurely, and
+ * hasError() will return true.
+ */
+class InflateDevice : public QIODevice
+{
+	Q_OBJECT
+	
+public:
+	/**
+	 * Constructs a new device which reads from the given source.
+	 * 
+	 * The source must be open for reading.
+	 */
+	explicit InflateDevice(QIODevice* source, QObject* parent = nullptr);
+	
+	~InflateDevice() override;
+	
+	/**
+	 * Returns true if the given data starts with the gzip magic bytes.
+	 */
+	static bool isCompressed(const unsigned char* buffer, std::size_t size);
+	
+	/**
+	 * Returns true.
+	 */
+	bool isSequential() const override;
+	
+	/**
+	 * Opens the device. Only QIODevice::ReadOnly is supported.
+	 */
+	bool open(OpenMode mode) override;
+	
+	void close() override;
+	
+	/**
+	 * Returns true if the compressed data was found to be invalid or truncated.
+	 */
+	bool hasError() const;
+	
+	/**
+	 * Returns true when the end of the compressed stream has been reached
+	 * and all data has been read.
+	 */
+	bool atEnd() const override;
+	
+protected:
+	qint64 readData(char* data, qint64 max_size) override;
+	
+	qint64 writeData(const char* data, qint64 size) override;
+	
+private:
+	QIODevice* source;
+	QByteArray input;
+	std::unique_ptr<z_stream_s> stream;
+	bool stream_end = false;
+	bool failed = false;
+};
+
+
+#endif
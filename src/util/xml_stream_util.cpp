@@ -21,6 +21,7 @@
 #include "xml_stream_util.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <exception>
 #include <limits>
 #include <stdexcept>
@@ -41,6 +42,15 @@
 #include "fileformats/xml_file_format.h"
 
 
+namespace {
+
+/// The number of coordinates which are formatted before writing to the device.
+constexpr std::size_t coords_per_chunk = 4096;
+
+}  // namespace
+
+
+
 void writeLineBreak(QXmlStreamWriter& xml)
 {
 	if (!xml.autoFormatting())
@@ -149,6 +159,32 @@ bool XmlRecoveryHelper::operator() ()
 
 
 
+//### DeferredCoords ###
+
+void DeferredCoords::parse(MapCoordVector& coords) const
+{
+	coords.clear();
+	coords.reserve(std::min(count, 500000u));
+	
+	try
+	{
+		MapCoord::parseRun(QStringRef(&text), coords);
+	}
+	catch (std::exception& e)
+	{
+		Q_UNUSED(e)
+		qDebug("Could not parse the coordinates: %s", e.what());
+		throw FileFormatException(ImportExport::tr("Could not parse the coordinates."));
+	}
+	
+	if (coords.size() != count)
+	{
+		throw FileFormatException(ImportExport::tr("Expected %1 coordinates, found %2.").arg(count).arg(coords.size()));
+	}
+}
+
+
+
 //### XmlElementWriter ###
 
 void XmlElementWriter::write(const MapCoordVector& coords)
@@ -163,9 +199,34 @@ void XmlElementWriter::write(const MapCoordVector& coords)
 		for (auto& coord : coords)
 			coord.save(xml);
 	}
+	else if (!coords.empty() && xml.device() && xml.codec() && xml.codec()->mibEnum() == 106)  // UTF-8
+	{
+		// Default: efficient plain text format, directly written as UTF-8
+		//   The text needs no escaping, so it can bypass the QXmlStreamWriter
+		// when the start element has been finished. Writing empty characters
+		// does just that.
+		xml.writeCharacters(QString{});
+		
+		auto const device = xml.device();
+		QByteArray data;
+		data.resize(int(std::min(coords.size(), coords_per_chunk) * MapCoord::max_utf8_size));
+		auto const begin = data.data();
+		auto const last = begin + data.size() - MapCoord::max_utf8_size;
+		auto end = begin;
+		for (auto& coord : coords)
+		{
+			if (end > last)
+			{
+				device->write(begin, end - begin);
+				end = begin;
+			}
+			end = coord.toUtf8(end);
+		}
+		device->write(begin, end - begin);
+	}
 	else
 	{
-		// Default: efficient plain text format
+		// Efficient plain text format, for writers without device
 		//   Note that it is more efficient to concatenate the data
 		// than to call writeCharacters() multiple times.
 		QString data;
@@ -200,13 +261,9 @@ void XmlElementReader::read(MapCoordVector& coords)
 			}
 			else if (token == QXmlStreamReader::Characters && !xml.isWhitespace())
 			{
-				QStringRef text = xml.text();
 				try
 				{
-					while (text.length())
-					{
-						coords.emplace_back(text);
-					}
+					MapCoord::parseRun(xml.text(), coords);
 				}
 				catch (std::exception& e)
 				{
@@ -239,3 +296,58 @@ void XmlElementReader::read(MapCoordVector& coords)
 		throw FileFormatException(ImportExport::tr("Expected %1 coordinates, found %2."));
 	}
 }
+
+
+void XmlElementReader::read(MapCoordVector& coords, DeferredCoords& deferred)
+{
+	namespace literal = XmlStreamLiteral;
+	
+	coords.clear();
+	deferred.text.clear();
+	deferred.count = attribute<unsigned int>(literal::count);
+	deferred.line = xml.lineNumber();
+	deferred.column = xml.columnNumber();
+	
+	try
+	{
+		for( xml.readNext(); xml.tokenType() != QXmlStreamReader::EndElement; xml.readNext() )
+		{
+			const QXmlStreamReader::TokenType token = xml.tokenType();
+			if (xml.error() || token == QXmlStreamReader::EndDocument)
+			{
+				throw FileFormatException(ImportExport::tr("Could not parse the coordinates."));
+			}
+			else if (token == QXmlStreamReader::Characters && !xml.isWhitespace())
+			{
+				deferred.text.append(xml.text());
+			}
+			else if (token == QXmlStreamReader::StartElement)
+			{
+				if (xml.name() == literal::coord)
+				{
+					coords.emplace_back(MapCoord::load(xml));
+				}
+				else
+				{
+					xml.skipCurrentElement();
+				}
+			}
+			// otherwise: ignore element
+		}
+	}
+	catch (std::range_error &e)
+	{
+		throw FileFormatException(MapCoord::tr(e.what()));
+	}
+	
+	if (!deferred.text.isEmpty())
+	{
+		// The formats are not mixed in valid files.
+		if (!coords.empty())
+			throw FileFormatException(ImportExport::tr("Could not parse the coordinates."));
+	}
+	else if (coords.size() != deferred.count)
+	{
+		throw FileFormatException(ImportExport::tr("Expected %1 coordinates, found %2.").arg(deferred.count).arg(coords.size()));
+	}
+}
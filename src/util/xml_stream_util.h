@@ -43,6 +43,29 @@ class MapCoord;  // IWYU pragma: keep
 using MapCoordVector = std::vector<MapCoord>;
 
 
+/**
+ * Coordinates in the simple text format which are read but not yet parsed.
+ * 
+ * Parsing this text does not depend on the XML stream. Thus the coordinates of
+ * many objects can be parsed concurrently after the stream was read.
+ */
+struct DeferredCoords
+{
+	QString text;             ///< The unparsed coordinates, or empty if nothing is deferred.
+	unsigned int count = 0;   ///< The expected number of coordinates.
+	qint64 line = 0;          ///< The line of the coords element, for error messages.
+	qint64 column = 0;        ///< The column of the coords element, for error messages.
+	
+	/**
+	 * Parses the text into coords.
+	 * 
+	 * Throws FileFormatException on error.
+	 */
+	void parse(MapCoordVector& coords) const;
+};
+
+
+
 /**
  * Writes a line break to the XML stream unless auto formatting is active.
  */
@@ -341,6 +364,15 @@ public:
 	 */
 	void read(MapCoordVector& coords);
 	
+	/**
+	 * Reads the coordinates vector, but defers parsing the simple text format.
+	 * 
+	 * Coordinates in the syntactically rich format are read into coords
+	 * immediately. Coordinates in the simple text format are left in deferred,
+	 * to be parsed by DeferredCoords::parse().
+	 */
+	void read(MapCoordVector& coords, DeferredCoords& deferred);
+	
 	/**
 	 * Read tags.
 	 */
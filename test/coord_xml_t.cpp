@@ -20,6 +20,7 @@
 #include "coord_xml_t.h"
 
 #include <algorithm>
+#include <limits>
 
 #include <QtTest>
 
@@ -368,6 +369,75 @@ void CoordXmlTest::writeFastImplementation()
 }
 
 
+void CoordXmlTest::writeStringImplementation_data()
+{
+	common_data();
+}
+
+void CoordXmlTest::writeStringImplementation()
+{
+	QString string;
+	string.reserve(5000000);
+	QXmlStreamWriter xml(&string);
+	xml.setAutoFormatting(false);
+	xml.writeStartDocument();
+	
+	XMLFileFormat::active_version = 6; // Activate fast text format.
+	XmlElementWriter element(xml, QLatin1String("root"));
+	
+	QFETCH(int, num_coords);
+	MapCoordVector coords(num_coords, proto_coord);
+	QBENCHMARK
+	{
+		element.write(coords);
+	}
+	
+	xml.writeEndDocument();
+}
+
+
+void CoordXmlTest::writeUtf8Test()
+{
+	auto const min = std::numeric_limits<qint32>::min();
+	auto const max = std::numeric_limits<qint32>::max();
+	MapCoordVector coords = {
+	    MapCoord::fromNative(0, 0),
+	    proto_coord,
+	    MapCoord::fromNative(9, -10, MapCoord::ClosePoint),
+	    MapCoord::fromNative(99, 100, MapCoord::HolePoint),
+	    MapCoord::fromNative(123456789, -987654321, MapCoord::Flags(255)),
+	    MapCoord::fromNative(max, min),
+	    MapCoord::fromNative(min, max),
+	};
+	
+	char buffer[MapCoord::max_utf8_size];
+	for (auto const& coord : coords)
+	{
+		auto const end = coord.toUtf8(buffer);
+		QVERIFY(end - buffer <= int(MapCoord::max_utf8_size));
+		QCOMPARE(QString::fromUtf8(buffer, int(end - buffer)), coord.toString());
+	}
+	
+	// The device and string implementations must produce the same output.
+	XMLFileFormat::active_version = 6; // Activate fast text format.
+	auto write = [&coords](QXmlStreamWriter& xml) {
+		XmlElementWriter element(xml, QLatin1String("coords"));
+		element.write(coords);
+	};
+	
+	QBuffer device;
+	device.open(QBuffer::WriteOnly);
+	QXmlStreamWriter device_xml(&device);
+	write(device_xml);
+	
+	QString string;
+	QXmlStreamWriter string_xml(&string);
+	write(string_xml);
+	
+	QCOMPARE(QString::fromUtf8(device.data()), string);
+}
+
+
 void CoordXmlTest::readXml_data()
 {
 	common_data();
@@ -1059,6 +1129,142 @@ void CoordXmlTest::readFastImplementation()
 }
 
 
+void CoordXmlTest::readDeferredImplementation_data()
+{
+	common_data();
+}
+
+void CoordXmlTest::readDeferredImplementation()
+{
+	QFETCH(int, num_coords);
+	MapCoordVector coords(num_coords, proto_coord);
+	
+	buffer.buffer().truncate(0);
+	QBuffer header;
+	{
+		QXmlStreamWriter xml(&header);
+		
+		header.open(QBuffer::ReadWrite);
+		xml.setAutoFormatting(false);
+		xml.setAutoFormatting(false);
+		xml.writeStartDocument();
+		
+		XMLFileFormat::active_version = 6; // Activate fast text format.
+		
+		xml.writeStartElement(QString::fromLatin1("root"));
+		xml.writeCharacters(QString{}); // flush root start element
+		
+		buffer.open(QBuffer::ReadWrite);
+		xml.setDevice(&buffer);
+		{
+			XmlElementWriter element(xml, QLatin1String("coords"));
+			element.write(coords);
+		}
+		
+		xml.setDevice(nullptr);
+		
+		buffer.close();
+		header.close();
+	}
+	
+	header.open(QBuffer::ReadOnly);
+	buffer.open(QBuffer::ReadOnly);
+	QXmlStreamReader xml;
+	xml.addData(header.buffer());
+	xml.readNextStartElement();
+	QCOMPARE(xml.name().toString(), QString::fromLatin1("root"));
+	
+	bool failed = false;
+	QBENCHMARK
+	{
+		// benchmark iteration overhead
+		coords.clear();
+		xml.addData(buffer.data());
+		
+		xml.readNextStartElement();
+		if (xml.name() != QLatin1String("coords"))
+		{
+			failed = true;
+			break;
+		}
+		
+		XmlElementReader element(xml);
+		DeferredCoords deferred;
+		element.read(coords, deferred);
+		if (!coords.empty() || deferred.text.isEmpty())
+		{
+			failed = true;
+			break;
+		}
+		deferred.parse(coords);
+	}
+		
+	QVERIFY(!failed);
+	QCOMPARE((int)coords.size(), num_coords);
+	QVERIFY(compare_all(coords, proto_coord));
+	
+	header.close();
+	buffer.close();
+}
+
+
+void CoordXmlTest::parseRunTest()
+{
+	auto const min = std::numeric_limits<qint32>::min();
+	auto const max = std::numeric_limits<qint32>::max();
+	MapCoordVector coords = {
+	    MapCoord::fromNative(0, 0),
+	    proto_coord,
+	    MapCoord::fromNative(9, -10, MapCoord::ClosePoint),
+	    MapCoord::fromNative(99, 100, MapCoord::HolePoint),
+	    MapCoord::fromNative(12345678, -87654321, MapCoord::Flags(255)),
+	    MapCoord::fromNative(123456789, -987654321),
+	    MapCoord::fromNative(max, min),
+	    MapCoord::fromNative(min, max),
+	};
+	QString text;
+	for (int i = 0; i < 100; ++i)
+	{
+		for (auto const& coord : coords)
+			text += coord.toString();
+	}
+	
+	auto parse_each = [](QStringRef text) {
+		MapCoordVector result;
+		while (text.length())
+			result.emplace_back(text);
+		return result;
+	};
+	
+	auto const expected = parse_each(QStringRef(&text));
+	MapCoordVector actual;
+	MapCoord::parseRun(QStringRef(&text), actual);
+	QVERIFY(actual == expected);
+	
+	// The first coordinate initializes the bounds offset.
+	{
+		QScopedValueRollback<MapCoord::BoundsOffset> rollback { MapCoord::boundsOffset() };
+		auto const offset_text = QString::fromLatin1("60000000 -60000000;") + text.left(text.indexOf(QLatin1String("12345678 ")));
+		
+		MapCoord::boundsOffset().reset(true);
+		auto const offset_expected = parse_each(QStringRef(&offset_text));
+		auto const expected_offset = MapCoord::boundsOffset();
+		QCOMPARE(expected_offset.x, qint64(60000000));
+		
+		MapCoord::boundsOffset().reset(true);
+		MapCoordVector offset_actual;
+		MapCoord::parseRun(QStringRef(&offset_text), offset_actual);
+		QVERIFY(offset_actual == offset_expected);
+		QCOMPARE(MapCoord::boundsOffset().x, expected_offset.x);
+		QCOMPARE(MapCoord::boundsOffset().y, expected_offset.y);
+	}
+	
+	QVERIFY_EXCEPTION_THROWN(MapCoord::parseRun(QStringRef(&text).left(text.length() - 1), actual), std::invalid_argument);
+	auto const invalid = QString::fromLatin1("12 34;56 78x;");
+	QVERIFY_EXCEPTION_THROWN(MapCoord::parseRun(QStringRef(&invalid), actual), std::invalid_argument);
+}
+
+
 bool CoordXmlTest::compare_all(MapCoordVector& coords, MapCoord& expected) const
 {
 	return std::all_of(begin(coords), end(coords), [expected](const MapCoord& coord){ return coord == expected; });
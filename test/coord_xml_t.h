@@ -60,6 +60,14 @@ private slots:
 	void writeFastImplementation();
 	void writeFastImplementation_data();
 	
+	/** Calls the actual implementation for writers without device,
+	 *  i.e. without the direct UTF-8 output. */
+	void writeStringImplementation();
+	void writeStringImplementation_data();
+	
+	/** Verifies that the UTF-8 output matches MapCoord::toString(). */
+	void writeUtf8Test();
+	
 	/** Reads rich XML. */
 	void readXml();
 	void readXml_data();
@@ -80,6 +88,13 @@ private slots:
 	void readFastImplementation();
 	void readFastImplementation_data();
 	
+	/** Calls the actual implementation for deferred parsing. */
+	void readDeferredImplementation();
+	void readDeferredImplementation_data();
+	
+	/** Verifies that MapCoord::parseRun() matches the MapCoord constructor. */
+	void parseRunTest();
+	
 private:
 	/** The common test data setup. */
 	void common_data();
@@ -32,6 +32,7 @@
 #include "core/map_grid.h"
 #include "core/map_printer.h"
 #include "core/objects/object.h"
+#include "fileformats/binary_file_format.h"
 #include "fileformats/file_format.h"
 #include "fileformats/file_format_registry.h"
 #include "fileformats/file_import_export.h"
@@ -514,6 +515,100 @@ void FileFormatTest::pristineMapTest()
 
 
 
+void FileFormatTest::compressedXmlTest()
+{
+	Map original;
+	original.loadFrom(QString::fromLatin1("data:issue-513-coords-outside-printable.omap"), nullptr, nullptr, false, false);
+	QVERIFY(original.getNumObjects() > 0);
+	
+	XMLFileFormat format;
+	QBuffer buffer;
+	buffer.open(QIODevice::ReadWrite);
+	{
+		auto exporter = std::unique_ptr<Exporter>(format.createExporter(&buffer, &original, nullptr));
+		exporter->setOption(QString::fromLatin1("compressed"), true);
+		exporter->doExport();
+	}
+	
+	auto const data = buffer.data();
+	QVERIFY(data.startsWith("\x1f\x8b"));
+	QVERIFY(format.understands(reinterpret_cast<const unsigned char*>(data.constData()), std::size_t(data.size())));
+	
+	buffer.seek(0);
+	Map reloaded;
+	{
+		auto importer = std::unique_ptr<Importer>(format.createImporter(&buffer, &reloaded, nullptr));
+		importer->doImport(false);
+		importer->finishImport();
+	}
+	
+	QString error;
+	if (!compareMaps(original, reloaded, error))
+		QFAIL(QString::fromLatin1("Loaded map does not equal saved map, error: %1").arg(error).toLocal8Bit());
+	
+	// Truncated data must not be loaded silently.
+	QBuffer truncated;
+	truncated.setData(data.left(data.size() / 2));
+	truncated.open(QIODevice::ReadOnly);
+	Map broken;
+	auto importer = std::unique_ptr<Importer>(format.createImporter(&truncated, &broken, nullptr));
+	QVERIFY_EXCEPTION_THROWN(importer->doImport(false), FileFormatException);
+}
+
+
+void FileFormatTest::binaryFileTest()
+{
+	Map original;
+	original.loadFrom(QString::fromLatin1("data:issue-513-coords-outside-printable.omap"), nullptr, nullptr, false, false);
+	QVERIFY(original.getNumObjects() > 0);
+	
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	
+	BinaryFileFormat format;
+	qint64 file_size[2] = {};
+	for (auto compress_blocks : { false, true })
+	{
+		auto const path = dir.path() + (compress_blocks ? QLatin1String("/compressed.omap") : QLatin1String("/mapped.omap"));
+		{
+			QFile file(path);
+			QVERIFY(file.open(QIODevice::WriteOnly));
+			auto exporter = std::unique_ptr<Exporter>(format.createExporter(&file, &original, nullptr));
+			exporter->setOption(QString::fromLatin1("compressBlocks"), compress_blocks);
+			exporter->doExport();
+			file_size[compress_blocks] = file.size();
+		}
+		
+		// Import from the file, with the object blocks in the mapped memory.
+		QFile file(path);
+		QVERIFY(file.open(QIODevice::ReadOnly));
+		auto mapping = file.map(0, file.size());
+		QVERIFY(mapping);
+		QVERIFY(format.understands(mapping, std::size_t(file.size())));
+		file.unmap(mapping);
+		
+		Map reloaded;
+		{
+			auto importer = std::unique_ptr<Importer>(format.createImporter(&file, &reloaded, nullptr));
+			importer->doImport(false);
+			importer->finishImport();
+		}
+		
+		QString error;
+		if (!compareMaps(original, reloaded, error))
+			QFAIL(QString::fromLatin1("Loaded map does not equal saved map, error: %1").arg(error).toLocal8Bit());
+		
+		// The format is recognized when loading the file by path.
+		Map loaded;
+		QVERIFY(loaded.loadFrom(path, nullptr, nullptr, false, false));
+		if (!compareMaps(original, loaded, error))
+			QFAIL(QString::fromLatin1("Loaded map does not equal saved map, error: %1").arg(error).toLocal8Bit());
+	}
+	QVERIFY(file_size[true] < file_size[false]);
+}
+
+
+
 /*
  * We don't need a real GUI window.
  * 
@@ -61,6 +61,18 @@ private slots:
 	 * through an implicit export-import-cycle before the test.
 	 */
 	void pristineMapTest();
+	
+	/**
+	 * Tests saving and loading a map in the compressed variant of the
+	 * XML format.
+	 */
+	void compressedXmlTest();
+	
+	/**
+	 * Tests saving and loading a map in the binary format, using a real file,
+	 * with uncompressed (memory-mapped) and with compressed object blocks.
+	 */
+	void binaryFileTest();
 };
 
 #endif // OPENORIENTEERING_FILE_FORMAT_T_H
@@ -19,21 +19,39 @@
 
 #include "map_t.h"
 
+#include <memory>
+
 #include <QtTest>
 #include <QBuffer>
+#include <QDataStream>
+#include <QLatin1String>
 #include <QMessageBox>
+#include <QSignalSpy>
+#include <QTemporaryDir>
 #include <QTextStream>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include "test_config.h"
 
 #include "global.h"
+#include "core/autosave_journal.h"
 #include "core/map.h"
 #include "core/map_color.h"
+#include "core/map_part.h"
 #include "core/map_printer.h" // IWYU pragma: keep
 #include "core/map_view.h"
+#include "core/objects/object.h"
+#include "core/objects/object_clipboard.h"
 #include "core/objects/symbol_rule_set.h"
+#include "core/symbols/area_symbol.h"
+#include "core/symbols/line_symbol.h"
 #include "core/symbols/symbol.h"
 #include "core/symbols/point_symbol.h"
+#include "fileformats/xml_file_format_p.h"
+#include "undo/object_undo.h"
+#include "undo/undo.h"
+#include "undo/undo_manager.h"
 
 
 namespace
@@ -166,6 +184,490 @@ void MapTest::specialColorsTest()
 	QCOMPARE(cmap.getColor(cmap.getNumColors()), static_cast<MapColor*>(nullptr));
 }
 
+void MapTest::symbolIndexTest()
+{
+	Map map;
+	auto symbol_a = static_cast<PointSymbol*>(map.getUndefinedPoint()->duplicate());
+	auto symbol_b = static_cast<PointSymbol*>(map.getUndefinedPoint()->duplicate());
+	map.addSymbol(symbol_a, 0);
+	map.addSymbol(symbol_b, 1);
+	QVERIFY(!map.existsObjectWithSymbol(symbol_a));
+	QVERIFY(!map.existsObjectWithSymbol(symbol_b));
+	
+	auto object_1 = new PointObject(symbol_a);
+	auto object_2 = new PointObject(symbol_a);
+	auto object_3 = new PointObject(symbol_b);
+	map.addObject(object_1);
+	map.addObject(object_2);
+	map.addObject(object_3);
+	auto part = map.getCurrentPart();
+	QCOMPARE(part->objectsWithSymbol(symbol_a).size(), std::size_t(2));
+	QCOMPARE(part->objectsWithSymbol(symbol_b).size(), std::size_t(1));
+	
+	std::vector<bool> in_use;
+	map.determineSymbolsInUse(in_use);
+	QCOMPARE(in_use, std::vector<bool>({true, true}));
+	
+	QVERIFY(object_1->setSymbol(symbol_b, false));
+	QCOMPARE(part->objectsWithSymbol(symbol_a).size(), std::size_t(1));
+	QCOMPARE(part->objectsWithSymbol(symbol_b).size(), std::size_t(2));
+	
+	map.changeSymbolForAllObjects(symbol_a, symbol_b);
+	QVERIFY(!map.existsObjectWithSymbol(symbol_a));
+	QCOMPARE(part->objectsWithSymbol(symbol_b).size(), std::size_t(3));
+	map.determineSymbolsInUse(in_use);
+	QCOMPARE(in_use, std::vector<bool>({false, true}));
+	
+	map.addObjectToSelection(object_2, false);
+	QVERIFY(map.deleteAllObjectsWithSymbol(symbol_b));
+	QCOMPARE(map.getNumObjects(), 0);
+	QCOMPARE(map.getNumSelectedObjects(), 0);
+	QVERIFY(!map.existsObjectWithSymbol(symbol_b));
+	QVERIFY(!map.deleteAllObjectsWithSymbol(symbol_b));
+}
+
+
+
+void MapTest::objectIndexTest()
+{
+	Map map;
+	auto part = map.getCurrentPart();
+	std::vector<Object*> objects;
+	for (int i = 0; i < 10; ++i)
+	{
+		objects.push_back(new PointObject(map.getUndefinedPoint()));
+		map.addObject(objects.back());
+	}
+	for (int i = 0; i < 10; ++i)
+		QCOMPARE(part->findObjectIndex(objects[std::size_t(i)]), i);
+	
+	std::vector<Object*> removed = { objects[7], objects[1], objects[2], objects[9] };
+	QCOMPARE(part->deleteObjects(begin(removed), end(removed), true), std::size_t(4));
+	QCOMPARE(part->getNumObjects(), 6);
+	QCOMPARE(part->getObject(0), objects[0]);
+	QCOMPARE(part->getObject(1), objects[3]);
+	QCOMPARE(part->getObject(5), objects[8]);
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		QCOMPARE(part->findObjectIndex(part->getObject(i)), i);
+	QVERIFY(!part->deleteObject(objects[7], true));
+	
+	part->insertObjects({ {1, objects[1]}, {2, objects[2]}, {7, objects[7]}, {9, objects[9]} });
+	QCOMPARE(part->getNumObjects(), 10);
+	for (int i = 0; i < 10; ++i)
+	{
+		QCOMPARE(part->getObject(i), objects[std::size_t(i)]);
+		QCOMPARE(part->findObjectIndex(objects[std::size_t(i)]), i);
+	}
+	
+	// Duplicates are deleted only once.
+	std::vector<Object*> duplicates = { objects[3], objects[5], objects[3], objects[5] };
+	QCOMPARE(part->deleteObjects(begin(duplicates), end(duplicates), false), std::size_t(2));
+	QCOMPARE(part->getNumObjects(), 8);
+	QCOMPARE(part->getObject(3), objects[4]);
+	QCOMPARE(part->getObject(4), objects[6]);
+}
+
+
+
+void MapTest::spatialIndexTest()
+{
+	Map map;
+	auto part = map.getCurrentPart();
+	
+	// A grid of short lines, 5 mm apart, and a line which covers many cells
+	std::vector<Object*> objects;
+	for (int i = 0; i < 100; ++i)
+	{
+		auto object = new PathObject(map.getUndefinedLine());
+		object->addCoordinate(MapCoord(5.0 * (i % 10), 5.0 * (i / 10)));
+		object->addCoordinate(MapCoord(5.0 * (i % 10) + 1, 5.0 * (i / 10)));
+		map.addObject(object);
+		objects.push_back(object);
+	}
+	auto large = new PathObject(map.getUndefinedLine());
+	large->addCoordinate(MapCoord(-200, -200));
+	large->addCoordinate(MapCoord(300, 300));
+	map.addObject(large);
+	
+	auto const rect = QRectF(9, -1, 8, 2);
+	QVERIFY(part->findObjectsInRect(rect) == std::vector<Object*>({ objects[2], objects[3], large }));
+	QVERIFY(part->indexedExtent().contains(QRectF(-200, -200, 500, 500)));
+	
+	// Moving
+	objects[2]->move(MapCoord(100.0, 100.0));
+	QVERIFY(part->findObjectsInRect(rect) == std::vector<Object*>({ objects[3], large }));
+	QVERIFY(part->findObjectsInRect(QRectF(105, 95, 10, 10)) == std::vector<Object*>({ objects[2], large }));
+	
+	// Regenerating the output
+	objects[3]->asPath()->getCoordinate(1).setY(40);
+	objects[3]->setOutputDirty();
+	objects[3]->update();
+	QVERIFY(part->findObjectsInRect(QRectF(15.5, 39, 1, 2)) == std::vector<Object*>({ objects[3], objects[83], large }));
+	
+	// Deleting
+	part->deleteObject(objects[3], false);
+	QVERIFY(part->findObjectsInRect(rect) == std::vector<Object*>({ large }));
+	
+	// A query which covers more cells than there are occupied cells
+	auto const all = part->findObjectsInRect(QRectF(-1e6, -1e6, 2e6, 2e6));
+	QCOMPARE(int(all.size()), part->getNumObjects());
+	for (std::size_t i = 0; i < all.size(); ++i)
+		QCOMPARE(all[i], part->getObject(int(i)));
+}
+
+
+
+void MapTest::selectionTest()
+{
+	Map map;
+	std::vector<Object*> objects;
+	objects.reserve(10000);
+	for (int i = 0; i < 10000; ++i)
+	{
+		objects.push_back(new PointObject(map.getUndefinedPoint()));
+		map.addObject(objects.back());
+	}
+	
+	QBENCHMARK
+	{
+		for (auto object : objects)
+			map.addObjectToSelection(object, false);
+		for (std::size_t i = 0; i < objects.size(); i += 2)
+			map.removeObjectFromSelection(objects[i], false);
+		QCOMPARE(map.getNumSelectedObjects(), 5000);
+		for (std::size_t i = 0; i < objects.size(); ++i)
+		{
+			if (map.isObjectSelected(objects[i]) != (i % 2 == 1))
+				QFAIL("Unexpected selection state");
+		}
+		map.clearObjectSelection(false);
+	}
+	
+	QVERIFY(map.selectedObjects().empty());
+	QVERIFY(!map.isObjectSelected(objects.front()));
+	QVERIFY(!map.getFirstSelectedObject());
+	
+	// Iteration order is deterministic
+	map.addObjectToSelection(objects[3], false);
+	map.addObjectToSelection(objects[1], false);
+	map.addObjectToSelection(objects[2], false);
+	map.removeObjectFromSelection(objects[3], false);
+	QCOMPARE(map.getFirstSelectedObject(), objects[2]);
+	QCOMPARE(std::vector<Object*>(map.selectedObjectsBegin(), map.selectedObjectsEnd()),
+	         std::vector<Object*>({objects[2], objects[1]}));
+}
+
+
+
+
+void MapTest::moveObjectTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(color);
+	map.addSymbol(line_symbol, 0);
+	
+	auto coords = MapCoordVector { {0.0, 0.0}, {10.0, 0.0}, {10.0, 5.0} };
+	coords.back().setHolePoint(true);
+	auto line = new PathObject(line_symbol, coords);
+	map.addObject(line);
+	line->update();
+	QVERIFY(!line->isOutputDirty());
+	
+	auto const extent = line->getExtent();
+	line->move(1000, -2000);
+	QVERIFY(!line->isOutputDirty());
+	QCOMPARE(line->getExtent(), extent.translated(1.0, -2.0));
+	QCOMPARE(line->findPathCoordForIndex(2).pos, MapCoordF(11.0, 3.0));
+	
+	line->forceUpdate();
+	QCOMPARE(line->getExtent(), extent.translated(1.0, -2.0));
+	
+	// Fill patterns are aligned to the pattern origin, not to the object.
+	auto area_symbol = new AreaSymbol();
+	area_symbol->setColor(color);
+	area_symbol->setNumFillPatterns(1);
+	map.addSymbol(area_symbol, 1);
+	coords = { {0.0, 0.0}, {10.0, 0.0}, {10.0, 5.0}, {0.0, 0.0} };
+	coords.back().setClosePoint(true);
+	coords.back().setHolePoint(true);
+	auto area = new PathObject(area_symbol, coords);
+	map.addObject(area);
+	area->update();
+	QVERIFY(!area->isOutputDirty());
+	area->move(MapCoord { 1.0, 1.0 });
+	QVERIFY(area->isOutputDirty());
+	
+	// A plain area is translated, unless it is hatched.
+	auto plain_symbol = new AreaSymbol();
+	plain_symbol->setColor(color);
+	map.addSymbol(plain_symbol, 2);
+	auto plain = new PathObject(plain_symbol, coords);
+	map.addObject(plain);
+	plain->update();
+	plain->move(MapCoord { 1.0, 1.0 });
+	QVERIFY(!plain->isOutputDirty());
+	
+	// The hatching is aligned to the map, like fill patterns.
+	map.setAreaHatchingEnabled(true);
+	plain->forceUpdate();
+	QVERIFY(!plain->isOutputDirty());
+	plain->move(MapCoord { 1.0, 1.0 });
+	QVERIFY(plain->isOutputDirty());
+	map.setAreaHatchingEnabled(false);
+}
+
+void MapTest::rotateMapTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(color);
+	map.addSymbol(line_symbol, 0);
+	
+	for (int i = 0; i < 2000; ++i)
+	{
+		auto line = new PathObject(line_symbol, MapCoordVector{ {0.0, double(i)}, {10.0, double(i)} });
+		map.addObject(line);
+		line->update();
+	}
+	auto const first = map.getPart(0)->getObject(0);
+	auto const last = map.getPart(0)->getObject(map.getNumObjects() - 1);
+	map.addObjectToSelection(last, false);
+	
+	// A canceled rotation restores the original objects. The observer is
+	// called before waiting for the result, so the cancellation does not
+	// depend on the speed of the machine.
+	auto const first_extent = first->getExtent();
+	auto cancel_calls = 0;
+	auto const cancel = [&cancel_calls](int, int) { ++cancel_calls; return false; };
+	QVERIFY(!map.rotateMap(M_PI / 2, MapCoord{}, false, false, false, cancel));
+	QCOMPARE(cancel_calls, 1);
+	QVERIFY(!map.isProcessingObjects());
+	QCOMPARE(first->getRawCoordinateVector()[1], MapCoord(10.0, 0.0));
+	QCOMPARE(first->getExtent(), first_extent);
+	QVERIFY(!first->isOutputDirty());
+	QCOMPARE(last->getRawCoordinateVector()[0], MapCoord(0.0, 1999.0));
+	QCOMPARE(last->getRawCoordinateVector()[1], MapCoord(10.0, 1999.0));
+	QVERIFY(!last->isOutputDirty());
+	for (int i = 0; i < map.getNumObjects(); ++i)
+	{
+		auto const object = map.getPart(0)->getObject(i);
+		QCOMPARE(object->getRawCoordinateVector()[0], MapCoord(0.0, double(i)));
+	}
+	
+	// While objects are processed, the observer may run the event loop,
+	// and the map reports being busy.
+	auto reported_maximum = 0;
+	auto busy_while_processing = true;
+	auto const observer = [&map, &reported_maximum, &busy_while_processing](int value, int maximum) {
+		if (value < maximum)
+			busy_while_processing = busy_while_processing && map.isProcessingObjects();
+		reported_maximum = maximum;
+		return true;
+	};
+	QVERIFY(map.rotateMap(M_PI / 2, MapCoord{}, false, false, false, observer));
+	QCOMPARE(reported_maximum, map.getNumObjects());
+	QVERIFY(busy_while_processing);
+	QVERIFY(!map.isProcessingObjects());
+	QCOMPARE(first->getRawCoordinateVector()[1], MapCoord(0.0, -10.0));
+	QVERIFY(!first->isOutputDirty());
+	QVERIFY(first->getExtent().contains(QPointF(0.0, -5.0)));
+	QVERIFY(!first->getExtent().contains(QPointF(5.0, 0.0)));
+	QVERIFY(map.isObjectSelected(last));
+}
+
+void MapTest::modifyObjectsUndoTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(color);
+	map.addSymbol(line_symbol, 0);
+	
+	MapCoordVector coords;
+	for (int i = 0; i < 1000; ++i)
+		coords.emplace_back(double(i), 0.0);
+	auto path = new PathObject(line_symbol, coords);
+	map.addObject(path);
+	
+	auto original = path->duplicate();
+	path->setCoordinate(500, MapCoord(500.0, 10.0));
+	path->setTag(QStringLiteral("name"), QStringLiteral("x"));
+	path->update();
+	auto step = std::make_unique<ModifyObjectsUndoStep>(&map);
+	step->addObject(path, original);
+	
+	// The saved step doesn't depend on the current state of the object.
+	QByteArray buffer;
+	{
+		QXmlStreamWriter xml(&buffer);
+		step->save(xml);
+	}
+	step.reset();
+	SymbolDictionary symbol_dict;
+	symbol_dict[QString::number(0)] = line_symbol;
+	QXmlStreamReader xml(buffer);
+	QVERIFY(xml.readNextStartElement());
+	auto loaded = std::unique_ptr<UndoStep>(UndoStep::load(xml, &map, symbol_dict));
+	QCOMPARE(loaded->getType(), UndoStep::ModifyObjectsUndoStepType);
+	QVERIFY(loaded->isValid());
+	
+	// Undo modifies the object in place.
+	auto redo = std::unique_ptr<UndoStep>(loaded->undo());
+	QCOMPARE(map.getPart(0)->getObject(0), path);
+	QCOMPARE(path->getRawCoordinateVector().size(), coords.size());
+	QCOMPARE(path->getRawCoordinateVector()[500], MapCoord(500.0, 0.0));
+	QVERIFY(path->tags().isEmpty());
+	QVERIFY(!path->isOutputDirty());
+	
+	auto undo = std::unique_ptr<UndoStep>(redo->undo());
+	QCOMPARE(path->getRawCoordinateVector()[500], MapCoord(500.0, 10.0));
+	QCOMPARE(path->getTag(QStringLiteral("name")), QStringLiteral("x"));
+	
+	// Inserted coordinates are removed again.
+	original = path->duplicate();
+	path->addCoordinate(10, MapCoord(10.5, 5.0));
+	path->update();
+	step = std::make_unique<ModifyObjectsUndoStep>(&map);
+	step->addObject(path, original);
+	redo.reset(step->undo());
+	QCOMPARE(path->getRawCoordinateVector().size(), coords.size());
+	QCOMPARE(path->getRawCoordinateVector()[10], MapCoord(10.0, 0.0));
+	undo.reset(redo->undo());
+	QCOMPARE(path->getRawCoordinateVector().size(), coords.size() + 1);
+	QCOMPARE(path->getRawCoordinateVector()[10], MapCoord(10.5, 5.0));
+	
+	auto save_and_load = [&map, &symbol_dict](UndoStep& step) {
+		QByteArray buffer;
+		{
+			QXmlStreamWriter xml(&buffer);
+			step.save(xml);
+		}
+		QXmlStreamReader xml(buffer);
+		xml.readNextStartElement();
+		return std::unique_ptr<UndoStep>(UndoStep::load(xml, &map, symbol_dict));
+	};
+	
+	// The undefined symbol is restored from its index -1.
+	original = path->duplicate();
+	original->setSymbol(Map::getUndefinedLine(), true);
+	step = std::make_unique<ModifyObjectsUndoStep>(&map);
+	step->addObject(path, original);
+	loaded = save_and_load(*step);
+	QVERIFY(loaded->isValid());
+	redo.reset(loaded->undo());
+	QCOMPARE(path->getSymbol(), static_cast<const Symbol*>(Map::getUndefinedLine()));
+	undo.reset(redo->undo());
+	QCOMPARE(path->getSymbol(), static_cast<const Symbol*>(line_symbol));
+	
+	// A delta which doesn't match the object invalidates the step.
+	original = path->duplicate();
+	auto const last = path->getRawCoordinateVector().size() - 1;
+	path->setCoordinate(last, MapCoord(path->getCoordinate(last).x(), 10.0));
+	path->update();
+	step = std::make_unique<ModifyObjectsUndoStep>(&map);
+	step->addObject(path, original);
+	loaded = save_and_load(*step);
+	path->deleteCoordinate(10, false);
+	path->update();
+	auto const size_before_undo = path->getRawCoordinateVector().size();
+	redo.reset(loaded->undo());
+	QVERIFY(!loaded->isValid());
+	QVERIFY(!redo->isValid());
+	QCOMPARE(path->getRawCoordinateVector().size(), size_before_undo);
+	
+	// Deleting the symbol invalidates the step.
+	map.deleteSymbol(0);
+	QVERIFY(!undo->isValid());
+}
+
+
+void MapTest::undoMemoryBudgetTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(color);
+	map.addSymbol(line_symbol, 0);
+	
+	const int num_steps = 10;
+	for (int i = 0; i < num_steps; ++i)
+	{
+		MapCoordVector coords;
+		for (int j = 0; j < 1000; ++j)
+			coords.emplace_back(double(j), double(i));
+		map.addObject(new PathObject(line_symbol, coords));
+	}
+	
+	auto& undo_manager = map.undoManager();
+	for (int i = 0; i < num_steps; ++i)
+	{
+		auto path = map.getPart(0)->getObject(i)->asPath();
+		auto step = std::make_unique<ReplaceObjectsUndoStep>(&map);
+		step->addObject(path, path->duplicate());
+		path->setCoordinate(0, MapCoord(-1.0, double(i)));
+		undo_manager.push(std::move(step));
+	}
+	QCOMPARE(undo_manager.undoStepCount(), num_steps);
+	
+	auto const full_usage = undo_manager.memoryUsage();
+	undo_manager.setMemoryBudget(full_usage / 4);
+	QVERIFY(undo_manager.memoryUsage() <= full_usage / 4);
+	
+	// Spilled steps still refer to the right symbols.
+	map.addSymbol(new LineSymbol(), 0);
+	
+	for (int i = num_steps - 1; i >= 0; --i)
+	{
+		QVERIFY(undo_manager.canUndo());
+		QVERIFY(undo_manager.undo());
+		auto path = map.getPart(0)->getObject(i)->asPath();
+		QCOMPARE(path->getRawCoordinateVector()[0], MapCoord(0.0, double(i)));
+		QCOMPARE(path->getSymbol(), line_symbol);
+	}
+	QVERIFY(!undo_manager.canUndo());
+	QVERIFY(undo_manager.memoryUsage() <= full_usage / 4);
+	
+	for (int i = 0; i < num_steps; ++i)
+	{
+		QVERIFY(undo_manager.canRedo());
+		QVERIFY(undo_manager.redo());
+		auto path = map.getPart(0)->getObject(i)->asPath();
+		QCOMPARE(path->getRawCoordinateVector()[0], MapCoord(-1.0, double(i)));
+	}
+	
+	// Steps which are loaded back and spilled again don't let the journal grow.
+	auto const journal_size = undo_manager.journalSize();
+	QVERIFY(journal_size > 0);
+	for (int cycle = 0; cycle < 50; ++cycle)
+	{
+		while (undo_manager.canUndo())
+			QVERIFY(undo_manager.undo());
+		while (undo_manager.canRedo())
+			QVERIFY(undo_manager.redo());
+	}
+	QVERIFY(undo_manager.journalSize() <= 4 * journal_size + UndoManager::min_journal_compaction_size);
+	
+	// Without a budget, all steps are loaded back.
+	undo_manager.setMemoryBudget(0);
+	QVERIFY(undo_manager.memoryUsage() > full_usage / 4);
+	QCOMPARE(undo_manager.undoStepCount(), num_steps);
+	QVERIFY(undo_manager.canUndo());
+	QCOMPARE(undo_manager.journalSize(), qint64(0));
+}
+
+
+
 void MapTest::importTest_data()
 {
 	QTest::addColumn<QString>("first_file");
@@ -314,6 +816,389 @@ void MapTest::matchQuerySymbolNumberTest()
 }
 
 
+void MapTest::symbolRuleSetApplyTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	LineSymbol* symbols[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		symbols[i] = new LineSymbol();
+		symbols[i]->setLineWidth(1);
+		symbols[i]->setColor(color);
+		map.addSymbol(symbols[i], i);
+	}
+	
+	MapCoordVector coords = { MapCoord(0.0, 0.0), MapCoord(10.0, 0.0) };
+	for (int i = 0; i < 6; ++i)
+	{
+		auto path = new PathObject(symbols[i % 2], coords);
+		if (i < 2)
+			path->setTag(QStringLiteral("x"), QStringLiteral("1"));
+		map.addObject(path);
+	}
+	
+	// The tag rule takes precedence over the symbol rules.
+	SymbolRuleSet rules;
+	rules.push_back({ ObjectQuery(QStringLiteral("x"), ObjectQuery::OperatorIs, QStringLiteral("1")), symbols[2], SymbolRule::DefinedAssignment });
+	rules.push_back({ ObjectQuery(symbols[0]), symbols[1], SymbolRule::DefinedAssignment });
+	rules.push_back({ ObjectQuery(symbols[1]), symbols[0], SymbolRule::DefinedAssignment });
+	rules.apply(map, map);
+	
+	auto part = map.getPart(0);
+	for (int i = 0; i < 6; ++i)
+	{
+		auto object = part->getObject(i);
+		QCOMPARE(object->getSymbol(), i < 2 ? symbols[2] : symbols[1 - i % 2]);
+		QVERIFY(!object->isOutputDirty());
+	}
+	
+	// The switch is a single undo step.
+	QCOMPARE(map.undoManager().undoStepCount(), 1);
+	QVERIFY(map.undoManager().undo());
+	for (int i = 0; i < 6; ++i)
+	{
+		auto object = part->getObject(i);
+		QCOMPARE(object->getSymbol(), symbols[i % 2]);
+		QVERIFY(!object->isOutputDirty());
+	}
+}
+
+
+
+void MapTest::objectClipboardTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(color);
+	map.addSymbol(line_symbol, 0);
+	auto point_symbol = new PointSymbol();
+	point_symbol->setRotatable(true);
+	map.addSymbol(point_symbol, 1);
+	
+	MapCoordVector coords = { MapCoord(0.0, 0.0), MapCoord(10.0, 0.0), MapCoord(10.0, 10.0) };
+	coords[1].setDashPoint(true);
+	auto path = new PathObject(line_symbol, coords);
+	path->setTag(QStringLiteral("x"), QStringLiteral("1"));
+	map.addObject(path);
+	auto point = new PointObject(point_symbol);
+	point->setPosition(MapCoord(5.0, 5.0));
+	point->setRotation(1.0f);
+	map.addObject(point);
+	map.addObjectToSelection(path, false);
+	map.addObjectToSelection(point, false);
+	
+	auto const data = ObjectClipboard::save(map, map.selectedObjects());
+	QVERIFY(!data.isEmpty());
+	
+	QRectF extent;
+	auto objects = ObjectClipboard::load(data, map, extent);
+	QCOMPARE(int(objects.size()), 2);
+	QVERIFY(extent.contains(QPointF(10.0, 10.0)));
+	QVERIFY(objects[0]->equals(path, true));
+	QVERIFY(objects[1]->equals(point, true));
+	
+	auto part = map.getCurrentPart();
+	part->importObjects(std::move(objects), true);
+	QCOMPARE(map.getNumObjects(), 4);
+	QCOMPARE(map.getNumSelectedObjects(), 2);
+	QVERIFY(!part->getObject(2)->isOutputDirty());
+	QVERIFY(map.undoManager().undo());
+	QCOMPARE(map.getNumObjects(), 2);
+	
+	// Other maps resolve the symbols by number, type and name,
+	// and missing symbols are imported.
+	Map other_map;
+	auto other_color = new MapColor(color->getName(), 0);
+	other_map.addColor(other_color, 0);
+	auto other_line_symbol = new LineSymbol();
+	other_line_symbol->setLineWidth(2);
+	other_line_symbol->setColor(other_color);
+	other_map.addSymbol(other_line_symbol, 0);
+	objects = ObjectClipboard::load(data, other_map, extent);
+	QCOMPARE(int(objects.size()), 2);
+	QCOMPARE(other_map.getNumSymbols(), 2);
+	QCOMPARE(other_map.getNumColors(), 1);
+	QCOMPARE(objects[0]->getSymbol(), static_cast<const Symbol*>(other_line_symbol));
+	QCOMPARE(objects[1]->getSymbol(), static_cast<const Symbol*>(other_map.getSymbol(1)));
+	QVERIFY(objects[1]->getSymbol()->equals(point_symbol));
+	QVERIFY(objects[0]->equals(path, false));
+	for (auto object : objects)
+		delete object;
+	
+	// Different scales are left to the full import.
+	Map scaled_map;
+	scaled_map.setScaleDenominator(map.getScaleDenominator() * 2);
+	QVERIFY(ObjectClipboard::load(data, scaled_map, extent).empty());
+	QCOMPARE(scaled_map.getNumSymbols(), 0);
+	
+	// Stale symbol references are detected, and the symbols are resolved
+	// like for other maps.
+	auto const session_id = map.symbolsSessionId();
+	QVERIFY(!session_id.isNull());
+	map.deleteSymbol(1);
+	QVERIFY(map.symbolsSessionId() != session_id);
+	objects = ObjectClipboard::load(data, map, extent);
+	QCOMPARE(int(objects.size()), 2);
+	QCOMPARE(map.getNumSymbols(), 2);
+	QCOMPARE(objects[0]->getSymbol(), static_cast<const Symbol*>(line_symbol));
+	QCOMPARE(objects[1]->getSymbol(), static_cast<const Symbol*>(map.getSymbol(1)));
+	for (auto object : objects)
+		delete object;
+	
+	// The map is identified by the session ID, not by its address.
+	auto const previous_session_id = map.symbolsSessionId();
+	map.reset();
+	QVERIFY(map.symbolsSessionId() != previous_session_id);
+}
+
+
+
+void MapTest::deferredObjectUpdatesTest()
+{
+	Map map;
+	auto color = new MapColor(0);
+	map.addColor(color, 0);
+	auto symbol = new LineSymbol();
+	symbol->setLineWidth(1);
+	symbol->setColor(color);
+	map.addSymbol(symbol, 0);
+	
+	// Three clusters of objects, far from each other
+	for (int i = 0; i < 15; ++i)
+	{
+		auto const offset = (i / 5) * 1000.0;
+		MapCoordVector coords = { MapCoord(offset + i, 0.0), MapCoord(offset + i, 10.0) };
+		map.addObject(new PathObject(symbol, coords));
+	}
+	auto part = map.getPart(0);
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		part->getObject(i)->setOutputDirty();
+	
+	map.deferObjectUpdates();
+	QVERIFY(map.hasDeferredObjectUpdates());
+	
+	// Only the objects next to the drawn area are updated on demand.
+	map.updateObjects(QRectF(-10.0, -10.0, 30.0, 30.0));
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		QCOMPARE(part->getObject(i)->isOutputDirty(), i >= 5);
+	
+	// Hit tests update the objects next to the position on demand.
+	std::vector<std::pair<int, Object*>> found;
+	map.findObjectsAt(MapCoordF(1005.0, 5.0), 0.1f, false, false, false, false, found);
+	QVERIFY(!found.empty());
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		QCOMPARE(part->getObject(i)->isOutputDirty(), i >= 10);
+	
+	// Extent queries finish the deferred updates.
+	auto const extent = map.calculateExtent();
+	QVERIFY(extent.contains(QRectF(0.0, 0.0, 2014.0, 10.0)));
+	QVERIFY(!map.hasDeferredObjectUpdates());
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		QVERIFY(!part->getObject(i)->isOutputDirty());
+	
+	// Otherwise, the objects are updated in the background.
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		part->getObject(i)->setOutputDirty();
+	map.deferObjectUpdates();
+	QVERIFY(map.hasDeferredObjectUpdates());
+	part->deleteObject(7, false);  // Removed objects are dropped.
+	QTRY_VERIFY(!map.hasDeferredObjectUpdates());
+	for (int i = 0; i < part->getNumObjects(); ++i)
+		QVERIFY(!part->getObject(i)->isOutputDirty());
+}
+
+
+
+
+void MapTest::asyncSaveTest()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	auto const path = dir.path() + QLatin1String("/async.omap");
+	
+	Map map;
+	MapView view{ &map };
+	QVERIFY(map.loadFrom(examples_dir.absoluteFilePath(QStringLiteral("forest sample.omap")), nullptr, &view, false, false));
+	auto const num_objects = map.getNumObjects();
+	QVERIFY(num_objects > 0);
+	map.setObjectsDirty();
+	
+	QSignalSpy spy(&map, &Map::saveFinished);
+	QVERIFY(map.saveToAsync(path, &view));
+	QVERIFY(map.isSaving());
+	// The map is not saved before the file is complete.
+	QVERIFY(map.hasUnsavedChanges());
+	
+	QTRY_COMPARE(spy.count(), 1);
+	QCOMPARE(spy.front().at(0).toString(), path);
+	QCOMPARE(spy.front().at(1).toBool(), true);
+	QVERIFY(!map.isSaving());
+	QVERIFY(!map.hasUnsavedChanges());
+	
+	map.setObjectsDirty();
+	QVERIFY(map.saveToAsync(path, &view));
+	QVERIFY(map.isSaving());
+	
+	// Changes after taking the snapshot are not saved.
+	map.deleteObject(map.getCurrentPart()->getObject(0), false);
+	map.setObjectsDirty();
+	QVERIFY(map.hasUnsavedChanges());
+	
+	QVERIFY(map.finishSaving());
+	QCOMPARE(spy.count(), 2);
+	QVERIFY(!map.isSaving());
+	QVERIFY(map.hasUnsavedChanges());
+	
+	Map saved_map;
+	QVERIFY(saved_map.loadFrom(path, nullptr, nullptr, false, false));
+	QCOMPARE(saved_map.getNumObjects(), num_objects);
+	QCOMPARE(saved_map.getNumSymbols(), map.getNumSymbols());
+}
+
+
+void MapTest::asyncSaveSnapshotBenchmark()
+{
+	Map map;
+	MapView view{ &map };
+	QVERIFY(map.loadFrom(examples_dir.absoluteFilePath(QStringLiteral("forest sample.omap")), nullptr, &view, false, false));
+	
+	// Capturing the snapshot is the part of saveToAsync() which runs on the
+	// calling thread.
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	XMLFileExporter exporter(&buffer, &map, &view);
+	QBENCHMARK
+	{
+		QVERIFY(exporter.takeSnapshot());
+	}
+}
+
+
+void MapTest::autosaveJournalTest()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	auto const base_path = dir.path() + QLatin1String("/base.omap");
+	auto const journal_path = dir.path() + QLatin1String("/base.omap.autosave");
+	
+	Map map;
+	MapView view{ &map };
+	QVERIFY(map.loadFrom(examples_dir.absoluteFilePath(QStringLiteral("forest sample.omap")), nullptr, &view, false, false));
+	QVERIFY(map.saveTo(base_path, &view));
+	auto const num_objects = map.getNumObjects();
+	
+	AutosaveJournal journal(&map);
+	journal.setBaseFile(base_path);
+	QVERIFY(!journal.needsCompaction());
+	
+	// Delete an object
+	auto object = map.getCurrentPart()->getObject(0);
+	map.deleteObject(object, true);
+	auto add_step = new AddObjectsUndoStep(&map);
+	add_step->addObject(0, object);
+	map.push(add_step);
+	QVERIFY(journal.write(journal_path, &view));
+	QVERIFY(!journal.needsCompaction());
+	
+	// Modify an object
+	auto tags_step = new ObjectTagsUndoStep(&map);
+	tags_step->addObject(0);
+	map.getCurrentPart()->getObject(0)->setTag(QStringLiteral("journal"), QStringLiteral("recorded"));
+	map.push(tags_step);
+	QVERIFY(journal.write(journal_path, &view));
+	
+	{
+		Map recovered_map;
+		QVERIFY(recovered_map.loadFrom(journal_path, nullptr, nullptr, false, false));
+		QCOMPARE(recovered_map.getNumObjects(), num_objects - 1);
+		QCOMPARE(recovered_map.getCurrentPart()->getObject(0)->getTag(QStringLiteral("journal")), QStringLiteral("recorded"));
+	}
+	
+	// Undo the modification
+	QVERIFY(map.undoManager().undo(nullptr));
+	QVERIFY(journal.write(journal_path, &view));
+	
+	{
+		Map recovered_map;
+		QVERIFY(recovered_map.loadFrom(journal_path, nullptr, nullptr, false, false));
+		QCOMPARE(recovered_map.getNumObjects(), num_objects - 1);
+		QVERIFY(recovered_map.getCurrentPart()->getObject(0)->getTag(QStringLiteral("journal")).isEmpty());
+	}
+	
+	// Replace an object by a modified copy, like a boolean operation
+	{
+		auto part = map.getCurrentPart();
+		auto original = part->getObject(0);
+		auto replacement = original->duplicate();
+		replacement->setTag(QStringLiteral("journal"), QStringLiteral("combined"));
+		part->deleteObject(0, true);
+		auto add_step = new AddObjectsUndoStep(&map);
+		add_step->addObject(0, original);
+		map.addObject(replacement);
+		auto delete_step = new DeleteObjectsUndoStep(&map);
+		delete_step->addObject(part->findObjectIndex(replacement));
+		auto combined_step = new CombinedUndoStep(&map);
+		combined_step->push(add_step);
+		combined_step->push(delete_step);
+		map.push(combined_step);
+	}
+	QVERIFY(!journal.needsCompaction());
+	QVERIFY(journal.write(journal_path, &view));
+	QVERIFY(!journal.needsCompaction());
+	
+	{
+		Map recovered_map;
+		QVERIFY(recovered_map.loadFrom(journal_path, nullptr, nullptr, false, false));
+		auto part = recovered_map.getCurrentPart();
+		QCOMPARE(part->getNumObjects(), num_objects - 1);
+		QCOMPARE(part->getObject(part->getNumObjects() - 1)->getTag(QStringLiteral("journal")), QStringLiteral("combined"));
+	}
+	
+	// A record which doesn't fit the map discards all recorded changes.
+	{
+		auto const damaged_path = dir.path() + QLatin1String("/damaged.omap.autosave");
+		QVERIFY(QFile::copy(journal_path, damaged_path));
+		
+		DeleteObjectsUndoStep invalid_step(&map);
+		invalid_step.addObject(num_objects + 10);
+		QByteArray payload;
+		{
+			QXmlStreamWriter xml(&payload);
+			invalid_step.save(xml);
+		}
+		QFile file(damaged_path);
+		QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+		QDataStream stream(&file);
+		stream.setVersion(QDataStream::Qt_5_0);
+		stream << quint8(3) << payload << qChecksum(payload.constData(), uint(payload.size()));  // StepRecord
+		file.close();
+		
+		Map recovered_map;
+		QVERIFY(recovered_map.loadFrom(damaged_path, nullptr, nullptr, false, false));
+		QCOMPARE(recovered_map.getNumObjects(), num_objects);
+	}
+	
+	// Changes which are not covered by undo steps need compaction.
+	map.setOtherDirty();
+	QVERIFY(journal.needsCompaction());
+	QVERIFY(journal.write(journal_path, &view));
+	QVERIFY(!journal.needsCompaction());
+	QVERIFY(QFile::remove(base_path));
+	
+	{
+		Map recovered_map;
+		QVERIFY(recovered_map.loadFrom(journal_path, nullptr, nullptr, false, false));
+		QCOMPARE(recovered_map.getNumObjects(), num_objects - 1);
+		auto part = recovered_map.getCurrentPart();
+		QCOMPARE(part->getObject(part->getNumObjects() - 1)->getTag(QStringLiteral("journal")), QStringLiteral("combined"));
+	}
+}
+
 
 /*
  * We don't need a real GUI window.
@@ -44,6 +44,30 @@ private slots:
 	/** Tests if special colors are correctly handled. */
 	void specialColorsTest();
 	
+	/** Tests the maintenance of the objects-by-symbol index. */
+	void symbolIndexTest();
+	
+	/** Tests object index lookup and bulk deletion and insertion. */
+	void objectIndexTest();
+	
+	/** Tests finding objects with the spatial index of a map part. */
+	void spatialIndexTest();
+	
+	/** Tests and benchmarks bulk selection and deselection. */
+	void selectionTest();
+	
+	/** Tests translating renderables in place when moving objects. */
+	void moveObjectTest();
+	
+	/** Tests whole-map rotation, including cancellation. */
+	void rotateMapTest();
+	
+	/** Tests undo steps which store the differences of modified objects. */
+	void modifyObjectsUndoTest();
+	
+	/** Tests spilling undo steps to the journal when exceeding the memory budget. */
+	void undoMemoryBudgetTest();
+	
 	/** Tests various modes of Map::importMap(). */
 	void importTest_data();
 	void importTest();
@@ -55,6 +79,24 @@ private slots:
 	void matchQuerySymbolNumberTest_data();
 	void matchQuerySymbolNumberTest();
 	
+	/** Tests applying symbol rules to all objects, with undo. */
+	void symbolRuleSetApplyTest();
+	
+	/** Tests the binary clipboard format for objects. */
+	void objectClipboardTest();
+	
+	/** Tests deferred object updates, as used after loading a map. */
+	void deferredObjectUpdatesTest();
+	
+	/** Tests saving a snapshot of the map while the map is modified. */
+	void asyncSaveTest();
+	
+	/** Measures capturing the snapshot for saving asynchronously. */
+	void asyncSaveSnapshotBenchmark();
+	
+	/** Tests recording changes in the autosave journal, and recovery. */
+	void autosaveJournalTest();
+	
 };
 
 #endif
@@ -470,6 +470,70 @@ void PathObjectTest::atypicalPathTest()
 		Q_UNUSED(tangent)
 	}
 }
+
+void PathObjectTest::simplifyTest()
+{
+	const auto threshold = 0.1;
+	
+	// An open polyline with collinear points and a single corner
+	MapCoordVector coords;
+	for (int i = 0; i <= 10; ++i)
+		coords.emplace_back(double(i), 0.0);
+	for (int i = 1; i <= 10; ++i)
+		coords.emplace_back(10.0, double(i));
+	coords.back().setHolePoint(true);
+	
+	PathObject open_path { Map::getCoveringRedLine(), coords };
+	PathObject* undo_duplicate = nullptr;
+	QVERIFY(open_path.simplify(&undo_duplicate, threshold));
+	QVERIFY(undo_duplicate);
+	QCOMPARE(undo_duplicate->getCoordinateCount(), coords.size());
+	delete undo_duplicate;
+	QCOMPARE(open_path.getCoordinateCount(), MapCoordVector::size_type(3));
+	QCOMPARE(MapCoordF(open_path.getCoordinate(0)), MapCoordF(0.0, 0.0));
+	QCOMPARE(MapCoordF(open_path.getCoordinate(1)), MapCoordF(10.0, 0.0));
+	QCOMPARE(MapCoordF(open_path.getCoordinate(2)), MapCoordF(10.0, 10.0));
+	QVERIFY(open_path.getCoordinate(2).isHolePoint());
+	
+	// Nothing left to remove
+	QVERIFY(!open_path.simplify(nullptr, threshold));
+	
+	// A closed square with points on its edges
+	coords = { {0.0, 0.0}, {5.0, 0.0}, {10.0, 0.0}, {10.0, 5.0}, {10.0, 10.0}, {5.0, 10.0}, {0.0, 10.0}, {0.0, 5.0}, {0.0, 0.0} };
+	coords.back().setClosePoint(true);
+	coords.back().setHolePoint(true);
+	PathObject square { Map::getCoveringRedLine(), coords };
+	QVERIFY(square.simplify(nullptr, threshold));
+	QCOMPARE(square.getCoordinateCount(), MapCoordVector::size_type(5));
+	QVERIFY(square.parts().front().isClosed());
+	
+	// A straight line made of many bezier curves
+	coords.clear();
+	for (int i = 0; i < 20; ++i)
+	{
+		coords.emplace_back(double(i), 0.0);
+		coords.back().setCurveStart(true);
+		coords.emplace_back(i + 0.3, 0.0);
+		coords.emplace_back(i + 0.7, 0.0);
+	}
+	coords.emplace_back(20.0, 0.0);
+	coords.back().setHolePoint(true);
+	PathObject curved { Map::getCoveringRedLine(), coords };
+	PathObject reference { curved };
+	
+	// Simplify concurrently, together with the square which remains unchanged.
+	std::vector<PathObject*> undo_duplicates;
+	QCOMPARE(PathObject::simplifyAll({ &curved, &square }, &undo_duplicates, threshold), std::size_t(1));
+	QCOMPARE(undo_duplicates.size(), std::size_t(2));
+	QVERIFY(undo_duplicates[0]);
+	QVERIFY(!undo_duplicates[1]);
+	delete undo_duplicates[0];
+	
+	QVERIFY(curved.getCoordinateCount() <= 4);
+	QCOMPARE(MapCoordF(curved.getCoordinate(0)), MapCoordF(0.0, 0.0));
+	QCOMPARE(MapCoordF(curved.getCoordinate(curved.getCoordinateCount() - 1)), MapCoordF(20.0, 0.0));
+	QVERIFY(reference.calcMaximumDistanceTo(0, coords.size() - 1, &curved, 0, curved.getCoordinateCount() - 1) <= threshold);
+}
 	
 
 /*
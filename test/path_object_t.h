@@ -53,6 +53,9 @@ private slots:
 	/** Tests PathCoord and SplitPathCoord for a non-trivial zero-length path. */
 	void atypicalPathTest();
 	
+	/** Tests PathObject::simplify() for polylines and curves. */
+	void simplifyTest();
+	
 };
 
 #endif
@@ -29,19 +29,26 @@
 #include <QMouseEvent>
 #include <QPoint>
 #include <QPointF>
+#include <QRectF>
 #include <QString>
 
 #include "core/map.h"
 #include "core/map_color.h"
 #include "core/map_coord.h"
+#include "core/map_part.h"
+#include "core/objects/boolean_tool.h"
 #include "core/objects/object.h"
+#include "core/symbols/area_symbol.h"
 #include "core/symbols/line_symbol.h"
+#include "core/symbols/symbol.h"
 #include "global.h"
 #include "gui/main_window.h"
 #include "gui/map/map_editor.h"
 #include "gui/map/map_widget.h"
+#include "tools/edit_line_tool.h"
 #include "tools/edit_point_tool.h"
 #include "tools/edit_tool.h"
+#include "tools/fill_tool.h"
 
 
 /// Creates a test map and provides pointers to specific map elements.
@@ -204,6 +211,254 @@ void ToolsTest::editTool()
 }
 
 
+void ToolsTest::editLineToolDragPreview()
+{
+	// Initialization, with enough objects to use the drag preview
+	TestMap map;
+	auto const num_objects = 120;
+	for (int i = 0; i < num_objects; ++i)
+	{
+		auto object = new PathObject(map.line_symbol);
+		object->addCoordinate(MapCoord(0.5 * (i % 12), 40.0 + i / 12));
+		object->addCoordinate(MapCoord(0.5 * (i % 12) + 0.3, 40.0 + i / 12));
+		map.map->addObject(object);
+	}
+	
+	auto part = map.map->getCurrentPart();
+	map.map->clearObjectSelection(false);
+	part->applyOnAllObjects([&map](Object* object) {
+		map.map->addObjectToSelection(object, false);
+	});
+	map.map->emitSelectionChanged();
+	QCOMPARE(map.map->getNumSelectedObjects(), num_objects + 1);
+	
+	TestMapEditor editor(map.map);
+	auto tool = new EditLineTool(editor.editor, nullptr);
+	editor.editor->setTool(tool);
+	
+	// Drag the selection by its frame
+	MapWidget* map_widget = editor.map_widget;
+	QRectF extent;
+	map.map->includeSelectionRect(extent);
+	auto const drag_start_pos = map_widget->mapToViewport(MapCoordF(extent.left(), extent.center().y())).toPoint();
+	auto const drag_end_pos = drag_start_pos + QPoint(0, -50);
+	auto const original_pos = map_widget->mapToViewport(map.line_object->getCoordinate(0));
+	
+	QMouseEvent hover_event(QEvent::MouseMove, drag_start_pos, map_widget->mapToGlobal(drag_start_pos), Qt::NoButton, Qt::NoButton, Qt::NoModifier);
+	QApplication::sendEvent(map_widget, &hover_event);
+	QTest::mousePress(map_widget, Qt::LeftButton, nullptr, drag_start_pos);
+	QMouseEvent drag_event(QEvent::MouseMove, drag_end_pos, map_widget->mapToGlobal(drag_end_pos), Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+	QApplication::sendEvent(map_widget, &drag_event);
+	
+	// While the preview is shown, the objects are not modified.
+	QCOMPARE(map_widget->mapToViewport(map.line_object->getCoordinate(0)), original_pos);
+	
+	QTest::mouseRelease(map_widget, Qt::LeftButton, nullptr, drag_end_pos);
+	
+	// Check position deviation of all objects
+	QPointF difference = map_widget->mapToViewport(map.line_object->getCoordinate(0)) - original_pos - (drag_end_pos - drag_start_pos);
+	QCOMPARE(qMax(qAbs(difference.x()), 0.5), 0.5);
+	QCOMPARE(qMax(qAbs(difference.y()), 0.5), 0.5);
+	QRectF new_extent;
+	map.map->includeSelectionRect(new_extent);
+	auto const extent_offset = map_widget->mapToViewport(new_extent.center()) - map_widget->mapToViewport(extent.center()) - (drag_end_pos - drag_start_pos);
+	QCOMPARE(qMax(qAbs(extent_offset.x()), 0.5), 0.5);
+	QCOMPARE(qMax(qAbs(extent_offset.y()), 0.5), 0.5);
+	
+	// Cleanup
+	editor.editor->setTool(nullptr);
+}
+
+
+void ToolsTest::fillTool_data()
+{
+	QTest::addColumn<int>("size");
+	QTest::addColumn<qreal>("gap");
+	QTest::addColumn<qreal>("expected_area");
+	QTest::addColumn<qreal>("tolerance");
+	
+	// The vector fill gives exact results. The raster fill gives
+	// approximate results, from the gap which it closes.
+	QTest::newRow("closed by centerline") << 20 << 0.0 << 800.0 << 0.001;
+	QTest::newRow("closed by width")      << 20 << 0.2 << 800.0 << 20.0;
+	QTest::newRow("open")                 << 20 << 3.0 << 1600.0 << 0.001;
+	// Large enough for rasterizing multiple tiles
+	QTest::newRow("large, closed by width") << 100 << 0.2 << 20000.0 << 100.0;
+}
+
+void ToolsTest::fillTool()
+{
+	QFETCH(int, size);
+	QFETCH(qreal, gap);
+	QFETCH(qreal, expected_area);
+	QFETCH(qreal, tolerance);
+	
+	auto map = new Map();
+	auto black = new MapColor();
+	black->setCmyk(MapColorCmyk(0.0f, 0.0f, 0.0f, 1.0f));
+	black->setOpacity(1.0f);
+	black->setName(QString::fromLatin1("black"));
+	map->addColor(black, 0);
+	
+	auto line_symbol = new LineSymbol();
+	line_symbol->setLineWidth(1);
+	line_symbol->setColor(black);
+	map->addSymbol(line_symbol, 0);
+	auto area_symbol = new AreaSymbol();
+	area_symbol->setColor(black);
+	map->addSymbol(area_symbol, 1);
+	
+	// A square which is divided by a line ending at the given gap
+	auto square = new PathObject(line_symbol);
+	square->addCoordinate(MapCoord(-size, -size));
+	square->addCoordinate(MapCoord(size, -size));
+	square->addCoordinate(MapCoord(size, size));
+	square->addCoordinate(MapCoord(-size, size));
+	square->closeAllParts();
+	map->addObject(square);
+	auto divider = new PathObject(line_symbol);
+	divider->addCoordinate(MapCoord(0, -size));
+	divider->addCoordinate(MapCoord(0.0, size - gap));
+	map->addObject(divider);
+	
+	// An unrelated area object, selected for making its symbol active
+	auto area = new PathObject(area_symbol);
+	area->addCoordinate(MapCoord(100, 100));
+	area->addCoordinate(MapCoord(110, 100));
+	area->addCoordinate(MapCoord(110, 110));
+	area->closeAllParts();
+	map->addObject(area);
+	
+	// A far line, making the map part larger than 1 m x 1 m
+	auto far_line = new PathObject(line_symbol);
+	far_line->addCoordinate(MapCoord(2000, 2000));
+	far_line->addCoordinate(MapCoord(2010, 2000));
+	map->addObject(far_line);
+	
+	TestMapEditor editor(map);
+	map->addObjectToSelection(area, true);
+	QCOMPARE(editor.editor->activeSymbol(), static_cast<Symbol*>(area_symbol));
+	auto tool = new FillTool(editor.editor, nullptr);
+	editor.editor->setTool(tool);
+	
+	// Objects away from the filled face are not touched.
+	far_line->setOutputDirty();
+	editor.simulateClick(editor.map_widget->mapToViewport(MapCoordF(-size / 2.0, 0.0)));
+	QCOMPARE(map->getNumObjects(), 5);
+	QVERIFY(far_line->isOutputDirty());
+	auto result = map->getFirstSelectedObject();
+	QVERIFY(result != area);
+	QCOMPARE(result->getSymbol(), static_cast<const Symbol*>(area_symbol));
+	
+	result->update();
+	auto const area_size = qAbs(result->asPath()->parts().front().calculateArea());
+	QVERIFY2(qAbs(area_size - expected_area) <= tolerance, qPrintable(QString::number(area_size)));
+	
+	editor.editor->setTool(nullptr);
+}
+
+
+void ToolsTest::booleanUnionPerSymbol()
+{
+	Map map;
+	auto symbol = new AreaSymbol();
+	map.addSymbol(symbol, 0);
+	
+	auto square = [&map, symbol](qreal x, qreal y) {
+		auto object = new PathObject(symbol);
+		object->addCoordinate(MapCoord(x, y));
+		object->addCoordinate(MapCoord(x + 10, y));
+		object->addCoordinate(MapCoord(x + 10, y + 10));
+		object->addCoordinate(MapCoord(x, y + 10));
+		object->closeAllParts();
+		map.addObject(object);
+		map.addObjectToSelection(object, false);
+		return object;
+	};
+	// Two overlapping squares, one touching square, one isolated square
+	square(0, 0);
+	square(5, 5);
+	square(15, 0);
+	auto isolated = square(100, 100);
+	QCOMPARE(map.getNumObjects(), 4);
+	auto is_isolated = [isolated](const Object* object) { return object == isolated; };
+	
+	QVERIFY(BooleanTool(BooleanTool::Union, &map).executePerSymbol());
+	QCOMPARE(map.getNumObjects(), 2);
+	QCOMPARE(map.getNumSelectedObjects(), 2);
+	QVERIFY(map.getCurrentPart()->existsObject(is_isolated));
+	QVERIFY(map.isObjectSelected(isolated));
+	
+	QVERIFY(map.undoManager().undo());
+	QCOMPARE(map.getNumObjects(), 4);
+	QVERIFY(map.getCurrentPart()->existsObject(is_isolated));
+}
+
+
+void ToolsTest::booleanTiledUnion()
+{
+	// A grid of overlapping squares, in scattered order, with more objects
+	// than the threshold for progress reporting
+	constexpr int size = 32;
+	auto const setup_map = [](Map& map) {
+		auto symbol = new AreaSymbol();
+		map.addSymbol(symbol, 0);
+		for (int i = 0; i < size * size; ++i)
+		{
+			auto const x = qreal((i * 7) % size) * 5;
+			auto const y = qreal(i / size) * 5;
+			auto object = new PathObject(symbol);
+			object->addCoordinate(MapCoord(x, y));
+			object->addCoordinate(MapCoord(x + 6, y));
+			object->addCoordinate(MapCoord(x + 6, y + 6));
+			object->addCoordinate(MapCoord(x, y + 6));
+			object->closeAllParts();
+			map.addObject(object);
+			map.addObjectToSelection(object, false);
+		}
+	};
+	
+	// The observer is called before waiting for the result, so the
+	// cancellation does not depend on the speed of the machine.
+	// A canceled operation leaves the map unchanged.
+	{
+		Map map;
+		setup_map(map);
+		BooleanTool tool(BooleanTool::Union, &map);
+		int calls = 0;
+		tool.setProgressObserver([&calls](int, int) { ++calls; return false; });
+		QVERIFY(!tool.executePerSymbol());
+		QCOMPARE(calls, 1);
+		QCOMPARE(map.getNumObjects(), size * size);
+		QCOMPARE(map.getNumSelectedObjects(), size * size);
+		QVERIFY(!map.undoManager().canUndo());
+	}
+	
+	Map map;
+	setup_map(map);
+	int reported_value = 0;
+	int reported_maximum = 0;
+	bool values_in_range = true;
+	BooleanTool tool(BooleanTool::Union, &map);
+	tool.setProgressObserver([&](int value, int maximum) {
+		values_in_range = values_in_range && value >= reported_value && value <= maximum;
+		reported_value = value;
+		reported_maximum = maximum;
+		return true;
+	});
+	QVERIFY(tool.executePerSymbol());
+	QCOMPARE(map.getNumObjects(), 1);
+	
+	auto result = map.getCurrentPart()->getObject(0)->asPath();
+	result->update();
+	QCOMPARE(int(result->parts().size()), 1);
+	QCOMPARE(result->parts().front().calculateArea(), 161.0 * 161.0);
+	QVERIFY(values_in_range);
+	QCOMPARE(reported_maximum, size * size);
+	QCOMPARE(reported_value, reported_maximum);
+}
+
+
 /*
  * We select a non-standard QPA because we don't need a real GUI window.
  * 
@@ -34,6 +34,19 @@ private slots:
 	void initTestCase();
 	
 	void editTool();
+	
+	/** Tests moving many objects with the edit line tool's drag preview. */
+	void editLineToolDragPreview();
+	
+	/** Tests the fill tool with faces closed by centerlines or by line widths. */
+	void fillTool_data();
+	void fillTool();
+	
+	/** Tests the per-symbol union of area objects. */
+	void booleanUnionPerSymbol();
+	
+	/** Tests the tiled union of many area objects, with progress and cancellation. */
+	void booleanTiledUnion();
 };
 
 #endif